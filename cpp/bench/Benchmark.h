@@ -0,0 +1,229 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/*
+    Benchmark
+    A minimal microbenchmark runner.
+    Each benchmark is run for some warm-up iterations, then timed over a number of repetitions of a fixed number
+    of iterations. Results report the time per iteration (min, median, mean and standard deviation across the
+    repetitions) and the throughput in items per second, and can be written to a JSON file for comparisons.
+
+    Command line options:
+    --warmup N       warm-up iterations before timing (default 100)
+    --iterations N   iterations per repetition (default 1000)
+    --repetitions N  timed repetitions (default 10)
+    --filter TEXT    only run the benchmarks whose name contains TEXT
+    --json PATH      write the results to PATH
+*/
+namespace Benchmark
+{
+    /* Prevent the compiler from optimising away a value or the writes to a buffer */
+    template<typename T>
+    inline void doNotOptimise(T const& value)
+    {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    struct Options
+    {
+        int m_warmupIterations = 100;
+        int m_iterations = 1000;
+        int m_repetitions = 10;
+        std::string m_filter;
+        std::string m_jsonPath;
+
+        /* Returns false on invalid arguments */
+        bool parse(int argc, char* argv[])
+        {
+            for(int i=1; i<argc; ++i)
+            {
+                std::string arg = argv[i];
+                if(i + 1 >= argc)
+                {
+                    printf("Missing value for %s\n", arg.c_str());
+                    return false;
+                }
+
+                std::string value = argv[++i];
+                if(arg == "--warmup")
+                {
+                    m_warmupIterations = std::max(0, std::stoi(value));
+                }
+                else if(arg == "--iterations")
+                {
+                    m_iterations = std::max(1, std::stoi(value));
+                }
+                else if(arg == "--repetitions")
+                {
+                    m_repetitions = std::max(1, std::stoi(value));
+                }
+                else if(arg == "--filter")
+                {
+                    m_filter = value;
+                }
+                else if(arg == "--json")
+                {
+                    m_jsonPath = value;
+                }
+                else
+                {
+                    printf("Unknown option %s\n", arg.c_str());
+                    return false;
+                }
+            }
+
+            return true;
+        }
+    };
+
+    struct Result
+    {
+        std::string m_name;
+        double m_itemsPerIteration = 1.;
+        double m_minNs = 0.; // per iteration
+        double m_medianNs = 0.;
+        double m_meanNs = 0.;
+        double m_stddevNs = 0.;
+
+        double getItemsPerSecond() const
+        {
+            return m_medianNs > 0. ? m_itemsPerIteration * 1e9 / m_medianNs : 0.;
+        }
+    };
+
+    class Runner
+    {
+    public:
+        Runner(const Options& options):
+            m_options(options)
+        {
+
+        }
+
+        /*
+            Add a benchmark. fn runs one iteration, itemsPerIteration is the amount of work it does (e.g. frames)
+            to report the throughput. Any setup should be done before adding the benchmark (or captured by fn).
+        */
+        void add(const std::string& name, double itemsPerIteration, std::function<void()> fn)
+        {
+            m_benchmarks.push_back({name, itemsPerIteration, fn});
+        }
+
+        void run()
+        {
+            printf("%-40s %12s %12s %12s %10s %14s\n", "benchmark", "median ns", "min ns", "mean ns", "stddev %", "items/s");
+            for(const Entry& entry : m_benchmarks)
+            {
+                if(!m_options.m_filter.empty() && entry.m_name.find(m_options.m_filter) == std::string::npos)
+                {
+                    continue;
+                }
+
+                Result result = run(entry);
+                printf("%-40s %12.1f %12.1f %12.1f %10.1f %14.4g\n", result.m_name.c_str(), result.m_medianNs, result.m_minNs,
+                        result.m_meanNs, result.m_meanNs > 0. ? 100. * result.m_stddevNs / result.m_meanNs : 0., result.getItemsPerSecond());
+                m_results.push_back(result);
+            }
+
+            if(!m_options.m_jsonPath.empty())
+            {
+                writeJson(m_options.m_jsonPath);
+            }
+        }
+
+        const std::vector<Result>& getResults() const
+        {
+            return m_results;
+        }
+
+    private:
+        struct Entry
+        {
+            std::string m_name;
+            double m_itemsPerIteration;
+            std::function<void()> m_fn;
+        };
+
+        Result run(const Entry& entry)
+        {
+            for(int i=0; i<m_options.m_warmupIterations; ++i)
+            {
+                entry.m_fn();
+            }
+
+            std::vector<double> times(m_options.m_repetitions);
+            for(int r=0; r<m_options.m_repetitions; ++r)
+            {
+                auto start = std::chrono::steady_clock::now();
+                for(int i=0; i<m_options.m_iterations; ++i)
+                {
+                    entry.m_fn();
+                }
+                auto end = std::chrono::steady_clock::now();
+                times[r] = std::chrono::duration<double, std::nano>(end - start).count() / m_options.m_iterations;
+            }
+
+            Result result;
+            result.m_name = entry.m_name;
+            result.m_itemsPerIteration = entry.m_itemsPerIteration;
+
+            double sum = 0.;
+            for(double t : times)
+            {
+                sum += t;
+            }
+            result.m_meanNs = sum / times.size();
+
+            double variance = 0.;
+            for(double t : times)
+            {
+                variance += (t - result.m_meanNs) * (t - result.m_meanNs);
+            }
+            result.m_stddevNs = std::sqrt(variance / times.size());
+
+            std::sort(times.begin(), times.end());
+            result.m_minNs = times.front();
+            result.m_medianNs = times.size() % 2 ? times[times.size() / 2] : 0.5 * (times[times.size() / 2 - 1] + times[times.size() / 2]);
+
+            return result;
+        }
+
+        void writeJson(const std::string& path) const
+        {
+            FILE* file = fopen(path.c_str(), "w");
+            if(!file)
+            {
+                printf("Could not write %s\n", path.c_str());
+                return;
+            }
+
+            fprintf(file, "{\n");
+            fprintf(file, "  \"warmup_iterations\": %i,\n", m_options.m_warmupIterations);
+            fprintf(file, "  \"iterations\": %i,\n", m_options.m_iterations);
+            fprintf(file, "  \"repetitions\": %i,\n", m_options.m_repetitions);
+            fprintf(file, "  \"benchmarks\": [\n");
+            for(size_t i=0; i<m_results.size(); ++i)
+            {
+                const Result& r = m_results[i];
+                fprintf(file, "    {\"name\": \"%s\", \"median_ns\": %.3f, \"min_ns\": %.3f, \"mean_ns\": %.3f, \"stddev_ns\": %.3f, "
+                        "\"items_per_iteration\": %.1f, \"items_per_second\": %.6g}%s\n", r.m_name.c_str(), r.m_medianNs, r.m_minNs,
+                        r.m_meanNs, r.m_stddevNs, r.m_itemsPerIteration, r.getItemsPerSecond(), i + 1 < m_results.size() ? "," : "");
+            }
+            fprintf(file, "  ]\n}\n");
+            fclose(file);
+
+            printf("Results written to %s\n", path.c_str());
+        }
+
+        Options m_options;
+        std::vector<Entry> m_benchmarks;
+        std::vector<Result> m_results;
+    };
+}
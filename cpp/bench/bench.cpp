@@ -0,0 +1,419 @@
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+
+#include "AudioBuffer.h"
+#include "AudioEventQueue.h"
+#include "AudioSignalUtils.h"
+#include "ChannelMatrix.h"
+#include "GranularSynth.h"
+#include "PitchShifter.h"
+#include "RenderServer.h"
+#include "RingBuffer.h"
+#include "SampleFormat.h"
+#include "SineGenerator.h"
+#include "Sound.h"
+#include "Spatialiser.h"
+#include "TaskQueue.h"
+#include "TripleBuffer.h"
+
+/*
+    Microbenchmarks of the hot paths.
+    Everything runs on a single thread without any audio device, so that results can be compared across builds.
+
+    make bench                                 build and run, results written to build/bench.json
+    make bench-baseline                        save build/bench.json as the baseline
+    make bench-compare                         run and flag regressions against the baseline
+    make bench BENCH_ARGS="--filter Sound"     pass options to the runner (see Benchmark.h)
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const int g_numChannels = 2;
+const unsigned long g_framesPerBuffer = 512;
+const int g_numServerSessions = 16;
+const int g_numVoicesPerSession = 8;
+const int g_numMixVoices = 8;
+const int g_mixChannelCounts[] = {2, 6, 8};
+const int g_numSpatialisedEmitters = 5000;
+
+/************************************************************/
+
+/* A granular synth reconstructing its source, as in ex_granularsynth */
+class BenchGranularSynth : public IGranularSynth
+{
+    virtual void getParams(int& grainStartPosition, int& grainDurationSamples, float& grainOverlap, float& grainPitch) override
+    {
+        grainStartPosition = m_head;
+        grainDurationSamples = 2048;
+        grainOverlap = 0.5f;
+        grainPitch = 1.2f;
+
+        m_head += static_cast<int>(grainDurationSamples * grainOverlap);
+        if(m_head >= static_cast<int>(m_source->size()) - grainDurationSamples)
+        {
+            m_head = 0;
+        }
+    }
+
+    int m_head = 0;
+};
+
+/* A render server session mixing looping voices */
+class BenchSession : public RenderSession
+{
+public:
+    BenchSession(const std::vector<float>& data)
+    {
+        for(int v=0; v<g_numVoicesPerSession; ++v)
+        {
+            m_voices.emplace_back(v + 1);
+            m_voices.back().load(const_cast<float*>(data.data()), static_cast<int>(data.size()));
+            m_voices.back().setLoop(true);
+            m_voices.back().play();
+        }
+    }
+
+private:
+    virtual void execute(float* outputBuffer, unsigned long framesPerBuffer, int numChannels) override
+    {
+        memset(outputBuffer, 0, framesPerBuffer * numChannels * sizeof(float));
+        for(Sound& voice : m_voices)
+        {
+            voice.execute(outputBuffer, framesPerBuffer, numChannels);
+        }
+    }
+
+    std::vector<Sound> m_voices;
+};
+
+std::vector<float> makeSine(int lengthSamples, float freqHz)
+{
+    std::vector<float> data(lengthSamples);
+    for(int i=0; i<lengthSamples; ++i)
+    {
+        data[i] = 0.5f * std::sin(2.f * static_cast<float>(Math::M_PI) * freqHz * i / static_cast<float>(g_sampleRate));
+    }
+    return data;
+}
+
+int main(int argc, char* argv[])
+{
+    Benchmark::Options options;
+    if(!options.parse(argc, argv))
+    {
+        return EXIT_FAILURE;
+    }
+
+    printf("Benchmarks: %i warm-up iterations, %i repetitions of %i iterations, %lu frames per buffer\n",
+            options.m_warmupIterations, options.m_repetitions, options.m_iterations, g_framesPerBuffer);
+
+    Benchmark::Runner runner(options);
+    const unsigned long numSamples = g_framesPerBuffer * g_numChannels;
+    std::vector<float> output(numSamples, 0.f);
+
+    // RingBuffer: writing then reading a frame, as the audio thread and the device callback do
+    RingBuffer<float> ringBuffer(numSamples, 3);
+    std::vector<float> deviceBuffer(numSamples, 0.f);
+    ringBuffer.finishRead(); // the ring starts full
+    runner.add("RingBuffer::write+read", g_framesPerBuffer, [&]()
+    {
+        memcpy(ringBuffer.getWriteBuffer(), output.data(), numSamples * sizeof(float));
+        ringBuffer.finishWrite();
+        memcpy(deviceBuffer.data(), ringBuffer.getReadBuffer(), numSamples * sizeof(float));
+        ringBuffer.finishRead();
+        Benchmark::doNotOptimise(deviceBuffer.data());
+    });
+
+    // TripleBuffer: publishing a game frame of emitter positions then taking it, no copy whatever the size
+    struct EmitterPositions
+    {
+        float m_x[g_numSpatialisedEmitters];
+        float m_y[g_numSpatialisedEmitters];
+        float m_z[g_numSpatialisedEmitters];
+    };
+    auto positions = std::make_unique<TripleBuffer<EmitterPositions>>();
+    runner.add("TripleBuffer::publish+acquire", 1, [&]()
+    {
+        positions->getWriteBuffer().m_x[0] += 0.01f;
+        positions->publish();
+        positions->acquire();
+        Benchmark::doNotOptimise(positions->getReadBuffer().m_x[0]);
+    });
+
+    // AudioEventQueue: a block of voice events posted and published by the audio thread, then drained by the game
+    AudioEventQueue events;
+    unsigned long eventCounter = 0;
+    runner.add("AudioEventQueue::post+flush+drain/16", 16, [&]()
+    {
+        for(unsigned long source=0; source<16; ++source)
+        {
+            events.post(source % 4 == 0 ? AudioEvent::Type::LOOPED : AudioEvent::Type::FINISHED, source);
+        }
+        events.flush();
+        events.drain([&](const AudioEvent& event) { eventCounter += event.m_count; });
+        Benchmark::doNotOptimise(eventCounter);
+    });
+
+    // TaskQueue: pushing a task with some params then popping and executing it
+    TaskQueue taskQueue(16);
+    int taskCounter = 0;
+    runner.add("TaskQueue::push+pop", 1, [&]()
+    {
+        struct TaskParams
+        {
+            unsigned long soundId;
+            float value;
+        } taskParams = {1, 0.5f};
+
+        taskQueue.push([](void* context, void*, float)
+        {
+            ++*(int*)context;
+        }, &taskCounter, &taskParams, sizeof(taskParams));
+
+        TaskQueue::Task task;
+        taskQueue.pop(task);
+        task.execute(0.f);
+        Benchmark::doNotOptimise(taskCounter);
+    });
+
+    // TaskQueue batches: a frame of commands added to a batch, pushed with one publish, then consumed at once
+    std::vector<std::unique_ptr<TaskQueue>> batchQueues;
+    std::vector<std::unique_ptr<TaskQueue::Batch>> batches;
+    for(int batchSize : {1, 16, 256})
+    {
+        batchQueues.push_back(std::make_unique<TaskQueue>(batchSize));
+        batches.push_back(std::make_unique<TaskQueue::Batch>(batchSize));
+        TaskQueue* batchQueue = batchQueues.back().get();
+        TaskQueue::Batch* batch = batches.back().get();
+        runner.add("TaskQueue::pushBatch+consumeAll/" + std::to_string(batchSize), batchSize, [batchQueue, batch, batchSize, &taskCounter]()
+        {
+            struct TaskParams
+            {
+                unsigned long soundId;
+                float value;
+            } taskParams = {1, 0.5f};
+
+            for(int i=0; i<batchSize; ++i)
+            {
+                batch->add([](void* context, void*, float)
+                {
+                    ++*(int*)context;
+                }, &taskCounter, &taskParams, sizeof(taskParams));
+            }
+            batchQueue->pushBatch(*batch);
+            batchQueue->consumeAll([](TaskQueue::Task& task)
+            {
+                task.execute(0.f);
+            });
+            Benchmark::doNotOptimise(taskCounter);
+        });
+    }
+
+    // Sound: mixing a looping voice with constant parameters, with a gain ramp and with pitch
+    std::vector<float> soundData = makeSine(static_cast<int>(g_sampleRate), 440.f);
+    Sound sound(1);
+    sound.load(soundData.data(), static_cast<int>(soundData.size()));
+    sound.setLoop(true);
+    sound.play();
+    runner.add("Sound::execute", g_framesPerBuffer, [&]()
+    {
+        sound.execute(output.data(), g_framesPerBuffer, g_numChannels);
+        Benchmark::doNotOptimise(output.data());
+    });
+
+    Sound rampSound(sound);
+    bool rampUp = false;
+    runner.add("Sound::execute/gain_ramp", g_framesPerBuffer, [&]()
+    {
+        rampUp = !rampUp;
+        rampSound.setGain(rampUp ? 1.f : 0.5f, g_framesPerBuffer);
+        rampSound.execute(output.data(), g_framesPerBuffer, g_numChannels);
+        Benchmark::doNotOptimise(output.data());
+    });
+
+    Sound pitchSound(sound);
+    pitchSound.setPitch(1.5f);
+    runner.add("Sound::execute/pitch", g_framesPerBuffer, [&]()
+    {
+        pitchSound.execute(output.data(), g_framesPerBuffer, g_numChannels);
+        Benchmark::doNotOptimise(output.data());
+    });
+
+    // Mixing voices into an interleaved buffer, against mixing into planar channels then interleaving once
+    std::vector<std::vector<Sound>> mixVoices;
+    mixVoices.reserve(2 * std::size(g_mixChannelCounts));
+    std::vector<std::unique_ptr<AudioBuffer>> mixBuses;
+    std::vector<float> mixOutput(g_framesPerBuffer * 8, 0.f);
+    for(int numChannels : g_mixChannelCounts)
+    {
+        const std::string suffix = "/" + std::to_string(numChannels) + "ch";
+
+        mixVoices.emplace_back(g_numMixVoices, sound);
+        std::vector<Sound>* interleavedVoices = &mixVoices.back();
+        runner.add("Mix::interleaved" + suffix, g_framesPerBuffer, [&mixOutput, interleavedVoices, numChannels]()
+        {
+            memset(mixOutput.data(), 0, g_framesPerBuffer * numChannels * sizeof(float));
+            for(Sound& voice : *interleavedVoices)
+            {
+                voice.execute(mixOutput.data(), g_framesPerBuffer, numChannels);
+            }
+            Benchmark::doNotOptimise(mixOutput.data());
+        });
+
+        mixVoices.emplace_back(g_numMixVoices, sound);
+        std::vector<Sound>* planarVoices = &mixVoices.back();
+        mixBuses.push_back(std::make_unique<AudioBuffer>(numChannels, g_framesPerBuffer));
+        AudioBuffer* bus = mixBuses.back().get();
+        runner.add("Mix::planar" + suffix, g_framesPerBuffer, [&mixOutput, planarVoices, bus, numChannels]()
+        {
+            bus->clear(g_framesPerBuffer);
+            for(Sound& voice : *planarVoices)
+            {
+                voice.executePlanar(bus->getChannels(), g_framesPerBuffer, numChannels);
+            }
+            AudioBufferUtils::interleave(bus->getChannels(), numChannels, g_framesPerBuffer, mixOutput.data());
+            Benchmark::doNotOptimise(mixOutput.data());
+        });
+    }
+
+    // ChannelMatrix: a block of multichannel music mapped to the output channels, against a plain copy
+    std::vector<std::vector<float>> musicChannels(6, makeSine(static_cast<int>(g_framesPerBuffer), 440.f));
+    std::vector<const float*> musicInputs;
+    for(const std::vector<float>& channel : musicChannels)
+    {
+        musicInputs.push_back(channel.data());
+    }
+    AudioBuffer matrixOutput(6, g_framesPerBuffer);
+    runner.add("ChannelMatrix::copy/6ch", g_framesPerBuffer, [&musicInputs, &matrixOutput]()
+    {
+        for(int c=0; c<6; ++c)
+        {
+            memcpy(matrixOutput.getChannel(c), musicInputs[c], g_framesPerBuffer * sizeof(float));
+        }
+        Benchmark::doNotOptimise(matrixOutput.getChannel(0));
+    });
+    std::vector<std::unique_ptr<ChannelMatrix>> matrices;
+    for(int numOutputs : {6, 2})
+    {
+        matrices.push_back(std::make_unique<ChannelMatrix>(6, numOutputs));
+        ChannelMatrix* matrix = matrices.back().get();
+        runner.add(numOutputs == 6 ? "ChannelMatrix::process/direct_6ch" : "ChannelMatrix::process/5.1_to_stereo", g_framesPerBuffer, [&musicInputs, &matrixOutput, matrix]()
+        {
+            matrix->process(musicInputs.data(), matrixOutput.getChannels(), g_framesPerBuffer);
+            Benchmark::doNotOptimise(matrixOutput.getChannel(0));
+        });
+    }
+
+    // SampleConverter: a block converted to the device format, as the audio thread does when writing to the ring
+    std::vector<unsigned char> convertedOutput(numSamples * sizeof(float));
+    std::vector<float> convertInput = makeSine(static_cast<int>(numSamples), 440.f);
+    std::vector<std::unique_ptr<SampleConverter>> converters;
+    for(SampleFormat format : {SampleFormat::INT16, SampleFormat::INT24})
+    {
+        for(bool dither : {false, true})
+        {
+            converters.push_back(std::make_unique<SampleConverter>(format, dither));
+            SampleConverter* converter = converters.back().get();
+            const std::string name = std::string("SampleConverter::convert/") + SampleFormatUtils::getName(format) + (dither ? "_dither" : "");
+            runner.add(name, g_framesPerBuffer, [&convertInput, &convertedOutput, converter, numSamples]()
+            {
+                converter->convert(convertInput.data(), convertedOutput.data(), numSamples);
+                Benchmark::doNotOptimise(convertedOutput.data());
+            });
+        }
+    }
+
+    // Spatialiser: gains of 5000 moving emitters, once per block
+    std::vector<std::unique_ptr<Spatialiser>> spatialisers;
+    for(Spatialiser::Layout layout : {Spatialiser::Layout::STEREO, Spatialiser::Layout::SURROUND_5_1})
+    {
+        spatialisers.push_back(std::make_unique<Spatialiser>(g_numSpatialisedEmitters, layout));
+        Spatialiser* spatialiser = spatialisers.back().get();
+        for(int e=0; e<g_numSpatialisedEmitters; ++e)
+        {
+            spatialiser->setEmitterPosition(spatialiser->addEmitter(), {0.01f * e - 25.f, 1.f, 0.007f * e - 17.f});
+        }
+        const std::string name = std::string("Spatialiser::update/") + (layout == Spatialiser::Layout::STEREO ? "stereo" : "5.1");
+        runner.add(name, g_numSpatialisedEmitters, [spatialiser]()
+        {
+            spatialiser->getPositionsX()[0] += 0.01f;
+            spatialiser->update();
+            Benchmark::doNotOptimise(spatialiser);
+        });
+    }
+
+    // IGranularSynth: mono output
+    std::vector<float> grainSource = makeSine(static_cast<int>(g_sampleRate), 220.f);
+    BenchGranularSynth granularSynth;
+    granularSynth.init(grainSource);
+    runner.add("IGranularSynth::execute", g_framesPerBuffer, [&]()
+    {
+        granularSynth.execute(output.data(), g_framesPerBuffer, 1);
+        Benchmark::doNotOptimise(output.data());
+    });
+
+    // PitchShifter: a mono voice shifted in place, with and without the waveform similarity search
+    std::vector<std::unique_ptr<PitchShifter>> pitchShifters;
+    for(int searchRadius : {128, 0})
+    {
+        pitchShifters.push_back(std::make_unique<PitchShifter>(1, 1024, 2.f, searchRadius));
+        PitchShifter* pitchShifter = pitchShifters.back().get();
+        pitchShifter->setPitch(1.23f);
+        runner.add(searchRadius > 0 ? "PitchShifter::process" : "PitchShifter::process/no_search", g_framesPerBuffer, [&soundData, &output, pitchShifter]()
+        {
+            float* channel = output.data();
+            std::copy_n(soundData.data(), g_framesPerBuffer, channel);
+            pitchShifter->process(&channel, g_framesPerBuffer);
+            Benchmark::doNotOptimise(channel);
+        });
+    }
+
+    // Windows: filling a preallocated hann window
+    std::vector<float> window(2048);
+    runner.add("Windows::window/hann_2048", window.size(), [&]()
+    {
+        AudioSignalUtils::Windows::window<float>(window.data(), static_cast<int>(window.size()), AudioSignalUtils::Windows::Type::HANN, false);
+        Benchmark::doNotOptimise(window.data());
+    });
+
+    // SineGenerator
+    SineGenerator sineGenerator(440.f, g_sampleRate);
+    runner.add("SineGenerator::execute", g_framesPerBuffer, [&]()
+    {
+        sineGenerator.execute(output.data(), g_framesPerBuffer, g_numChannels);
+        Benchmark::doNotOptimise(output.data());
+    });
+
+    // RenderServer: a round of session blocks on a single thread, giving the real time sessions per core
+    std::vector<float> sessionData = makeSine(static_cast<int>(0.1 * g_sampleRate), 440.f);
+    std::vector<std::unique_ptr<BenchSession>> sessions;
+    RenderServer renderServer(g_sampleRate, g_numChannels, g_framesPerBuffer, 0, g_numServerSessions);
+    for(int s=0; s<g_numServerSessions; ++s)
+    {
+        sessions.push_back(std::make_unique<BenchSession>(sessionData));
+        renderServer.addSession(sessions.back().get(), nullptr);
+    }
+    const std::string serverBenchmarkName = "RenderServer::renderBlocks/" + std::to_string(g_numServerSessions) + "_sessions";
+    runner.add(serverBenchmarkName, g_numServerSessions, [&]()
+    {
+        renderServer.renderBlocks(1);
+    });
+
+    runner.run();
+
+    for(const Benchmark::Result& result : runner.getResults())
+    {
+        if(result.m_name == serverBenchmarkName)
+        {
+            printf("Render server: %.0f real time sessions of %i voices per core\n",
+                    result.getItemsPerSecond() * g_framesPerBuffer / g_sampleRate, g_numVoicesPerSession);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+"""
+Compare benchmark results against a baseline and flag regressions.
+
+Usage: compare_bench.py baseline.json current.json [--threshold PERCENT]
+
+A benchmark regresses when its median time per iteration is more than threshold percent slower than the baseline
+(default 10%). Exits with status 1 if any benchmark regressed, so that it can be used in CI.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        return {b["name"]: b for b in json.load(f)["benchmarks"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare benchmark results against a baseline.")
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=10.0, help="regression threshold in percent")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    print("%-40s %12s %12s %9s" % ("benchmark", "baseline ns", "current ns", "change"))
+    regressions = []
+    for name, result in current.items():
+        if name not in baseline:
+            print("%-40s %12s %12.1f %9s" % (name, "-", result["median_ns"], "new"))
+            continue
+
+        before = baseline[name]["median_ns"]
+        after = result["median_ns"]
+        change = 100.0 * (after - before) / before if before > 0 else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions.append(name)
+        elif change < -args.threshold:
+            flag = "  improvement"
+        print("%-40s %12.1f %12.1f %+8.1f%%%s" % (name, before, after, change, flag))
+
+    for name in baseline:
+        if name not in current:
+            print("%-40s %12.1f %12s %9s" % (name, baseline[name]["median_ns"], "-", "missing"))
+
+    if regressions:
+        print("%i regression(s) above %.1f%%: %s" % (len(regressions), args.threshold, ", ".join(regressions)))
+        return 1
+
+    print("No regression above %.1f%%" % args.threshold)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,103 @@
+#include <vector>
+
+#include "AudioDevice.h"
+#include "Sound.h"
+#include "SoundEngine.h"
+
+/*
+    Example adaptive ring.
+    The sound engine adapts its ring buffer depth to the scheduling of the machine: it starts at the maximum depth,
+    shrinks while the device and audio threads keep up, grows again on underruns when the device starts stalling,
+    and shrinks back once the stalls are over. Underruns are filled with silence and counted.
+    The mock audio device plays a steady, then stalling, then steady schedule and checks the delivered audio.
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const int g_numChannels = 2;
+const unsigned long g_framesPerBuffer = 128;
+const int g_minRingDepth = 2;
+const int g_maxRingDepth = 6;
+
+/************************************************************/
+
+class SineSoundEngine : public SoundEngine
+{
+public:
+    SineSoundEngine():
+        SoundEngine(g_sampleRate, g_numChannels, g_framesPerBuffer, g_maxRingDepth),
+        m_audioDevice(g_sampleRate, g_numChannels, g_framesPerBuffer, callback, this),
+        m_sine(1)
+    {
+        std::vector<float> data(static_cast<int>(g_sampleRate));
+        for(size_t i=0; i<data.size(); ++i)
+        {
+            data[i] = 0.5f * std::sin(2.f * static_cast<float>(Math::M_PI) * 100.f * i / static_cast<float>(g_sampleRate));
+        }
+        m_sine.load(data.data(), static_cast<int>(data.size()));
+        m_sine.setLoop(true);
+        m_sine.play();
+
+        setRingDepthBounds(g_minRingDepth, g_maxRingDepth);
+    }
+
+    AudioDevice& getAudioDevice()
+    {
+        return m_audioDevice;
+    }
+
+private:
+    virtual void audioThreadExecute(float* outputBuffer, unsigned long framesPerBuffer, int numChannels) override
+    {
+        memset(outputBuffer, 0, framesPerBuffer * numChannels * sizeof(float));
+        m_sine.execute(outputBuffer, framesPerBuffer, numChannels);
+    }
+
+    AudioDevice m_audioDevice;
+    Sound m_sine;
+};
+
+struct Phase
+{
+    const char* m_name;
+    float m_durationSeconds;
+    float m_stallProbability;
+    float m_stallPeriods; // stall duration in buffer periods
+};
+
+int main(int argc, char* argv[])
+{
+    printf("Example adaptive ring...\n");
+
+    const float periodMicroseconds = static_cast<float>(1e6 * g_framesPerBuffer / g_sampleRate);
+    printf("%lu frames per buffer at %.0f Hz (period %.0f us), ring depth between %i and %i frames\n",
+            g_framesPerBuffer, g_sampleRate, periodMicroseconds, g_minRingDepth, g_maxRingDepth);
+
+    SineSoundEngine soundEngine;
+    AudioDevice& audioDevice = soundEngine.getAudioDevice();
+    audioDevice.setSeed(1234);
+
+    const Phase phases[] =
+    {
+        {"steady", 4.f, 0.f, 0.f},
+        {"stalling", 2.f, 0.02f, 2.5f},
+        {"steady again", 4.f, 0.f, 0.f},
+    };
+
+    soundEngine.initialise();
+    for(const Phase& phase : phases)
+    {
+        audioDevice.setStalls(phase.m_stallProbability, phase.m_stallPeriods * periodMicroseconds);
+        unsigned long numUnderrunsBefore = soundEngine.getProfiler().getStats().m_numUnderruns;
+        audioDevice.process(phase.m_durationSeconds);
+
+        printf("\n%s for %.1f s: ring depth %i frames (%.1f ms), underruns %lu, depth changes so far %lu\n", phase.m_name,
+                phase.m_durationSeconds, soundEngine.getRingDepth(), soundEngine.getRingDepth() * periodMicroseconds / 1000.f,
+                soundEngine.getProfiler().getStats().m_numUnderruns - numUnderrunsBefore, soundEngine.getNumRingDepthChanges());
+        audioDevice.printStats();
+    }
+    soundEngine.terminate();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,122 @@
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "AudioMeter.h"
+#include "ExampleChecks.h"
+#include "SineGenerator.h"
+
+/*
+    Example audio meter.
+    Demonstration of metering performed outside of the audio thread.
+    1. Checks that a fresh tap analyses exactly the blocks pushed, none dropped, and their level.
+       The example fails if any check fails.
+    2. A simulated audio thread renders a sine at real time pace and pushes each block into a MeterTap.
+       The MeterAnalyser thread computes peak, RMS, loudness and spectrum, while the main thread reads the published
+       snapshots.
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const int g_numChannels = 2;
+const unsigned long g_framesPerBuffer = 512;
+const float g_freqHz = 1000.f;
+const float g_volume = 0.5f;
+const int g_processTimeSeconds = 2; // processing time
+
+/************************************************************/
+
+using ExampleChecks::check;
+
+/* A fresh tap, a few blocks pushed then analysed on this thread */
+void checkTap()
+{
+    const unsigned int numBlocks = 8;
+    printf("\nFresh tap, %u blocks:\n", numBlocks);
+
+    MeterTap tap(g_sampleRate, g_numChannels, g_framesPerBuffer);
+    SineGenerator sineGenerator(g_freqHz, g_sampleRate);
+    sineGenerator.setGain(g_volume);
+    std::vector<float> buffer(g_framesPerBuffer * g_numChannels);
+    for(unsigned int b=0; b<numBlocks; ++b)
+    {
+        sineGenerator.execute(buffer.data(), g_framesPerBuffer, g_numChannels);
+        tap.push(buffer.data());
+    }
+
+    MeterSnapshot snapshot = {};
+    const bool analysed = tap.analyse() && tap.getSnapshot(snapshot);
+    const float expectedRms = g_volume / std::sqrt(2.f);
+    printf("  blocks %u (dropped %u) - rms %.4f (sine %.4f)\n", snapshot.m_numBlocks, snapshot.m_numDroppedBlocks,
+            snapshot.m_rms[0], expectedRms);
+    check(analysed && snapshot.m_numBlocks == numBlocks && snapshot.m_numDroppedBlocks == 0, "exactly the blocks pushed, none dropped");
+    check(std::abs(snapshot.m_rms[0] / expectedRms - 1.f) < 0.01f, "rms of the sine, no silent block");
+}
+
+int main(int argc, char* argv[])
+{
+    printf("Example audio meter...\n");
+
+    // 1. checks
+    checkTap();
+
+    // 2. real time metering
+    printf("\nReal time:\n");
+    MeterTap tap(g_sampleRate, g_numChannels, g_framesPerBuffer);
+
+    MeterAnalyser analyser;
+    analyser.addTap(&tap);
+    analyser.start();
+
+    // simulated audio thread
+    std::atomic<bool> runningFlag(true);
+    std::thread audioThread([&]()
+    {
+        SineGenerator sineGenerator(g_freqHz, g_sampleRate);
+        sineGenerator.setGain(g_volume);
+        std::vector<float> buffer(g_framesPerBuffer * g_numChannels);
+
+        auto blockDuration = std::chrono::duration<double>(g_framesPerBuffer / g_sampleRate);
+        auto nextBlockTime = std::chrono::steady_clock::now();
+        while(runningFlag.load())
+        {
+            sineGenerator.execute(buffer.data(), g_framesPerBuffer, g_numChannels);
+            tap.push(buffer.data());
+
+            nextBlockTime += std::chrono::duration_cast<std::chrono::steady_clock::duration>(blockDuration);
+            std::this_thread::sleep_until(nextBlockTime);
+        }
+    });
+
+    // game thread reading the meters
+    for(int i=0; i<g_processTimeSeconds * 4; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+
+        MeterSnapshot snapshot;
+        if(tap.getSnapshot(snapshot))
+        {
+            // loudest band
+            int loudestBand = 0;
+            for(int b=1; b<MeterSnapshot::NumBands; ++b)
+            {
+                if(snapshot.m_spectrum[b] > snapshot.m_spectrum[loudestBand])
+                {
+                    loudestBand = b;
+                }
+            }
+
+            printf("blocks %u (dropped %u) - peak %.3f rms %.3f loudness %.1f LUFS - loudest band %.0f Hz at %.1f dB\n",
+                    snapshot.m_numBlocks, snapshot.m_numDroppedBlocks, snapshot.m_peak[0], snapshot.m_rms[0], snapshot.m_loudness,
+                    snapshot.m_bandFrequency[loudestBand], snapshot.m_spectrum[loudestBand]);
+        }
+    }
+
+    runningFlag.store(false);
+    audioThread.join();
+    analyser.stop();
+
+    return ExampleChecks::getExitCode();
+}
@@ -24,7 +24,7 @@ int main(int argc, char* argv[])
     printf("Example audio player...\n");
 
     const std::string filePath = std::string(TESTSOUND_PATH);
-    AudioPlayer audioPlayer(filePath.c_str());
+    AudioPlayer audioPlayer(filePath.c_str(), g_numChannels); // file channels mapped to the output channels
     audioPlayer.setLoop(g_loop);
     audioPlayer.play();
 
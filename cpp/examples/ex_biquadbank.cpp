@@ -0,0 +1,189 @@
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+#include "BiquadFilter.h"
+#include "ExampleChecks.h"
+#include "SineGenerator.h"
+#include "Sound.h"
+
+/*
+    Example biquad filter bank.
+    Per voice low-pass filtering (e.g. occlusion and distance) of many Sound voices.
+    The example checks that the BiquadFilterBank filters like one scalar biquad per voice, inactive voices included,
+    then compares their cost with every voice active and with a quarter of them active, and reports how many voices
+    a single core could filter in real time. The bank processes as many voices per instruction as the SIMD width of
+    the target. The example fails if any check fails.
+
+    Build in release mode to get meaningful numbers, optionally targeting the host instruction set:
+    make ex_biquadbank CONFIG=release ARCHFLAGS=-march=native && ./build/ex_biquadbank
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const unsigned long g_framesPerBuffer = 512;
+const int g_numVoices = 256;
+const int g_numBlocks = 2000; // number of processed blocks for each measurement
+
+/************************************************************/
+
+using ExampleChecks::check;
+
+/* The voices used by the benchmark: a sound and the mono buffer it's rendered into */
+struct Voices
+{
+    Voices()
+    {
+        // some sine data shared by all the voices
+        int lengthSamples = static_cast<int>(g_sampleRate);
+        std::vector<float> data(lengthSamples);
+        SineGenerator sineGenerator(440.f, g_sampleRate);
+        sineGenerator.execute(data.data(), lengthSamples, 1);
+
+        m_sounds.reserve(g_numVoices);
+        for(int v=0; v<g_numVoices; ++v)
+        {
+            Sound sound(v + 1);
+            sound.load(data.data(), lengthSamples);
+            sound.setLoop(true);
+            sound.play();
+            m_sounds.emplace_back(std::move(sound));
+        }
+
+        m_data.resize(g_numVoices * g_framesPerBuffer);
+        for(int v=0; v<g_numVoices; ++v)
+        {
+            m_buffers.push_back(m_data.data() + v * g_framesPerBuffer);
+        }
+    }
+
+    void render()
+    {
+        for(int v=0; v<g_numVoices; ++v)
+        {
+            m_sounds[v].render(m_buffers[v], g_framesPerBuffer);
+        }
+    }
+
+    std::vector<Sound> m_sounds;
+    std::vector<float> m_data;
+    std::vector<float*> m_buffers;
+};
+
+/* Changing the cutoff of each voice every block - as if emitters were moving */
+float getCutoff(int voice, int block)
+{
+    return 500.f + static_cast<float>((voice * 37 + block * 11) % 8000);
+}
+
+/* Returns the average time in seconds to filter all the voices for one block */
+template<typename FilterFn>
+double measure(Voices& voices, FilterFn filter)
+{
+    double elapsed = 0.;
+    for(int b=0; b<g_numBlocks; ++b)
+    {
+        voices.render(); // not measured
+
+        auto start = std::chrono::steady_clock::now();
+        filter(b);
+        elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    return elapsed / g_numBlocks;
+}
+
+void report(const char* name, double blockTime, double scalarBlockTime)
+{
+    double blockDuration = g_framesPerBuffer / g_sampleRate;
+    double timePerVoice = blockTime / g_numVoices;
+    printf("%-12s %10.2f us/block %8.1f ns/voice/block %10.0f voices/core %6.2fx\n",
+            name, blockTime * 1e6, timePerVoice * 1e9, blockDuration / timePerVoice, scalarBlockTime / blockTime);
+}
+
+/* numActiveVoices first voices active, the others have no buffer */
+double measureBank(Voices& voices, int numActiveVoices)
+{
+    BiquadFilterBank bank(g_numVoices, g_framesPerBuffer);
+    for(int v=0; v<g_numVoices; ++v)
+    {
+        bank.setFilter(v, Biquad::LOWPASS, getCutoff(v, 0), 0.707f, g_sampleRate, true);
+    }
+
+    std::vector<float*> buffers(voices.m_buffers);
+    std::fill(buffers.begin() + numActiveVoices, buffers.end(), nullptr);
+    return measure(voices, [&](int block)
+    {
+        for(int v=0; v<g_numVoices; ++v)
+        {
+            bank.setFilter(v, Biquad::LOWPASS, getCutoff(v, block), 0.707f, g_sampleRate);
+        }
+        bank.process(buffers.data(), g_numVoices, g_framesPerBuffer);
+    });
+}
+
+/* The bank against scalar filters, over a block which isn't a whole number of SIMD tiles, one voice inactive */
+void checkBank(Voices& voices)
+{
+    const int numVoices = 11;
+    const unsigned long numFrames = 127;
+    const int inactiveVoice = 5;
+    printf("\nBank of %i lanes against scalar filters, %i voices, %lu frames:\n", Biquad::NumLanes, numVoices, numFrames);
+
+    voices.render();
+    std::vector<float> expected(voices.m_data.begin(), voices.m_data.begin() + numVoices * g_framesPerBuffer);
+
+    BiquadFilterBank bank(numVoices, g_framesPerBuffer);
+    std::vector<float*> buffers(voices.m_buffers.begin(), voices.m_buffers.begin() + numVoices);
+    buffers[inactiveVoice] = nullptr;
+    for(int v=0; v<numVoices; ++v)
+    {
+        const Biquad::Coefficients c = Biquad::calculate(Biquad::LOWPASS, getCutoff(v, 0), 0.707f, g_sampleRate);
+        bank.setCoefficients(v, c, true);
+        if(v != inactiveVoice)
+        {
+            BiquadFilter filter;
+            filter.setCoefficients(c);
+            filter.process(expected.data() + v * g_framesPerBuffer, numFrames);
+        }
+    }
+    bank.process(buffers.data(), numVoices, numFrames);
+
+    float maxDifference = 0.f;
+    for(size_t i=0; i<expected.size(); ++i)
+    {
+        maxDifference = std::max(maxDifference, std::abs(voices.m_data[i] - expected[i]));
+    }
+    printf("  max difference %g\n", maxDifference);
+    check(maxDifference < 1e-5f, "same output as the scalar filters, inactive voice untouched");
+}
+
+int main(int argc, char* argv[])
+{
+    printf("Example biquad filter bank...\n");
+    printf("%i voices, %lu frames per buffer, %.0f Hz\n", g_numVoices, g_framesPerBuffer, g_sampleRate);
+
+    Voices voices;
+    checkBank(voices);
+    printf("\n");
+
+    // scalar path: one biquad per voice processed in series
+    std::vector<BiquadFilter> filters(g_numVoices);
+    double scalar = measure(voices, [&](int block)
+    {
+        for(int v=0; v<g_numVoices; ++v)
+        {
+            filters[v].setCoefficients(Biquad::calculate(Biquad::LOWPASS, getCutoff(v, block), 0.707f, g_sampleRate));
+            filters[v].process(voices.m_buffers[v], g_framesPerBuffer);
+        }
+    });
+
+    report("scalar", scalar, scalar);
+    char name[32];
+    snprintf(name, sizeof(name), "bank x%i", Biquad::NumLanes);
+    report(name, measureBank(voices, g_numVoices), scalar);
+    report("1/4 active", measureBank(voices, g_numVoices / 4), scalar);
+
+    return ExampleChecks::getExitCode();
+}
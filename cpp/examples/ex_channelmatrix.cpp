@@ -0,0 +1,179 @@
+#include <chrono>
+#include <vector>
+
+#include "AudioBuffer.h"
+#include "ChannelMatrix.h"
+#include "ExampleChecks.h"
+#include "RandomUtils.h"
+
+/*
+    Example channel matrix.
+    1. Checks of the presets and of a custom matrix. The example fails if any check fails.
+    2. Cost of playing multichannel music through the matrix, against a plain copy of the channels and against the
+       former per sample path (sample by sample from a vector of channel vectors, as AudioPlayer did).
+       A downmix reads more channels than it writes: it is also compared with a copy of every input channel, the
+       memory traffic it can't avoid.
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const unsigned long g_framesPerBuffer = 512;
+const float g_durationSeconds = 10.f; // of the music
+const int g_numRepetitions = 5;
+
+/************************************************************/
+
+using ExampleChecks::check;
+
+bool isClose(float a, float b)
+{
+    return std::abs(a - b) <= 1e-6f;
+}
+
+/* Processes one frame where input c holds (c + 1), returns the output frame */
+std::vector<float> processFrame(const ChannelMatrix& matrix)
+{
+    AudioBuffer input(matrix.getNumInputs(), 1);
+    AudioBuffer output(matrix.getNumOutputs(), 1);
+    for(int c=0; c<matrix.getNumInputs(); ++c)
+    {
+        input.getChannel(c)[0] = static_cast<float>(c + 1);
+    }
+    matrix.process(input.getChannels(), output.getChannels(), 1);
+
+    std::vector<float> frame;
+    for(int c=0; c<matrix.getNumOutputs(); ++c)
+    {
+        frame.push_back(output.getChannel(c)[0]);
+    }
+    return frame;
+}
+
+bool matches(const std::vector<float>& frame, std::initializer_list<float> expected)
+{
+    bool match = frame.size() == expected.size();
+    int c = 0;
+    for(float value : expected)
+    {
+        match = match && isClose(frame[c++], value);
+    }
+    return match;
+}
+
+void checkPresets()
+{
+    const float minus3dB = std::sqrt(0.5f);
+    printf("\nPresets (input channel c holds c + 1):\n");
+    check(matches(processFrame(ChannelMatrix(1, 2)), {minus3dB, minus3dB}), "mono to stereo: both sides at -3 dB");
+    check(matches(processFrame(ChannelMatrix(2, 1)), {1.5f}), "stereo to mono: average");
+    check(matches(processFrame(ChannelMatrix(6, 2)), {1.f + minus3dB * (3.f + 5.f), 2.f + minus3dB * (3.f + 6.f)}),
+            "5.1 to stereo: L + 0.707 C + 0.707 Ls, R + 0.707 C + 0.707 Rs, no LFE");
+    check(matches(processFrame(ChannelMatrix(2, 4)), {1.f, 2.f, 0.f, 0.f}) && matches(processFrame(ChannelMatrix(4, 2)), {1.f, 2.f}),
+            "direct: silent extra outputs, dropped extra inputs");
+
+    ChannelMatrix custom(2, 2);
+    custom.setGain(0, 1, 0.25f);
+    custom.setGain(1, 1, 0.f);
+    check(matches(processFrame(custom), {1.5f, 0.f}) && !custom.setPreset(ChannelMatrix::Preset::MONO_TO_STEREO),
+            "custom gains, presets must match the channel counts");
+}
+
+/* Former AudioPlayer path: frame by frame, channel by channel from the vector of channel vectors, interleaved */
+void executePerSample(const std::vector<std::vector<float>>& samples, unsigned long playhead, float* output, int numChannels)
+{
+    for(unsigned long i=0; i<g_framesPerBuffer; ++i)
+    {
+        for(int c=0; c<numChannels; ++c)
+        {
+            *output++ = c < static_cast<int>(samples.size()) ? samples[c][playhead + i] : 0.f;
+        }
+    }
+}
+
+template<typename Func>
+double measure(unsigned long numFrames, Func func)
+{
+    double best = 1e9;
+    for(int r=0; r<g_numRepetitions; ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for(unsigned long playhead=0; playhead + g_framesPerBuffer <= numFrames; playhead += g_framesPerBuffer)
+        {
+            func(playhead);
+        }
+        const double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, elapsed / (numFrames / g_framesPerBuffer));
+    }
+    return best;
+}
+
+void measureCost(int numInputs, int numOutputs)
+{
+    const unsigned long numFrames = static_cast<unsigned long>(g_durationSeconds * g_sampleRate);
+    std::vector<std::vector<float>> samples(numInputs, std::vector<float>(numFrames));
+    std::vector<const float*> inputs;
+    for(std::vector<float>& channel : samples)
+    {
+        for(float& sample : channel)
+        {
+            sample = RandomUtils::g_random.getRandRealInRange(-0.5f, 0.5f);
+        }
+        inputs.push_back(channel.data());
+    }
+
+    ChannelMatrix matrix(numInputs, numOutputs);
+    AudioBuffer output(numOutputs, g_framesPerBuffer);
+    std::vector<float> interleaved(g_framesPerBuffer * numOutputs);
+
+    const double copyMicroseconds = measure(numFrames, [&](unsigned long playhead)
+    {
+        for(int c=0; c<numOutputs; ++c)
+        {
+            memcpy(output.getChannel(c), inputs[c % numInputs] + playhead, g_framesPerBuffer * sizeof(float));
+        }
+    });
+    const double inputCopyMicroseconds = measure(numFrames, [&](unsigned long playhead)
+    {
+        for(int c=0; c<std::max(numInputs, numOutputs); ++c)
+        {
+            memcpy(output.getChannel(c % numOutputs), inputs[c % numInputs] + playhead, g_framesPerBuffer * sizeof(float));
+        }
+    });
+    const double matrixMicroseconds = measure(numFrames, [&](unsigned long playhead)
+    {
+        matrix.process(inputs.data(), playhead, output.getChannels(), 0, g_framesPerBuffer);
+    });
+    const double interleavedMicroseconds = measure(numFrames, [&](unsigned long playhead)
+    {
+        matrix.process(inputs.data(), playhead, output.getChannels(), 0, g_framesPerBuffer);
+        AudioBufferUtils::interleave(output.getChannels(), numOutputs, g_framesPerBuffer, interleaved.data());
+    });
+    const double perSampleMicroseconds = measure(numFrames, [&](unsigned long playhead)
+    {
+        executePerSample(samples, playhead, interleaved.data(), numOutputs);
+    });
+
+    printf("  %i to %i channels: copy %.2f us, matrix %.2f us (%.2fx the copy, %.2fx a copy of the inputs), matrix + interleave %.2f us, per sample %.2f us\n",
+            numInputs, numOutputs, copyMicroseconds, matrixMicroseconds, matrixMicroseconds / copyMicroseconds, matrixMicroseconds / inputCopyMicroseconds,
+            interleavedMicroseconds, perSampleMicroseconds);
+}
+
+int main(int argc, char* argv[])
+{
+    printf("Example channel matrix...\n");
+
+    // 1. presets
+    checkPresets();
+
+    // 2. cost, best of the repetitions
+    printf("\nCost per block of %lu frames, playing %.0f s of music:\n", g_framesPerBuffer, g_durationSeconds);
+    measureCost(2, 2);
+    measureCost(6, 6);
+    measureCost(8, 8);
+    measureCost(6, 2);
+    measureCost(1, 2);
+    measureCost(2, 1);
+
+    return ExampleChecks::getExitCode();
+}
@@ -1,12 +1,13 @@
-#define LOG_MUTEX_LEVEL 1
-
 #include <vector>
 
 #include "AudioFile.h"
+#include "AudioMeter.h"
+#include "MixGraph.h"
 #include "PaSoundEngine.h"
 #include "SineGenerator.h"
 #include "Sound.h"
-#include "TaskQueue.h"
+#include "PriorityTaskQueue.h"
+#include "TaskScheduler.h"
 #include "Timer.h"
 
 /*
@@ -14,7 +15,12 @@
     A more comprehensive example showing the use of:
     - Sound Engine: communicating to an audio device using a ring buffer and therefore allowing playback of audio data.
     - Task Queue: used to post task requests (in this case play/stop sound) from the main game thread to the audio thread.
+      Tasks are prioritised (stop beats play, which beats parameter changes) and drained under a time budget every block.
+      Tasks can carry a sample time on the engine clock: they are then executed on that exact sample, splitting the block.
     - Sound: class representing a sound.
+    - Mix Graph: sounds are mixed into submix buses (sfx, music) with a send to an echo bus, down to the master bus.
+    - Meter Tap: the output is metered on a separate analysis thread.
+    - Block Profiler: the audio thread render time (with the cost of voices, mix and metering) is printed at shutdown.
     Sounds are identified using ids and they are pre-loaded in the sound engine.
 */
 
@@ -23,6 +29,9 @@
 const double g_sampleRate = 44100.;
 const int g_numChannels = 2;
 const int g_framesPerBuffer = 1024;
+const int g_numMixWorkers = 1; // worker threads processing independent buses in parallel with the audio thread
+const int g_taskQueueSize = 64; // maximum number of tasks per priority
+const float g_taskBudgetMicroseconds = 200.f; // time per block for processing tasks (stop tasks are never deferred)
 
 /************************************************************/
 
@@ -55,8 +64,21 @@ class TestSoundEngine : public PaSoundEngine
 public:
     TestSoundEngine(double sampleRate, int numChannels, unsigned long framesPerBuffer):
         PaSoundEngine(sampleRate, numChannels, framesPerBuffer),
-        m_queue(10) //maximum queue capacity
+        m_queue(g_taskQueueSize, g_taskBudgetMicroseconds),
+        m_scheduler(g_taskQueueSize),
+        m_masterTap(sampleRate, numChannels, framesPerBuffer),
+        m_mixer(g_numMixWorkers)
     {
+        //============== Profiling sections of the audio thread ===================//
+
+        m_voicesSection = getProfiler().addSection("voices");
+        m_mixSection = getProfiler().addSection("mix");
+        m_meterSection = getProfiler().addSection("meter");
+
+        //============== Building the mix graph ===================//
+
+        buildMixGraph(false);
+
         //============== Loading sounds into memory ===================//
 
         m_sounds.reserve(4);
@@ -118,15 +140,18 @@ public:
         }
     }
 
-    void playSound(unsigned long soundId)
+    /* Sounds are played, stopped and changed at the beginning of the next audio block, or at sampleTime if not 0 */
+    void playSound(unsigned long soundId, uint64_t sampleTime = 0)
     {
         struct TaskParams
         {
             unsigned long soundId;
+            uint64_t pushTicks; // to measure the trigger latency
         } taskParams;
         taskParams.soundId = soundId;
+        taskParams.pushTicks = sampleTime == 0 ? CycleClock::now() : 0;
 
-        auto task = [](void* context, void* params, float deltaTime)
+        auto task = [](void* context, void* params, float)
         {
             TestSoundEngine* soundEngine = (TestSoundEngine*)context;
             TaskParams* taskParams = (TaskParams*)params;
@@ -138,13 +163,17 @@ public:
             }
 
             s->play();
+            if(taskParams->pushTicks != 0)
+            {
+                soundEngine->markTrigger(taskParams->pushTicks);
+            }
             LM_LOG("Playing sound %s", getNameForSoundId(s->getId()));
         };
 
-        m_queue.push(task, this, &taskParams, sizeof(taskParams));
+        m_queue.pushAt(sampleTime, PriorityTaskQueue::HIGH, task, this, &taskParams, sizeof(taskParams));
     }
 
-    void stopSound(unsigned long soundId)
+    void stopSound(unsigned long soundId, uint64_t sampleTime = 0)
     {
         struct TaskParams
         {
@@ -152,7 +181,7 @@ public:
         } taskParams;
         taskParams.soundId = soundId;
 
-        auto task = [](void* context, void* params, float deltaTime)
+        auto task = [](void* context, void* params, float)
         {
             TestSoundEngine* soundEngine = (TestSoundEngine*)context;
             TaskParams* taskParams = (TaskParams*)params;
@@ -167,7 +196,89 @@ public:
             LM_LOG("Stopping sound %s", getNameForSoundId(s->getId()));
         };
 
-        m_queue.push(task, this, &taskParams, sizeof(taskParams));
+        m_queue.pushAt(sampleTime, PriorityTaskQueue::CRITICAL, task, this, &taskParams, sizeof(taskParams));
+    }
+
+    enum SoundParam
+    {
+        GAIN,
+        PAN,
+        PITCH
+    };
+
+    /* The parameter ramps sample accurately to the new value over rampSeconds */
+    void setSoundParam(unsigned long soundId, SoundParam param, float value, float rampSeconds, uint64_t sampleTime = 0)
+    {
+        struct TaskParams
+        {
+            unsigned long soundId;
+            SoundParam param;
+            float value;
+            int rampSamples;
+        } taskParams;
+        taskParams.soundId = soundId;
+        taskParams.param = param;
+        taskParams.value = value;
+        taskParams.rampSamples = static_cast<int>(rampSeconds * m_sampleRate);
+
+        auto task = [](void* context, void* params, float)
+        {
+            TestSoundEngine* soundEngine = (TestSoundEngine*)context;
+            TaskParams* taskParams = (TaskParams*)params;
+
+            Sound* s = soundEngine->getSound(taskParams->soundId);
+            if(!s)
+            {
+                return;
+            }
+
+            switch(taskParams->param)
+            {
+                case GAIN:
+                    s->setGain(taskParams->value, taskParams->rampSamples);
+                    break;
+                case PAN:
+                    s->setPan(taskParams->value, taskParams->rampSamples);
+                    break;
+                case PITCH:
+                    s->setPitch(taskParams->value, taskParams->rampSamples);
+                    break;
+            }
+        };
+
+        m_queue.pushAt(sampleTime, PriorityTaskQueue::NORMAL, task, this, &taskParams, sizeof(taskParams));
+    }
+
+    /* 
+        Game thread. The graph is built off the audio thread and swapped in at the beginning of the next block.
+        The echo on the sfx bus can be turned on and off at runtime rebuilding the graph.
+    */
+    void buildMixGraph(bool sfxEcho)
+    {
+        MixGraphDesc desc;
+        int sfxBus = desc.addBus("sfx");
+        int musicBus = desc.addBus("music", MixGraphDesc::MasterBus, 0.8f);
+        assert(sfxBus == m_sfxBus && musicBus == m_musicBus);
+        if(sfxEcho)
+        {
+            int echoBus = desc.addBus("echo");
+            desc.addInsert(echoBus, echoInsert, &m_echo);
+            desc.addSend(sfxBus, echoBus, 0.5f);
+        }
+
+        m_mixer.setGraph(MixGraph::compile(desc, m_numChannels, m_framesPerBuffer));
+    }
+
+    /* Task processing stats, updated by the audio thread */
+    PriorityTaskQueue::Stats getTaskStats() const
+    {
+        return m_queue.getStats();
+    }
+
+    /* Meters of the output, updated by the analyser thread */
+    MeterTap& getMasterTap()
+    {
+        return m_masterTap;
     }
 
 private:
@@ -181,14 +292,35 @@ private:
     // we do any audio processing here - each time a write buffer is available
     virtual void audioThreadExecute(float* outputBuffer, unsigned long framesPerBuffer, int numChannels) override
     {
-        // clean buffer
-        memset(outputBuffer, 0, framesPerBuffer*numChannels*sizeof(float));
+        // swap in a new graph (if any) and clean the bus buffers
+        MixGraph* graph = m_mixer.beginBlock(framesPerBuffer);
 
-        // processing sounds
-        for(int i=0; i<m_sounds.size(); ++i)
+        // processing sounds into their bus, the block is split at the sample time of scheduled tasks
+        m_scheduler.process(getBlockSampleTime(), framesPerBuffer, 0.f, [&](unsigned long offset, unsigned long numFrames)
         {
-            m_sounds[i].execute(outputBuffer, framesPerBuffer, numChannels);
+            BlockProfiler::Scope scope(getProfiler(), m_voicesSection);
+
+            if(!graph)
+            {
+                return;
+            }
+
+            for(size_t i=0; i<m_sounds.size(); ++i)
+            {
+                int bus = m_sounds[i].getId() == g_soundIdMusic ? m_musicBus : m_sfxBus;
+                m_sounds[i].executePlanar(graph->getBusChannels(bus), offset + numFrames, numChannels, offset);
+            }
+        });
+
+        // mixing the buses down to the output buffer
+        {
+            BlockProfiler::Scope scope(getProfiler(), m_mixSection);
+            m_mixer.execute(outputBuffer, framesPerBuffer, numChannels);
         }
+
+        // copying the mix for metering - analysis is done on the analyser thread
+        BlockProfiler::Scope scope(getProfiler(), m_meterSection);
+        m_masterTap.push(outputBuffer);
     }
 
     /* Retrieve a sound based on its id */
@@ -197,7 +329,7 @@ private:
         // ensure we call this function from the audio thread
         assert(isInAudioThread());
 
-        for(int i=0; i<m_sounds.size(); ++i)
+        for(size_t i=0; i<m_sounds.size(); ++i)
         {
             Sound& s = m_sounds[i];
             if(s.getId() == soundId)
@@ -216,67 +348,145 @@ private:
         // ensure we call this function from the audio thread
         assert(isInAudioThread());
 
-        // No processing if there are no tasks to process
-        if(!m_queue.getNumTasks())
-        {
-            return;
-        }
+        // tasks left when the budget is used are processed in the next block, timed tasks are scheduled
+        m_queue.drain(deltaTime, &m_scheduler);
+    }
+
+    /* This NOT THREAD SAFE and should only be accessed by the update thread. */
+    std::vector<Sound> m_sounds; // examples of sounds loaded in memory
 
-        LM_VERBOSE("Begin frame.");
+    PriorityTaskQueue m_queue;
+    TaskScheduler m_scheduler;
 
-        /* For simplicity we define a fix size of number of tasks per frame. */
-        int numProcessedTasks = 0;
-        
-        while(numProcessedTasks < m_numMaxTasksPerFrame)
+    int m_voicesSection;
+    int m_mixSection;
+    int m_meterSection;
+
+    MeterTap m_masterTap;
+
+    /* A simple feedback echo used as an effect insert */
+    struct Echo
+    {
+        static const int m_delayFrames = 11025;
+        float m_feedback = 0.4f;
+        std::vector<float> m_delayLine = std::vector<float>(m_delayFrames * g_numChannels, 0.f);
+        int m_position = 0;
+    } m_echo;
+
+    static void echoInsert(float* const* channels, unsigned long framesPerBuffer, int numChannels, void* context)
+    {
+        // one delay line per channel, the position is shared
+        Echo* echo = (Echo*)context;
+        for(int c=0; c<numChannels; ++c)
         {
-            TaskQueue::Task task;
-            if(!m_queue.pop(task))
+            float* buffer = channels[c];
+            float* delayLine = echo->m_delayLine.data() + c * Echo::m_delayFrames;
+            int position = echo->m_position;
+            for(unsigned long i=0; i<framesPerBuffer; ++i)
             {
-                break;
+                float delayed = delayLine[position];
+                delayLine[position] = buffer[i] + delayed * echo->m_feedback;
+                buffer[i] = delayed;
+                position = (position + 1) % Echo::m_delayFrames;
             }
-
-            task.execute(deltaTime);
-            ++numProcessedTasks;
         }
-
-        LM_VERBOSE("End frame.");
+        echo->m_position = static_cast<int>((echo->m_position + framesPerBuffer) % Echo::m_delayFrames);
     }
 
-    /* This NOT THREAD SAFE and should only be accessed by the update thread. */
-    std::vector<Sound> m_sounds; // examples of sounds loaded in memory
+    MixGraphProcessor m_mixer;
 
-    TaskQueue m_queue;
-    const int m_numMaxTasksPerFrame = 2;
+    /* Buses are always added in the same order so that their indices are the same in every graph */
+    static const int m_sfxBus = 1;
+    static const int m_musicBus = 2;
 };
 
+/* Print the latest output meters */
+void printMeters(TestSoundEngine& soundEngine)
+{
+    MeterSnapshot snapshot;
+    if(soundEngine.getMasterTap().getSnapshot(snapshot))
+    {
+        printf("Meters: peak %.2f %.2f, rms %.2f %.2f, loudness %.1f LUFS, dropped blocks %u\n",
+                snapshot.m_peak[0], snapshot.m_peak[1], snapshot.m_rms[0], snapshot.m_rms[1], snapshot.m_loudness, snapshot.m_numDroppedBlocks);
+    }
+}
+
+/* Print the task processing stats */
+void printTaskStats(TestSoundEngine& soundEngine)
+{
+    PriorityTaskQueue::Stats stats = soundEngine.getTaskStats();
+    printf("Tasks: %lu processed over %lu blocks (max %i per block), backlog %i (max %i), budget overruns %lu, last drain %.1f us\n",
+            stats.m_numDrained, stats.m_numBlocks, stats.m_maxDrained, stats.m_backlog, stats.m_maxBacklog, stats.m_numOverruns, stats.m_lastDrainMicroseconds);
+}
+
 int main(int argc, char* argv[])
 {
     printf("Hello World from main...\n");
 
+    g_logger.setLevel(Logger::LOG); // Logger::VERBOSE to trace the sound engine
+
     TestSoundEngine soundEngine(g_sampleRate, g_numChannels, g_framesPerBuffer);
+    soundEngine.getProfiler().setSectionsEnabled(true);
     soundEngine.initialise();
+
+    MeterAnalyser analyser;
+    analyser.addTap(&soundEngine.getMasterTap());
+    analyser.start();
     
     // 1. Let's play the start sound and music
     soundEngine.playSound(g_soundIdStart);
     soundEngine.sleepFor(1); //wait
+    printMeters(soundEngine);
 
     // 2. Let's play some music
     soundEngine.playSound(g_soundIdMusic);
     soundEngine.sleepFor(4); //wait
+    printMeters(soundEngine);
 
-    // 3. Play sine
+    // 3. Play sine while the music fades down and sweeping the sine pitch and pan
+    soundEngine.setSoundParam(g_soundIdMusic, TestSoundEngine::GAIN, 0.3f, 1.f);
+    soundEngine.setSoundParam(g_soundIdSine, TestSoundEngine::PAN, -1.f, 0.f);
     soundEngine.playSound(g_soundIdSine);
+    soundEngine.setSoundParam(g_soundIdSine, TestSoundEngine::PITCH, 2.f, 1.f);
+    soundEngine.setSoundParam(g_soundIdSine, TestSoundEngine::PAN, 1.f, 1.f);
     soundEngine.sleepFor(3); //wait
+    printMeters(soundEngine);
 
-    // 4. Stop music
+    // 4. Fade out and stop music
+    soundEngine.setSoundParam(g_soundIdMusic, TestSoundEngine::GAIN, 0.f, 0.5f);
+    soundEngine.sleepFor(1); //wait
     soundEngine.stopSound(g_soundIdMusic);
     soundEngine.sleepFor(1); //wait
+    printMeters(soundEngine);
 
-    // 5. Playing a shot sound
+    // 5. Playing a shot sound with some echo
+    soundEngine.buildMixGraph(true);
     soundEngine.playSound(g_soundIdShot);
     soundEngine.sleepFor(2); //wait
+    printMeters(soundEngine);
+
+    // 6. Playing the sine on a 120 bpm grid: each beat lands on its exact sample whatever the buffer size
+    {
+        const uint64_t beatSamples = static_cast<uint64_t>(g_sampleRate * 0.5);
+        const uint64_t noteSamples = static_cast<uint64_t>(g_sampleRate * 0.1);
+        const uint64_t start = soundEngine.getSampleTime() + static_cast<uint64_t>(g_sampleRate * 0.1); // leaving time for the tasks to be processed
+        soundEngine.setSoundParam(g_soundIdSine, TestSoundEngine::PITCH, 1.f, 0.f);
+        soundEngine.setSoundParam(g_soundIdSine, TestSoundEngine::PAN, 0.f, 0.f);
+        for(int beat=0; beat<4; ++beat)
+        {
+            soundEngine.playSound(g_soundIdSine, start + beat * beatSamples);
+            soundEngine.stopSound(g_soundIdSine, start + beat * beatSamples + noteSamples);
+        }
+        soundEngine.sleepFor(3); //wait
+        printMeters(soundEngine);
+    }
+
+    printTaskStats(soundEngine);
+    soundEngine.printTriggerLatency();
+    soundEngine.getProfiler().print();
 
     soundEngine.terminate();
+    analyser.stop();
     
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,334 @@
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioDevice.h"
+#include "LatencyHistogram.h"
+#include "PriorityTaskQueue.h"
+#include "Sound.h"
+#include "SoundEngine.h"
+
+/*
+    Example game load.
+    A headless load generator for the command path: game threads push commands (play, stop, gain, pan) to a
+    sound engine driven by a mock audio device at the real buffer period, with a steady rate and periodic bursts
+    (e.g. an explosion or a level streaming in).
+    As task queues are single-producer, each producer thread has its own queue, all drained by the audio thread
+    under a time budget.
+
+    Reported:
+    - accepted and rejected pushes (queue full),
+    - queue depth over time (maximum over each 100ms),
+    - command-to-execution latency,
+    - audio thread overruns: task budget overruns, block deadline misses and device underruns.
+    Use it to size the queue capacities and the task budget for a given command load.
+
+    Options (all optional):
+    --producers N --rate COMMANDS_PER_SECOND --burst-size N --burst-interval MS
+    --capacity N (per priority lane) --budget US --frames N --voices N --duration SECONDS
+    --overflow reject|block|spill (when a queue is full, see TaskQueue) --block-timeout US
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const int g_numChannels = 2;
+const int g_ringBufferNumFrames = 3;
+const int g_timelineIntervalMs = 100;
+
+/************************************************************/
+
+struct LoadConfig
+{
+    int m_numProducers = 4;
+    double m_commandRate = 500.; // commands per second per producer
+    int m_burstSize = 64; // commands pushed at once
+    int m_burstIntervalMs = 500;
+    int m_queueCapacity = 64; // per producer and priority lane
+    float m_budgetMicroseconds = 500.f; // per block for all the queues
+    unsigned long m_framesPerBuffer = 256;
+    int m_numVoices = 64;
+    float m_durationSeconds = 5.f;
+    TaskQueue::OverflowPolicy m_overflowPolicy = TaskQueue::OverflowPolicy::REJECT;
+    float m_blockTimeoutMicroseconds = 1000.f;
+
+    bool parse(int argc, char* argv[])
+    {
+        for(int i=1; i+1<argc; i+=2)
+        {
+            std::string arg = argv[i];
+            if(arg == "--overflow")
+            {
+                std::string policy = argv[i + 1];
+                m_overflowPolicy = policy == "block" ? TaskQueue::OverflowPolicy::BLOCK :
+                                   policy == "spill" ? TaskQueue::OverflowPolicy::SPILL : TaskQueue::OverflowPolicy::REJECT;
+                continue;
+            }
+
+            double value = std::stod(argv[i + 1]);
+            if(arg == "--producers") m_numProducers = std::max(1, static_cast<int>(value));
+            else if(arg == "--rate") m_commandRate = value;
+            else if(arg == "--burst-size") m_burstSize = static_cast<int>(value);
+            else if(arg == "--burst-interval") m_burstIntervalMs = std::max(1, static_cast<int>(value));
+            else if(arg == "--capacity") m_queueCapacity = std::max(1, static_cast<int>(value));
+            else if(arg == "--budget") m_budgetMicroseconds = static_cast<float>(value);
+            else if(arg == "--frames") m_framesPerBuffer = std::max(16, static_cast<int>(value));
+            else if(arg == "--voices") m_numVoices = std::max(1, static_cast<int>(value));
+            else if(arg == "--duration") m_durationSeconds = static_cast<float>(value);
+            else if(arg == "--block-timeout") m_blockTimeoutMicroseconds = static_cast<float>(value);
+            else
+            {
+                printf("Unknown option %s\n", arg.c_str());
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+class LoadSoundEngine : public SoundEngine
+{
+public:
+    enum CommandType
+    {
+        PLAY,
+        STOP,
+        GAIN,
+        PAN,
+        NumCommandTypes
+    };
+
+    LoadSoundEngine(const LoadConfig& config):
+        SoundEngine(g_sampleRate, g_numChannels, config.m_framesPerBuffer, g_ringBufferNumFrames),
+        m_audioDevice(g_sampleRate, g_numChannels, config.m_framesPerBuffer, callback, this),
+        m_timeline(static_cast<int>(config.m_durationSeconds * 1000 / g_timelineIntervalMs) + 2)
+    {
+        for(int p=0; p<config.m_numProducers; ++p)
+        {
+            m_queues.push_back(std::make_unique<PriorityTaskQueue>(config.m_queueCapacity, config.m_budgetMicroseconds / config.m_numProducers));
+            m_queues.back()->setOverflowPolicy(config.m_overflowPolicy, config.m_blockTimeoutMicroseconds);
+        }
+
+        // short voices so that plays keep happening
+        std::vector<float> data(static_cast<int>(0.2 * g_sampleRate));
+        for(size_t i=0; i<data.size(); ++i)
+        {
+            data[i] = 0.05f * std::sin(2.f * static_cast<float>(Math::M_PI) * 220.f * i / static_cast<float>(g_sampleRate));
+        }
+        m_voices.reserve(config.m_numVoices);
+        for(int v=0; v<config.m_numVoices; ++v)
+        {
+            Sound voice(v + 1);
+            voice.load(data.data(), static_cast<int>(data.size()));
+            m_voices.emplace_back(std::move(voice));
+        }
+
+        for(auto& depth : m_timeline)
+        {
+            depth.store(0);
+        }
+    }
+
+    /* Producer thread. Returns false if the command was rejected (queue full). */
+    bool pushCommand(int producer, CommandType type, int voice, float value)
+    {
+        struct TaskParams
+        {
+            CommandType type;
+            int voice;
+            float value;
+            uint64_t pushTicks;
+        } taskParams = {type, voice, value, CycleClock::now()};
+
+        auto task = [](void* context, void* params, float)
+        {
+            LoadSoundEngine* soundEngine = (LoadSoundEngine*)context;
+            TaskParams* taskParams = (TaskParams*)params;
+
+            Sound& voice = soundEngine->m_voices[taskParams->voice % soundEngine->m_voices.size()];
+            switch(taskParams->type)
+            {
+                case PLAY:
+                    voice.stop();
+                    voice.play();
+                    break;
+                case STOP:
+                    voice.stop();
+                    break;
+                case GAIN:
+                    voice.setGain(taskParams->value, 256);
+                    break;
+                case PAN:
+                    voice.setPan(taskParams->value, 256);
+                    break;
+                default:
+                    break;
+            }
+
+            soundEngine->m_commandLatency.record(static_cast<uint64_t>(CycleClock::ticksToMicroseconds(CycleClock::now() - taskParams->pushTicks)));
+        };
+
+        // stops beat plays which beat cosmetic changes
+        static const PriorityTaskQueue::Priority priorities[NumCommandTypes] =
+        {
+            PriorityTaskQueue::HIGH, PriorityTaskQueue::CRITICAL, PriorityTaskQueue::NORMAL, PriorityTaskQueue::LOW
+        };
+
+        return m_queues[producer]->push(priorities[type], task, this, &taskParams, sizeof(taskParams));
+    }
+
+    /* Device thread */
+    void runDevice(float durationSeconds)
+    {
+        m_audioDevice.process(durationSeconds);
+    }
+
+    void printReport() const
+    {
+        printf("Queue depth, max every %i ms:", g_timelineIntervalMs);
+        for(size_t i=0; i<m_timeline.size(); ++i)
+        {
+            printf("%s%i", i % 20 == 0 ? "\n    " : " ", m_timeline[i].load());
+        }
+        printf("\n");
+
+        unsigned long numOverruns = 0;
+        int maxBacklog = 0;
+        for(const auto& queue : m_queues)
+        {
+            PriorityTaskQueue::Stats stats = queue->getStats();
+            numOverruns += stats.m_numOverruns;
+            maxBacklog = std::max(maxBacklog, stats.m_maxBacklog);
+        }
+        printf("Task budget overruns %lu, max backlog per queue after a block %i\n", numOverruns, maxBacklog);
+
+        m_commandLatency.print("Command to execution latency");
+    }
+
+private:
+    virtual void audioThreadProcess(float deltaTime) override
+    {
+        int depth = 0;
+        for(auto& queue : m_queues)
+        {
+            depth += queue->getNumTasks();
+            queue->drain(deltaTime);
+        }
+
+        // the audio thread is the only writer of the timeline
+        size_t interval = static_cast<size_t>(getSampleTime() * 1000 / (g_sampleRate * g_timelineIntervalMs));
+        if(interval < m_timeline.size() && depth > m_timeline[interval].load(std::memory_order_relaxed))
+        {
+            m_timeline[interval].store(depth, std::memory_order_relaxed);
+        }
+    }
+
+    virtual void audioThreadExecute(float* outputBuffer, unsigned long framesPerBuffer, int numChannels) override
+    {
+        memset(outputBuffer, 0, framesPerBuffer * numChannels * sizeof(float));
+        for(Sound& voice : m_voices)
+        {
+            voice.execute(outputBuffer, framesPerBuffer, numChannels);
+        }
+    }
+
+    AudioDevice m_audioDevice;
+    std::vector<std::unique_ptr<PriorityTaskQueue>> m_queues; // one per producer
+    std::vector<Sound> m_voices;
+    std::vector<std::atomic<int>> m_timeline; // max queue depth per interval
+    LatencyHistogram m_commandLatency; // microseconds
+};
+
+int main(int argc, char* argv[])
+{
+    printf("Example game load...\n");
+
+    LoadConfig config;
+    if(!config.parse(argc, argv))
+    {
+        return EXIT_FAILURE;
+    }
+
+    // rejected pushes are counted here rather than logged
+    g_logger.setLevel(Logger::NONE);
+
+    static const char* overflowPolicies[] = {"reject", "block", "spill"};
+    printf("%i producers x %.0f commands/s + bursts of %i every %i ms, queue capacity %i per producer lane (overflow: %s), "
+            "task budget %.0f us, %lu frames per buffer, %i voices, %.1f s\n", config.m_numProducers, config.m_commandRate,
+            config.m_burstSize, config.m_burstIntervalMs, config.m_queueCapacity, overflowPolicies[static_cast<int>(config.m_overflowPolicy)],
+            config.m_budgetMicroseconds, config.m_framesPerBuffer, config.m_numVoices, config.m_durationSeconds);
+
+    LoadSoundEngine soundEngine(config);
+    soundEngine.initialise();
+
+    std::atomic<bool> runningFlag(true);
+    std::vector<std::thread> producers;
+    std::vector<unsigned long> numAccepted(config.m_numProducers, 0);
+    std::vector<unsigned long> numRejected(config.m_numProducers, 0);
+    for(int p=0; p<config.m_numProducers; ++p)
+    {
+        producers.emplace_back([&, p]()
+        {
+            std::mt19937 generator(1000 + p);
+            std::uniform_int_distribution<int> commandType(0, LoadSoundEngine::NumCommandTypes - 1);
+            std::uniform_int_distribution<int> voice(0, config.m_numVoices - 1);
+            std::uniform_real_distribution<float> value(0.f, 1.f);
+
+            auto push = [&]()
+            {
+                bool accepted = soundEngine.pushCommand(p, (LoadSoundEngine::CommandType)commandType(generator), voice(generator), value(generator));
+                ++(accepted ? numAccepted[p] : numRejected[p]);
+            };
+
+            const auto period = std::chrono::duration<double>(config.m_commandRate > 0. ? 1. / config.m_commandRate : 1.);
+            const auto burstInterval = std::chrono::milliseconds(config.m_burstIntervalMs);
+            auto nextCommand = std::chrono::steady_clock::now();
+            auto nextBurst = nextCommand + burstInterval;
+            while(runningFlag.load())
+            {
+                auto now = std::chrono::steady_clock::now();
+                if(now >= nextBurst)
+                {
+                    for(int i=0; i<config.m_burstSize; ++i)
+                    {
+                        push();
+                    }
+                    nextBurst += burstInterval;
+                }
+                if(config.m_commandRate > 0. && now >= nextCommand)
+                {
+                    push();
+                    nextCommand += std::chrono::duration_cast<std::chrono::steady_clock::duration>(period);
+                }
+                std::this_thread::sleep_until(std::min(nextCommand, nextBurst));
+            }
+        });
+    }
+
+    soundEngine.runDevice(config.m_durationSeconds);
+
+    runningFlag.store(false);
+    for(std::thread& producer : producers)
+    {
+        producer.join();
+    }
+    soundEngine.terminate();
+
+    unsigned long totalAccepted = 0;
+    unsigned long totalRejected = 0;
+    for(int p=0; p<config.m_numProducers; ++p)
+    {
+        printf("Producer %i: accepted %lu, rejected %lu\n", p, numAccepted[p], numRejected[p]);
+        totalAccepted += numAccepted[p];
+        totalRejected += numRejected[p];
+    }
+    printf("Pushes: accepted %lu, rejected %lu (%.2f%%)\n", totalAccepted, totalRejected,
+            100. * totalRejected / std::max(1ul, totalAccepted + totalRejected));
+
+    soundEngine.printReport();
+    soundEngine.getProfiler().print();
+
+    return EXIT_SUCCESS;
+}
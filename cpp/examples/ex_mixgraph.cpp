@@ -0,0 +1,203 @@
+#include <chrono>
+#include <cmath>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "ExampleChecks.h"
+#include "MixGraph.h"
+#include "SineGenerator.h"
+#include "Sound.h"
+
+/*
+    Example mix graph.
+    Voices are mixed into group buses (sfx, music, voice), which are routed to the master bus.
+    The sfx and voice groups also send to a reverb bus. Each group has an expensive insert so that the benefit
+    of processing independent buses on worker threads is visible.
+    The voices are either mixed on the audio thread before the graph runs (only the inserts and gains run in
+    parallel), or rendered by the job of their group bus, the groups rendering their voices in parallel. Checks that
+    both give the same output.
+    While the audio thread (here simulated by the main thread) processes blocks, another thread rebuilds the graph
+    and swaps it in, without ever blocking the audio thread.
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const int g_numChannels = 2;
+const unsigned long g_framesPerBuffer = 512;
+const int g_numVoicesPerGroup = 16;
+const int g_numBlocks = 1000;
+
+/************************************************************/
+
+using ExampleChecks::check;
+
+/* An arbitrary amount of work to simulate an effect, e.g. a reverb */
+struct HeavyInsert
+{
+    std::vector<float> m_state = std::vector<float>(g_framesPerBuffer * g_numChannels, 0.f);
+    float m_amount = 0.5f;
+};
+
+void heavyInsert(float* const* channels, unsigned long framesPerBuffer, int numChannels, void* context)
+{
+    HeavyInsert* insert = (HeavyInsert*)context;
+    for(int c=0; c<numChannels; ++c)
+    {
+        float* buffer = channels[c];
+        float* state = insert->m_state.data() + c * g_framesPerBuffer;
+        for(int pass=0; pass<8; ++pass)
+        {
+            for(unsigned long i=0; i<framesPerBuffer; ++i)
+            {
+                state[i] = state[i] * 0.5f + std::tanh(buffer[i]) * 0.5f;
+            }
+        }
+        for(unsigned long i=0; i<framesPerBuffer; ++i)
+        {
+            buffer[i] += state[i] * insert->m_amount;
+        }
+    }
+}
+
+struct Groups
+{
+    int m_sfx;
+    int m_music;
+    int m_voice;
+};
+
+/* The voices of the group buses, voice v belongs to group v % 3 */
+struct GroupVoices
+{
+    int m_buses[3];
+    std::vector<Sound>* m_voices;
+};
+
+/* Voice source of the graph: mixes the voices of a group bus, on the job of that bus */
+void mixGroupVoices(int bus, float* const* channels, unsigned long framesPerBuffer, int numChannels, void* context)
+{
+    GroupVoices* groupVoices = (GroupVoices*)context;
+    std::vector<Sound>& voices = *groupVoices->m_voices;
+    for(size_t v=0; v<voices.size(); ++v)
+    {
+        if(groupVoices->m_buses[v % 3] == bus)
+        {
+            voices[v].executePlanar(channels, framesPerBuffer, numChannels);
+        }
+    }
+}
+
+MixGraph* buildGraph(HeavyInsert* inserts, float reverbSend, Groups& outGroups)
+{
+    MixGraphDesc desc;
+    outGroups.m_sfx = desc.addBus("sfx");
+    outGroups.m_music = desc.addBus("music", MixGraphDesc::MasterBus, 0.7f);
+    outGroups.m_voice = desc.addBus("voice");
+    int reverb = desc.addBus("reverb", MixGraphDesc::MasterBus, 0.5f);
+
+    desc.addInsert(outGroups.m_sfx, heavyInsert, &inserts[0]);
+    desc.addInsert(outGroups.m_music, heavyInsert, &inserts[1]);
+    desc.addInsert(outGroups.m_voice, heavyInsert, &inserts[2]);
+    desc.addInsert(reverb, heavyInsert, &inserts[3]);
+
+    desc.addSend(outGroups.m_sfx, reverb, reverbSend);
+    desc.addSend(outGroups.m_voice, reverb, reverbSend);
+
+    return MixGraph::compile(desc, g_numChannels, g_framesPerBuffer);
+}
+
+/* Returns the average time in seconds to process a block, outOutput is the last block */
+double run(int numWorkers, bool rebuildGraph, bool voicesInJobs, std::vector<float>& outOutput)
+{
+    HeavyInsert inserts[4];
+    Groups groups;
+    MixGraphProcessor mixer(numWorkers);
+    mixer.setGraph(buildGraph(inserts, 0.3f, groups));
+
+    // voices
+    int lengthSamples = static_cast<int>(g_sampleRate);
+    std::vector<float> data(lengthSamples);
+    SineGenerator sineGenerator(220.f, g_sampleRate);
+    sineGenerator.setGain(0.05f);
+    sineGenerator.execute(data.data(), lengthSamples, 1);
+
+    std::vector<Sound> voices;
+    voices.reserve(g_numVoicesPerGroup * 3);
+    for(int v=0; v<g_numVoicesPerGroup * 3; ++v)
+    {
+        Sound sound(v + 1);
+        sound.load(data.data(), lengthSamples);
+        sound.setLoop(true);
+        sound.play();
+        voices.emplace_back(std::move(sound));
+    }
+
+    // a game thread changing the mix while the audio thread runs
+    std::atomic<bool> runningFlag(true);
+    std::thread gameThread([&]()
+    {
+        int numRebuilds = 0;
+        while(rebuildGraph && runningFlag.load())
+        {
+            Groups rebuiltGroups;
+            mixer.setGraph(buildGraph(inserts, (numRebuilds++ % 2) ? 0.3f : 0.6f, rebuiltGroups));
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        mixer.collectGarbage();
+    });
+
+    GroupVoices groupVoices = {{groups.m_sfx, groups.m_music, groups.m_voice}, &voices};
+    outOutput.assign(g_framesPerBuffer * g_numChannels, 0.f);
+    double elapsed = 0.;
+    for(int b=0; b<g_numBlocks; ++b)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        MixGraph* graph = mixer.beginBlock(g_framesPerBuffer);
+        if(voicesInJobs)
+        {
+            mixer.execute(outOutput.data(), g_framesPerBuffer, g_numChannels, mixGroupVoices, &groupVoices);
+        }
+        else
+        {
+            for(size_t v=0; v<voices.size(); ++v)
+            {
+                voices[v].executePlanar(graph->getBusChannels(groupVoices.m_buses[v % 3]), g_framesPerBuffer, g_numChannels);
+            }
+            mixer.execute(outOutput.data(), g_framesPerBuffer, g_numChannels);
+        }
+
+        elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    runningFlag.store(false);
+    gameThread.join();
+
+    return elapsed / g_numBlocks;
+}
+
+int main(int argc, char* argv[])
+{
+    printf("Example mix graph...\n");
+
+    double blockDuration = g_framesPerBuffer / g_sampleRate;
+    unsigned int numCores = std::thread::hardware_concurrency();
+
+    std::vector<float> audioThreadOutput;
+    std::vector<float> jobsOutput;
+    for(int numWorkers=0; numWorkers<=3; ++numWorkers)
+    {
+        double audioThreadTime = run(numWorkers, false, false, audioThreadOutput);
+        double jobsTime = run(numWorkers, false, true, jobsOutput);
+        printf("%i workers: voices on the audio thread %8.1f us/block (%5.1f%% of the block budget), in the bus jobs %8.1f us/block (%5.1f%%)\n",
+                numWorkers, audioThreadTime * 1e6, 100. * audioThreadTime / blockDuration, jobsTime * 1e6, 100. * jobsTime / blockDuration);
+    }
+    check(audioThreadOutput == jobsOutput, "voices rendered in the bus jobs give the same output");
+
+    double blockTime = run(std::min(3u, numCores > 0 ? numCores - 1 : 0), true, true, jobsOutput);
+    printf("Rebuilding the graph every 5ms: %8.1f us/block\n", blockTime * 1e6);
+
+    return ExampleChecks::getExitCode();
+}
@@ -0,0 +1,107 @@
+#include <vector>
+
+#include "AudioDevice.h"
+#include "Sound.h"
+#include "SoundEngine.h"
+
+/*
+    Example mock device.
+    Runs a sound engine against the mock audio device under different scheduling conditions and ring buffer depths,
+    without any sound card. The device calls back at the buffer period, optionally with jitter and stalls, and checks
+    the delivered audio for gaps: the engine plays a looping low frequency sine, so that any dropout, repeated block
+    or discontinuity at a block boundary shows up in the device stats.
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const int g_numChannels = 2;
+const unsigned long g_framesPerBuffer = 256;
+const float g_sineFreqHz = 100.f; // whole number of cycles per second so that the loop is seamless
+const float g_sineAmplitude = 0.5f;
+const float g_durationSeconds = 2.f;
+
+/************************************************************/
+
+class SineSoundEngine : public SoundEngine
+{
+public:
+    SineSoundEngine(int ringBufferNumFrames):
+        SoundEngine(g_sampleRate, g_numChannels, g_framesPerBuffer, ringBufferNumFrames),
+        m_audioDevice(g_sampleRate, g_numChannels, g_framesPerBuffer, callback, this),
+        m_sine(1)
+    {
+        std::vector<float> data(static_cast<int>(g_sampleRate));
+        for(size_t i=0; i<data.size(); ++i)
+        {
+            data[i] = g_sineAmplitude * std::sin(2.f * static_cast<float>(Math::M_PI) * g_sineFreqHz * i / static_cast<float>(g_sampleRate));
+        }
+        m_sine.load(data.data(), static_cast<int>(data.size()));
+        m_sine.setLoop(true);
+        m_sine.play();
+
+        // largest step of the sine, with some margin
+        m_audioDevice.setDiscontinuityThreshold(1.5f * 2.f * static_cast<float>(Math::M_PI) * g_sineFreqHz * g_sineAmplitude / static_cast<float>(g_sampleRate));
+    }
+
+    AudioDevice& getAudioDevice()
+    {
+        return m_audioDevice;
+    }
+
+private:
+    virtual void audioThreadExecute(float* outputBuffer, unsigned long framesPerBuffer, int numChannels) override
+    {
+        memset(outputBuffer, 0, framesPerBuffer * numChannels * sizeof(float));
+        m_sine.execute(outputBuffer, framesPerBuffer, numChannels);
+    }
+
+    AudioDevice m_audioDevice;
+    Sound m_sine;
+};
+
+struct Scenario
+{
+    const char* m_name;
+    float m_jitterMicroseconds;
+    float m_stallProbability;
+    float m_stallMicroseconds;
+};
+
+int main(int argc, char* argv[])
+{
+    printf("Example mock device...\n");
+
+    const float periodMicroseconds = static_cast<float>(1e6 * g_framesPerBuffer / g_sampleRate);
+    printf("%lu frames per buffer at %.0f Hz (period %.0f us), %.1f s per run\n", g_framesPerBuffer, g_sampleRate, periodMicroseconds, g_durationSeconds);
+
+    const Scenario scenarios[] =
+    {
+        {"steady", 0.f, 0.f, 0.f},
+        {"jitter of half a period", 0.5f * periodMicroseconds, 0.f, 0.f},
+        {"stalls of 3 periods", 0.f, 0.01f, 3.f * periodMicroseconds},
+    };
+    const int ringDepths[] = {2, 4};
+
+    for(const Scenario& scenario : scenarios)
+    {
+        for(int ringDepth : ringDepths)
+        {
+            SineSoundEngine soundEngine(ringDepth);
+            AudioDevice& audioDevice = soundEngine.getAudioDevice();
+            audioDevice.setSeed(1234);
+            audioDevice.setJitter(scenario.m_jitterMicroseconds);
+            audioDevice.setStalls(scenario.m_stallProbability, scenario.m_stallMicroseconds);
+
+            soundEngine.initialise();
+            audioDevice.process(g_durationSeconds);
+            soundEngine.terminate();
+
+            printf("\n%s, ring buffer of %i frames\n", scenario.m_name, ringDepth);
+            audioDevice.printStats();
+            printf("Engine underruns %lu\n", soundEngine.getProfiler().getStats().m_numUnderruns);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,133 @@
+#include <chrono>
+#include <cmath>
+#include <stdio.h>
+#include <vector>
+
+#include "SineGenerator.h"
+#include "Sound.h"
+
+/*
+    Example parameter ramps.
+    Gain, pan and pitch changes are applied with sample accuracy by ramping towards the target value,
+    so that large buffer sizes don't produce steps (zipper noise).
+    The example checks the largest gain step between consecutive samples of a fade, and compares the cost
+    of mixing voices with constant parameters against voices with ramping parameters.
+
+    Build in release mode to get meaningful numbers:
+    make ex_parameterramps CONFIG=release && ./build/ex_parameterramps
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const int g_numChannels = 2;
+const unsigned long g_framesPerBuffer = 1024;
+const int g_numVoices = 128;
+const int g_numBlocks = 1000;
+
+/************************************************************/
+
+/* Largest difference between consecutive samples of a fade out of a DC signal: a block step would be as big as the fade */
+void checkFade()
+{
+    std::vector<float> dc(g_framesPerBuffer * 4, 1.f);
+    Sound sound(1);
+    sound.load(dc.data(), static_cast<int>(dc.size()));
+    sound.play();
+
+    int rampSamples = static_cast<int>(0.01 * g_sampleRate); // 10ms fade
+    sound.setGain(0.f, rampSamples);
+
+    std::vector<float> output(g_framesPerBuffer * g_numChannels, 0.f);
+    sound.execute(output.data(), g_framesPerBuffer, g_numChannels);
+
+    float maxStep = 0.f;
+    for(unsigned long i=1; i<g_framesPerBuffer; ++i)
+    {
+        maxStep = std::max(maxStep, std::abs(output[i * g_numChannels] - output[(i - 1) * g_numChannels]));
+    }
+
+    printf("Fade out over %i samples within a %lu frames block: largest step between samples %.4f (a block step would be 1.0)\n",
+            rampSamples, g_framesPerBuffer, maxStep);
+}
+
+/* Returns the average time in seconds to mix all the voices for a block */
+template<typename ChangeFn>
+double measure(std::vector<Sound>& voices, ChangeFn change)
+{
+    std::vector<float> output(g_framesPerBuffer * g_numChannels);
+    double elapsed = 0.;
+    for(int b=0; b<g_numBlocks; ++b)
+    {
+        for(size_t v=0; v<voices.size(); ++v)
+        {
+            change(voices[v], b);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        memset(output.data(), 0, output.size() * sizeof(float));
+        for(size_t v=0; v<voices.size(); ++v)
+        {
+            voices[v].execute(output.data(), g_framesPerBuffer, g_numChannels);
+        }
+
+        elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    return elapsed / g_numBlocks;
+}
+
+int main(int argc, char* argv[])
+{
+    printf("Example parameter ramps...\n");
+
+    checkFade();
+
+    // voices
+    int lengthSamples = static_cast<int>(g_sampleRate);
+    std::vector<float> data(lengthSamples);
+    SineGenerator sineGenerator(440.f, g_sampleRate);
+    sineGenerator.execute(data.data(), lengthSamples, 1);
+
+    std::vector<Sound> voices;
+    voices.reserve(g_numVoices);
+    for(int v=0; v<g_numVoices; ++v)
+    {
+        Sound sound(v + 1);
+        sound.load(data.data(), lengthSamples);
+        sound.setLoop(true);
+        sound.play();
+        voices.emplace_back(std::move(sound));
+    }
+
+    const int rampSamples = static_cast<int>(g_framesPerBuffer); // always ramping
+    double constant = measure(voices, [](Sound& sound, int)
+    {
+        sound.setGain(0.5f);
+        sound.setPan(0.f);
+        sound.setPitch(1.f);
+    });
+    double gain = measure(voices, [&](Sound& sound, int block)
+    {
+        sound.setGain(block % 2 ? 0.2f : 0.8f, rampSamples);
+    });
+    double pan = measure(voices, [&](Sound& sound, int block)
+    {
+        sound.setGain(0.5f);
+        sound.setPan(block % 2 ? -0.5f : 0.5f, rampSamples);
+    });
+    double pitch = measure(voices, [&](Sound& sound, int block)
+    {
+        sound.setPan(0.f);
+        sound.setPitch(block % 2 ? 0.9f : 1.1f, rampSamples);
+    });
+
+    printf("%i voices, %lu frames per buffer\n", g_numVoices, g_framesPerBuffer);
+    printf("constant gain:  %8.2f us/block\n", constant * 1e6);
+    printf("gain ramp:      %8.2f us/block (%.2fx)\n", gain * 1e6, gain / constant);
+    printf("gain+pan ramp:  %8.2f us/block (%.2fx)\n", pan * 1e6, pan / constant);
+    printf("pitch ramp:     %8.2f us/block (%.2fx)\n", pitch * 1e6, pitch / constant);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,284 @@
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "AudioBuffer.h"
+#include "ExampleChecks.h"
+#include "MixGraph.h"
+#include "PitchShifter.h"
+#include "RandomUtils.h"
+#include "Sound.h"
+
+/*
+    Example pitch shift.
+    1. Checks of the pitch shifter: the input delayed by the latency at a pitch of 1, the frequency of a shifted sine,
+       a steady level thanks to the waveform similarity search (against no search), and of the time stretch synth.
+       The example fails if any check fails.
+    2. Per voice pitch variation: voices rendered to mono, each through its own pitch shifter, then mixed, against the
+       block budget. A pitch shifter is also inserted on a bus of a mix graph.
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const int g_numChannels = 2;
+const unsigned long g_framesPerBuffer = 256;
+const int g_voiceCounts[] = {8, 32, 64};
+const int g_numBlocks = 500;
+
+/************************************************************/
+
+using ExampleChecks::check;
+
+std::vector<float> makeSine(float freqHz, int numSamples, float amplitude = 0.5f)
+{
+    std::vector<float> data(numSamples);
+    for(int i=0; i<numSamples; ++i)
+    {
+        data[i] = amplitude * std::sin(2.f * static_cast<float>(Math::M_PI) * freqHz * i / static_cast<float>(g_sampleRate));
+    }
+    return data;
+}
+
+/* Runs a mono signal through the pitch shifter block by block */
+std::vector<float> shift(PitchShifter& pitchShifter, const std::vector<float>& input)
+{
+    std::vector<float> output(input);
+    for(size_t i=0; i<output.size(); i += g_framesPerBuffer)
+    {
+        float* channel = output.data() + i;
+        pitchShifter.process(&channel, std::min<size_t>(g_framesPerBuffer, output.size() - i));
+    }
+    return output;
+}
+
+/* Frequency from the rising zero crossings, interpolated, over the samples from start */
+float estimateFrequency(const std::vector<float>& signal, size_t start)
+{
+    double first = -1.;
+    double last = 0.;
+    int numCrossings = 0;
+    for(size_t i=start+1; i<signal.size(); ++i)
+    {
+        if(signal[i - 1] < 0.f && signal[i] >= 0.f)
+        {
+            const double crossing = i - 1 + signal[i - 1] / (signal[i - 1] - signal[i]);
+            first = first < 0. ? crossing : first;
+            last = crossing;
+            ++numCrossings;
+        }
+    }
+    return numCrossings > 1 ? static_cast<float>((numCrossings - 1) * g_sampleRate / (last - first)) : 0.f;
+}
+
+/* Min and max RMS over 10 ms windows, in dB, from start */
+void getLevelRange(const std::vector<float>& signal, size_t start, float& minDb, float& maxDb)
+{
+    const size_t window = static_cast<size_t>(0.01 * g_sampleRate);
+    minDb = 1e9f;
+    maxDb = -1e9f;
+    for(size_t i=start; i + window <= signal.size(); i += window)
+    {
+        double sum = 0.;
+        for(size_t j=i; j<i+window; ++j)
+        {
+            sum += signal[j] * signal[j];
+        }
+        const float db = 10.f * std::log10(static_cast<float>(sum / window) + 1e-12f);
+        minDb = std::min(minDb, db);
+        maxDb = std::max(maxDb, db);
+    }
+}
+
+void checkPitchShifter()
+{
+    const int numSamples = static_cast<int>(g_sampleRate);
+
+    printf("\nPitch shifter:\n");
+    PitchShifter identity(2);
+    std::vector<float> noise(numSamples);
+    for(float& sample : noise)
+    {
+        sample = RandomUtils::g_random.getRandRealInRange(-0.5f, 0.5f);
+    }
+    AudioBuffer stereo(2, numSamples);
+    for(int c=0; c<2; ++c)
+    {
+        for(int i=0; i<numSamples; ++i)
+        {
+            stereo.getChannel(c)[i] = c == 0 ? noise[i] : -noise[i];
+        }
+    }
+    for(int i=0; i<numSamples; i += static_cast<int>(g_framesPerBuffer))
+    {
+        float* channels[2] = {stereo.getChannel(0) + i, stereo.getChannel(1) + i};
+        identity.process(channels, std::min<unsigned long>(g_framesPerBuffer, numSamples - i));
+    }
+    const int latency = identity.getLatency();
+    float maxError = 0.f;
+    for(int i=latency; i<numSamples; ++i)
+    {
+        maxError = std::max(maxError, std::abs(stereo.getChannel(0)[i] - noise[i - latency]));
+        maxError = std::max(maxError, std::abs(stereo.getChannel(1)[i] + noise[i - latency]));
+    }
+    printf("  latency %i samples (%.1f ms), max error at a pitch of 1: %g\n", latency, 1000. * latency / g_sampleRate, maxError);
+    check(maxError < 1e-5f, "pitch of 1: the input delayed by the latency");
+
+    const std::vector<float> sine = makeSine(220.f, numSamples);
+    for(float pitch : {1.5f, 0.75f, 1.06f})
+    {
+        PitchShifter pitchShifter(1);
+        pitchShifter.setPitch(pitch);
+        const float frequency = estimateFrequency(shift(pitchShifter, sine), 4 * latency);
+        printf("  220 Hz at a pitch of %.2f: %.1f Hz\n", pitch, frequency);
+        check(std::abs(frequency / (220.f * pitch) - 1.f) < 0.005f, "shifted frequency within 0.5%");
+    }
+
+    // waveform similarity: grains add up in phase, the level of a sine holds
+    for(int searchRadius : {128, 0})
+    {
+        PitchShifter pitchShifter(1, 1024, 2.f, searchRadius);
+        pitchShifter.setPitch(1.3f);
+        float minDb = 0.f;
+        float maxDb = 0.f;
+        getLevelRange(shift(pitchShifter, sine), 4 * latency, minDb, maxDb);
+        printf("  search radius %3i: level from %.1f to %.1f dB\n", searchRadius, minDb, maxDb);
+        if(searchRadius > 0)
+        {
+            check(maxDb - minDb < 1.f, "steady level with the waveform similarity search");
+        }
+    }
+
+    printf("\nTime stretch synth:\n");
+    const std::vector<float> source = makeSine(440.f, numSamples);
+    for(float stretch : {2.f, 0.5f})
+    {
+        for(float pitch : {1.f, 1.25f})
+        {
+            TimeStretchSynth synth;
+            synth.init(source);
+            synth.setStretch(stretch);
+            synth.setPitch(pitch);
+            std::vector<float> output(numSamples, 0.f);
+            synth.execute(output.data(), numSamples, 1);
+            float minDb = 0.f;
+            float maxDb = 0.f;
+            getLevelRange(output, 2048, minDb, maxDb);
+            const float frequency = estimateFrequency(output, 2048);
+            printf("  stretch %.1f, pitch %.2f: %.1f Hz, level from %.1f to %.1f dB\n", stretch, pitch, frequency, minDb, maxDb);
+            check(std::abs(frequency / (440.f * pitch) - 1.f) < 0.005f && maxDb - minDb < 1.f, "frequency within 0.5%, steady level");
+        }
+    }
+}
+
+struct Voice
+{
+    std::unique_ptr<Sound> m_sound;
+    std::unique_ptr<PitchShifter> m_pitchShifter;
+};
+
+void measureVoices(double blockMicroseconds)
+{
+    std::vector<float> data = makeSine(261.6f, static_cast<int>(g_sampleRate), 0.05f);
+    const std::vector<float> overtone = makeSine(523.2f, static_cast<int>(g_sampleRate), 0.02f);
+    for(size_t i=0; i<data.size(); ++i)
+    {
+        data[i] += overtone[i];
+    }
+
+    printf("\nPer voice pitch shift, %lu frames per buffer (%.0f us):\n", g_framesPerBuffer, blockMicroseconds);
+    for(int numVoices : g_voiceCounts)
+    {
+        std::vector<Voice> voices(numVoices);
+        for(Voice& voice : voices)
+        {
+            voice.m_sound = std::make_unique<Sound>(1);
+            voice.m_sound->load(data.data(), static_cast<int>(data.size()));
+            voice.m_sound->setLoop(true);
+            voice.m_sound->play();
+            voice.m_pitchShifter = std::make_unique<PitchShifter>(1);
+            voice.m_pitchShifter->setPitch(RandomUtils::g_random.getRandRealInRange(0.7f, 1.4f));
+        }
+
+        AudioBuffer bus(g_numChannels, g_framesPerBuffer);
+        std::vector<float> mono(g_framesPerBuffer);
+        double elapsed = 0.;
+        for(int b=0; b<g_numBlocks; ++b)
+        {
+            auto start = std::chrono::steady_clock::now();
+            bus.clear(g_framesPerBuffer);
+            for(Voice& voice : voices)
+            {
+                float* channel = mono.data();
+                voice.m_sound->render(channel, g_framesPerBuffer);
+                voice.m_pitchShifter->process(&channel, g_framesPerBuffer);
+                for(int c=0; c<g_numChannels; ++c)
+                {
+                    AudioBufferUtils::addScaled(bus.getChannel(c), channel, 1.f, g_framesPerBuffer);
+                }
+            }
+            elapsed += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        const double microseconds = elapsed / g_numBlocks;
+        printf("  %2i voices: %6.1f us per block (%.1f%% of the block), %.2f us per voice\n", numVoices, microseconds,
+                100. * microseconds / blockMicroseconds, microseconds / numVoices);
+    }
+}
+
+void runBusInsert(double blockMicroseconds)
+{
+    PitchShifter busPitchShifter(g_numChannels);
+    busPitchShifter.setPitch(0.8f);
+
+    MixGraphDesc desc;
+    int music = desc.addBus("music");
+    desc.addInsert(music, PitchShifter::insert, &busPitchShifter);
+    MixGraphProcessor mixer(0);
+    mixer.setGraph(MixGraph::compile(desc, g_numChannels, g_framesPerBuffer));
+
+    std::vector<float> data = makeSine(440.f, static_cast<int>(g_sampleRate), 0.2f);
+    Sound sound(1);
+    sound.load(data.data(), static_cast<int>(data.size()));
+    sound.setLoop(true);
+    sound.play();
+
+    std::vector<float> output(g_framesPerBuffer * g_numChannels);
+    std::vector<float> left;
+    double elapsed = 0.;
+    for(int b=0; b<g_numBlocks; ++b)
+    {
+        auto start = std::chrono::steady_clock::now();
+        MixGraph* graph = mixer.beginBlock(g_framesPerBuffer);
+        sound.executePlanar(graph->getBusChannels(music), g_framesPerBuffer, g_numChannels);
+        mixer.execute(output.data(), g_framesPerBuffer, g_numChannels);
+        elapsed += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+        for(unsigned long i=0; i<g_framesPerBuffer; ++i)
+        {
+            left.push_back(output[i * g_numChannels]);
+        }
+    }
+
+    const double microseconds = elapsed / g_numBlocks;
+    const float frequency = estimateFrequency(left, 4 * busPitchShifter.getLatency());
+    printf("\nBus insert: 440 Hz at a pitch of 0.80 gives %.1f Hz, %.1f us per block (%.1f%% of the block)\n", frequency,
+            microseconds, 100. * microseconds / blockMicroseconds);
+    check(std::abs(frequency / 352.f - 1.f) < 0.005f, "pitch shifted bus");
+}
+
+int main(int argc, char* argv[])
+{
+    printf("Example pitch shift...\n");
+
+    const double blockMicroseconds = 1e6 * g_framesPerBuffer / g_sampleRate;
+
+    // 1. checks
+    checkPitchShifter();
+
+    // 2. voices and bus
+    measureVoices(blockMicroseconds);
+    runBusInsert(blockMicroseconds);
+
+    return ExampleChecks::getExitCode();
+}
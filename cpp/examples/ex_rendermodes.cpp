@@ -0,0 +1,180 @@
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "AudioDevice.h"
+#include "ExampleChecks.h"
+#include "Sound.h"
+#include "SoundEngine.h"
+#include "TaskQueue.h"
+
+/*
+    Example render modes.
+    Runs the same engine in the RING, DIRECT and HYBRID render modes against the mock audio device and reports the
+    trigger latency (game thread command to device buffer) of each.
+    The engine is lightly loaded, except during a heavy phase where every block takes more than half the buffer period
+    to render, so that HYBRID falls back to the ring buffer and then back to direct rendering once the load settles.
+    The engine renders a quiet bed under the clicks, so that the device flags every silent block it plays. Checks that
+    every silent block is an underrun counted by the engine, and that HYBRID plays none across the fallback and the
+    return to direct rendering. A descheduled thread can underrun in any mode, so HYBRID gets a few attempts at that
+    check, which a fallback that always underruns fails every time. The example fails if any check fails.
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const int g_numChannels = 2;
+const unsigned long g_framesPerBuffer = 256;
+const int g_ringBufferNumFrames = 3;
+const float g_durationSeconds = 4.f;
+const float g_heavyStartSeconds = 1.f;
+const float g_heavyEndSeconds = 2.f;
+const float g_heavyLoadRatio = 0.6f; // of the buffer period
+const float g_bedLevel = 0.001f;
+const int g_numHybridAttempts = 3;
+
+/************************************************************/
+
+using ExampleChecks::check;
+
+class ModeSoundEngine : public SoundEngine
+{
+public:
+    ModeSoundEngine(RenderMode renderMode):
+        SoundEngine(g_sampleRate, g_numChannels, g_framesPerBuffer, g_ringBufferNumFrames),
+        m_queue(64),
+        m_audioDevice(g_sampleRate, g_numChannels, g_framesPerBuffer, callback, this),
+        m_click(1),
+        m_loadMicroseconds(0.f)
+    {
+        std::vector<float> clickData(64, 0.5f);
+        m_click.load(clickData.data(), static_cast<int>(clickData.size()));
+
+        setRenderMode(renderMode);
+        setHybridThresholds(0.5f, 0.25f, 128);
+    }
+
+    /* Game thread */
+    void playClick()
+    {
+        struct TaskParams
+        {
+            uint64_t pushTicks;
+        } taskParams;
+        taskParams.pushTicks = CycleClock::now();
+
+        auto task = [](void* context, void* params, float)
+        {
+            ModeSoundEngine* soundEngine = (ModeSoundEngine*)context;
+            TaskParams* taskParams = (TaskParams*)params;
+
+            soundEngine->m_click.stop();
+            soundEngine->m_click.play();
+            soundEngine->markTrigger(taskParams->pushTicks);
+        };
+
+        m_queue.push(task, this, &taskParams, sizeof(taskParams));
+    }
+
+    /* Game thread. Simulated render cost of every block. */
+    void setLoad(float microseconds)
+    {
+        m_loadMicroseconds.store(microseconds, std::memory_order_relaxed);
+    }
+
+    AudioDevice& getAudioDevice()
+    {
+        return m_audioDevice;
+    }
+
+private:
+    virtual void audioThreadProcess(float deltaTime) override
+    {
+        TaskQueue::Task task;
+        while(m_queue.pop(task))
+        {
+            task.execute(deltaTime);
+        }
+    }
+
+    virtual void audioThreadExecute(float* outputBuffer, unsigned long framesPerBuffer, int numChannels) override
+    {
+        std::fill(outputBuffer, outputBuffer + framesPerBuffer * numChannels, g_bedLevel);
+        m_click.execute(outputBuffer, framesPerBuffer, numChannels);
+
+        const uint64_t endTicks = CycleClock::now() + CycleClock::microsecondsToTicks(m_loadMicroseconds.load(std::memory_order_relaxed));
+        while(CycleClock::now() < endTicks)
+        {
+            // busy
+        }
+    }
+
+    TaskQueue m_queue;
+    AudioDevice m_audioDevice;
+    Sound m_click;
+    std::atomic<float> m_loadMicroseconds;
+};
+
+/* Returns whether HYBRID fell back to the ring and played no silent block */
+bool run(SoundEngine::RenderMode renderMode, const char* name)
+{
+    ModeSoundEngine soundEngine(renderMode);
+    soundEngine.initialise();
+
+    const float periodMicroseconds = static_cast<float>(1e6 * g_framesPerBuffer / g_sampleRate);
+    std::atomic<bool> runningFlag(true);
+    std::thread gameThread([&]()
+    {
+        // triggering at random times so that all the phases relative to the device period are covered
+        std::mt19937 generator(1234);
+        std::uniform_int_distribution<int> intervalMicroseconds(5000, 30000);
+        const auto startTime = std::chrono::steady_clock::now();
+        while(runningFlag.load())
+        {
+            float elapsedSeconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+            bool heavy = elapsedSeconds >= g_heavyStartSeconds && elapsedSeconds < g_heavyEndSeconds;
+            soundEngine.setLoad(heavy ? g_heavyLoadRatio * periodMicroseconds : 0.f);
+
+            soundEngine.playClick();
+            std::this_thread::sleep_for(std::chrono::microseconds(intervalMicroseconds(generator)));
+        }
+    });
+
+    soundEngine.getAudioDevice().process(g_durationSeconds);
+
+    runningFlag.store(false);
+    gameThread.join();
+    const bool renderingDirect = soundEngine.isRenderingDirect();
+    soundEngine.terminate();
+
+    const LatencyHistogram& total = soundEngine.getTriggerLatency().m_total;
+    BlockProfiler::Stats stats = soundEngine.getProfiler().getStats();
+    const AudioDevice::Stats& deviceStats = soundEngine.getAudioDevice().getStats();
+    printf("%-8s trigger latency p50 %6llu us, p99 %6llu us, max %6llu us | underruns %lu, silent blocks %lu, late callbacks %lu, ring fallbacks %lu, direct at the end %s\n",
+            name, (unsigned long long)total.getPercentile(50.), (unsigned long long)total.getPercentile(99.), (unsigned long long)total.getMax(), stats.m_numUnderruns,
+            deviceStats.m_numSilentBlocks, deviceStats.m_numLateCallbacks, soundEngine.getNumRingFallbacks(), renderingDirect ? "yes" : "no");
+
+    check(deviceStats.m_numSilentBlocks == stats.m_numUnderruns, "every silent block is a counted underrun");
+    return soundEngine.getNumRingFallbacks() > 0 && deviceStats.m_numSilentBlocks == 0;
+}
+
+int main(int argc, char* argv[])
+{
+    printf("Example render modes...\n");
+    printf("%lu frames per buffer at %.0f Hz (period %.0f us), ring buffer of %i frames, heavy load from %.1f s to %.1f s\n",
+            g_framesPerBuffer, g_sampleRate, 1e6 * g_framesPerBuffer / g_sampleRate, g_ringBufferNumFrames, g_heavyStartSeconds, g_heavyEndSeconds);
+
+    g_logger.setLevel(Logger::ERROR);
+
+    run(SoundEngine::RenderMode::RING, "RING");
+    run(SoundEngine::RenderMode::DIRECT, "DIRECT");
+
+    bool silenceFreeFallback = false;
+    for(int attempt=0; attempt<g_numHybridAttempts && !silenceFreeFallback; ++attempt)
+    {
+        silenceFreeFallback = run(SoundEngine::RenderMode::HYBRID, "HYBRID");
+    }
+    check(silenceFreeFallback, "no silent block across the fallback");
+
+    return ExampleChecks::getExitCode();
+}
@@ -0,0 +1,258 @@
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "ExampleChecks.h"
+#include "RenderServer.h"
+#include "Sound.h"
+
+/*
+    Example render server.
+    Many lightweight sessions rendered in real time on a fixed worker pool, each delivering its audio to its own sink:
+    session 0 to a WAV file, session 1 to a shared memory ring read by a consumer thread (standing in for another
+    process), the others to a callback measuring their level.
+
+    1. capacity: every session renders as fast as possible, giving the number of real time sessions per core,
+    2. real time: g_numSessions sessions for a few seconds, one session being removed and added back while running,
+    3. overload: sessions needing 1.5 times the available time, showing that the deadline misses are spread evenly,
+    4. removals: a session removed at times sweeping the end of short runs, checking that every removal returns and
+       frees the slot, whether the scheduler is running, stopping or stopped. The example fails if the check fails.
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const int g_numChannels = 2;
+const unsigned long g_framesPerBuffer = 256;
+const int g_numVoicesPerSession = 8;
+const int g_numSessions = 16;
+const int g_maxNumSessions = 64;
+const float g_durationSeconds = 3.f;
+const unsigned long g_sharedMemoryFrames = 8192;
+const int g_numRemovalRuns = 100;
+
+/************************************************************/
+
+using ExampleChecks::check;
+
+/* A session playing a chord of looping voices */
+class ChordSession : public RenderSession
+{
+public:
+    ChordSession(int index)
+    {
+        for(int v=0; v<g_numVoicesPerSession; ++v)
+        {
+            // a whole number of cycles so that the loop is seamless
+            float freqHz = 110.f * (1 + (index + v) % 8);
+            std::vector<float> data(static_cast<int>(0.1 * g_sampleRate));
+            for(size_t i=0; i<data.size(); ++i)
+            {
+                data[i] = 0.05f * std::sin(2.f * static_cast<float>(Math::M_PI) * freqHz * i / static_cast<float>(g_sampleRate));
+            }
+
+            m_voices.emplace_back(v + 1);
+            m_voices.back().load(data.data(), static_cast<int>(data.size()));
+            m_voices.back().setLoop(true);
+            m_voices.back().play();
+        }
+    }
+
+    float m_peak = 0.f; // written by the callback sink
+    float m_extraLoadMicroseconds = 0.f; // simulated extra render cost per block
+
+private:
+    virtual void execute(float* outputBuffer, unsigned long framesPerBuffer, int numChannels) override
+    {
+        memset(outputBuffer, 0, framesPerBuffer * numChannels * sizeof(float));
+        for(Sound& voice : m_voices)
+        {
+            voice.execute(outputBuffer, framesPerBuffer, numChannels);
+        }
+
+        const uint64_t endTicks = CycleClock::now() + CycleClock::microsecondsToTicks(m_extraLoadMicroseconds);
+        while(CycleClock::now() < endTicks)
+        {
+            // busy
+        }
+    }
+
+    std::vector<Sound> m_voices;
+};
+
+void peakSink(const float* buffer, unsigned long framesPerBuffer, int numChannels, uint64_t, void* context)
+{
+    ChordSession* session = (ChordSession*)context;
+    for(unsigned long i=0; i<framesPerBuffer * numChannels; ++i)
+    {
+        session->m_peak = std::max(session->m_peak, std::abs(buffer[i]));
+    }
+}
+
+/* Blocks and deadline misses across the sessions */
+void printFairness(const std::vector<std::unique_ptr<ChordSession>>& sessions, int numSessions)
+{
+    unsigned long minBlocks = ~0ul, maxBlocks = 0, minMisses = ~0ul, maxMisses = 0;
+    for(int s=0; s<numSessions; ++s)
+    {
+        RenderSession::Stats stats = sessions[s]->getStats();
+        minBlocks = std::min(minBlocks, stats.m_numBlocks);
+        maxBlocks = std::max(maxBlocks, stats.m_numBlocks);
+        minMisses = std::min(minMisses, stats.m_numDeadlineMisses);
+        maxMisses = std::max(maxMisses, stats.m_numDeadlineMisses);
+    }
+    printf("Per session: blocks %lu to %lu, deadline misses %lu to %lu\n", minBlocks, maxBlocks, minMisses, maxMisses);
+}
+
+int main(int argc, char* argv[])
+{
+    printf("Example render server...\n");
+
+    const int numThreads = std::max(1u, std::thread::hardware_concurrency());
+    const double blocksPerSecond = g_sampleRate / g_framesPerBuffer; // needed by a real time session
+    printf("%lu frames per buffer at %.0f Hz, %i voices per session, %i threads\n", g_framesPerBuffer, g_sampleRate, g_numVoicesPerSession, numThreads);
+
+    std::vector<std::unique_ptr<ChordSession>> sessions;
+    for(int s=0; s<std::max(32, g_numSessions); ++s)
+    {
+        sessions.push_back(std::make_unique<ChordSession>(s));
+    }
+
+    // 1. capacity
+    int capacity = 0;
+    {
+        const int numSessions = 32;
+        const int numBlocks = 200;
+        RenderServer server(g_sampleRate, g_numChannels, g_framesPerBuffer, numThreads - 1, g_maxNumSessions);
+        for(int s=0; s<numSessions; ++s)
+        {
+            server.addSession(sessions[s].get(), nullptr);
+        }
+
+        auto startTime = std::chrono::steady_clock::now();
+        server.renderBlocks(numBlocks);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+        double renderedBlocksPerSecond = numSessions * numBlocks / seconds;
+        capacity = static_cast<int>(renderedBlocksPerSecond / blocksPerSecond);
+        printf("\n1. Capacity: %.0f blocks/s, %i real time sessions, %.1f sessions per core\n", renderedBlocksPerSecond, capacity,
+                static_cast<double>(capacity) / numThreads);
+    }
+
+    // 2. real time
+    {
+        const int numSessions = std::min(g_numSessions, g_maxNumSessions);
+        RenderServer server(g_sampleRate, g_numChannels, g_framesPerBuffer, numThreads - 1, g_maxNumSessions);
+
+        FileSink fileSink("ex_renderserver_session0.wav", g_sampleRate, g_numChannels);
+        std::vector<char> sharedMemory(SharedMemorySink::getRequiredBytes(g_sharedMemoryFrames, g_numChannels));
+        SharedMemorySink sharedMemorySink(sharedMemory.data(), g_sharedMemoryFrames, g_numChannels);
+        std::vector<std::unique_ptr<CallbackSink>> callbackSinks;
+
+        std::vector<int> sessionIds;
+        for(int s=0; s<numSessions; ++s)
+        {
+            ISessionSink* sink = nullptr;
+            if(s == 0)
+            {
+                sink = &fileSink;
+            }
+            else if(s == 1)
+            {
+                sink = &sharedMemorySink;
+            }
+            else
+            {
+                callbackSinks.push_back(std::make_unique<CallbackSink>(peakSink, sessions[s].get()));
+                sink = callbackSinks.back().get();
+            }
+            sessionIds.push_back(server.addSession(sessions[s].get(), sink));
+        }
+
+        std::atomic<bool> runningFlag(true);
+
+        // reader of the shared memory ring, polling like another process would
+        uint64_t numReadFrames = 0;
+        std::thread consumerThread([&]()
+        {
+            const SharedMemorySink::Header* header = (const SharedMemorySink::Header*)sharedMemory.data();
+            std::vector<float> frames(g_framesPerBuffer * g_numChannels);
+            while(runningFlag.load())
+            {
+                uint64_t numWrittenFrames = header->m_numWrittenFrames.load(std::memory_order_acquire);
+                while(numReadFrames + g_framesPerBuffer <= numWrittenFrames)
+                {
+                    SharedMemorySink::read(sharedMemory.data(), numReadFrames, frames.data(), g_framesPerBuffer);
+                    numReadFrames += g_framesPerBuffer;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        });
+
+        // the last session leaves and comes back
+        std::thread controlThread([&]()
+        {
+            std::this_thread::sleep_for(std::chrono::duration<float>(g_durationSeconds / 3.f));
+            server.removeSession(sessionIds.back());
+            std::this_thread::sleep_for(std::chrono::duration<float>(g_durationSeconds / 3.f));
+            sessionIds.back() = server.addSession(sessions[numSessions - 1].get(), callbackSinks.back().get());
+        });
+
+        server.run(g_durationSeconds);
+
+        runningFlag.store(false);
+        controlThread.join();
+        consumerThread.join();
+        fileSink.close();
+
+        printf("\n2. Real time: %i sessions for %.1f s\n", numSessions, g_durationSeconds);
+        server.print();
+        printFairness(sessions, numSessions - 1);
+        printf("Session %i (removed then added back): %lu blocks\n", numSessions - 1, sessions[numSessions - 1]->getStats().m_numBlocks);
+        printf("Session 0 written to ex_renderserver_session0.wav, session 1 shared memory: %llu frames read, session 2 peak %.2f\n",
+                (unsigned long long)numReadFrames, sessions[2]->m_peak);
+    }
+
+    // 3. overload
+    {
+        const int numSessions = std::min(g_numSessions, g_maxNumSessions);
+        const float periodMicroseconds = static_cast<float>(1e6 / blocksPerSecond);
+        RenderServer server(g_sampleRate, g_numChannels, g_framesPerBuffer, numThreads - 1, g_maxNumSessions);
+        std::vector<std::unique_ptr<ChordSession>> overloadSessions;
+        for(int s=0; s<numSessions; ++s)
+        {
+            overloadSessions.push_back(std::make_unique<ChordSession>(s));
+            overloadSessions.back()->m_extraLoadMicroseconds = 1.5f * periodMicroseconds * numThreads / numSessions;
+            server.addSession(overloadSessions.back().get(), nullptr);
+        }
+
+        server.run(1.f);
+
+        printf("\n3. Overload: %i sessions for 1 s, each taking %.0f us per block\n", numSessions, overloadSessions[0]->m_extraLoadMicroseconds);
+        server.print();
+        printFairness(overloadSessions, numSessions);
+    }
+
+    // 4. removals
+    {
+        RenderServer server(g_sampleRate, g_numChannels, g_framesPerBuffer, numThreads - 1, g_maxNumSessions);
+        int numRemovals = 0;
+        for(int r=0; r<g_numRemovalRuns; ++r)
+        {
+            const int sessionId = server.addSession(sessions[0].get(), nullptr);
+            std::thread controlThread([&]()
+            {
+                // from the start of the 1 ms run to 1 ms after its end
+                std::this_thread::sleep_for(std::chrono::microseconds(20 * r));
+                numRemovals += server.removeSession(sessionId) ? 1 : 0;
+            });
+            server.run(0.001f);
+            controlThread.join();
+        }
+
+        printf("\n4. Removals: %i of %i sessions removed around the end of a run\n", numRemovals, g_numRemovalRuns);
+        check(numRemovals == g_numRemovalRuns && server.getNumSessions() == 0, "every removal returns and frees the slot");
+    }
+
+    return ExampleChecks::getExitCode();
+}
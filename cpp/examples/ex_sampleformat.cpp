@@ -0,0 +1,164 @@
+#include <vector>
+
+#include "AudioDevice.h"
+#include "ExampleChecks.h"
+#include "SampleFormat.h"
+#include "Sound.h"
+#include "SoundEngine.h"
+
+/*
+    Example sample format.
+    1. Checks of the float to integer conversion: rounding, clipping, dither bounds and linearity, and the SSE path
+       against the scalar one. The example fails if any check fails.
+    2. The sound engine rendering a sine to a mock device in each output format, the ring storing the device format.
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const int g_numChannels = 2;
+const unsigned long g_framesPerBuffer = 256;
+const float g_durationSeconds = 1.f;
+
+/************************************************************/
+
+using ExampleChecks::check;
+
+/* Converts a single sample without dither, returns it as an integer */
+int convertSample(SampleFormat format, float sample)
+{
+    SampleConverter converter(format, false);
+    unsigned char output[4] = {};
+    converter.convert(&sample, output, 1);
+    return static_cast<int>(std::lround(SampleFormatUtils::readSample(output, format, 0) * SampleFormatUtils::getFullScale(format)));
+}
+
+void checkConversions(SampleFormat format)
+{
+    const float scale = SampleFormatUtils::getFullScale(format);
+    const int maxValue = static_cast<int>(scale) - 1;
+    const int minValue = -static_cast<int>(scale);
+    printf("\n%s:\n", SampleFormatUtils::getName(format));
+
+    // rounding to nearest, ties to even
+    check(convertSample(format, 0.49f / scale) == 0 && convertSample(format, 0.51f / scale) == 1, "rounds to the nearest value");
+    check(convertSample(format, 0.5f / scale) == 0 && convertSample(format, 1.5f / scale) == 2 && convertSample(format, -1.5f / scale) == -2,
+            "rounds ties to even");
+    check(convertSample(format, -0.51f / scale) == -1 && convertSample(format, 100.25f / scale) == 100, "rounds negative and larger values");
+
+    // clipping
+    check(convertSample(format, 1.f) == maxValue && convertSample(format, 4.f) == maxValue, "clips at the max value");
+    check(convertSample(format, -1.f) == minValue && convertSample(format, -4.f) == minValue, "clips at the min value");
+
+    // dither: full scale inputs must clip, not wrap around, and the error stays within 1.5 LSB
+    const unsigned long numSamples = 1 << 16;
+    const int sampleBytes = SampleFormatUtils::getSampleBytes(format);
+    std::vector<float> input(numSamples);
+    std::vector<unsigned char> output(numSamples * sampleBytes);
+    SampleConverter ditherConverter(format, true, 1234);
+    bool bounded = true;
+    for(float value : {1.f, -1.f, 0.f, 0.3f})
+    {
+        std::fill(input.begin(), input.end(), value);
+        ditherConverter.convert(input.data(), output.data(), numSamples);
+        for(unsigned long i=0; i<numSamples; ++i)
+        {
+            const float sample = SampleFormatUtils::readSample(output.data(), format, i) * scale;
+            bounded = bounded && sample >= minValue && sample <= maxValue && std::abs(sample - std::clamp(value * scale, -scale, scale - 1.f)) <= 1.5f;
+        }
+    }
+    check(bounded, "dithered output within 1.5 LSB of the input, clipped without wrapping");
+
+    // dither linearises the quantisation: a constant of a quarter LSB averages to a quarter LSB instead of 0
+    std::fill(input.begin(), input.end(), 0.25f / scale);
+    ditherConverter.convert(input.data(), output.data(), numSamples);
+    double sum = 0.;
+    for(unsigned long i=0; i<numSamples; ++i)
+    {
+        sum += SampleFormatUtils::readSample(output.data(), format, i) * scale;
+    }
+    const double mean = sum / numSamples;
+    printf("  mean of a dithered 0.25 LSB constant: %.3f LSB\n", mean);
+    check(std::abs(mean - 0.25) < 0.02, "dithered mean matches the input below one LSB");
+
+    // SSE and scalar paths: whole buffer against chunks ending with scalar tails
+    for(unsigned long i=0; i<numSamples; ++i)
+    {
+        input[i] = 1.2f * std::sin(0.001f * i);
+    }
+    SampleConverter wholeConverter(format, true, 99);
+    SampleConverter chunkConverter(format, true, 99);
+    std::vector<unsigned char> chunkOutput(numSamples * sampleBytes);
+    wholeConverter.convert(input.data(), output.data(), numSamples);
+    const unsigned long chunkSamples = 12; // an SSE block of 8 and a scalar tail of 4
+    for(unsigned long i=0; i<numSamples; i += chunkSamples)
+    {
+        unsigned long n = std::min(chunkSamples, numSamples - i);
+        chunkConverter.convert(input.data() + i, chunkOutput.data() + i * sampleBytes, n);
+    }
+    check(output == chunkOutput, "SSE and scalar paths give the same output");
+}
+
+class SineSoundEngine : public SoundEngine
+{
+public:
+    SineSoundEngine(SampleFormat format):
+        SoundEngine(g_sampleRate, g_numChannels, g_framesPerBuffer, 3, format),
+        m_audioDevice(g_sampleRate, g_numChannels, g_framesPerBuffer, callback, this, format),
+        m_sine(1)
+    {
+        std::vector<float> data(static_cast<int>(g_sampleRate));
+        for(size_t i=0; i<data.size(); ++i)
+        {
+            data[i] = 0.5f * std::sin(2.f * static_cast<float>(Math::M_PI) * 100.f * i / static_cast<float>(g_sampleRate));
+        }
+        m_sine.load(data.data(), static_cast<int>(data.size()));
+        m_sine.setLoop(true);
+        m_sine.play();
+
+        // sine step plus the quantisation and dither
+        m_audioDevice.setDiscontinuityThreshold(2.f * static_cast<float>(Math::M_PI) * 100.f * 0.5f / static_cast<float>(g_sampleRate) + 0.001f);
+    }
+
+    AudioDevice& getAudioDevice()
+    {
+        return m_audioDevice;
+    }
+
+private:
+    virtual void audioThreadExecute(float* outputBuffer, unsigned long framesPerBuffer, int numChannels) override
+    {
+        memset(outputBuffer, 0, framesPerBuffer * numChannels * sizeof(float));
+        m_sine.execute(outputBuffer, framesPerBuffer, numChannels);
+    }
+
+    AudioDevice m_audioDevice;
+    Sound m_sine;
+};
+
+int main(int argc, char* argv[])
+{
+    printf("Example sample format...\n");
+
+    // 1. conversion checks
+    checkConversions(SampleFormat::INT16);
+    checkConversions(SampleFormat::INT24);
+
+    // 2. engine output formats
+    printf("\n%lu frames per buffer, %i channels, %.1f s per format\n", g_framesPerBuffer, g_numChannels, g_durationSeconds);
+    for(SampleFormat format : {SampleFormat::FLOAT32, SampleFormat::INT16, SampleFormat::INT24})
+    {
+        SineSoundEngine soundEngine(format);
+        soundEngine.initialise();
+        soundEngine.getAudioDevice().process(g_durationSeconds);
+        soundEngine.terminate();
+
+        const AudioDevice::Stats& stats = soundEngine.getAudioDevice().getStats();
+        printf("\n%s: %lu bytes per ring frame, %.1f us per block\n", SampleFormatUtils::getName(format),
+                g_framesPerBuffer * g_numChannels * SampleFormatUtils::getSampleBytes(format), soundEngine.getProfiler().getStats().m_meanMicroseconds);
+        soundEngine.getAudioDevice().printStats();
+        check(stats.m_numDiscontinuities == 0 && stats.m_numRepeatedBlocks == 0, "continuous output");
+    }
+
+    return ExampleChecks::getExitCode();
+}
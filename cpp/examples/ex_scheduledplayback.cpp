@@ -0,0 +1,155 @@
+#include <chrono>
+#include <cmath>
+#include <stdio.h>
+#include <vector>
+
+#include "Sound.h"
+#include "TaskScheduler.h"
+
+/*
+    Example scheduled playback.
+    Tasks carrying a sample time are executed on their exact sample: the scheduler splits the block being rendered
+    at the sample times of the tasks due within it.
+    The example plays a click at arbitrary sample times and finds where the clicks start in the output, with tasks
+    applied at the beginning of the block (the sound starts up to a block late) and with the scheduler.
+    Then it checks that the scheduler doesn't add any cost when there are no tasks to execute.
+
+    Build in release mode to get meaningful numbers:
+    make ex_scheduledplayback CONFIG=release && ./build/ex_scheduledplayback
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const int g_numChannels = 2;
+const unsigned long g_framesPerBuffer = 1024;
+const int g_numVoices = 128;
+const int g_numBlocks = 1000;
+
+/************************************************************/
+
+const uint64_t g_clickTimes[] = {1000, 3333, 5000, 7777};
+const int g_numClicks = sizeof(g_clickTimes) / sizeof(g_clickTimes[0]);
+
+/* Render the clicks and print the sample time of their start in the output */
+void renderClicks(bool splitBlocks)
+{
+    std::vector<float> clickData(256, 1.f);
+    Sound sound(1);
+    sound.load(clickData.data(), static_cast<int>(clickData.size()));
+
+    TaskScheduler scheduler(g_numClicks);
+    for(int i=0; i<g_numClicks; ++i)
+    {
+        TaskQueue::Task task;
+        task.m_fn = [](void* context, void*, float)
+        {
+            Sound* sound = (Sound*)context;
+            sound->stop(); // restart from the beginning
+            sound->play();
+        };
+        task.m_context = &sound;
+        task.m_sampleTime = g_clickTimes[i];
+        scheduler.schedule(task);
+    }
+
+    const int numBlocks = static_cast<int>(g_clickTimes[g_numClicks - 1] / g_framesPerBuffer) + 2;
+    std::vector<float> output(numBlocks * g_framesPerBuffer * g_numChannels, 0.f);
+    for(int b=0; b<numBlocks; ++b)
+    {
+        uint64_t blockSampleTime = b * g_framesPerBuffer;
+        float* blockOutput = output.data() + blockSampleTime * g_numChannels;
+        if(splitBlocks)
+        {
+            scheduler.process(blockSampleTime, g_framesPerBuffer, 0.f, [&](unsigned long offset, unsigned long numFrames)
+            {
+                sound.execute(blockOutput + offset * g_numChannels, numFrames, g_numChannels);
+            });
+        }
+        else
+        {
+            // tasks applied at the beginning of the block they fall in
+            scheduler.executeUntil(blockSampleTime + g_framesPerBuffer - 1, 0.f);
+            sound.execute(blockOutput, g_framesPerBuffer, g_numChannels);
+        }
+    }
+
+    printf("%s:\n", splitBlocks ? "Scheduled tasks" : "Tasks at block start");
+    int click = 0;
+    for(size_t i=0; i<output.size() / g_numChannels && click < g_numClicks; ++i)
+    {
+        bool start = output[i * g_numChannels] != 0.f && (i == 0 || output[(i - 1) * g_numChannels] == 0.f);
+        if(start)
+        {
+            long error = static_cast<long>(i) - static_cast<long>(g_clickTimes[click]);
+            printf("    click %i expected at %lu, starts at %zu (%+ld samples)\n", click, (unsigned long)g_clickTimes[click], i, error);
+            ++click;
+        }
+    }
+}
+
+/* Returns the average time in seconds to mix all the voices for a block */
+double measure(std::vector<Sound>& voices, bool useScheduler)
+{
+    TaskScheduler scheduler(16);
+    std::vector<float> output(g_framesPerBuffer * g_numChannels);
+    double elapsed = 0.;
+    for(int b=0; b<g_numBlocks; ++b)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        memset(output.data(), 0, output.size() * sizeof(float));
+        auto render = [&](unsigned long offset, unsigned long numFrames)
+        {
+            for(size_t v=0; v<voices.size(); ++v)
+            {
+                voices[v].execute(output.data() + offset * g_numChannels, numFrames, g_numChannels);
+            }
+        };
+
+        if(useScheduler)
+        {
+            scheduler.process(b * g_framesPerBuffer, g_framesPerBuffer, 0.f, render);
+        }
+        else
+        {
+            render(0, g_framesPerBuffer);
+        }
+
+        elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    return elapsed / g_numBlocks;
+}
+
+int main(int argc, char* argv[])
+{
+    printf("Example scheduled playback...\n");
+
+    renderClicks(false);
+    renderClicks(true);
+
+    std::vector<float> data(static_cast<int>(g_sampleRate));
+    for(size_t i=0; i<data.size(); ++i)
+    {
+        data[i] = 0.1f * std::sin(2.f * static_cast<float>(Math::M_PI) * 440.f * i / static_cast<float>(g_sampleRate));
+    }
+
+    std::vector<Sound> voices;
+    voices.reserve(g_numVoices);
+    for(int v=0; v<g_numVoices; ++v)
+    {
+        Sound sound(v + 1);
+        sound.load(data.data(), static_cast<int>(data.size()));
+        sound.setLoop(true);
+        sound.play();
+        voices.emplace_back(std::move(sound));
+    }
+
+    double direct = measure(voices, false);
+    double scheduled = measure(voices, true);
+    printf("%i voices, %lu frames per buffer, no task due: %.2f us/block without scheduler, %.2f us/block with scheduler\n",
+            g_numVoices, g_framesPerBuffer, direct * 1e6, scheduled * 1e6);
+
+    return EXIT_SUCCESS;
+}
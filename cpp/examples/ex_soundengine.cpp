@@ -31,7 +31,9 @@ public:
         if(SoundEngine::initialise())
         {
             m_audioDevice = new AudioDevice(m_sampleRate, m_numChannels, m_framesPerBuffer, callback, this);
+            return true;
         }
+        return false;
     }
 
     virtual bool terminate() override
@@ -41,8 +43,11 @@ public:
             if(m_audioDevice)
             {
                 delete m_audioDevice;
+                m_audioDevice = nullptr;
             }
+            return true;
         }
+        return false;
     }
     
 
@@ -0,0 +1,287 @@
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "AudioBuffer.h"
+#include "ExampleChecks.h"
+#include "RandomUtils.h"
+#include "Sound.h"
+#include "Spatialiser.h"
+#include "VoiceManager.h"
+
+/*
+    Example spatialisation.
+    1. Checks of the gains: distance curves, equal power panning in stereo and 5.1, spread at the listener position
+       and per block gain ramps. The example fails if any check fails.
+    2. Cost of the gain update for thousands of moving emitters, against the block budget (timings are reported, not
+       checked, as they depend on the machine and on SSE).
+    3. A 5.1 scene: emitters spatialised around a turning listener, the voice manager mixing the loudest ones with
+       their distance gain as attenuation.
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const unsigned long g_framesPerBuffer = 256;
+const int g_emitterCounts[] = {1000, 5000, 20000};
+const int g_numSceneEmitters = 5000;
+const int g_maxNumRealVoices = 64;
+const float g_worldSize = 200.f; // metres, emitters are in [-g_worldSize/2, g_worldSize/2]^2
+const int g_numBlocks = 1000;
+
+/************************************************************/
+
+using ExampleChecks::check;
+
+bool isClose(float a, float b, float tolerance = 1e-3f)
+{
+    return std::abs(a - b) <= tolerance;
+}
+
+/* Sum of the squared channel gains, the distance gain squared for an equal power pan */
+float getPower(const Spatialiser& spatialiser, int emitter)
+{
+    float power = 0.f;
+    for(int c=0; c<spatialiser.getNumChannels(); ++c)
+    {
+        power += spatialiser.getGain(emitter, c) * spatialiser.getGain(emitter, c);
+    }
+    return power;
+}
+
+/* Emitter on the horizontal plane at azimuth (degrees, clockwise from the front) and distance of the default listener */
+Spatialiser::Vector3 getPosition(float azimuthDegrees, float distance)
+{
+    const float azimuth = azimuthDegrees * static_cast<float>(Math::M_PI) / 180.f;
+    return {distance * std::sin(azimuth), 0.f, -distance * std::cos(azimuth)};
+}
+
+void checkGains()
+{
+    const float halfPower = std::sqrt(0.5f);
+
+    printf("\nDistance curves:\n");
+    Spatialiser curves(3, Spatialiser::Layout::STEREO);
+    for(int e=0; e<3; ++e)
+    {
+        curves.addEmitter();
+    }
+    curves.setEmitterPosition(0, getPosition(0.f, 0.5f));
+    curves.setEmitterPosition(1, getPosition(0.f, 2.f));
+    curves.setEmitterPosition(2, getPosition(0.f, 500.f));
+    curves.setDistanceCurve(Spatialiser::DistanceModel::INVERSE, 1.f, 100.f);
+    curves.update();
+    check(curves.getDistanceGain(0) == 1.f && isClose(curves.getDistanceGain(1), 0.5f) && isClose(curves.getDistanceGain(2), 0.01f),
+            "inverse: full gain within the min distance, 1/2 at twice the min distance, clamped at the max distance");
+    curves.setDistanceCurve(Spatialiser::DistanceModel::LINEAR, 1.f, 3.f);
+    curves.update();
+    check(curves.getDistanceGain(0) == 1.f && isClose(curves.getDistanceGain(1), 0.5f) && curves.getDistanceGain(2) == 0.f,
+            "linear: full gain within the min distance, 1/2 halfway, silent beyond the max distance");
+
+    // 5 emitters: one SIMD lane and a padded one
+    printf("\nStereo:\n");
+    Spatialiser stereo(5, Spatialiser::Layout::STEREO);
+    const float stereoAzimuths[] = {0.f, 90.f, -90.f, 180.f, 45.f};
+    for(int e=0; e<5; ++e)
+    {
+        stereo.setEmitterPosition(stereo.addEmitter(), getPosition(stereoAzimuths[e], 2.f));
+    }
+    stereo.update();
+    auto stereoGains = [&](int e, float left, float right)
+    {
+        return isClose(stereo.getGain(e, 0), 0.5f * left) && isClose(stereo.getGain(e, 1), 0.5f * right);
+    };
+    check(stereoGains(0, halfPower, halfPower) && stereoGains(3, halfPower, halfPower), "front and back: centre");
+    check(stereoGains(1, 0.f, 1.f) && stereoGains(2, 1.f, 0.f), "right and left: hard panned");
+    check(isClose(getPower(stereo, 4), 0.25f) && stereo.getGain(4, 1) > stereo.getGain(4, 0), "45 degrees: right of centre, equal power");
+
+    printf("\n5.1 (L, R, C, LFE, Ls, Rs):\n");
+    Spatialiser surround(8, Spatialiser::Layout::SURROUND_5_1);
+    const float surroundAzimuths[] = {0.f, 15.f, -30.f, 180.f, 70.f, -110.f, -70.f, 0.f};
+    for(int e=0; e<8; ++e)
+    {
+        surround.setEmitterPosition(surround.addEmitter(), getPosition(surroundAzimuths[e], e == 7 ? 0.f : 2.f));
+    }
+    surround.update();
+    auto surroundGains = [&](int e, std::initializer_list<float> gains)
+    {
+        bool match = true;
+        int c = 0;
+        for(float gain : gains)
+        {
+            // compared as power: the atan2 approximation leaks a little (below -80 dB) on the neighbouring speaker
+            const float channelGain = surround.getGain(e, c++);
+            match = match && isClose(channelGain * channelGain, 0.25f * gain * gain);
+        }
+        return match;
+    };
+    check(surroundGains(0, {0.f, 0.f, 1.f, 0.f, 0.f, 0.f}) && surroundGains(2, {1.f, 0.f, 0.f, 0.f, 0.f, 0.f}),
+            "on a speaker: that speaker only");
+    check(surroundGains(1, {0.f, halfPower, halfPower, 0.f, 0.f, 0.f}) && surroundGains(4, {0.f, halfPower, 0.f, 0.f, 0.f, halfPower}),
+            "halfway between two speakers: equal gains on both");
+    check(surroundGains(3, {0.f, 0.f, 0.f, 0.f, halfPower, halfPower}) && surroundGains(6, {halfPower, 0.f, 0.f, 0.f, halfPower, 0.f}),
+            "behind and on the side: between the surrounds, between the front and the surround");
+    bool equalPower = true;
+    bool noLfe = true;
+    for(int e=0; e<8; ++e)
+    {
+        equalPower = equalPower && isClose(getPower(surround, e), e == 7 ? 1.f : 0.25f);
+        noLfe = noLfe && surround.getGain(e, 3) == 0.f;
+    }
+    const float spreadGain = std::sqrt(1.f / 5.f);
+    check(equalPower && noLfe, "equal power everywhere, nothing on the LFE");
+    bool spread = true;
+    for(int c : {0, 1, 2, 4, 5})
+    {
+        spread = spread && isClose(surround.getGain(7, c), spreadGain);
+    }
+    check(spread, "at the listener: spread over every speaker");
+
+    printf("\nGain ramps:\n");
+    Spatialiser ramps(1, Spatialiser::Layout::STEREO);
+    ramps.addEmitter();
+    std::vector<float> ones(g_framesPerBuffer, 1.f);
+    AudioBuffer buffer(2, g_framesPerBuffer);
+    float maxStep = 0.f;
+    float previous = 0.f;
+    for(int b=0; b<8; ++b)
+    {
+        // jumps from hard left to hard right every block
+        ramps.setEmitterPosition(0, getPosition(b % 2 ? 90.f : -90.f, 1.f));
+        ramps.update();
+        buffer.clear(g_framesPerBuffer);
+        ramps.mixEmitter(0, ones.data(), buffer.getChannels(), g_framesPerBuffer);
+        for(unsigned long i=0; i<g_framesPerBuffer; ++i)
+        {
+            maxStep = std::max(maxStep, std::abs(buffer.getChannel(1)[i] - previous));
+            previous = buffer.getChannel(1)[i];
+        }
+    }
+    check(isClose(previous, 1.f, 1.001f / g_framesPerBuffer) && maxStep <= 1.001f / g_framesPerBuffer, "gains ramp across the block, no step");
+}
+
+void measureUpdateCost(double blockMicroseconds)
+{
+    printf("\nUpdate cost, every emitter moving every block (%lu frames per buffer, %.0f us, target below 5%%):\n", g_framesPerBuffer, blockMicroseconds);
+    for(int numEmitters : g_emitterCounts)
+    {
+        for(Spatialiser::Layout layout : {Spatialiser::Layout::STEREO, Spatialiser::Layout::SURROUND_5_1})
+        {
+            Spatialiser spatialiser(numEmitters, layout);
+            std::vector<float> velocities(numEmitters);
+            for(int e=0; e<numEmitters; ++e)
+            {
+                spatialiser.setEmitterPosition(spatialiser.addEmitter(), {RandomUtils::g_random.getRandRealInRange(-0.5f, 0.5f) * g_worldSize,
+                        RandomUtils::g_random.getRandRealInRange(0.f, 10.f), RandomUtils::g_random.getRandRealInRange(-0.5f, 0.5f) * g_worldSize});
+                velocities[e] = RandomUtils::g_random.getRandRealInRange(-0.1f, 0.1f);
+            }
+
+            float* x = spatialiser.getPositionsX();
+            double elapsed = 0.;
+            for(int b=0; b<g_numBlocks; ++b)
+            {
+                for(int e=0; e<numEmitters; ++e)
+                {
+                    x[e] += velocities[e];
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                spatialiser.update();
+                elapsed += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            }
+
+            const double microseconds = elapsed / g_numBlocks;
+            printf("  %5i emitters, %s: %6.1f us per block (%.2f%% of the block), %.1f ns per emitter\n", numEmitters,
+                    layout == Spatialiser::Layout::STEREO ? "stereo" : "5.1   ", microseconds, 100. * microseconds / blockMicroseconds,
+                    1000. * microseconds / numEmitters);
+        }
+    }
+}
+
+void runScene(double blockMicroseconds)
+{
+    const int numChannels = 6;
+    std::vector<std::vector<float>> sources;
+    for(int s=0; s<16; ++s)
+    {
+        std::vector<float> data(static_cast<int>((0.5f + 0.05f * s) * g_sampleRate));
+        for(size_t i=0; i<data.size(); ++i)
+        {
+            data[i] = 0.2f * std::sin(2.f * static_cast<float>(Math::M_PI) * 110.f * (1 + s % 8) * i / static_cast<float>(g_sampleRate));
+        }
+        sources.push_back(std::move(data));
+    }
+
+    Spatialiser spatialiser(g_numSceneEmitters, Spatialiser::Layout::SURROUND_5_1);
+    spatialiser.setDistanceCurve(Spatialiser::DistanceModel::INVERSE, 1.f, 40.f);
+    VoiceManager voiceManager(g_numSceneEmitters, g_maxNumRealVoices);
+    voiceManager.setMaskingRatio(0.05f);
+    std::vector<std::unique_ptr<Sound>> sounds;
+    for(int e=0; e<g_numSceneEmitters; ++e)
+    {
+        spatialiser.setEmitterPosition(spatialiser.addEmitter(), {RandomUtils::g_random.getRandRealInRange(-0.5f, 0.5f) * g_worldSize, 0.f,
+                RandomUtils::g_random.getRandRealInRange(-0.5f, 0.5f) * g_worldSize});
+        sounds.push_back(std::make_unique<Sound>(e + 1));
+        std::vector<float>& source = sources[e % sources.size()];
+        sounds.back()->load(source.data(), static_cast<int>(source.size()));
+        sounds.back()->setLoop(true);
+        sounds.back()->play();
+        voiceManager.addVoice(sounds.back().get());
+    }
+
+    AudioBuffer bus(numChannels, g_framesPerBuffer);
+    std::vector<float> mono(g_framesPerBuffer);
+    double elapsed = 0.;
+    for(int b=0; b<g_numBlocks; ++b)
+    {
+        // the listener turns on itself
+        const float angle = 2.f * static_cast<float>(Math::M_PI) * b / g_numBlocks;
+        spatialiser.setListener({0.f, 1.8f, 0.f}, {std::sin(angle), 0.f, -std::cos(angle)}, {0.f, 1.f, 0.f});
+
+        auto start = std::chrono::steady_clock::now();
+        spatialiser.update();
+        for(int e=0; e<g_numSceneEmitters; ++e)
+        {
+            voiceManager.setAttenuation(e, spatialiser.getDistanceGain(e));
+        }
+        voiceManager.update();
+
+        bus.clear(g_framesPerBuffer);
+        for(int e=0; e<g_numSceneEmitters; ++e)
+        {
+            if(voiceManager.isReal(e))
+            {
+                sounds[e]->render(mono.data(), g_framesPerBuffer);
+                spatialiser.mixEmitter(e, mono.data(), bus.getChannels(), g_framesPerBuffer);
+            }
+            else
+            {
+                sounds[e]->skip(g_framesPerBuffer);
+            }
+        }
+        elapsed += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    const double microseconds = elapsed / g_numBlocks;
+    printf("\n%i emitters in 5.1, %i real voices at most: %.1f us per block (%.1f%% of the block)\n", g_numSceneEmitters,
+            g_maxNumRealVoices, microseconds, 100. * microseconds / blockMicroseconds);
+    voiceManager.printStats();
+}
+
+int main(int argc, char* argv[])
+{
+    printf("Example spatialisation...\n");
+
+    const double blockMicroseconds = 1e6 * g_framesPerBuffer / g_sampleRate;
+
+    // 1. gain checks
+    checkGains();
+
+    // 2. update cost
+    measureUpdateCost(blockMicroseconds);
+
+    // 3. scene
+    runScene(blockMicroseconds);
+
+    return ExampleChecks::getExitCode();
+}
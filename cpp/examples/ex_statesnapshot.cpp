@@ -0,0 +1,324 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "AudioDevice.h"
+#include "CycleClock.h"
+#include "ExampleChecks.h"
+#include "LatencyHistogram.h"
+#include "SoundEngine.h"
+#include "Spatialiser.h"
+#include "TaskQueue.h"
+#include "TripleBuffer.h"
+
+/*
+    Example state snapshot.
+    Continuous state (the listener, emitter positions, game parameters) sent from the game thread to the audio thread
+    once per game frame.
+    1. Through a triple buffer: the game thread writes the whole frame of state and publishes it, the audio thread takes
+       the latest one at the start of each block and applies it to a spatialiser. The sound engine is driven by a mock
+       audio device at the real buffer period, the game thread runs faster than a real game to stress the exchange.
+       Checks that no snapshot is torn (every field written by the same game frame) and that snapshots never go back
+       in time. The example fails if any check fails.
+    2. Through a task queue, one task per value: cost per game frame against the triple buffer, and values rejected
+       when the queue is drained at a fixed number of tasks per block.
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const int g_numChannels = 2;
+const unsigned long g_framesPerBuffer = 256;
+const int g_ringBufferNumFrames = 3;
+const int g_numEmitters = 512;
+const int g_numParameters = 32;
+const float g_durationSeconds = 3.f;
+const int g_gameFrameMicroseconds = 500; // stress: a real game frame is around 16 ms
+const int g_queueCapacity = 1024;
+const int g_maxTasksPerBlock = 256;
+const int g_numCostFrames = 2000;
+
+/************************************************************/
+
+using ExampleChecks::check;
+
+/* A game frame of audio state, structure of arrays as the spatialiser */
+struct GameAudioState
+{
+    uint64_t m_frame = 0;
+    Spatialiser::Vector3 m_listenerPosition;
+    Spatialiser::Vector3 m_listenerForward;
+    float m_x[g_numEmitters] = {};
+    float m_y[g_numEmitters] = {};
+    float m_z[g_numEmitters] = {};
+    float m_parameters[g_numParameters] = {}; // e.g. RTPCs: speed, health, time of day
+};
+
+/* Value of field i in game frame, so that the reader can tell which frame wrote it */
+float getValue(uint64_t frame, int i)
+{
+    return static_cast<float>(frame % 100000) + 0.001f * i;
+}
+
+/* Game thread. Writes every field of the state for the frame */
+void writeState(GameAudioState& state, uint64_t frame)
+{
+    state.m_frame = frame;
+    const float angle = 0.001f * frame;
+    state.m_listenerPosition = {0.f, 1.8f, getValue(frame, 0)};
+    state.m_listenerForward = {std::sin(angle), 0.f, -std::cos(angle)};
+    for(int e=0; e<g_numEmitters; ++e)
+    {
+        state.m_x[e] = getValue(frame, e);
+        state.m_y[e] = 1.f;
+        state.m_z[e] = getValue(frame, e + 1);
+    }
+    for(int p=0; p<g_numParameters; ++p)
+    {
+        state.m_parameters[p] = getValue(frame, p);
+    }
+}
+
+/* Whether every field of the state was written by the same frame */
+bool isConsistent(const GameAudioState& state)
+{
+    bool consistent = state.m_listenerPosition.m_z == getValue(state.m_frame, 0);
+    for(int e=0; e<g_numEmitters; ++e)
+    {
+        consistent = consistent && state.m_x[e] == getValue(state.m_frame, e) && state.m_z[e] == getValue(state.m_frame, e + 1);
+    }
+    for(int p=0; p<g_numParameters; ++p)
+    {
+        consistent = consistent && state.m_parameters[p] == getValue(state.m_frame, p);
+    }
+    return consistent;
+}
+
+class SnapshotSoundEngine : public SoundEngine
+{
+public:
+    SnapshotSoundEngine():
+        SoundEngine(g_sampleRate, g_numChannels, g_framesPerBuffer, g_ringBufferNumFrames),
+        m_audioDevice(g_sampleRate, g_numChannels, g_framesPerBuffer, callback, this),
+        m_spatialiser(g_numEmitters, Spatialiser::Layout::STEREO),
+        m_lastFrame(0),
+        m_numTorn(0),
+        m_numBackwards(0)
+    {
+        for(int e=0; e<g_numEmitters; ++e)
+        {
+            m_spatialiser.addEmitter();
+        }
+    }
+
+    /* Game thread */
+    TripleBuffer<GameAudioState>& getState()
+    {
+        return m_state;
+    }
+
+    /* Device thread */
+    void runDevice(float durationSeconds)
+    {
+        m_audioDevice.process(durationSeconds);
+    }
+
+    void printReport()
+    {
+        printf("  %llu states published, %llu taken by the audio thread (the others were superseded)\n",
+                static_cast<unsigned long long>(m_state.getNumPublished()), static_cast<unsigned long long>(m_state.getNumAcquired()));
+        m_acquireLatency.print("Taking and applying the latest state (us)");
+        check(m_state.getNumAcquired() > 0, "the audio thread received states");
+        check(m_numTorn.load() == 0, "no torn state: every field from the same game frame");
+        check(m_numBackwards.load() == 0, "states never go back in time");
+    }
+
+private:
+    virtual void audioThreadProcess(float) override
+    {
+        // one acquire per block: the latest complete state, read in place
+        const uint64_t start = CycleClock::now();
+        if(m_state.acquire())
+        {
+            const GameAudioState& state = m_state.getReadBuffer();
+            m_spatialiser.setListener(state.m_listenerPosition, state.m_listenerForward, {0.f, 1.f, 0.f});
+            memcpy(m_spatialiser.getPositionsX(), state.m_x, sizeof(state.m_x));
+            memcpy(m_spatialiser.getPositionsY(), state.m_y, sizeof(state.m_y));
+            memcpy(m_spatialiser.getPositionsZ(), state.m_z, sizeof(state.m_z));
+            m_acquireLatency.record(static_cast<uint64_t>(CycleClock::ticksToMicroseconds(CycleClock::now() - start)));
+
+            // verification, not needed in a game
+            m_numTorn.fetch_add(isConsistent(state) ? 0 : 1, std::memory_order_relaxed);
+            m_numBackwards.fetch_add(state.m_frame < m_lastFrame ? 1 : 0, std::memory_order_relaxed);
+            m_lastFrame = state.m_frame;
+        }
+        m_spatialiser.update();
+    }
+
+    virtual void audioThreadExecute(float* outputBuffer, unsigned long framesPerBuffer, int numChannels) override
+    {
+        memset(outputBuffer, 0, framesPerBuffer * numChannels * sizeof(float));
+    }
+
+    AudioDevice m_audioDevice;
+    TripleBuffer<GameAudioState> m_state;
+    Spatialiser m_spatialiser; // audio thread only
+    uint64_t m_lastFrame; // audio thread only
+    std::atomic<unsigned long> m_numTorn;
+    std::atomic<unsigned long> m_numBackwards;
+    LatencyHistogram m_acquireLatency;
+};
+
+void runTripleBuffer()
+{
+    printf("\nTriple buffer: %i emitters and %i parameters (%zu bytes) every %i us, %.1f s:\n", g_numEmitters,
+            g_numParameters, sizeof(GameAudioState), g_gameFrameMicroseconds, g_durationSeconds);
+
+    SnapshotSoundEngine soundEngine;
+    soundEngine.initialise();
+
+    std::atomic<bool> runningFlag(true);
+    std::thread game([&]()
+    {
+        TripleBuffer<GameAudioState>& state = soundEngine.getState();
+        auto nextFrame = std::chrono::steady_clock::now();
+        for(uint64_t frame=1; runningFlag.load(); ++frame)
+        {
+            writeState(state.getWriteBuffer(), frame);
+            state.publish();
+            nextFrame += std::chrono::microseconds(g_gameFrameMicroseconds);
+            std::this_thread::sleep_until(nextFrame);
+        }
+    });
+
+    soundEngine.runDevice(g_durationSeconds);
+    runningFlag.store(false);
+    game.join();
+    soundEngine.terminate();
+
+    soundEngine.printReport();
+}
+
+/* Audio thread side of the task path: one value per task */
+struct QueuedState
+{
+    GameAudioState m_state;
+    int m_numValues = 0;
+};
+
+/* Value i of the state: the emitter coordinates then the parameters */
+float& getField(GameAudioState& state, int i)
+{
+    float* arrays[] = {state.m_x, state.m_y, state.m_z};
+    return i < 3 * g_numEmitters ? arrays[i / g_numEmitters][i % g_numEmitters] : state.m_parameters[i - 3 * g_numEmitters];
+}
+
+void pushValues(TaskQueue& queue, QueuedState& target, GameAudioState& state, unsigned long& numRejected)
+{
+    struct TaskParams
+    {
+        int m_index;
+        float m_value;
+    };
+    auto task = [](void* context, void* params, float)
+    {
+        QueuedState* queued = (QueuedState*)context;
+        TaskParams* taskParams = (TaskParams*)params;
+        getField(queued->m_state, taskParams->m_index) = taskParams->m_value;
+        ++queued->m_numValues;
+    };
+
+    for(int i=0; i<3 * g_numEmitters + g_numParameters; ++i)
+    {
+        TaskParams taskParams = {i, getField(state, i)};
+        numRejected += queue.push(task, &target, &taskParams, sizeof(taskParams)) ? 0 : 1;
+    }
+}
+
+void runTaskQueue()
+{
+    const int numValues = 3 * g_numEmitters + g_numParameters;
+    printf("\nTask queue, one task per value (%i values per game frame):\n", numValues);
+
+    // cost per game frame, on a single thread: game side then audio side
+    TaskQueue queue(g_queueCapacity * 4);
+    QueuedState queued;
+    GameAudioState state;
+    unsigned long numRejected = 0;
+    double queueMicroseconds = 0.;
+    for(int f=0; f<g_numCostFrames; ++f)
+    {
+        writeState(state, f + 1);
+        auto start = std::chrono::steady_clock::now();
+        pushValues(queue, queued, state, numRejected);
+        TaskQueue::Task task;
+        while(queue.pop(task))
+        {
+            task.execute(0.f);
+        }
+        queueMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    TripleBuffer<GameAudioState> tripleBuffer;
+    Spatialiser spatialiser(g_numEmitters, Spatialiser::Layout::STEREO);
+    double tripleBufferMicroseconds = 0.;
+    for(int f=0; f<g_numCostFrames; ++f)
+    {
+        writeState(state, f + 1);
+        auto start = std::chrono::steady_clock::now();
+        tripleBuffer.getWriteBuffer() = state;
+        tripleBuffer.publish();
+        tripleBuffer.acquire();
+        const GameAudioState& latest = tripleBuffer.getReadBuffer();
+        memcpy(spatialiser.getPositionsX(), latest.m_x, sizeof(latest.m_x));
+        memcpy(spatialiser.getPositionsY(), latest.m_y, sizeof(latest.m_y));
+        memcpy(spatialiser.getPositionsZ(), latest.m_z, sizeof(latest.m_z));
+        tripleBufferMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+    printf("  per game frame: task queue %.1f us, triple buffer %.1f us (game state copied in, positions copied out)\n",
+            queueMicroseconds / g_numCostFrames, tripleBufferMicroseconds / g_numCostFrames);
+
+    // a 60 Hz game against blocks draining a fixed number of tasks
+    TaskQueue boundedQueue(g_queueCapacity);
+    QueuedState boundedQueued;
+    numRejected = 0;
+    const double blockSeconds = g_framesPerBuffer / g_sampleRate;
+    const int numBlocks = static_cast<int>(g_durationSeconds / blockSeconds);
+    int numGameFrames = 0;
+    int maxBacklog = 0;
+    for(int b=0; b<numBlocks; ++b)
+    {
+        while(numGameFrames / 60. <= b * blockSeconds)
+        {
+            writeState(state, ++numGameFrames);
+            pushValues(boundedQueue, boundedQueued, state, numRejected);
+        }
+        maxBacklog = std::max(maxBacklog, boundedQueue.getNumTasks());
+        TaskQueue::Task task;
+        for(int t=0; t<g_maxTasksPerBlock && boundedQueue.pop(task); ++t)
+        {
+            task.execute(0.f);
+        }
+    }
+    const unsigned long numPushed = static_cast<unsigned long>(numGameFrames) * numValues;
+    printf("  60 Hz game, queue of %i tasks drained %i tasks per block: %lu of %lu values rejected (%.1f%%), max backlog %i tasks (%.1f blocks)\n",
+            g_queueCapacity, g_maxTasksPerBlock, numRejected, numPushed, 100. * numRejected / numPushed, maxBacklog,
+            static_cast<float>(maxBacklog) / g_maxTasksPerBlock);
+}
+
+int main(int argc, char* argv[])
+{
+    printf("Example state snapshot...\n");
+
+    // rejected pushes are counted rather than logged
+    g_logger.setLevel(Logger::NONE);
+
+    // 1. triple buffer between the game and audio threads
+    runTripleBuffer();
+
+    // 2. the same state through a task queue
+    runTaskQueue();
+
+    return ExampleChecks::getExitCode();
+}
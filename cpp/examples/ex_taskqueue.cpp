@@ -1,18 +1,29 @@
 #include <stdlib.h>
 #include <thread>
 
-#include "LogMutex.h"
-#include "TaskQueue.h"
+#include "CycleClock.h"
+#include "LatencyHistogram.h"
+#include "Logger.h"
+#include "PriorityTaskQueue.h"
 
 /*
     Example task queue.
     Implementation of a thread-safe queue in a multi-threaded environment.
     The queue here is used to send some jobs from a producer to a consumer thread.
+    Jobs have a priority: urgent jobs are always processed in the frame, the others are processed in priority order
+    until the frame time budget is used and the rest waits for the next frame.
+    Jobs issued together can be pushed as a batch, all of them or none if the queue can't take them all.
+    When the queue is full, jobs are rejected by default, or spilled to an overflow with the SPILL policy.
+    The worker blocks until a job is pushed instead of polling. Then the wake latency (push to execution) of a
+    blocked consumer is compared with polling every 10 ms.
 */
 
 /************************ PARAMS ****************************/
 
 const int g_taskQueueSize = 10;
+const float g_frameBudgetMicroseconds = 500000.f; // time per frame for processing jobs
+const int g_numLatencyTasks = 200;
+const int g_latencyTaskIntervalMicroseconds = 2000;
 
 /************************************************************/
 
@@ -20,9 +31,10 @@ class Worker
 {
 public:
     Worker():
-        m_queue(g_taskQueueSize),
-        m_workerThread(&Worker::update, this),
-        m_workerThreadRunningFlag(true)
+        m_queue(g_taskQueueSize, g_frameBudgetMicroseconds),
+        m_batch(2 * g_taskQueueSize),
+        m_workerThreadRunningFlag(true),
+        m_workerThread(&Worker::update, this)
     {
 
     }
@@ -30,69 +42,135 @@ public:
     ~Worker()
     {
         m_workerThreadRunningFlag.store(false); // signal the update thread to stop
+        m_queue.wake();
         if (m_workerThread.joinable())
         {
             m_workerThread.join(); //wait for the write thread to finish
         }
     }
 
-    void addJob()
+    void addJob(PriorityTaskQueue::Priority priority = PriorityTaskQueue::NORMAL)
     {
         /* For simplicity the job is just a text message */
-        auto task = [](void* context, void* params, float delatTime)
+        TaskParams taskParams;
+        taskParams.priority = priority;
+
+        m_queue.push(priority, job, this, &taskParams, sizeof(taskParams));
+    }
+
+    /* Jobs pushed with a single publish, returns false if none was pushed */
+    bool addJobs(int numJobs, PriorityTaskQueue::Priority priority = PriorityTaskQueue::NORMAL)
+    {
+        TaskParams taskParams;
+        taskParams.priority = priority;
+
+        m_batch.clear();
+        for(int i=0; i<numJobs; ++i)
         {
-            Worker* worker = (Worker*)context;
-            LM_LOG("This is a task...");
-        };
+            m_batch.add(job, this, &taskParams, sizeof(taskParams));
+        }
+        return m_queue.pushBatch(priority, m_batch);
+    }
 
-        m_queue.push(task, this);
+    /* Before pushing */
+    void setOverflowPolicy(TaskQueue::OverflowPolicy policy)
+    {
+        m_queue.setOverflowPolicy(policy);
+    }
+
+    void printStats()
+    {
+        PriorityTaskQueue::Stats stats = m_queue.getStats();
+        LM_LOG("%lu tasks processed over %lu frames (max %i per frame), max backlog %i, budget overruns %lu, %lu wakes",
+                stats.m_numDrained, stats.m_numBlocks, stats.m_maxDrained, stats.m_maxBacklog, stats.m_numOverruns,
+                m_queue.getNumWakes());
     }
 
 private:
+    struct TaskParams
+    {
+        PriorityTaskQueue::Priority priority;
+    };
+
+    static void job(void*, void* params, float)
+    {
+        TaskParams* taskParams = (TaskParams*)params;
+        LM_LOG("This is a task with priority %i...", taskParams->priority);
+
+        /* Wait some time to simulate some time spent processing tasks */
+        std::this_thread::sleep_for(std::chrono::milliseconds(200)); // this is arbitrary for demonstration porpuses
+    }
+
     /* worker thread update function */
     void update()
     {
         while (m_workerThreadRunningFlag.load())
         {   
-            // No processing if there are no tasks to process
+            // No processing if there are no tasks to process, sleeping until the next push
+            m_queue.waitForTasks();
             if(!m_queue.getNumTasks())
             {
-                std::this_thread::sleep_for(std::chrono::milliseconds(10)); // sleep to avoid busy-waiting
                 continue;
             }
 
             LM_LOG("Begin frame.");
 
-            /* For simplicity we define a fix size of number of tasks per frame. */
-            int numProcessedTasks = 0;
-            int deltaTimeMilliseconds = 0; //delta time between tasks in milliseconds
-            while(numProcessedTasks < m_numMaxTasksPerFrame)
-            {
-                TaskQueue::Task task;
-                if(!m_queue.pop(task))
-                {
-                    break;
-                }
+            /* Jobs are processed until the frame budget is used */
+            int numProcessedTasks = m_queue.drain(0.f);
+            LM_LOG("Processed %i tasks, %i left for the next frame.", numProcessedTasks, m_queue.getNumTasks());
 
-                task.execute(deltaTimeMilliseconds);
+            LM_LOG("End frame.");
+        }
+    }
 
-                /* Wait some time to simulate some time spent processing tasks */
-                deltaTimeMilliseconds = 200; // this is arbitrary for demonstration porpuses
-                std::this_thread::sleep_for(std::chrono::milliseconds(deltaTimeMilliseconds));
+    PriorityTaskQueue m_queue;
+    TaskQueue::Batch m_batch; // main thread only
+    std::atomic<bool> m_workerThreadRunningFlag; //atomic flag to control the lifetime of the update thread, set before the thread starts
+    std::thread m_workerThread;
+};
 
-                ++numProcessedTasks;
+/* Push to execution latency of timestamped tasks, with a consumer polling every 10 ms or blocked until a push */
+void measureWakeLatency(bool blocking)
+{
+    TaskQueue queue(g_numLatencyTasks);
+    LatencyHistogram latency;
+    std::atomic<bool> runningFlag(true);
+    std::thread consumer([&]()
+    {
+        while(runningFlag.load())
+        {
+            if(blocking)
+            {
+                queue.waitForTasks();
+            }
+            else if(!queue.getNumTasks())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
             }
 
-            LM_LOG("End frame.");
+            TaskQueue::Task task;
+            while(queue.pop(task))
+            {
+                task.execute(0.f);
+            }
         }
-    }
+    });
 
-    TaskQueue m_queue;
-    std::thread m_workerThread;
-    std::atomic<bool> m_workerThreadRunningFlag; //atomic flag to control the lifetime of the update thread
+    for(int i=0; i<g_numLatencyTasks; ++i)
+    {
+        const uint64_t pushTicks = CycleClock::now();
+        queue.push([](void* context, void* params, float)
+        {
+            ((LatencyHistogram*)context)->record(static_cast<uint64_t>(CycleClock::ticksToMicroseconds(CycleClock::now() - *(uint64_t*)params)));
+        }, &latency, &pushTicks, sizeof(pushTicks));
+        std::this_thread::sleep_for(std::chrono::microseconds(g_latencyTaskIntervalMicroseconds));
+    }
 
-    const int m_numMaxTasksPerFrame = 2;
-};
+    runningFlag.store(false);
+    queue.wake();
+    consumer.join();
+    latency.print(blocking ? "Wake latency, blocked consumer" : "Wake latency, polling every 10 ms");
+}
 
 int main(int argc, char* argv[])
 {
@@ -106,14 +184,34 @@ int main(int argc, char* argv[])
 
     std::this_thread::sleep_for(std::chrono::seconds(2));
 
+    worker.addJob(PriorityTaskQueue::LOW);
+    worker.addJob(PriorityTaskQueue::LOW);
     worker.addJob();
     worker.addJob();
-    worker.addJob();
-    worker.addJob();
-    worker.addJob();
-    worker.addJob();
+    worker.addJob(PriorityTaskQueue::HIGH);
+    worker.addJob(PriorityTaskQueue::CRITICAL);
 
     std::this_thread::sleep_for(std::chrono::seconds(5));
 
+    // a batch larger than the queue is rejected as a whole
+    LM_LOG("Batch of 3 jobs pushed: %i", worker.addJobs(3, PriorityTaskQueue::CRITICAL));
+    LM_LOG("Batch of %i jobs pushed: %i", g_taskQueueSize + 1, worker.addJobs(g_taskQueueSize + 1));
+
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+
+    // more jobs than the queue holds, the extra ones wait in the overflow
+    worker.setOverflowPolicy(TaskQueue::OverflowPolicy::SPILL);
+    for(int i=0; i<g_taskQueueSize + 2; ++i)
+    {
+        worker.addJob(PriorityTaskQueue::LOW);
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(3));
+
+    worker.printStats();
+
+    measureWakeLatency(false);
+    measureWakeLatency(true);
+
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "AudioDevice.h"
+#include "Sound.h"
+#include "SoundEngine.h"
+#include "TaskQueue.h"
+
+/*
+    Example trigger latency.
+    Measures the time from a play command on the game thread to its first block reaching the device buffer.
+    A mock audio device calls the sound engine at the buffer period, like an actual device would, so that the example
+    runs without any audio hardware. The game thread triggers a click at pseudo-random times (fixed seed).
+    The latency is split into:
+    - task queue: waiting for the audio thread to process the command (it processes commands between device callbacks),
+    - ring buffer: computed frames waiting to be copied to the device,
+    - total: from the command to the device.
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const int g_numChannels = 2;
+const unsigned long g_framesPerBuffer = 256;
+const int g_ringBufferNumFrames = 3;
+const float g_durationSeconds = 5.f;
+
+/************************************************************/
+
+class MockSoundEngine : public SoundEngine
+{
+public:
+    MockSoundEngine(double sampleRate, int numChannels, unsigned long framesPerBuffer):
+        SoundEngine(sampleRate, numChannels, framesPerBuffer, g_ringBufferNumFrames),
+        m_queue(64),
+        m_audioDevice(sampleRate, numChannels, framesPerBuffer, callback, this),
+        m_click(1)
+    {
+        std::vector<float> clickData(64, 0.5f);
+        m_click.load(clickData.data(), static_cast<int>(clickData.size()));
+    }
+
+    /* Game thread */
+    void playClick()
+    {
+        struct TaskParams
+        {
+            uint64_t pushTicks;
+        } taskParams;
+        taskParams.pushTicks = CycleClock::now();
+
+        auto task = [](void* context, void* params, float)
+        {
+            MockSoundEngine* soundEngine = (MockSoundEngine*)context;
+            TaskParams* taskParams = (TaskParams*)params;
+
+            soundEngine->m_click.stop();
+            soundEngine->m_click.play();
+            soundEngine->markTrigger(taskParams->pushTicks);
+        };
+
+        m_queue.push(task, this, &taskParams, sizeof(taskParams));
+    }
+
+    /* Device thread */
+    void runDevice(float durationSeconds)
+    {
+        m_audioDevice.process(durationSeconds);
+    }
+
+private:
+    virtual void audioThreadProcess(float deltaTime) override
+    {
+        TaskQueue::Task task;
+        while(m_queue.pop(task))
+        {
+            task.execute(deltaTime);
+        }
+    }
+
+    virtual void audioThreadExecute(float* outputBuffer, unsigned long framesPerBuffer, int numChannels) override
+    {
+        memset(outputBuffer, 0, framesPerBuffer * numChannels * sizeof(float));
+        m_click.execute(outputBuffer, framesPerBuffer, numChannels);
+    }
+
+    TaskQueue m_queue;
+    AudioDevice m_audioDevice;
+    Sound m_click;
+};
+
+int main(int argc, char* argv[])
+{
+    printf("Example trigger latency...\n");
+
+    MockSoundEngine soundEngine(g_sampleRate, g_numChannels, g_framesPerBuffer);
+    soundEngine.initialise();
+
+    std::atomic<bool> runningFlag(true);
+    std::thread gameThread([&]()
+    {
+        // triggering at random times so that all the phases relative to the device period are covered
+        std::mt19937 generator(1234);
+        std::uniform_int_distribution<int> intervalMicroseconds(5000, 30000);
+        while(runningFlag.load())
+        {
+            soundEngine.playClick();
+            std::this_thread::sleep_for(std::chrono::microseconds(intervalMicroseconds(generator)));
+        }
+    });
+
+    soundEngine.runDevice(g_durationSeconds);
+
+    runningFlag.store(false);
+    gameThread.join();
+    soundEngine.terminate();
+
+    double periodMicroseconds = 1e6 * g_framesPerBuffer / g_sampleRate;
+    printf("%lu frames per buffer at %.0f Hz (period %.0f us), ring buffer of %i frames\n",
+            g_framesPerBuffer, g_sampleRate, periodMicroseconds, g_ringBufferNumFrames);
+    soundEngine.printTriggerLatency();
+    soundEngine.getProfiler().print();
+
+    return EXIT_SUCCESS;
+}
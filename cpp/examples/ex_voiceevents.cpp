@@ -0,0 +1,456 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "AudioDevice.h"
+#include "AudioEventQueue.h"
+#include "CycleClock.h"
+#include "ExampleChecks.h"
+#include "RandomUtils.h"
+#include "Sound.h"
+#include "SoundEngine.h"
+#include "TaskQueue.h"
+#include "VoiceManager.h"
+
+/*
+    Example voice events.
+    Notifications from the audio thread to the game thread: sounds finishing, looping, passing markers, voices stolen,
+    and xruns, through the event queue of the sound engine.
+    1. Checks of the transport events, rendered, pitched and virtual (skipped) voices alike, of the coalescing when
+       the game thread does not drain, and of the voice stealing. The example fails if any check fails.
+    2. A game thread playing one-shots on a small pool of voices, driven by a mock audio device: every play is
+       notified exactly once, finished or stolen, with the game thread draining the events once per frame. Midway the
+       game thread stalls and the audio thread renders a block late: the game gets the events of the stall in its next
+       frame, and an xrun.
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const int g_numChannels = 2;
+const unsigned long g_framesPerBuffer = 256;
+const int g_ringBufferNumFrames = 3;
+const int g_numVoices = 8;
+const int g_maxNumPlays = 4096;
+const float g_durationSeconds = 3.f;
+const int g_gameFrameMicroseconds = 16667;
+const int g_stallMilliseconds = 300;
+const float g_lateBlockMilliseconds = 8.f;
+
+/************************************************************/
+
+using ExampleChecks::check;
+
+/* Occurrences of each event type, summing the coalesced counts */
+struct EventCounts
+{
+    unsigned long m_numEvents = 0;
+    unsigned long m_counts[5] = {};
+    unsigned long m_markers[2] = {};
+    uint64_t m_lastFinishedTime = 0;
+
+    void add(const AudioEvent& event)
+    {
+        ++m_numEvents;
+        m_counts[static_cast<int>(event.m_type)] += event.m_count;
+        if(event.m_type == AudioEvent::Type::MARKER && event.m_value < 2)
+        {
+            m_markers[event.m_value] += event.m_count;
+        }
+        if(event.m_type == AudioEvent::Type::FINISHED)
+        {
+            m_lastFinishedTime = event.m_sampleTime;
+        }
+    }
+
+    unsigned long get(AudioEvent::Type type) const
+    {
+        return m_counts[static_cast<int>(type)];
+    }
+};
+
+enum class RenderPath
+{
+    RENDER,
+    SKIP
+};
+
+/* Plays sound for numBlocks blocks, posting to events, drained every drainBlocks blocks (0 for only at the end) */
+EventCounts playBlocks(Sound& sound, AudioEventQueue& events, RenderPath path, int numBlocks, int drainBlocks)
+{
+    EventCounts counts;
+    AudioBuffer buffer(g_numChannels, g_framesPerBuffer);
+    sound.setEventQueue(&events, sound.getId());
+    sound.play();
+    for(int b=0; b<numBlocks; ++b)
+    {
+        events.setSampleTime(b * g_framesPerBuffer);
+        if(path == RenderPath::RENDER)
+        {
+            sound.executePlanar(buffer.getChannels(), g_framesPerBuffer, g_numChannels);
+        }
+        else
+        {
+            sound.skip(g_framesPerBuffer);
+        }
+        events.flush();
+
+        if(drainBlocks > 0 && (b + 1) % drainBlocks == 0)
+        {
+            events.drain([&](const AudioEvent& event) { counts.add(event); });
+        }
+    }
+
+    // twice: what stayed pending while the queue was full goes in with the first drain
+    events.drain([&](const AudioEvent& event) { counts.add(event); });
+    events.flush();
+    events.drain([&](const AudioEvent& event) { counts.add(event); });
+    sound.setEventQueue(nullptr, 0);
+    return counts;
+}
+
+void checkEvents()
+{
+    const int length = 1000;
+    std::vector<float> data(length, 0.1f);
+    const int numBlocks = 10; // 2560 frames
+
+    printf("\nTransport events (%i frames, %i blocks of %lu frames):\n", length, numBlocks, g_framesPerBuffer);
+    {
+        AudioEventQueue events;
+        Sound oneShot(1);
+        oneShot.load(data.data(), length);
+        EventCounts counts = playBlocks(oneShot, events, RenderPath::RENDER, numBlocks, 1);
+        printf("  one-shot: %lu finished at sample %llu\n", counts.get(AudioEvent::Type::FINISHED),
+                static_cast<unsigned long long>(counts.m_lastFinishedTime));
+        check(counts.get(AudioEvent::Type::FINISHED) == 1 && counts.m_numEvents == 1, "one-shot: one finished event");
+        check(counts.m_lastFinishedTime == length / g_framesPerBuffer * g_framesPerBuffer, "stamped with the block it finished in");
+
+        oneShot.play();
+        oneShot.stop();
+        check(events.getNumPosted() == 1, "no event on an explicit stop");
+    }
+
+    // looping, 2 markers: rendered at a pitch of 1 (spans), pitched (per sample) and skipped (virtual voice)
+    struct LoopCase
+    {
+        const char* m_name;
+        RenderPath m_path;
+        float m_pitch;
+        unsigned long m_numLoops;
+        unsigned long m_numMarkers;
+    };
+    const LoopCase cases[] = {
+        {"rendered", RenderPath::RENDER, 1.f, 2, 3},
+        {"skipped", RenderPath::SKIP, 1.f, 2, 3},
+        {"rendered at 1.5", RenderPath::RENDER, 1.5f, 3, 4},
+        {"skipped at 1.5", RenderPath::SKIP, 1.5f, 3, 4}
+    };
+    for(const LoopCase& loopCase : cases)
+    {
+        AudioEventQueue events;
+        Sound loop(2);
+        loop.load(data.data(), length);
+        loop.setLoop(true);
+        loop.setPitch(loopCase.m_pitch);
+        loop.addMarker(100);
+        loop.addMarker(500);
+        EventCounts counts = playBlocks(loop, events, loopCase.m_path, numBlocks, 1);
+        printf("  loop %-16s %lu looped, markers %lu and %lu\n", loopCase.m_name, counts.get(AudioEvent::Type::LOOPED),
+                counts.m_markers[0], counts.m_markers[1]);
+        check(counts.get(AudioEvent::Type::LOOPED) == loopCase.m_numLoops && counts.m_markers[0] == loopCase.m_numMarkers &&
+                counts.m_markers[1] == loopCase.m_numMarkers, "loops and markers");
+    }
+
+    // a loop shorter than a block: a virtual voice wraps several times per advance
+    {
+        const int shortLength = 100;
+        std::vector<float> shortData(shortLength, 0.1f);
+        EventCounts counts[2];
+        for(RenderPath path : {RenderPath::RENDER, RenderPath::SKIP})
+        {
+            AudioEventQueue events;
+            Sound loop(4);
+            loop.load(shortData.data(), shortLength);
+            loop.setLoop(true);
+            loop.addMarker(10);
+            loop.addMarker(60);
+            counts[static_cast<int>(path)] = playBlocks(loop, events, path, numBlocks, 1);
+        }
+        printf("  %i frames loop: rendered %lu looped, markers %lu and %lu, skipped %lu looped, markers %lu and %lu\n", shortLength,
+                counts[0].get(AudioEvent::Type::LOOPED), counts[0].m_markers[0], counts[0].m_markers[1],
+                counts[1].get(AudioEvent::Type::LOOPED), counts[1].m_markers[0], counts[1].m_markers[1]);
+        check(counts[0].get(AudioEvent::Type::LOOPED) == 25 && counts[0].m_markers[0] == 26 && counts[0].m_markers[1] == 25,
+                "short loop rendered: loops and markers");
+        check(counts[1].get(AudioEvent::Type::LOOPED) == counts[0].get(AudioEvent::Type::LOOPED) &&
+                counts[1].m_markers[0] == counts[0].m_markers[0] && counts[1].m_markers[1] == counts[0].m_markers[1],
+                "short loop skipped: the same loops and markers");
+    }
+
+    // coalescing: a short loop for 1000 blocks, the game thread drains every block, then never
+    printf("\nCoalescing (64 frames loop, 1000 blocks, capacity 4):\n");
+    {
+        std::vector<float> shortData(64, 0.1f);
+        EventCounts reference;
+        EventCounts coalesced;
+        unsigned long numDropped = 0;
+        for(int drainBlocks : {1, 0})
+        {
+            AudioEventQueue events(4);
+            Sound loop(3);
+            loop.load(shortData.data(), static_cast<int>(shortData.size()));
+            loop.setLoop(true);
+            loop.addMarker(10);
+            (drainBlocks > 0 ? reference : coalesced) = playBlocks(loop, events, RenderPath::RENDER, 1000, drainBlocks);
+            numDropped += events.getNumDropped();
+        }
+        printf("  draining every block: %lu events, never: %lu events, %lu looped and %lu markers in both\n", reference.m_numEvents,
+                coalesced.m_numEvents, coalesced.get(AudioEvent::Type::LOOPED), coalesced.m_markers[0]);
+        check(coalesced.get(AudioEvent::Type::LOOPED) == reference.get(AudioEvent::Type::LOOPED) &&
+                coalesced.m_markers[0] == reference.m_markers[0], "same occurrences, coalesced");
+        check(coalesced.m_numEvents <= 6 && numDropped == 0, "bounded events, none dropped");
+    }
+
+    printf("\nVoice stealing:\n");
+    {
+        AudioEventQueue events;
+        std::vector<Sound> sounds;
+        sounds.reserve(2);
+        VoiceManager voiceManager(2, 2);
+        for(unsigned long id : {10ul, 11ul})
+        {
+            sounds.emplace_back(id);
+            sounds.back().load(data.data(), length);
+            sounds.back().setEventQueue(&events, id);
+            voiceManager.addVoice(&sounds.back());
+        }
+
+        const int free = voiceManager.acquireVoice();
+        sounds[0].play();
+        sounds[1].play();
+        sounds[1].setGain(0.2f);
+        const int stolen = voiceManager.acquireVoice();
+        events.flush();
+        EventCounts counts;
+        unsigned long stolenSource = 0;
+        events.drain([&](const AudioEvent& event)
+        {
+            counts.add(event);
+            stolenSource = event.m_source;
+        });
+        printf("  free voice %i, stolen voice %i (source %lu)\n", free, stolen, stolenSource);
+        check(free == 0 && stolen == 1 && !sounds[1].isPlaying() && sounds[0].isPlaying(), "a stopped voice first, then the quietest");
+        check(counts.get(AudioEvent::Type::STOLEN) == 1 && counts.m_numEvents == 1 && stolenSource == 11, "one stolen event");
+        check(voiceManager.acquireVoice() == 1 && voiceManager.getStats().m_numSteals == 1, "the stolen voice is free");
+    }
+}
+
+/* Voices of the game, one-shots played on a pool of voices with stealing */
+class EventsSoundEngine : public SoundEngine
+{
+public:
+    EventsSoundEngine():
+        SoundEngine(g_sampleRate, g_numChannels, g_framesPerBuffer, g_ringBufferNumFrames),
+        m_audioDevice(g_sampleRate, g_numChannels, g_framesPerBuffer, callback, this),
+        m_queue(256),
+        m_voiceManager(g_numVoices, g_numVoices),
+        m_ambience(1000),
+        m_renderLate(false)
+    {
+        // clips from 0.05 to 0.4 s
+        m_voices.reserve(g_numVoices);
+        for(int v=0; v<g_numVoices; ++v)
+        {
+            std::vector<float> clip(static_cast<size_t>(g_sampleRate * (0.05 + 0.05 * v)), 0.01f);
+            m_voices.emplace_back(v + 1);
+            m_voices[v].load(clip.data(), static_cast<int>(clip.size()));
+            m_voiceManager.addVoice(&m_voices[v]);
+        }
+
+        std::vector<float> ambience(static_cast<size_t>(g_sampleRate * 0.5), 0.01f);
+        m_ambience.load(ambience.data(), static_cast<int>(ambience.size()));
+        m_ambience.setLoop(true);
+        m_ambience.addMarker(0);
+        m_ambience.setEventQueue(&getEvents(), 1000);
+        m_ambience.play();
+    }
+
+    /* Game thread. Play a one-shot, notified with playId */
+    bool play(unsigned long playId)
+    {
+        auto task = [](void* context, void* params, float)
+        {
+            EventsSoundEngine* soundEngine = (EventsSoundEngine*)context;
+            const unsigned long playId = *(unsigned long*)params;
+
+            // the stolen voice posts STOLEN with the id of its previous play
+            const int voice = soundEngine->m_voiceManager.acquireVoice();
+            soundEngine->m_voices[voice].setEventQueue(&soundEngine->getEvents(), playId);
+            soundEngine->m_voices[voice].play();
+        };
+
+        return m_queue.push(task, this, &playId, sizeof(playId));
+    }
+
+    /* Game thread. The next block renders late, a deadline miss */
+    void renderLate()
+    {
+        m_renderLate.store(true);
+    }
+
+    /* Device thread */
+    void runDevice(float durationSeconds)
+    {
+        m_audioDevice.process(durationSeconds);
+    }
+
+private:
+    virtual void audioThreadProcess(float deltaTime) override
+    {
+        TaskQueue::Task task;
+        while(m_queue.pop(task))
+        {
+            task.execute(deltaTime);
+        }
+        m_voiceManager.update();
+    }
+
+    virtual void audioThreadExecute(float* outputBuffer, unsigned long framesPerBuffer, int numChannels) override
+    {
+        memset(outputBuffer, 0, framesPerBuffer * numChannels * sizeof(float));
+        for(Sound& voice : m_voices)
+        {
+            voice.execute(outputBuffer, framesPerBuffer, numChannels);
+        }
+        m_ambience.execute(outputBuffer, framesPerBuffer, numChannels);
+
+        if(m_renderLate.exchange(false))
+        {
+            const uint64_t end = CycleClock::now() + CycleClock::microsecondsToTicks(1000. * g_lateBlockMilliseconds);
+            while(CycleClock::now() < end)
+            {
+            }
+        }
+    }
+
+    AudioDevice m_audioDevice;
+    TaskQueue m_queue;
+    VoiceManager m_voiceManager; // audio thread only
+    std::vector<Sound> m_voices;
+    Sound m_ambience;
+    std::atomic<bool> m_renderLate;
+};
+
+void runGame()
+{
+    printf("\nGame: one-shots on %i voices, events drained every %.1f ms, %.1f s:\n", g_numVoices,
+            g_gameFrameMicroseconds / 1000., g_durationSeconds);
+
+    EventsSoundEngine soundEngine;
+    AudioEventQueue& events = soundEngine.getEvents();
+    soundEngine.initialise();
+
+    // game thread state
+    std::vector<int> notified(g_maxNumPlays, 0); // notifications per play id
+    EventCounts counts;
+    unsigned long numPlays = 0;
+    int maxEventsPerFrame = 0;
+    int stallFrameEvents = 0;
+    bool stallXrun = false;
+    bool hasStalled = false;
+
+    auto drainEvents = [&]()
+    {
+        return events.drain([&](const AudioEvent& event)
+        {
+            counts.add(event);
+            if((event.m_type == AudioEvent::Type::FINISHED || event.m_type == AudioEvent::Type::STOLEN) && event.m_source < notified.size())
+            {
+                notified[event.m_source] += event.m_count;
+            }
+        });
+    };
+
+    std::atomic<bool> runningFlag(true);
+    std::thread game([&]()
+    {
+        const auto start = std::chrono::steady_clock::now();
+        auto nextFrame = start;
+        bool stalled = false;
+        while(runningFlag.load())
+        {
+            const int numEvents = drainEvents();
+            const float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+            if(stalled)
+            {
+                // the first frame after the stall
+                stallFrameEvents = numEvents;
+                stallXrun = counts.get(AudioEvent::Type::XRUN) > 0;
+                stalled = false;
+            }
+            maxEventsPerFrame = std::max(maxEventsPerFrame, numEvents);
+
+            // no new plays during the last half second, so that every play ends before the device stops
+            const int numNewPlays = seconds < g_durationSeconds - 0.5f ? RandomUtils::g_random.getRandIntInRange(0, 3) : 0;
+            for(int i=0; i<numNewPlays && numPlays + 1 < notified.size(); ++i)
+            {
+                numPlays += soundEngine.play(numPlays + 1) ? 1 : 0;
+            }
+
+            if(!hasStalled && seconds > 0.5f * g_durationSeconds)
+            {
+                // e.g. a level load hitch: the audio thread keeps posting, nobody drains
+                soundEngine.renderLate();
+                std::this_thread::sleep_for(std::chrono::milliseconds(g_stallMilliseconds));
+                stalled = true;
+                hasStalled = true;
+                nextFrame = std::chrono::steady_clock::now();
+            }
+
+            nextFrame += std::chrono::microseconds(g_gameFrameMicroseconds);
+            std::this_thread::sleep_until(nextFrame);
+        }
+    });
+
+    soundEngine.runDevice(g_durationSeconds);
+    runningFlag.store(false);
+    game.join();
+    soundEngine.terminate();
+    drainEvents();
+
+    int numUnnotified = 0;
+    int numNotifiedTwice = 0;
+    for(unsigned long playId=1; playId<=numPlays; ++playId)
+    {
+        numUnnotified += notified[playId] == 0 ? 1 : 0;
+        numNotifiedTwice += notified[playId] > 1 ? 1 : 0;
+    }
+
+    printf("  %lu plays: %lu finished, %lu stolen, ambience looped %lu times, %lu markers\n", numPlays,
+            counts.get(AudioEvent::Type::FINISHED), counts.get(AudioEvent::Type::STOLEN), counts.get(AudioEvent::Type::LOOPED),
+            counts.get(AudioEvent::Type::MARKER));
+    printf("  %lu events drained, %lu occurrences coalesced, %lu dropped, at most %i events per frame\n", counts.m_numEvents,
+            events.getNumCoalesced(), events.getNumDropped(), maxEventsPerFrame);
+    printf("  after the %i ms stall: %i events in one frame, xruns %lu\n", g_stallMilliseconds, stallFrameEvents,
+            counts.get(AudioEvent::Type::XRUN));
+    check(numPlays > 0 && numUnnotified == 0 && numNotifiedTwice == 0, "every play notified exactly once, finished or stolen");
+    check(counts.get(AudioEvent::Type::STOLEN) > 0, "voices stolen once the pool is full");
+    check(counts.get(AudioEvent::Type::LOOPED) >= static_cast<unsigned long>(g_durationSeconds / 0.5f) - 1 &&
+            counts.get(AudioEvent::Type::MARKER) >= counts.get(AudioEvent::Type::LOOPED), "ambience loops and markers");
+    check(stallXrun, "xrun received after the late block");
+    check(events.getNumDropped() == 0, "no event dropped");
+}
+
+int main(int argc, char* argv[])
+{
+    printf("Example voice events...\n");
+
+    // 1. checks
+    checkEvents();
+
+    // 2. game
+    runGame();
+
+    return ExampleChecks::getExitCode();
+}
@@ -0,0 +1,242 @@
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "AudioBuffer.h"
+#include "ExampleChecks.h"
+#include "RandomUtils.h"
+#include "Sound.h"
+#include "VoiceManager.h"
+
+/*
+    Example voices.
+    Thousands of looping emitters scattered around a listener walking in a circle. The distance sets the gain of each
+    emitter (inverse distance, silent beyond the range) and the voice manager only mixes the loudest audible ones.
+
+    1. cost: time per block mixing every voice, against the voice manager with a budget of real voices,
+    2. virtualisation: real and virtual voice counts along the walk,
+    3. sample accuracy: a voice virtualised then promoted back matches a voice which was mixed all along, also when
+       its pitch ramps while it is virtual, and skipping frames under a pitch ramp moves the playhead as far as mixing
+       them. The example fails if any check fails.
+*/
+
+/************************ PARAMS ****************************/
+
+const double g_sampleRate = 48000.;
+const int g_numChannels = 2;
+const unsigned long g_framesPerBuffer = 256;
+const int g_numEmitters = 2000;
+const int g_maxNumRealVoices = 64;
+const float g_worldSize = 200.f; // metres, emitters are in [-g_worldSize/2, g_worldSize/2]^2
+const float g_range = 40.f; // metres, emitters are silent beyond
+const float g_minDistance = 1.f; // metres, full gain below
+const int g_numBlocks = 1000;
+
+/************************************************************/
+
+using ExampleChecks::check;
+
+struct Emitter
+{
+    float m_x;
+    float m_y;
+    std::unique_ptr<Sound> m_sound;
+};
+
+/* Inverse distance gain, 0 beyond the range */
+float getDistanceGain(const Emitter& emitter, float listenerX, float listenerY)
+{
+    const float distance = std::hypot(emitter.m_x - listenerX, emitter.m_y - listenerY);
+    return distance > g_range ? 0.f : g_minDistance / std::max(distance, g_minDistance);
+}
+
+std::vector<float> makeSine(float freqHz, float durationSeconds)
+{
+    std::vector<float> data(static_cast<int>(durationSeconds * g_sampleRate));
+    for(size_t i=0; i<data.size(); ++i)
+    {
+        data[i] = 0.2f * std::sin(2.f * static_cast<float>(Math::M_PI) * freqHz * i / static_cast<float>(g_sampleRate));
+    }
+    return data;
+}
+
+/* Updates the emitter gains for the listener position and mixes a block */
+void processBlock(std::vector<Emitter>& emitters, VoiceManager* voiceManager, AudioBuffer& buffer, float listenerX, float listenerY)
+{
+    for(size_t e=0; e<emitters.size(); ++e)
+    {
+        float gain = getDistanceGain(emitters[e], listenerX, listenerY);
+        emitters[e].m_sound->setGain(gain, static_cast<int>(g_framesPerBuffer));
+        if(voiceManager)
+        {
+            voiceManager->setAttenuation(static_cast<int>(e), gain > 0.f ? 1.f : 0.f);
+        }
+    }
+
+    buffer.clear(g_framesPerBuffer);
+    if(voiceManager)
+    {
+        voiceManager->update();
+        voiceManager->execute(buffer.getChannels(), g_framesPerBuffer, g_numChannels);
+    }
+    else
+    {
+        for(Emitter& emitter : emitters)
+        {
+            emitter.m_sound->executePlanar(buffer.getChannels(), g_framesPerBuffer, g_numChannels);
+        }
+    }
+}
+
+/* Walks the listener around the world, returns the mean time per block in microseconds */
+double walk(std::vector<Emitter>& emitters, VoiceManager* voiceManager, bool printCounts)
+{
+    AudioBuffer buffer(g_numChannels, g_framesPerBuffer);
+    double elapsed = 0.;
+    for(int b=0; b<g_numBlocks; ++b)
+    {
+        const float angle = 2.f * static_cast<float>(Math::M_PI) * b / g_numBlocks;
+        const float listenerX = 0.3f * g_worldSize * std::cos(angle);
+        const float listenerY = 0.3f * g_worldSize * std::sin(angle);
+
+        auto start = std::chrono::steady_clock::now();
+        processBlock(emitters, voiceManager, buffer, listenerX, listenerY);
+        elapsed += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+        if(printCounts && voiceManager && b % (g_numBlocks / 5) == 0)
+        {
+            printf("block %4i: ", b);
+            voiceManager->printStats();
+        }
+    }
+    return elapsed / g_numBlocks;
+}
+
+/*
+    Max difference between a voice virtualised for a while and a reference voice always mixed. A rampPitch > 0 ramps
+    the pitch of both while the voice is virtual, the ramp ending in the middle of a block.
+*/
+float checkSampleAccuracy(float pitch, float rampPitch = 0.f)
+{
+    std::vector<float> data = makeSine(331.f, 0.37f);
+    Sound managed(1);
+    managed.load(data.data(), static_cast<int>(data.size()));
+    managed.setLoop(true);
+    managed.setPitch(pitch);
+    managed.play();
+    Sound reference(managed);
+
+    VoiceManager voiceManager(1, 1);
+    voiceManager.addVoice(&managed);
+
+    AudioBuffer managedBuffer(g_numChannels, g_framesPerBuffer);
+    AudioBuffer referenceBuffer(g_numChannels, g_framesPerBuffer);
+    float maxDifference = 0.f;
+    for(int b=0; b<200; ++b)
+    {
+        // out of range for a while, then back
+        voiceManager.setAttenuation(0, b >= 50 && b < 130 ? 0.f : 1.f);
+        voiceManager.update();
+        if(b == 60 && rampPitch > 0.f)
+        {
+            managed.setPitch(rampPitch, 700);
+            reference.setPitch(rampPitch, 700);
+        }
+
+        managedBuffer.clear(g_framesPerBuffer);
+        referenceBuffer.clear(g_framesPerBuffer);
+        voiceManager.execute(managedBuffer.getChannels(), g_framesPerBuffer, g_numChannels);
+        reference.executePlanar(referenceBuffer.getChannels(), g_framesPerBuffer, g_numChannels);
+
+        if(voiceManager.isReal(0))
+        {
+            for(int c=0; c<g_numChannels; ++c)
+            {
+                for(unsigned long i=0; i<g_framesPerBuffer; ++i)
+                {
+                    maxDifference = std::max(maxDifference, std::abs(managedBuffer.getChannel(c)[i] - referenceBuffer.getChannel(c)[i]));
+                }
+            }
+        }
+    }
+    return maxDifference;
+}
+
+/* Playhead distance between a sound skipping numFrames and the same sound mixing them, from a pitch ramp */
+double checkSkip(float targetPitch, int rampSamples, unsigned long numFrames)
+{
+    std::vector<float> data = makeSine(331.f, 1.f);
+    Sound skipped(1);
+    skipped.load(data.data(), static_cast<int>(data.size()));
+    skipped.play();
+    skipped.setPitch(targetPitch, rampSamples);
+    Sound mixed(skipped);
+
+    AudioBuffer buffer(g_numChannels, numFrames);
+    buffer.clear(numFrames);
+    mixed.executePlanar(buffer.getChannels(), numFrames, g_numChannels);
+    skipped.skip(numFrames);
+
+    return std::abs(skipped.getPosition() - mixed.getPosition());
+}
+
+int main(int argc, char* argv[])
+{
+    printf("Example voices...\n");
+
+    std::vector<std::vector<float>> sources;
+    for(int s=0; s<16; ++s)
+    {
+        sources.push_back(makeSine(110.f * (1 + s % 8), 0.5f + 0.05f * s));
+    }
+
+    std::vector<Emitter> emitters(g_numEmitters);
+    VoiceManager voiceManager(g_numEmitters, g_maxNumRealVoices);
+    voiceManager.setMaskingRatio(0.05f); // 26 dB below the loudest voice
+    for(int e=0; e<g_numEmitters; ++e)
+    {
+        Emitter& emitter = emitters[e];
+        emitter.m_x = RandomUtils::g_random.getRandRealInRange(-0.5f, 0.5f) * g_worldSize;
+        emitter.m_y = RandomUtils::g_random.getRandRealInRange(-0.5f, 0.5f) * g_worldSize;
+        emitter.m_sound = std::make_unique<Sound>(e + 1);
+
+        std::vector<float>& source = sources[e % sources.size()];
+        emitter.m_sound->load(source.data(), static_cast<int>(source.size()));
+        emitter.m_sound->setLoop(true);
+        emitter.m_sound->play();
+        voiceManager.addVoice(emitter.m_sound.get());
+    }
+
+    const double blockMicroseconds = 1e6 * g_framesPerBuffer / g_sampleRate;
+    printf("%i emitters, %i real voices at most, %lu frames per buffer (%.0f us)\n", g_numEmitters, g_maxNumRealVoices,
+            g_framesPerBuffer, blockMicroseconds);
+
+    // 1. cost
+    double allVoicesMicroseconds = walk(emitters, nullptr, false);
+    double managedMicroseconds = walk(emitters, &voiceManager, false);
+    printf("\n1. Cost per block: every voice mixed %.1f us (%.1f%% of the block), voice manager %.1f us (%.1f%%), %.1fx\n",
+            allVoicesMicroseconds, 100. * allVoicesMicroseconds / blockMicroseconds, managedMicroseconds,
+            100. * managedMicroseconds / blockMicroseconds, allVoicesMicroseconds / managedMicroseconds);
+
+    // 2. virtualisation
+    printf("\n2. Voice counts along the walk\n");
+    walk(emitters, &voiceManager, true);
+
+    // 3. sample accuracy
+    const float constantDifference = checkSampleAccuracy(1.f);
+    const float pitchedDifference = checkSampleAccuracy(1.5f);
+    const float rampDifference = checkSampleAccuracy(1.f, 1.7f);
+    printf("\n3. Sample accuracy after promotion: max difference %g at pitch 1, %g at pitch 1.5, %g with a pitch ramp\n",
+            constantDifference, pitchedDifference, rampDifference);
+    check(constantDifference < 1e-4f && pitchedDifference < 1e-4f, "promoted voice matches the mixed one");
+    check(rampDifference < 1e-4f, "promoted voice matches the mixed one after a pitch ramp while virtual");
+
+    const double shortRampDistance = checkSkip(2.f, 10, 512);
+    const double longRampDistance = checkSkip(0.5f, 2000, 512);
+    const double endingRampDistance = checkSkip(1.5f, 300, 1024);
+    printf("Skip against mix, playhead distance: %g (ramp 1 to 2 over 10 frames, 512 skipped), %g (1 to 0.5 over 2000, 512), %g (1 to 1.5 over 300, 1024)\n",
+            shortRampDistance, longRampDistance, endingRampDistance);
+    check(shortRampDistance < 1e-2 && longRampDistance < 1e-2 && endingRampDistance < 1e-2, "skip moves the playhead as far as mixing under a pitch ramp");
+
+    return ExampleChecks::getExitCode();
+}
@@ -0,0 +1,407 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define AUDIO_BUFFER_SSE
+#endif
+
+/*
+    AudioBuffer
+    Planar multichannel buffer: each channel is a contiguous run of samples starting on a 64-byte boundary (cache
+    line and widest SIMD register), so that per channel loops are unit stride and vectorise.
+    The engine mixes in planar buffers and only interleaves once, when writing to the ring buffer or the device.
+*/
+class AudioBuffer
+{
+public:
+    static const size_t Alignment = 64;
+
+    AudioBuffer(int numChannels, unsigned long maxFrames):
+        m_numChannels(numChannels),
+        m_maxFrames(maxFrames),
+        m_stride(getStride(maxFrames)),
+        m_data(nullptr),
+        m_channels(nullptr)
+    {
+        m_data = static_cast<float*>(::operator new(m_stride * numChannels * sizeof(float), std::align_val_t(Alignment)));
+        m_channels = new float*[numChannels];
+        for(int c=0; c<numChannels; ++c)
+        {
+            m_channels[c] = m_data + c * m_stride;
+        }
+        memset(m_data, 0, m_stride * numChannels * sizeof(float));
+    }
+
+    virtual ~AudioBuffer()
+    {
+        if(m_data)
+        {
+            ::operator delete(m_data, std::align_val_t(Alignment));
+        }
+        delete[] m_channels;
+    }
+
+    // Deleting copies as they may cause shallow copies, moves transfer the buffer
+    AudioBuffer(const AudioBuffer&) = delete;
+    AudioBuffer& operator=(const AudioBuffer&) = delete;
+
+    AudioBuffer(AudioBuffer&& other):
+        m_numChannels(other.m_numChannels),
+        m_maxFrames(other.m_maxFrames),
+        m_stride(other.m_stride),
+        m_data(other.m_data),
+        m_channels(other.m_channels)
+    {
+        other.m_data = nullptr;
+        other.m_channels = nullptr;
+    }
+
+    AudioBuffer& operator=(AudioBuffer&& other) = delete;
+
+    float* getChannel(int channel)
+    {
+        return m_channels[channel];
+    }
+
+    const float* getChannel(int channel) const
+    {
+        return m_channels[channel];
+    }
+
+    /* Channel pointers, as taken by the planar execute functions */
+    float* const* getChannels()
+    {
+        return m_channels;
+    }
+
+    const float* const* getChannels() const
+    {
+        return m_channels;
+    }
+
+    void clear(unsigned long numFrames)
+    {
+        numFrames = std::min(numFrames, m_maxFrames);
+        for(int c=0; c<m_numChannels; ++c)
+        {
+            memset(m_channels[c], 0, numFrames * sizeof(float));
+        }
+    }
+
+    int getNumChannels() const
+    {
+        return m_numChannels;
+    }
+
+    unsigned long getMaxFrames() const
+    {
+        return m_maxFrames;
+    }
+
+    /* Frames between the start of two channels, rounded up so that every channel is aligned */
+    static unsigned long getStride(unsigned long maxFrames)
+    {
+        const unsigned long alignFrames = Alignment / sizeof(float);
+        return (maxFrames + alignFrames - 1) / alignFrames * alignFrames;
+    }
+
+private:
+    int m_numChannels;
+    unsigned long m_maxFrames;
+    unsigned long m_stride;
+    float* m_data;
+    float** m_channels;
+};
+
+/*
+    Channel kernels and conversions between planar and interleaved buffers.
+    The kernels are written with SSE as -O2 does not vectorise loops of unknown length. Their vector loops are bounded
+    by the whole vectors (numFrames & ~3) as GCC 12 wrongly warns on the scalar tail with i + 4 <= numFrames.
+    Channels are interleaved by groups of four (4x4 transposes), then pairs (unpacks), four frames at a time.
+*/
+namespace AudioBufferUtils
+{
+    /* output += input * gain */
+    inline void addScaled(float* output, const float* input, float gain, unsigned long numFrames)
+    {
+        unsigned long i = 0;
+#ifdef AUDIO_BUFFER_SSE
+        const __m128 gains = _mm_set1_ps(gain);
+        const unsigned long numVectorFrames = numFrames & ~3ul;
+        for(; i < numVectorFrames; i += 4)
+        {
+            _mm_storeu_ps(output + i, _mm_add_ps(_mm_loadu_ps(output + i), _mm_mul_ps(_mm_loadu_ps(input + i), gains)));
+        }
+#endif
+        for(; i < numFrames; ++i)
+        {
+            output[i] += input[i] * gain;
+        }
+    }
+
+    /* output = input * gain */
+    inline void copyScaled(float* output, const float* input, float gain, unsigned long numFrames)
+    {
+        unsigned long i = 0;
+#ifdef AUDIO_BUFFER_SSE
+        const __m128 gains = _mm_set1_ps(gain);
+        const unsigned long numVectorFrames = numFrames & ~3ul;
+        for(; i < numVectorFrames; i += 4)
+        {
+            _mm_storeu_ps(output + i, _mm_mul_ps(_mm_loadu_ps(input + i), gains));
+        }
+#endif
+        for(; i < numFrames; ++i)
+        {
+            output[i] = input[i] * gain;
+        }
+    }
+
+    /* output = input0 * gain0 + input1 * gain1, in one pass over the output */
+    inline void mixScaled(float* output, const float* input0, float gain0, const float* input1, float gain1, unsigned long numFrames)
+    {
+        unsigned long i = 0;
+#ifdef AUDIO_BUFFER_SSE
+        const __m128 gains0 = _mm_set1_ps(gain0);
+        const __m128 gains1 = _mm_set1_ps(gain1);
+        const unsigned long numVectorFrames = numFrames & ~3ul;
+        for(; i < numVectorFrames; i += 4)
+        {
+            const __m128 mixed = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(input0 + i), gains0), _mm_mul_ps(_mm_loadu_ps(input1 + i), gains1));
+            _mm_storeu_ps(output + i, mixed);
+        }
+#endif
+        for(; i < numFrames; ++i)
+        {
+            output[i] = input0[i] * gain0 + input1[i] * gain1;
+        }
+    }
+
+    /* output = input0 * gain0 + input1 * gain1 + input2 * gain2, in one pass over the output */
+    inline void mixScaled(float* output, const float* input0, float gain0, const float* input1, float gain1, const float* input2, float gain2, unsigned long numFrames)
+    {
+        unsigned long i = 0;
+#ifdef AUDIO_BUFFER_SSE
+        const __m128 gains0 = _mm_set1_ps(gain0);
+        const __m128 gains1 = _mm_set1_ps(gain1);
+        const __m128 gains2 = _mm_set1_ps(gain2);
+        const unsigned long numVectorFrames = numFrames & ~3ul;
+        for(; i < numVectorFrames; i += 4)
+        {
+            const __m128 mixed = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(input0 + i), gains0), _mm_mul_ps(_mm_loadu_ps(input1 + i), gains1));
+            _mm_storeu_ps(output + i, _mm_add_ps(mixed, _mm_mul_ps(_mm_loadu_ps(input2 + i), gains2)));
+        }
+#endif
+        for(; i < numFrames; ++i)
+        {
+            output[i] = input0[i] * gain0 + input1[i] * gain1 + input2[i] * gain2;
+        }
+    }
+
+    /* output += input * (startGain + gainStep * i), a linear gain ramp */
+    inline void addRamped(float* output, const float* input, float startGain, float gainStep, unsigned long numFrames)
+    {
+        unsigned long i = 0;
+#ifdef AUDIO_BUFFER_SSE
+        __m128 gains = _mm_add_ps(_mm_set1_ps(startGain), _mm_mul_ps(_mm_set1_ps(gainStep), _mm_setr_ps(0.f, 1.f, 2.f, 3.f)));
+        const __m128 steps = _mm_set1_ps(4.f * gainStep);
+        const unsigned long numVectorFrames = numFrames & ~3ul;
+        for(; i < numVectorFrames; i += 4)
+        {
+            _mm_storeu_ps(output + i, _mm_add_ps(_mm_loadu_ps(output + i), _mm_mul_ps(_mm_loadu_ps(input + i), gains)));
+            gains = _mm_add_ps(gains, steps);
+        }
+#endif
+        for(; i < numFrames; ++i)
+        {
+            output[i] += input[i] * (startGain + gainStep * i);
+        }
+    }
+
+    /* output[2i] += input[i] * (startLeft + leftStep * i), output[2i + 1] likewise: a mono input panned into an
+       interleaved stereo output with linear gain ramps (constant with zero steps) */
+    inline void addRampedStereo(float* output, const float* input, float startLeft, float leftStep, float startRight, float rightStep, unsigned long numFrames)
+    {
+        unsigned long i = 0;
+#ifdef AUDIO_BUFFER_SSE
+        const __m128 offsets = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+        __m128 lefts = _mm_add_ps(_mm_set1_ps(startLeft), _mm_mul_ps(_mm_set1_ps(leftStep), offsets));
+        __m128 rights = _mm_add_ps(_mm_set1_ps(startRight), _mm_mul_ps(_mm_set1_ps(rightStep), offsets));
+        const __m128 leftSteps = _mm_set1_ps(4.f * leftStep);
+        const __m128 rightSteps = _mm_set1_ps(4.f * rightStep);
+        const unsigned long numVectorFrames = numFrames & ~3ul;
+        for(; i < numVectorFrames; i += 4)
+        {
+            const __m128 samples = _mm_loadu_ps(input + i);
+            const __m128 left = _mm_mul_ps(samples, lefts);
+            const __m128 right = _mm_mul_ps(samples, rights);
+            float* frames = output + 2 * i;
+            _mm_storeu_ps(frames, _mm_add_ps(_mm_loadu_ps(frames), _mm_unpacklo_ps(left, right))); // l0 r0 l1 r1
+            _mm_storeu_ps(frames + 4, _mm_add_ps(_mm_loadu_ps(frames + 4), _mm_unpackhi_ps(left, right))); // l2 r2 l3 r3
+            lefts = _mm_add_ps(lefts, leftSteps);
+            rights = _mm_add_ps(rights, rightSteps);
+        }
+#endif
+        for(; i < numFrames; ++i)
+        {
+            output[2 * i] += input[i] * (startLeft + leftStep * i);
+            output[2 * i + 1] += input[i] * (startRight + rightStep * i);
+        }
+    }
+
+    /* output[i] = start + input[0] + ... + input[i - 1], for i in [0, numFrames] (numFrames + 1 values) */
+    inline void runningSum(float* output, const float* input, float start, unsigned long numFrames)
+    {
+        output[0] = start;
+        unsigned long i = 0;
+#ifdef AUDIO_BUFFER_SSE
+        // sums within the 4 lanes by two shifted adds, then carried over from the last lane
+        __m128 sums = _mm_set1_ps(start);
+        const unsigned long numVectorFrames = numFrames & ~3ul;
+        for(; i < numVectorFrames; i += 4)
+        {
+            __m128 values = _mm_loadu_ps(input + i);
+            values = _mm_add_ps(values, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(values), 4)));
+            values = _mm_add_ps(values, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(values), 8)));
+            sums = _mm_add_ps(sums, values);
+            _mm_storeu_ps(output + i + 1, sums);
+            sums = _mm_shuffle_ps(sums, sums, _MM_SHUFFLE(3, 3, 3, 3));
+        }
+#endif
+        for(; i < numFrames; ++i)
+        {
+            output[i + 1] = output[i] + input[i];
+        }
+    }
+
+    /* output[i] = input at the fractional position offsets[i], linearly interpolated. input[offsets[i] + 1] must be valid. */
+    inline void interpolate(float* output, const float* input, const float* offsets, unsigned long numFrames)
+    {
+        unsigned long i = 0;
+#ifdef AUDIO_BUFFER_SSE
+        const unsigned long numVectorFrames = numFrames & ~3ul;
+        for(; i < numVectorFrames; i += 4)
+        {
+            const __m128 positions = _mm_loadu_ps(offsets + i);
+            const __m128i indices = _mm_cvttps_epi32(positions);
+            const __m128 fractions = _mm_sub_ps(positions, _mm_cvtepi32_ps(indices));
+
+            alignas(16) int index[4];
+            _mm_store_si128((__m128i*)index, indices);
+            const __m128 samples1 = _mm_setr_ps(input[index[0]], input[index[1]], input[index[2]], input[index[3]]);
+            const __m128 samples2 = _mm_setr_ps(input[index[0] + 1], input[index[1] + 1], input[index[2] + 1], input[index[3] + 1]);
+            _mm_storeu_ps(output + i, _mm_add_ps(samples1, _mm_mul_ps(fractions, _mm_sub_ps(samples2, samples1))));
+        }
+#endif
+        for(; i < numFrames; ++i)
+        {
+            const int index = static_cast<int>(offsets[i]);
+            const float fraction = offsets[i] - index;
+            output[i] = input[index] + fraction * (input[index + 1] - input[index]);
+        }
+    }
+
+    /* buffer *= gains, per frame gains */
+    inline void multiply(float* buffer, const float* gains, unsigned long numFrames)
+    {
+        unsigned long i = 0;
+#ifdef AUDIO_BUFFER_SSE
+        const unsigned long numVectorFrames = numFrames & ~3ul;
+        for(; i < numVectorFrames; i += 4)
+        {
+            _mm_storeu_ps(buffer + i, _mm_mul_ps(_mm_loadu_ps(buffer + i), _mm_loadu_ps(gains + i)));
+        }
+#endif
+        for(; i < numFrames; ++i)
+        {
+            buffer[i] *= gains[i];
+        }
+    }
+
+    /* buffer *= gain */
+    inline void scale(float* buffer, float gain, unsigned long numFrames)
+    {
+        unsigned long i = 0;
+#ifdef AUDIO_BUFFER_SSE
+        const __m128 gains = _mm_set1_ps(gain);
+        const unsigned long numVectorFrames = numFrames & ~3ul;
+        for(; i < numVectorFrames; i += 4)
+        {
+            _mm_storeu_ps(buffer + i, _mm_mul_ps(_mm_loadu_ps(buffer + i), gains));
+        }
+#endif
+        for(; i < numFrames; ++i)
+        {
+            buffer[i] *= gain;
+        }
+    }
+
+    inline void interleave(const float* const* channels, int numChannels, unsigned long numFrames, float* output)
+    {
+        unsigned long i = 0;
+
+#ifdef AUDIO_BUFFER_SSE
+        const unsigned long numVectorFrames = numFrames & ~3ul;
+        for(; i < numVectorFrames; i += 4)
+        {
+            float* frames = output + i * numChannels;
+            int c = 0;
+            for(; c + 4 <= numChannels; c += 4)
+            {
+                __m128 row0 = _mm_loadu_ps(channels[c] + i);
+                __m128 row1 = _mm_loadu_ps(channels[c + 1] + i);
+                __m128 row2 = _mm_loadu_ps(channels[c + 2] + i);
+                __m128 row3 = _mm_loadu_ps(channels[c + 3] + i);
+                _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+                _mm_storeu_ps(frames + c, row0);
+                _mm_storeu_ps(frames + numChannels + c, row1);
+                _mm_storeu_ps(frames + 2 * numChannels + c, row2);
+                _mm_storeu_ps(frames + 3 * numChannels + c, row3);
+            }
+            for(; c + 2 <= numChannels; c += 2)
+            {
+                __m128 left = _mm_loadu_ps(channels[c] + i);
+                __m128 right = _mm_loadu_ps(channels[c + 1] + i);
+                __m128 low = _mm_unpacklo_ps(left, right); // l0 r0 l1 r1
+                __m128 high = _mm_unpackhi_ps(left, right); // l2 r2 l3 r3
+                _mm_storel_pi((__m64*)(frames + c), low);
+                _mm_storeh_pi((__m64*)(frames + numChannels + c), low);
+                _mm_storel_pi((__m64*)(frames + 2 * numChannels + c), high);
+                _mm_storeh_pi((__m64*)(frames + 3 * numChannels + c), high);
+            }
+            for(; c < numChannels; ++c)
+            {
+                for(int j=0; j<4; ++j)
+                {
+                    frames[j * numChannels + c] = channels[c][i + j];
+                }
+            }
+        }
+#endif
+
+        for(; i < numFrames; ++i)
+        {
+            for(int c=0; c<numChannels; ++c)
+            {
+                output[i * numChannels + c] = channels[c][i];
+            }
+        }
+    }
+
+    inline void deinterleave(const float* input, int numChannels, unsigned long numFrames, float* const* channels)
+    {
+        for(int c=0; c<numChannels; ++c)
+        {
+            float* channel = channels[c];
+            for(unsigned long i=0; i<numFrames; ++i)
+            {
+                channel[i] = input[i * numChannels + c];
+            }
+        }
+    }
+}
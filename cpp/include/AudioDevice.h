@@ -1,38 +1,53 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstring>
 #include <iostream>
+#include <random>
 #include <thread>
 
+#include "SampleFormat.h"
+
 /*
     AudioDevice.
 
     Interface used to replace an actual audio device.
     Does not provide any actual functionality. It's simply an abstraction of an audio device.
+    For testing it calls back at the actual buffer period, optionally with jitter and stalls, and checks the delivered
+    audio for gaps, so that latency and underrun handling can be tested without any sound card.
 */
 class AudioDevice
 {
 public:
     // Typedef for the callback function type
-    typedef void (*CallbackFunc)(float*, int, int, void*);
+    typedef void (*CallbackFunc)(void*, int, int, void*);
 
     /*
         We provide to the audio device sample rate, number of channles, number of samples per channel (i.e. number of frames), 
-        a callback function used to fill the audio device buffer whenever data is needed.
+        a callback function used to fill the audio device buffer whenever data is needed, and the format of the
+        samples in that buffer.
 
         !The total number of samples would be given by: numChannels * numFrames
         As an audio frame consists of a sample from each channel at the same point in time.
     */
-    AudioDevice(double sampleRate, int numChannels, int numFrames, CallbackFunc callback, void* cookie):
+    AudioDevice(double sampleRate, int numChannels, int numFrames, CallbackFunc callback, void* cookie,
+                SampleFormat format = SampleFormat::FLOAT32):
         m_sampleRate(sampleRate),
         m_numChannels(numChannels),
         m_numFrames(numFrames),
+        m_format(format),
         m_callback(callback),
-        m_cookie(cookie)
+        m_cookie(cookie),
+        m_generator(0)
     {
         // Initialize the buffer to hold the total number of samples
-        m_buffer = (float*) malloc(numChannels * numFrames * sizeof(float));
-        memset(m_buffer, 0.f, numChannels * numFrames * sizeof(float));
+        const size_t bytes = getBufferBytes();
+        m_buffer = (char*) malloc(bytes);
+        memset(m_buffer, 0, bytes);
+        m_previousBuffer = (char*) malloc(bytes);
+        memset(m_previousBuffer, 0, bytes);
     }
 
     // Destructor to free the allocated buffer
@@ -41,6 +56,10 @@ public:
         {
             free(m_buffer);
         }
+        if(m_previousBuffer)
+        {
+            free(m_previousBuffer);
+        }
     }
 
     // Deleting other special member functions as they may cause shallow copies or dangling pointers
@@ -50,36 +69,176 @@ public:
     AudioDevice& operator=(AudioDevice&& other) = delete;
 
     //========================= TESTING PURPOSES ONLY ==========================//
+    // Statistics of the last call to process, to be read once process returned
+    struct Stats
+    {
+        unsigned long m_numCallbacks = 0;
+        unsigned long m_numLateCallbacks = 0; // called more than a buffer period late, an actual device would have glitched
+        float m_maxLatenessMicroseconds = 0.f; // relative to the buffer period schedule
+        unsigned long m_numSilentBlocks = 0; // silent blocks once audio started (dropouts)
+        unsigned long m_numRepeatedBlocks = 0; // blocks identical to the previous one (stale data)
+        unsigned long m_numDiscontinuities = 0; // jumps larger than the threshold between consecutive blocks
+    };
+
+    // Add a random delay in [0, maxMicroseconds] to every callback, as the scheduling of an actual device thread
+    void setJitter(float maxMicroseconds)
+    {
+        m_jitterMicroseconds = std::max(0.f, maxMicroseconds);
+    }
+
+    // Delay a callback by durationMicroseconds with the given probability, e.g. the system being busy.
+    // The following callbacks catch up with the schedule, as the device drains its own buffers.
+    void setStalls(float probability, float durationMicroseconds)
+    {
+        m_stallProbability = std::clamp(probability, 0.f, 1.f);
+        m_stallMicroseconds = std::max(0.f, durationMicroseconds);
+    }
+
+    // Largest sample step expected at block boundaries for the signal under test, 0 to disable the check.
+    // e.g. a sine of amplitude a and frequency f steps by at most 2 * pi * f * a / sampleRate
+    void setDiscontinuityThreshold(float threshold)
+    {
+        m_discontinuityThreshold = threshold;
+    }
+
+    // Seed of the jitter and stall generator, so that runs can be reproduced
+    void setSeed(unsigned int seed)
+    {
+        m_generator.seed(seed);
+    }
+
     // helper function to simulate calls to the callback function
-    // in an audio device this is typically called by the audio processing thread whenever the audio buffer needs to be filled with more data 
+    // in an audio device this is typically called by the audio processing thread whenever the audio buffer needs to be filled with more data.
+    // The callback is called every buffer period (numFrames / sampleRate) against a steady clock, so that latencies and
+    // deadlines measured against this mock device are close to the ones of an actual device.
+    // The delivered audio is checked for gaps, see Stats.
     void process(float durationSeconds)
     {
-        float elapsedTime = 0.f;
-        while(elapsedTime < durationSeconds)
+        typedef std::chrono::steady_clock Clock;
+
+        m_stats = Stats();
+        m_audioStarted = false;
+        std::uniform_real_distribution<float> distribution(0.f, 1.f);
+
+        const auto period = std::chrono::duration<double>(m_numFrames / m_sampleRate);
+        const auto startTime = Clock::now();
+        const auto endTime = startTime + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(durationSeconds));
+        auto nextTime = startTime;
+        while(nextTime < endTime)
         {
-            auto loopStartTime = std::chrono::high_resolution_clock::now(); // Get loop start time
+            float delayMicroseconds = m_jitterMicroseconds * distribution(m_generator);
+            if(m_stallProbability > 0.f && distribution(m_generator) < m_stallProbability)
+            {
+                delayMicroseconds += m_stallMicroseconds;
+            }
+            std::this_thread::sleep_until(nextTime + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float, std::micro>(delayMicroseconds)));
+
+            float latenessMicroseconds = std::chrono::duration<float, std::micro>(Clock::now() - nextTime).count();
+            m_stats.m_maxLatenessMicroseconds = std::max(m_stats.m_maxLatenessMicroseconds, latenessMicroseconds);
+            if(latenessMicroseconds > std::chrono::duration<float, std::micro>(period).count())
+            {
+                ++m_stats.m_numLateCallbacks;
+            }
 
-            // callback
             if (m_callback) 
             {
-                m_callback(m_buffer, m_numFrames, m_numChannels, m_cookie);
+                m_callback(m_buffer, m_numChannels, m_numFrames, m_cookie);
             }
+            ++m_stats.m_numCallbacks;
+            verify();
 
-            // arbitrary time 
-            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            nextTime += std::chrono::duration_cast<Clock::duration>(period);
+        }
+    }
 
-            auto loopEndTime = std::chrono::high_resolution_clock::now(); // Get loop end time
+    const Stats& getStats() const
+    {
+        return m_stats;
+    }
 
-            elapsedTime += std::chrono::duration<float>(loopEndTime - loopStartTime).count();
-        }
+    SampleFormat getFormat() const
+    {
+        return m_format;
+    }
+
+    void printStats() const
+    {
+        printf("Device: %lu callbacks, %lu late (max %.0f us), %lu silent blocks, %lu repeated blocks, %lu discontinuities\n",
+                m_stats.m_numCallbacks, m_stats.m_numLateCallbacks, m_stats.m_maxLatenessMicroseconds, m_stats.m_numSilentBlocks,
+                m_stats.m_numRepeatedBlocks, m_stats.m_numDiscontinuities);
     }
     //=======================================================================//
 
 private:
+    // checks the block just delivered against the previous one
+    void verify()
+    {
+        const int numSamples = m_numChannels * m_numFrames;
+        const size_t bytes = getBufferBytes();
+
+        // zero bytes are silence in every format
+        bool silent = true;
+        for(size_t i=0; i<bytes && silent; ++i)
+        {
+            silent = m_buffer[i] == 0;
+        }
+
+        if(silent)
+        {
+            if(m_audioStarted)
+            {
+                ++m_stats.m_numSilentBlocks;
+            }
+        }
+        else
+        {
+            if(m_audioStarted)
+            {
+                if(memcmp(m_buffer, m_previousBuffer, bytes) == 0)
+                {
+                    ++m_stats.m_numRepeatedBlocks;
+                }
+                else if(m_discontinuityThreshold > 0.f)
+                {
+                    // first frame of this block against the last frame of the previous one
+                    for(int c=0; c<m_numChannels; ++c)
+                    {
+                        const float first = SampleFormatUtils::readSample(m_buffer, m_format, c);
+                        const float last = SampleFormatUtils::readSample(m_previousBuffer, m_format, numSamples - m_numChannels + c);
+                        if(std::abs(first - last) > m_discontinuityThreshold)
+                        {
+                            ++m_stats.m_numDiscontinuities;
+                            break;
+                        }
+                    }
+                }
+            }
+            m_audioStarted = true;
+        }
+
+        memcpy(m_previousBuffer, m_buffer, bytes);
+    }
+
+    size_t getBufferBytes() const
+    {
+        return static_cast<size_t>(m_numChannels) * m_numFrames * SampleFormatUtils::getSampleBytes(m_format);
+    }
+
     double m_sampleRate;
     int m_numChannels;
     int m_numFrames;
+    SampleFormat m_format;
     CallbackFunc m_callback;
     void* m_cookie; // user data
-    float* m_buffer; // buffer to hold audio samples
+    char* m_buffer; // buffer to hold audio samples, in m_format
+
+    // fault injection and verification
+    float m_jitterMicroseconds = 0.f;
+    float m_stallProbability = 0.f;
+    float m_stallMicroseconds = 0.f;
+    float m_discontinuityThreshold = 0.f;
+    std::mt19937 m_generator;
+    char* m_previousBuffer; // last delivered block
+    bool m_audioStarted = false;
+    Stats m_stats;
 };
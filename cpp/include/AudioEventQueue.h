@@ -0,0 +1,188 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/*
+    AudioEvent
+    A notification from the audio thread to the game thread.
+*/
+struct AudioEvent
+{
+    enum class Type : uint8_t
+    {
+        FINISHED, // the source reached its end and stopped
+        LOOPED, // the source wrapped around to its start
+        STOLEN, // the voice was stopped to play another source
+        MARKER, // the playhead passed a marker, m_value is the marker index
+        XRUN // m_value is XrunUnderrun (the device played silence) or XrunDeadlineMiss (a block rendered late)
+    };
+
+    static const int XrunUnderrun = 0;
+    static const int XrunDeadlineMiss = 1;
+
+    Type m_type = Type::FINISHED;
+    int m_value = 0;
+    unsigned long m_source = 0; // e.g. the sound or voice id, 0 for XRUN
+    uint32_t m_count = 0; // occurrences coalesced into this event
+    uint64_t m_sampleTime = 0; // sample time of the block of the last occurrence
+
+    bool isSame(Type type, unsigned long source, int value) const
+    {
+        return m_type == type && m_source == source && m_value == value;
+    }
+};
+
+/*
+    AudioEventQueue
+    Return channel from the audio thread to the game thread: voice lifecycle and engine notifications.
+    Single-producer single-consumer model, fixed capacity, never allocates after construction.
+
+    The audio thread posts events while it renders a block, into a pending list only it reads, and flushes them at
+    the end of the block with one publish. The game thread drains the published events once per frame, with one
+    release of their slots.
+    Coalescing: an event identical (type, source, value) to a pending one increments its count instead of taking a
+    slot. Events pend while the queue is full, so a game thread falling behind gets, once it drains again, one event
+    per distinct notification with the number of occurrences (e.g. a voice looped 12 times, 3 underruns) rather than
+    an unbounded backlog. An event which neither fits nor coalesces is dropped and counted.
+*/
+class AudioEventQueue
+{
+public:
+    explicit AudioEventQueue(int capacity = 256):
+        m_events(std::max(1, capacity)),
+        m_pending(std::max(1, capacity)),
+        m_numPending(0),
+        m_write(0),
+        m_sampleTime(0),
+        m_numPosted(0),
+        m_read(0),
+        m_numEvents(0),
+        m_numCoalesced(0),
+        m_numDropped(0)
+    {
+
+    }
+
+    // Deleting other special member functions as they may cause shallow copies or dangling pointers
+    AudioEventQueue(const AudioEventQueue&) = delete;
+    AudioEventQueue& operator=(const AudioEventQueue&) = delete;
+    AudioEventQueue(AudioEventQueue&& other) = delete;
+    AudioEventQueue& operator=(AudioEventQueue&& other) = delete;
+
+    /* Audio thread. Sample time stamped on the events posted from now on, e.g. the start of the block */
+    void setSampleTime(uint64_t sampleTime)
+    {
+        m_sampleTime = sampleTime;
+    }
+
+    /* Audio thread. Visible to the game thread after the next flush() */
+    void post(AudioEvent::Type type, unsigned long source, int value = 0, uint32_t count = 1)
+    {
+        ++m_numPosted;
+        for(int i=0; i<m_numPending; ++i)
+        {
+            AudioEvent& event = m_pending[i];
+            if(event.isSame(type, source, value))
+            {
+                event.m_count += count;
+                event.m_sampleTime = m_sampleTime;
+                m_numCoalesced.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        if(m_numPending == static_cast<int>(m_pending.size()))
+        {
+            m_numDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        AudioEvent& event = m_pending[m_numPending++];
+        event.m_type = type;
+        event.m_value = value;
+        event.m_source = source;
+        event.m_count = count;
+        event.m_sampleTime = m_sampleTime;
+    }
+
+    /* Audio thread. Publish the pending events, as many as fit, the others stay pending (and coalesce) */
+    void flush()
+    {
+        if(m_numPending == 0)
+        {
+            return;
+        }
+
+        const int capacity = static_cast<int>(m_events.size());
+        const int numFlushed = std::min(m_numPending, capacity - m_numEvents.load(std::memory_order_acquire));
+        for(int i=0; i<numFlushed; ++i)
+        {
+            m_events[m_write] = m_pending[i];
+            m_write = (m_write + 1) % capacity;
+        }
+
+        std::copy(m_pending.begin() + numFlushed, m_pending.begin() + m_numPending, m_pending.begin());
+        m_numPending -= numFlushed;
+        m_numEvents.fetch_add(numFlushed, std::memory_order_release);
+    }
+
+    /* Game thread. Calls func(const AudioEvent&) on every published event, in order, returns their number */
+    template<typename Func>
+    int drain(Func func)
+    {
+        const int capacity = static_cast<int>(m_events.size());
+        const int numEvents = m_numEvents.load(std::memory_order_acquire);
+        for(int i=0; i<numEvents; ++i)
+        {
+            func(static_cast<const AudioEvent&>(m_events[m_read]));
+            m_read = (m_read + 1) % capacity;
+        }
+
+        if(numEvents > 0)
+        {
+            m_numEvents.fetch_sub(numEvents, std::memory_order_release);
+        }
+        return numEvents;
+    }
+
+    int getCapacity() const
+    {
+        return static_cast<int>(m_events.size());
+    }
+
+    /* Audio thread. Number of events posted, coalesced or not */
+    unsigned long getNumPosted() const
+    {
+        return m_numPosted;
+    }
+
+    /* Thread safe. Events merged into a pending one */
+    unsigned long getNumCoalesced() const
+    {
+        return m_numCoalesced.load(std::memory_order_relaxed);
+    }
+
+    /* Thread safe. Events lost as the pending list was full */
+    unsigned long getNumDropped() const
+    {
+        return m_numDropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<AudioEvent> m_events; // published, ring of the capacity
+
+    // audio thread only
+    std::vector<AudioEvent> m_pending;
+    int m_numPending;
+    int m_write;
+    uint64_t m_sampleTime;
+    unsigned long m_numPosted;
+
+    alignas(64) int m_read; // game thread only
+    alignas(64) std::atomic<int> m_numEvents; // published and not drained yet
+    std::atomic<unsigned long> m_numCoalesced;
+    std::atomic<unsigned long> m_numDropped;
+};
@@ -0,0 +1,356 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "AudioSignalUtils.h"
+#include "BiquadFilter.h"
+#include "Logger.h"
+#include "RingBuffer.h"
+#include "SeqLock.h"
+
+/*
+    Metering and analysis performed outside of the audio thread.
+
+    The audio thread pushes its post-mix blocks into a MeterTap (a copy into a lock-free SPSC ring).
+    A MeterAnalyser thread consumes the blocks of all its taps, computes the meters and publishes a
+    MeterSnapshot per tap which can be read by any thread without locks (e.g. a debug HUD or telemetry).
+    If the analysis falls behind, the tap drops the blocks and counts them: the audio thread never waits.
+*/
+
+/* Meter values published by a MeterTap */
+struct MeterSnapshot
+{
+    static const int MaxChannels = 8;
+    static const int NumBands = 32;
+
+    float m_peak[MaxChannels]; // peak absolute sample value since the previous snapshot
+    float m_rms[MaxChannels]; // RMS since the previous snapshot
+    float m_loudness; // momentary loudness in LUFS (400ms window, K-weighted)
+    float m_spectrum[NumBands]; // magnitude in dB of log-spaced frequency bands
+    float m_bandFrequency[NumBands]; // lower frequency in Hz of each band
+    int m_numChannels;
+    unsigned int m_numBlocks; // total number of analysed blocks
+    unsigned int m_numDroppedBlocks; // total number of blocks dropped because the analysis was behind
+};
+
+/*
+    MeterTap
+    One tap per metered signal (master or bus).
+    push is called from the audio thread, everything else from the analyser thread.
+*/
+class MeterTap
+{
+public:
+    MeterTap(double sampleRate, int numChannels, unsigned long framesPerBuffer, int ringBufferNumFrames = 16):
+        m_sampleRate(sampleRate),
+        m_numChannels(std::min(numChannels, static_cast<int>(MeterSnapshot::MaxChannels))),
+        m_bufferNumChannels(numChannels),
+        m_framesPerBuffer(framesPerBuffer),
+        m_blocks(framesPerBuffer * numChannels, ringBufferNumFrames),
+        m_numDroppedBlocks(0),
+        m_numBlocks(0),
+        m_fftWritePosition(0),
+        m_loudnessBlockIndex(0)
+    {
+        // the ring starts full (see RingBuffer), emptied so that the first blocks pushed are the first analysed
+        for(int i=0; i<ringBufferNumFrames; ++i)
+        {
+            m_blocks.finishRead();
+        }
+
+        memset(&m_pending, 0, sizeof(m_pending));
+        m_pending.m_loudness = -INFINITY;
+        m_pending.m_numChannels = m_numChannels;
+
+        // K-weighting (ITU-R BS.1770): a high shelf followed by a high pass, approximated with cookbook biquads
+        m_kWeighting.resize(m_numChannels * 2);
+        for(int c=0; c<m_numChannels; ++c)
+        {
+            m_kWeighting[c * 2].setCoefficients(Biquad::calculate(Biquad::HIGHSHELF, 1681.97f, 0.7071f, sampleRate, 4.f));
+            m_kWeighting[c * 2 + 1].setCoefficients(Biquad::calculate(Biquad::HIGHPASS, 38.13f, 0.5f, sampleRate));
+        }
+        m_kWeighted.resize(framesPerBuffer);
+
+        // mean square of each block for the 400ms loudness window
+        int loudnessWindowBlocks = std::max(1, static_cast<int>(std::lround(0.4 * sampleRate / framesPerBuffer)));
+        m_loudnessBlocks.assign(loudnessWindowBlocks, 0.);
+
+        // spectrum analysis
+        AudioSignalUtils::Windows::window<float>(FFTSize, AudioSignalUtils::Windows::HANN, m_fftWindow, true);
+        m_fftInput.assign(FFTSize, 0.f);
+        m_fftData.resize(FFTSize);
+        for(int b=0; b<MeterSnapshot::NumBands; ++b)
+        {
+            // bands logarithmically spaced between 20Hz and Nyquist
+            double nyquist = sampleRate * 0.5;
+            m_pending.m_bandFrequency[b] = static_cast<float>(20. * std::pow(nyquist / 20., static_cast<double>(b) / MeterSnapshot::NumBands));
+            m_pending.m_spectrum[b] = -INFINITY;
+        }
+    }
+
+    // Deleting other special member functions as they may cause shallow copies
+    MeterTap(const MeterTap&) = delete;
+    MeterTap& operator=(const MeterTap&) = delete;
+    MeterTap(MeterTap&& other) = delete;
+    MeterTap& operator=(MeterTap&& other) = delete;
+
+    /*
+        Audio thread. Copies an interleaved block of framesPerBuffer frames.
+        Never blocks: the block is dropped if the analyser is behind.
+    */
+    void push(const float* buffer)
+    {
+        if(!m_blocks.canWrite())
+        {
+            m_numDroppedBlocks.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        memcpy(m_blocks.getWriteBuffer(), buffer, m_blocks.m_numSamples * sizeof(float));
+        m_blocks.finishWrite();
+    }
+
+    /* Any thread. Returns false if nothing has been published yet */
+    bool getSnapshot(MeterSnapshot& outSnapshot) const
+    {
+        return m_snapshot.load(outSnapshot) > 0;
+    }
+
+    /* Analyser thread. Analyses the pending blocks and publishes a new snapshot if any. */
+    bool analyse()
+    {
+        if(!m_blocks.canRead())
+        {
+            return false;
+        }
+
+        for(int c=0; c<m_numChannels; ++c)
+        {
+            m_pending.m_peak[c] = 0.f;
+            m_sumSquares[c] = 0.;
+        }
+        unsigned long numFrames = 0;
+
+        while(m_blocks.canRead())
+        {
+            analyseBlock(m_blocks.getReadBuffer());
+            m_blocks.finishRead();
+
+            numFrames += m_framesPerBuffer;
+            ++m_numBlocks;
+        }
+
+        for(int c=0; c<m_numChannels; ++c)
+        {
+            m_pending.m_rms[c] = static_cast<float>(std::sqrt(m_sumSquares[c] / numFrames));
+        }
+
+        updateLoudness();
+        updateSpectrum();
+
+        m_pending.m_numBlocks = m_numBlocks;
+        m_pending.m_numDroppedBlocks = m_numDroppedBlocks.load(std::memory_order_relaxed);
+        m_snapshot.store(m_pending);
+
+        return true;
+    }
+
+private:
+    static const int FFTSize = 2048;
+
+    void analyseBlock(const float* block)
+    {
+        // peak and rms
+        for(unsigned long i=0; i<m_framesPerBuffer; ++i)
+        {
+            const float* frame = block + i * m_bufferNumChannels;
+            for(int c=0; c<m_numChannels; ++c)
+            {
+                float sample = frame[c];
+                m_pending.m_peak[c] = std::max(m_pending.m_peak[c], std::abs(sample));
+                m_sumSquares[c] += static_cast<double>(sample) * sample;
+            }
+        }
+
+        // loudness: mean square of the K-weighted channels summed (all channels weighted 1)
+        double blockMeanSquare = 0.;
+        for(int c=0; c<m_numChannels; ++c)
+        {
+            for(unsigned long i=0; i<m_framesPerBuffer; ++i)
+            {
+                m_kWeighted[i] = block[i * m_bufferNumChannels + c];
+            }
+            m_kWeighting[c * 2].process(m_kWeighted.data(), m_framesPerBuffer);
+            m_kWeighting[c * 2 + 1].process(m_kWeighted.data(), m_framesPerBuffer);
+
+            double sum = 0.;
+            for(unsigned long i=0; i<m_framesPerBuffer; ++i)
+            {
+                sum += static_cast<double>(m_kWeighted[i]) * m_kWeighted[i];
+            }
+            blockMeanSquare += sum / m_framesPerBuffer;
+        }
+        m_loudnessBlocks[m_loudnessBlockIndex] = blockMeanSquare;
+        m_loudnessBlockIndex = (m_loudnessBlockIndex + 1) % m_loudnessBlocks.size();
+
+        // spectrum: keeping the latest FFTSize frames of the mono downmix
+        for(unsigned long i=0; i<m_framesPerBuffer; ++i)
+        {
+            const float* frame = block + i * m_bufferNumChannels;
+            float mono = 0.f;
+            for(int c=0; c<m_numChannels; ++c)
+            {
+                mono += frame[c];
+            }
+            m_fftInput[m_fftWritePosition] = mono / m_numChannels;
+            m_fftWritePosition = (m_fftWritePosition + 1) % FFTSize;
+        }
+    }
+
+    void updateLoudness()
+    {
+        double meanSquare = 0.;
+        for(double blockMeanSquare : m_loudnessBlocks)
+        {
+            meanSquare += blockMeanSquare;
+        }
+        meanSquare /= m_loudnessBlocks.size();
+
+        m_pending.m_loudness = meanSquare > 0. ? static_cast<float>(-0.691 + 10. * std::log10(meanSquare)) : -INFINITY;
+    }
+
+    void updateSpectrum()
+    {
+        for(int i=0; i<FFTSize; ++i)
+        {
+            // oldest sample first
+            int index = (m_fftWritePosition + i) % FFTSize;
+            m_fftData[i] = std::complex<float>(m_fftInput[index] * m_fftWindow[i], 0.f);
+        }
+
+        AudioSignalUtils::fft(m_fftData.data(), FFTSize);
+
+        // the band magnitude is the peak bin magnitude, normalised for a full scale sine
+        const float normalisation = 4.f / FFTSize; // 2/N for the single sided spectrum, x2 for the hann window gain
+        const float binWidth = static_cast<float>(m_sampleRate / FFTSize);
+        for(int b=0; b<MeterSnapshot::NumBands; ++b)
+        {
+            int firstBin = static_cast<int>(m_pending.m_bandFrequency[b] / binWidth);
+            int lastBin = b + 1 < MeterSnapshot::NumBands ? static_cast<int>(m_pending.m_bandFrequency[b + 1] / binWidth) : FFTSize / 2;
+            lastBin = std::max(lastBin, firstBin + 1);
+
+            float magnitude = 0.f;
+            for(int k=firstBin; k<lastBin && k<=FFTSize/2; ++k)
+            {
+                magnitude = std::max(magnitude, std::abs(m_fftData[k]) * normalisation);
+            }
+            m_pending.m_spectrum[b] = magnitude > 0.f ? 20.f * std::log10(magnitude) : -INFINITY;
+        }
+    }
+
+    const double m_sampleRate;
+    const int m_numChannels; // number of metered channels
+    const int m_bufferNumChannels; // number of channels of the pushed buffers
+    const unsigned long m_framesPerBuffer;
+
+    RingBuffer<float> m_blocks; // blocks copied from the audio thread
+    std::atomic<unsigned int> m_numDroppedBlocks;
+
+    SeqLock<MeterSnapshot> m_snapshot;
+
+    /* Analyser thread only */
+    MeterSnapshot m_pending;
+    unsigned int m_numBlocks;
+    double m_sumSquares[MeterSnapshot::MaxChannels];
+    std::vector<BiquadFilter> m_kWeighting; // two filters per channel
+    std::vector<float> m_kWeighted;
+    std::vector<double> m_loudnessBlocks;
+    std::vector<float> m_fftWindow;
+    std::vector<float> m_fftInput;
+    std::vector<std::complex<float>> m_fftData;
+    int m_fftWritePosition;
+    size_t m_loudnessBlockIndex;
+};
+
+/*
+    MeterAnalyser
+    Runs the analysis of a set of taps on its own thread.
+    Taps must be added before starting the analyser and outlive it.
+*/
+class MeterAnalyser
+{
+public:
+    MeterAnalyser(int intervalMilliseconds = 10):
+        m_intervalMilliseconds(intervalMilliseconds),
+        m_runningFlag(false)
+    {
+
+    }
+
+    ~MeterAnalyser()
+    {
+        stop();
+    }
+
+    // Deleting other special member functions as they may cause shallow copies
+    MeterAnalyser(const MeterAnalyser&) = delete;
+    MeterAnalyser& operator=(const MeterAnalyser&) = delete;
+    MeterAnalyser(MeterAnalyser&& other) = delete;
+    MeterAnalyser& operator=(MeterAnalyser&& other) = delete;
+
+    void addTap(MeterTap* tap)
+    {
+        if(m_runningFlag.load())
+        {
+            LM_ERROR("MeterAnalyser: cannot add a tap while running.");
+            return;
+        }
+
+        m_taps.push_back(tap);
+    }
+
+    void start()
+    {
+        if(!m_runningFlag.load())
+        {
+            m_runningFlag.store(true);
+            m_thread = std::thread(&MeterAnalyser::process, this);
+        }
+    }
+
+    void stop()
+    {
+        m_runningFlag.store(false);
+        if(m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+private:
+    void process()
+    {
+        while(m_runningFlag.load())
+        {
+            for(MeterTap* tap : m_taps)
+            {
+                tap->analyse();
+            }
+
+            // polling: the audio thread doesn't signal new blocks to keep its cost to a memcpy
+            std::this_thread::sleep_for(std::chrono::milliseconds(m_intervalMilliseconds));
+        }
+    }
+
+    const int m_intervalMilliseconds;
+    std::vector<MeterTap*> m_taps;
+    std::thread m_thread;
+    std::atomic<bool> m_runningFlag;
+};
@@ -1,47 +1,133 @@
 #pragma once
 
+#include <vector>
+
+#include "AudioBuffer.h"
 #include "AudioFile.h"
+#include "ChannelMatrix.h"
 #include "Transport.h"
 
 /*
     Audio Player
-    A minimal audio player used to load and play some sample data from a file loaded wih AudioFile
+    A minimal audio player used to load and play some sample data from a file loaded wih AudioFile.
+    The file channels are mapped to the output channels with a channel matrix, by default the one matching the channel
+    counts (e.g. a 5.1 file downmixed to stereo, see ChannelMatrix). Output channels beyond the matrix are silent.
+    The file must not be reloaded once the player is created.
 */
 class AudioPlayer : public ITransport
 {
-public:    
-    AudioPlayer(const char* filePath)
+public:
+    AudioPlayer(const char* filePath, int numOutputChannels = 2):
+        m_matrix(load(filePath), numOutputChannels),
+        m_chunk(numOutputChannels, ChunkFrames)
+    {
+        for(const std::vector<float>& channel : file.samples)
+        {
+            m_fileChannels.push_back(channel.data());
+        }
+    }
+
+    /* Replace the channel matrix before playing, it must have the file channels as inputs and numOutputChannels outputs */
+    void setChannelMatrix(const ChannelMatrix& matrix)
+    {
+        if(matrix.getNumInputs() == m_matrix.getNumInputs() && matrix.getNumOutputs() == m_matrix.getNumOutputs())
+        {
+            m_matrix = matrix;
+        }
+    }
+
+    ChannelMatrix& getChannelMatrix()
     {
-        assert(file.load(filePath));
+        return m_matrix;
     }
 
     void execute(float* outputBuffer, unsigned long framesPerBuffer, int numChannels)
     {
-        if(isPlaying())
+        const int numMatrixChannels = std::min(numChannels, m_matrix.getNumOutputs());
+        unsigned long i = 0;
+        while(i < framesPerBuffer && isPlaying())
         {
-            for(unsigned int i=0; i<framesPerBuffer; i++)
+            int spanFrames = 0;
+            int playhead = getAndAdvanceSpan(file.getNumSamplesPerChannel(), static_cast<int>(std::min<unsigned long>(framesPerBuffer - i, ChunkFrames)), spanFrames);
+            if(playhead < 0)
             {
-                int playhead = getAndAdvance(file.getNumSamplesPerChannel());
-                if(playhead < 0)
-                {
-                    break;
-                }
+                break;
+            }
 
-                for(int c=0; c<numChannels; ++c)
+            m_matrix.process(m_fileChannels.data(), playhead, m_chunk.getChannels(), 0, spanFrames);
+            float* output = outputBuffer + i * numChannels;
+            if(numChannels == m_matrix.getNumOutputs())
+            {
+                AudioBufferUtils::interleave(m_chunk.getChannels(), numChannels, spanFrames, output);
+            }
+            else
+            {
+                for(int j=0; j<spanFrames; ++j)
                 {
-                    if(c < file.getNumChannels())
+                    for(int c=0; c<numChannels; ++c)
                     {
-                        *outputBuffer++ = file.samples[c][playhead];
+                        output[j * numChannels + c] = c < numMatrixChannels ? m_chunk.getChannel(c)[j] : 0.f;
                     }
-                    else
+                }
+            }
+            i += spanFrames;
+        }
+    }
+
+    /* Planar version: the matrix writes each output channel in contiguous spans */
+    void executePlanar(float* const* outputChannels, unsigned long framesPerBuffer, int numChannels)
+    {
+        unsigned long i = 0;
+        while(i < framesPerBuffer && isPlaying())
+        {
+            int spanFrames = 0;
+            int playhead = getAndAdvanceSpan(file.getNumSamplesPerChannel(), static_cast<int>(framesPerBuffer - i), spanFrames);
+            if(playhead < 0)
+            {
+                break;
+            }
+
+            if(numChannels >= m_matrix.getNumOutputs())
+            {
+                m_matrix.process(m_fileChannels.data(), playhead, outputChannels, i, spanFrames);
+            }
+            else
+            {
+                // fewer outputs than the matrix: through the chunk buffer
+                for(int offset=0; offset<spanFrames; offset+=ChunkFrames)
+                {
+                    const int numFrames = std::min(spanFrames - offset, ChunkFrames);
+                    m_matrix.process(m_fileChannels.data(), playhead + offset, m_chunk.getChannels(), 0, numFrames);
+                    for(int c=0; c<numChannels; ++c)
                     {
-                        *outputBuffer++ = 0.f;
+                        memcpy(outputChannels[c] + i + offset, m_chunk.getChannel(c), numFrames * sizeof(float));
                     }
                 }
             }
+
+            for(int c=m_matrix.getNumOutputs(); c<numChannels; ++c)
+            {
+                memset(outputChannels[c] + i, 0, spanFrames * sizeof(float));
+            }
+            i += spanFrames;
         }
     }
 
     /* Keep it public to allow access to member functions */
-    AudioFile<float> file; 
-};
\ No newline at end of file
+    AudioFile<float> file;
+
+private:
+    static constexpr int ChunkFrames = 256;
+
+    /* Returns the number of channels of the file */
+    int load(const char* filePath)
+    {
+        bool loaded = file.load(filePath);
+        assert(loaded);
+        return loaded ? file.getNumChannels() : 0;
+    }
+
+    ChannelMatrix m_matrix;
+    AudioBuffer m_chunk; // matrix output before interleaving
+    std::vector<const float*> m_fileChannels;
+};
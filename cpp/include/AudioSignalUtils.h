@@ -1,5 +1,6 @@
 #pragma once
 
+#include <complex>
 #include <vector>
 
 #include "Math.h"
@@ -161,12 +162,53 @@ namespace AudioSignalUtils
                 default:
                     for(int i=0; i<size; ++i)
                     {
-                        *output++ = rectangular<T>(i, size, periodic);
+                        *output++ = rectangular<T>(i, size);
                     }
                     break;
             }
         }
     }
-}
 
+    /*
+        In-place iterative radix-2 FFT (Cooley-Tukey).
+        The size must be a power of two.
+        Reference: https://en.wikipedia.org/wiki/Cooley%E2%80%93Tukey_FFT_algorithm
+    */
+    template<typename T>
+    void fft(std::complex<T>* data, int size)
+    {
+        // bit reversal permutation
+        for(int i=1, j=0; i<size; ++i)
+        {
+            int bit = size >> 1;
+            for(; j & bit; bit >>= 1)
+            {
+                j ^= bit;
+            }
+            j ^= bit;
 
+            if(i < j)
+            {
+                std::swap(data[i], data[j]);
+            }
+        }
+
+        // butterflies
+        for(int length=2; length<=size; length <<= 1)
+        {
+            std::complex<T> step = std::polar<T>(1, static_cast<T>(-2. * Math::M_PI / length));
+            for(int i=0; i<size; i+=length)
+            {
+                std::complex<T> twiddle(1, 0);
+                for(int k=0; k<length/2; ++k)
+                {
+                    std::complex<T> even = data[i + k];
+                    std::complex<T> odd = data[i + k + length/2] * twiddle;
+                    data[i + k] = even + odd;
+                    data[i + k + length/2] = even - odd;
+                    twiddle *= step;
+                }
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,446 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "Math.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define BIQUAD_SSE
+#endif
+
+/*
+    A collection of biquad (second order IIR) filters.
+    Coefficients are calculated using the formulas from the RBJ Audio EQ Cookbook and
+    the filters are implemented in Transposed Direct Form II.
+
+    Reference: https://www.w3.org/TR/audio-eq-cookbook/
+*/
+namespace Biquad
+{
+    enum Type
+    {
+        LOWPASS,
+        HIGHPASS,
+        HIGHSHELF
+    };
+
+    /* Normalised coefficients (a0 == 1) */
+    struct Coefficients
+    {
+        float b0 = 1.f;
+        float b1 = 0.f;
+        float b2 = 0.f;
+        float a1 = 0.f;
+        float a2 = 0.f;
+    };
+
+    /* Calculate the coefficients for a given filter type, cutoff frequency, resonance (Q) and gain (shelving filters only) */
+    inline Coefficients calculate(Type type, float freqHz, float q, double sampleRate, float gainDb = 0.f)
+    {
+        // keeping the cutoff within a valid range to avoid unstable filters
+        double freq = std::clamp<double>(freqHz, 10., sampleRate * 0.49);
+        q = std::max(q, 0.01f);
+
+        double w0 = 2. * Math::M_PI * freq / sampleRate;
+        double cosw0 = std::cos(w0);
+        double alpha = std::sin(w0) / (2. * q);
+        double a0 = 1. + alpha;
+
+        Coefficients c;
+        switch(type)
+        {
+            case HIGHSHELF:
+            {
+                double A = std::pow(10., gainDb / 40.);
+                double sqrtA2alpha = 2. * std::sqrt(A) * alpha;
+                double shelfA0 = (A + 1.) - (A - 1.) * cosw0 + sqrtA2alpha;
+                c.b0 = static_cast<float>(A * ((A + 1.) + (A - 1.) * cosw0 + sqrtA2alpha) / shelfA0);
+                c.b1 = static_cast<float>(-2. * A * ((A - 1.) + (A + 1.) * cosw0) / shelfA0);
+                c.b2 = static_cast<float>(A * ((A + 1.) + (A - 1.) * cosw0 - sqrtA2alpha) / shelfA0);
+                c.a1 = static_cast<float>(2. * ((A - 1.) - (A + 1.) * cosw0) / shelfA0);
+                c.a2 = static_cast<float>(((A + 1.) - (A - 1.) * cosw0 - sqrtA2alpha) / shelfA0);
+                return c;
+            }
+            case HIGHPASS:
+                c.b0 = static_cast<float>(((1. + cosw0) * 0.5) / a0);
+                c.b1 = static_cast<float>(-(1. + cosw0) / a0);
+                c.b2 = c.b0;
+                break;
+            case LOWPASS:
+            default:
+                c.b0 = static_cast<float>(((1. - cosw0) * 0.5) / a0);
+                c.b1 = static_cast<float>((1. - cosw0) / a0);
+                c.b2 = c.b0;
+                break;
+        }
+        c.a1 = static_cast<float>((-2. * cosw0) / a0);
+        c.a2 = static_cast<float>((1. - alpha) / a0);
+
+        return c;
+    }
+
+    /*
+        Lanes of the filter bank, the width of the SIMD registers of the target instruction set (selected at compile
+        time, e.g. with -march=native): 16 with AVX-512, 8 with AVX, 4 otherwise.
+    */
+#if defined(__AVX512F__)
+    static const int NumLanes = 16;
+#elif defined(__AVX__)
+    static const int NumLanes = 8;
+#else
+    static const int NumLanes = 4;
+#endif
+
+    /* SIMD vector type used by the filter bank (GCC/Clang vector extension), one value per lane */
+    typedef float LaneVector __attribute__((vector_size(NumLanes * sizeof(float))));
+}
+
+/*
+    BiquadFilter
+    A scalar biquad filter processing a single mono signal.
+*/
+class BiquadFilter
+{
+public:
+    BiquadFilter():
+        m_z1(0.f),
+        m_z2(0.f)
+    {
+
+    }
+
+    void setCoefficients(const Biquad::Coefficients& coefficients)
+    {
+        m_coefficients = coefficients;
+    }
+
+    void reset()
+    {
+        m_z1 = 0.f;
+        m_z2 = 0.f;
+    }
+
+    /* Filter a mono buffer in place */
+    void process(float* buffer, unsigned long numFrames)
+    {
+        const Biquad::Coefficients c = m_coefficients;
+        float z1 = m_z1;
+        float z2 = m_z2;
+
+        for(unsigned long i=0; i<numFrames; ++i)
+        {
+            float x = buffer[i];
+            float y = c.b0 * x + z1;
+            z1 = c.b1 * x - c.a1 * y + z2;
+            z2 = c.b2 * x - c.a2 * y;
+            buffer[i] = y;
+        }
+
+        m_z1 = z1;
+        m_z2 = z2;
+    }
+
+private:
+    Biquad::Coefficients m_coefficients;
+    float m_z1; // filter state
+    float m_z2; // filter state
+};
+
+/*
+    BiquadFilterBank
+    Processes the biquad filters of many voices in parallel.
+
+    Voices are grouped by Biquad::NumLanes, the SIMD width of the target: the coefficients and states of a group are
+    stored as structure of arrays, one lane per voice, so that each filter operation is applied to all the voices
+    of a group with a single instruction (GCC/Clang vector extension).
+
+    The voices input is transposed into a lane interleaved scratch buffer before filtering and transposed
+    back afterwards, by 4x4 SSE tiles (4 frames of 4 voices), so that the filter loop only accesses contiguous memory.
+    Groups without any active voice are skipped.
+
+    Coefficients changes are interpolated linearly over the processed block to avoid zipper noise.
+    All the memory is allocated at construction: it's safe to call process from the audio thread.
+*/
+class BiquadFilterBank
+{
+public:
+    static const int NumLanes = Biquad::NumLanes;
+
+    BiquadFilterBank(int maxNumVoices, unsigned long maxFramesPerBuffer):
+        m_maxNumVoices(maxNumVoices),
+        m_maxFramesPerBuffer(maxFramesPerBuffer),
+        m_groups((maxNumVoices + NumLanes - 1) / NumLanes),
+        m_scratch(maxFramesPerBuffer),
+        m_silence(maxFramesPerBuffer, 0.f),
+        m_discard(maxFramesPerBuffer, 0.f)
+    {
+
+    }
+
+    // Deleting other special member functions as they may cause shallow copies
+    BiquadFilterBank(const BiquadFilterBank&) = delete;
+    BiquadFilterBank& operator=(const BiquadFilterBank&) = delete;
+    BiquadFilterBank(BiquadFilterBank&& other) = delete;
+    BiquadFilterBank& operator=(BiquadFilterBank&& other) = delete;
+
+    /*
+        Set the filter for a voice.
+        The new coefficients are reached at the end of the next processed block unless immediate is true.
+    */
+    void setFilter(int voice, Biquad::Type type, float freqHz, float q, double sampleRate, bool immediate = false)
+    {
+        setCoefficients(voice, Biquad::calculate(type, freqHz, q, sampleRate), immediate);
+    }
+
+    void setCoefficients(int voice, const Biquad::Coefficients& c, bool immediate = false)
+    {
+        if(voice < 0 || voice >= m_maxNumVoices)
+        {
+            return;
+        }
+
+        LaneGroup& group = m_groups[voice / NumLanes];
+        int lane = voice % NumLanes;
+
+        group.target[B0][lane] = c.b0;
+        group.target[B1][lane] = c.b1;
+        group.target[B2][lane] = c.b2;
+        group.target[A1][lane] = c.a1;
+        group.target[A2][lane] = c.a2;
+
+        if(immediate)
+        {
+            for(int k=0; k<NumCoefficients; ++k)
+            {
+                group.current[k][lane] = group.target[k][lane];
+            }
+        }
+    }
+
+    /* Clear the state of a voice, e.g. when the voice starts playing a new sound */
+    void reset(int voice)
+    {
+        if(voice < 0 || voice >= m_maxNumVoices)
+        {
+            return;
+        }
+
+        LaneGroup& group = m_groups[voice / NumLanes];
+        int lane = voice % NumLanes;
+        group.z1[lane] = 0.f;
+        group.z2[lane] = 0.f;
+    }
+
+    /*
+        Filter in place the mono buffers of numVoices voices.
+        voiceBuffers[v] is the buffer of voice v and it must contain at least numFrames samples, nullptr if the voice is
+        inactive (e.g. stopped or virtual): it is then filtering silence, and not at all if its whole group is inactive.
+    */
+    void process(float* const* voiceBuffers, int numVoices, unsigned long numFrames)
+    {
+        numVoices = std::min(numVoices, m_maxNumVoices);
+        numFrames = std::min(numFrames, m_maxFramesPerBuffer);
+        if(numVoices <= 0 || numFrames == 0)
+        {
+            return;
+        }
+
+        const float* inputs[NumLanes];
+        float* outputs[NumLanes];
+
+        for(int g=0; g*NumLanes < numVoices; ++g)
+        {
+            // unused and inactive lanes read silence and write to a discard buffer
+            bool active = false;
+            for(int l=0; l<NumLanes; ++l)
+            {
+                int voice = g * NumLanes + l;
+                float* buffer = voice < numVoices ? voiceBuffers[voice] : nullptr;
+                inputs[l] = buffer ? buffer : m_silence.data();
+                outputs[l] = buffer ? buffer : m_discard.data();
+                active = active || buffer;
+            }
+
+            if(!active)
+            {
+                continue;
+            }
+
+            transposeIn(inputs, numFrames);
+            processGroup(m_groups[g], numFrames);
+            transposeOut(outputs, numFrames);
+        }
+    }
+
+    int getMaxNumVoices() const
+    {
+        return m_maxNumVoices;
+    }
+
+private:
+    typedef Biquad::LaneVector LaneVector;
+
+    enum CoefficientIndex
+    {
+        B0,
+        B1,
+        B2,
+        A1,
+        A2,
+        NumCoefficients
+    };
+
+    /* Filter coefficients and state of NumLanes voices, stored as structure of arrays */
+    struct alignas(64) LaneGroup
+    {
+        LaneGroup()
+        {
+            for(int l=0; l<NumLanes; ++l)
+            {
+                // pass-through by default
+                current[B0][l] = target[B0][l] = 1.f;
+                for(int k=B1; k<NumCoefficients; ++k)
+                {
+                    current[k][l] = target[k][l] = 0.f;
+                }
+                z1[l] = 0.f;
+                z2[l] = 0.f;
+            }
+        }
+
+        alignas(64) float current[NumCoefficients][NumLanes];
+        alignas(64) float target[NumCoefficients][NumLanes];
+        alignas(64) float z1[NumLanes];
+        alignas(64) float z2[NumLanes];
+    };
+
+    /* voices buffers -> lane interleaved scratch */
+    void transposeIn(const float* const* inputs, unsigned long numFrames)
+    {
+        float* scratch = reinterpret_cast<float*>(m_scratch.data());
+        unsigned long i = 0;
+
+#ifdef BIQUAD_SSE
+        const unsigned long numVectorFrames = numFrames & ~3ul;
+        for(; i < numVectorFrames; i += 4)
+        {
+            float* frames = scratch + i * NumLanes;
+            for(int l=0; l<NumLanes; l += 4)
+            {
+                __m128 row0 = _mm_loadu_ps(inputs[l] + i);
+                __m128 row1 = _mm_loadu_ps(inputs[l + 1] + i);
+                __m128 row2 = _mm_loadu_ps(inputs[l + 2] + i);
+                __m128 row3 = _mm_loadu_ps(inputs[l + 3] + i);
+                _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+                _mm_store_ps(frames + l, row0);
+                _mm_store_ps(frames + NumLanes + l, row1);
+                _mm_store_ps(frames + 2 * NumLanes + l, row2);
+                _mm_store_ps(frames + 3 * NumLanes + l, row3);
+            }
+        }
+#endif
+
+        for(; i < numFrames; ++i)
+        {
+            for(int l=0; l<NumLanes; ++l)
+            {
+                scratch[i * NumLanes + l] = inputs[l][i];
+            }
+        }
+    }
+
+    /* lane interleaved scratch -> voices buffers */
+    void transposeOut(float* const* outputs, unsigned long numFrames)
+    {
+        const float* scratch = reinterpret_cast<const float*>(m_scratch.data());
+        unsigned long i = 0;
+
+#ifdef BIQUAD_SSE
+        const unsigned long numVectorFrames = numFrames & ~3ul;
+        for(; i < numVectorFrames; i += 4)
+        {
+            const float* frames = scratch + i * NumLanes;
+            for(int l=0; l<NumLanes; l += 4)
+            {
+                __m128 row0 = _mm_load_ps(frames + l);
+                __m128 row1 = _mm_load_ps(frames + NumLanes + l);
+                __m128 row2 = _mm_load_ps(frames + 2 * NumLanes + l);
+                __m128 row3 = _mm_load_ps(frames + 3 * NumLanes + l);
+                _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+                _mm_storeu_ps(outputs[l] + i, row0);
+                _mm_storeu_ps(outputs[l + 1] + i, row1);
+                _mm_storeu_ps(outputs[l + 2] + i, row2);
+                _mm_storeu_ps(outputs[l + 3] + i, row3);
+            }
+        }
+#endif
+
+        for(; i < numFrames; ++i)
+        {
+            for(int l=0; l<NumLanes; ++l)
+            {
+                outputs[l][i] = scratch[i * NumLanes + l];
+            }
+        }
+    }
+
+    void processGroup(LaneGroup& group, unsigned long numFrames)
+    {
+        // working on local vectors so that the compiler can keep everything in registers
+        LaneVector c[NumCoefficients];
+        LaneVector delta[NumCoefficients];
+
+        const float invNumFrames = 1.f / static_cast<float>(numFrames);
+        for(int k=0; k<NumCoefficients; ++k)
+        {
+            LaneVector target;
+            memcpy(&c[k], group.current[k], sizeof(LaneVector));
+            memcpy(&target, group.target[k], sizeof(LaneVector));
+            delta[k] = (target - c[k]) * invNumFrames;
+        }
+
+        LaneVector z1;
+        LaneVector z2;
+        memcpy(&z1, group.z1, sizeof(LaneVector));
+        memcpy(&z2, group.z2, sizeof(LaneVector));
+
+        // named rather than indexed in the loop: -O2 doesn't unroll a loop over the coefficients, which then live in memory
+        LaneVector b0 = c[B0];
+        LaneVector b1 = c[B1];
+        LaneVector b2 = c[B2];
+        LaneVector a1 = c[A1];
+        LaneVector a2 = c[A2];
+        LaneVector* scratch = m_scratch.data();
+        for(unsigned long i=0; i<numFrames; ++i)
+        {
+            LaneVector x = scratch[i];
+            LaneVector y = b0 * x + z1;
+            z1 = b1 * x - a1 * y + z2;
+            z2 = b2 * x - a2 * y;
+            scratch[i] = y;
+
+            b0 += delta[B0];
+            b1 += delta[B1];
+            b2 += delta[B2];
+            a1 += delta[A1];
+            a2 += delta[A2];
+        }
+
+        // the target is reached at the end of the block: snapping to it to avoid accumulating rounding errors
+        memcpy(group.current, group.target, sizeof(group.current));
+        memcpy(group.z1, &z1, sizeof(LaneVector));
+        memcpy(group.z2, &z2, sizeof(LaneVector));
+    }
+
+    const int m_maxNumVoices;
+    const unsigned long m_maxFramesPerBuffer;
+
+    std::vector<LaneGroup> m_groups;
+    std::vector<LaneVector> m_scratch; // lane interleaved samples of the group being processed
+    std::vector<float> m_silence; // input for unused lanes
+    std::vector<float> m_discard; // output for unused lanes
+};
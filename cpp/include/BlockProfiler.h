@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdio.h>
+#include <vector>
+
+#include "CycleClock.h"
+#include "LatencyHistogram.h"
+
+/*
+    BlockProfiler
+    Always-on instrumentation of the audio thread, measuring each block render time against the block deadline
+    (framesPerBuffer / sampleRate). The cost is two clock reads and a few relaxed atomic stores per block.
+
+    - render time of every block, kept in a rolling window of the last WindowSize blocks (p50/p99/max and utilisation
+      of the budget over the window) and in a cumulative histogram,
+    - deadline misses: blocks taking longer than the block duration to render,
+    - underruns: the device asking for data while none was ready,
+    - optional sections (e.g. voices, effects): cumulated time of code measured with a Scope, when enabled.
+
+    The audio (and device) thread writes, any other thread can poll the stats.
+*/
+class BlockProfiler
+{
+public:
+    static const int WindowSize = 512;
+    static const int MaxNumSections = 32;
+
+    struct Stats
+    {
+        unsigned long m_numBlocks = 0;
+        unsigned long m_numDeadlineMisses = 0;
+        unsigned long m_numUnderruns = 0;
+        float m_budgetMicroseconds = 0.f; // block duration
+        float m_lastMicroseconds = 0.f; // render time of the last block
+        // over the rolling window
+        float m_meanMicroseconds = 0.f;
+        float m_p50Microseconds = 0.f;
+        float m_p99Microseconds = 0.f;
+        float m_maxMicroseconds = 0.f;
+        float m_utilisation = 0.f; // mean render time / budget in percent
+        float m_peakUtilisation = 0.f; // max render time / budget in percent
+    };
+
+    BlockProfiler(double blockDurationSeconds):
+        m_budgetTicks(CycleClock::microsecondsToTicks(blockDurationSeconds * 1e6)),
+        m_window(new std::atomic<float>[WindowSize]),
+        m_blockStartTicks(0),
+        m_numBlocks(0),
+        m_numDeadlineMisses(0),
+        m_numUnderruns(0),
+        m_numSections(0),
+        m_sectionsEnabled(false)
+    {
+        for(int i=0; i<WindowSize; ++i)
+        {
+            m_window[i].store(0.f, std::memory_order_relaxed);
+        }
+    }
+
+    // Deleting other special member functions as the atomics are not copyable
+    BlockProfiler(const BlockProfiler&) = delete;
+    BlockProfiler& operator=(const BlockProfiler&) = delete;
+
+    /* Audio thread */
+    void beginBlock()
+    {
+        m_blockStartTicks = CycleClock::now();
+    }
+
+    /* Audio thread. Returns the render time of the block in microseconds. */
+    float endBlock()
+    {
+        const uint64_t elapsed = CycleClock::now() - m_blockStartTicks;
+        const float microseconds = static_cast<float>(CycleClock::ticksToMicroseconds(elapsed));
+        const unsigned long numBlocks = m_numBlocks.load(std::memory_order_relaxed);
+
+        m_window[numBlocks % WindowSize].store(microseconds, std::memory_order_relaxed);
+        m_histogram.record(static_cast<uint64_t>(microseconds));
+        if(elapsed > m_budgetTicks)
+        {
+            m_numDeadlineMisses.store(m_numDeadlineMisses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        // published last so that readers see the window value of this block
+        m_numBlocks.store(numBlocks + 1, std::memory_order_release);
+
+        return microseconds;
+    }
+
+    /* Device thread */
+    void recordUnderrun()
+    {
+        m_numUnderruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /* Thread safe. The counters alone, without computing the stats */
+    unsigned long getNumDeadlineMisses() const
+    {
+        return m_numDeadlineMisses.load(std::memory_order_relaxed);
+    }
+
+    unsigned long getNumUnderruns() const
+    {
+        return m_numUnderruns.load(std::memory_order_relaxed);
+    }
+
+    /* Thread safe. The rolling window stats are computed here, on the calling thread. */
+    Stats getStats() const
+    {
+        Stats stats;
+        stats.m_numBlocks = m_numBlocks.load(std::memory_order_acquire);
+        stats.m_numDeadlineMisses = m_numDeadlineMisses.load(std::memory_order_relaxed);
+        stats.m_numUnderruns = m_numUnderruns.load(std::memory_order_relaxed);
+        stats.m_budgetMicroseconds = static_cast<float>(CycleClock::ticksToMicroseconds(m_budgetTicks));
+
+        const int numValues = static_cast<int>(std::min<unsigned long>(stats.m_numBlocks, WindowSize));
+        if(numValues == 0)
+        {
+            return stats;
+        }
+
+        std::vector<float> values(numValues);
+        double sum = 0.;
+        for(int i=0; i<numValues; ++i)
+        {
+            values[i] = m_window[i].load(std::memory_order_relaxed);
+            sum += values[i];
+        }
+        stats.m_lastMicroseconds = m_window[(stats.m_numBlocks - 1) % WindowSize].load(std::memory_order_relaxed);
+
+        std::sort(values.begin(), values.end());
+        stats.m_meanMicroseconds = static_cast<float>(sum / numValues);
+        stats.m_p50Microseconds = values[numValues / 2];
+        stats.m_p99Microseconds = values[std::min(numValues - 1, numValues * 99 / 100)];
+        stats.m_maxMicroseconds = values[numValues - 1];
+        stats.m_utilisation = 100.f * stats.m_meanMicroseconds / stats.m_budgetMicroseconds;
+        stats.m_peakUtilisation = 100.f * stats.m_maxMicroseconds / stats.m_budgetMicroseconds;
+
+        return stats;
+    }
+
+    /* Render time of all the blocks since the start, in microseconds */
+    const LatencyHistogram& getHistogram() const
+    {
+        return m_histogram;
+    }
+
+    void print() const
+    {
+        Stats stats = getStats();
+        printf("Audio thread: %lu blocks, budget %.0f us, render time mean %.1f us p50 %.1f us p99 %.1f us max %.1f us, "
+                "utilisation %.1f%% (peak %.1f%%), deadline misses %lu, underruns %lu\n",
+                stats.m_numBlocks, stats.m_budgetMicroseconds, stats.m_meanMicroseconds, stats.m_p50Microseconds,
+                stats.m_p99Microseconds, stats.m_maxMicroseconds, stats.m_utilisation, stats.m_peakUtilisation,
+                stats.m_numDeadlineMisses, stats.m_numUnderruns);
+
+        for(int i=0; i<m_numSections; ++i)
+        {
+            unsigned long numBlocks = stats.m_numBlocks > 0 ? stats.m_numBlocks : 1;
+            printf("    %s: %.2f us per block (%lu calls)\n", m_sections[i].m_name,
+                    CycleClock::ticksToMicroseconds(m_sections[i].m_ticks.load(std::memory_order_relaxed)) / numBlocks,
+                    (unsigned long)m_sections[i].m_numCalls.load(std::memory_order_relaxed));
+        }
+    }
+
+    //========================= SECTIONS ==========================//
+
+    /* Not thread safe, sections must be added before the audio thread starts. Returns the section id, -1 if full. */
+    int addSection(const char* name)
+    {
+        if(m_numSections == MaxNumSections)
+        {
+            return -1;
+        }
+
+        m_sections[m_numSections].m_name = name;
+        return m_numSections++;
+    }
+
+    /* Thread safe, sections are not measured by default */
+    void setSectionsEnabled(bool enabled)
+    {
+        m_sectionsEnabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    bool isSectionsEnabled() const
+    {
+        return m_sectionsEnabled.load(std::memory_order_relaxed);
+    }
+
+    /* Audio thread. Measures the scope lifetime into a section, nothing is measured if sections are disabled */
+    class Scope
+    {
+    public:
+        Scope(BlockProfiler& profiler, int section):
+            m_profiler(profiler.isSectionsEnabled() && section >= 0 ? &profiler : nullptr),
+            m_section(section),
+            m_startTicks(m_profiler ? CycleClock::now() : 0)
+        {
+
+        }
+
+        ~Scope()
+        {
+            if(m_profiler)
+            {
+                m_profiler->addSectionTicks(m_section, CycleClock::now() - m_startTicks);
+            }
+        }
+
+    private:
+        BlockProfiler* m_profiler;
+        int m_section;
+        uint64_t m_startTicks;
+    };
+
+    /* Audio thread */
+    void addSectionTicks(int section, uint64_t ticks)
+    {
+        Section& s = m_sections[section];
+        s.m_ticks.store(s.m_ticks.load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+        s.m_numCalls.store(s.m_numCalls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+private:
+    struct Section
+    {
+        const char* m_name = "";
+        std::atomic<uint64_t> m_ticks{0};
+        std::atomic<uint64_t> m_numCalls{0};
+    };
+
+    const uint64_t m_budgetTicks;
+    std::unique_ptr<std::atomic<float>[]> m_window; // render times of the last blocks in microseconds
+    LatencyHistogram m_histogram;
+    uint64_t m_blockStartTicks; // audio thread only
+    std::atomic<unsigned long> m_numBlocks;
+    std::atomic<unsigned long> m_numDeadlineMisses;
+    std::atomic<unsigned long> m_numUnderruns;
+
+    Section m_sections[MaxNumSections];
+    int m_numSections;
+    std::atomic<bool> m_sectionsEnabled;
+};
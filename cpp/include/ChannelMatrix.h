@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "AudioBuffer.h"
+#include "Logger.h"
+
+/*
+    ChannelMatrix
+    Maps N input channels to M output channels: output[o] = sum over i of gain(o, i) * input[i].
+
+    Presets:
+    - DIRECT: input c to output c with a gain of 1, outputs without an input are silent, extra inputs are dropped,
+    - MONO_TO_STEREO: the mono input on both outputs at -3 dB (equal power, as a centred pan),
+    - STEREO_TO_MONO: half of each input,
+    - SURROUND_5_1_TO_STEREO: ITU-R BS.775 downmix from L, R, C, LFE, Ls, Rs: L + 0.707 C + 0.707 Ls and
+      R + 0.707 C + 0.707 Rs, the LFE is dropped. The downmix is not normalised and can clip on loud material.
+    The default matrix for a channel count pair is the matching preset if any, otherwise DIRECT.
+
+    process() runs block by block over contiguous spans of each input channel: the non zero gains of each output are
+    gathered when the matrix is set, then each output is a copy (gain of 1), a scaled copy or a sum of scaled inputs,
+    with the SSE kernels of AudioBufferUtils. A DIRECT matrix costs a memcpy per channel.
+    Gains are set from the thread calling process(), without allocating.
+*/
+class ChannelMatrix
+{
+public:
+    enum class Preset
+    {
+        DIRECT,
+        MONO_TO_STEREO,
+        STEREO_TO_MONO,
+        SURROUND_5_1_TO_STEREO
+    };
+
+    /* Default matrix for the channel counts, see the class description */
+    ChannelMatrix(int numInputs, int numOutputs):
+        m_numInputs(std::max(0, numInputs)),
+        m_numOutputs(std::max(0, numOutputs))
+    {
+        m_routes.reserve(m_numInputs * m_numOutputs);
+        m_routeStarts.reserve(m_numOutputs + 1);
+
+        if(m_numInputs == 1 && m_numOutputs == 2)
+        {
+            setPreset(Preset::MONO_TO_STEREO);
+        }
+        else if(m_numInputs == 2 && m_numOutputs == 1)
+        {
+            setPreset(Preset::STEREO_TO_MONO);
+        }
+        else if(m_numInputs == 6 && m_numOutputs == 2)
+        {
+            setPreset(Preset::SURROUND_5_1_TO_STEREO);
+        }
+        else
+        {
+            setPreset(Preset::DIRECT);
+        }
+    }
+
+    /* Replace the gains with a preset, which must match the channel counts (any counts for DIRECT) */
+    bool setPreset(Preset preset)
+    {
+        const int numInputs[] = {m_numInputs, 1, 2, 6};
+        const int numOutputs[] = {m_numOutputs, 2, 1, 2};
+        const int index = static_cast<int>(preset);
+        if(numInputs[index] != m_numInputs || numOutputs[index] != m_numOutputs)
+        {
+            LM_ERROR("ChannelMatrix: preset does not match the channel counts.");
+            return false;
+        }
+
+        m_gains.assign(m_numInputs * m_numOutputs, 0.f);
+        const float minus3dB = 0.70710678f;
+        switch(preset)
+        {
+            case Preset::MONO_TO_STEREO:
+                m_gains = {minus3dB, minus3dB};
+                break;
+            case Preset::STEREO_TO_MONO:
+                m_gains = {0.5f, 0.5f};
+                break;
+            case Preset::SURROUND_5_1_TO_STEREO:
+                m_gains = {1.f, 0.f, minus3dB, 0.f, minus3dB, 0.f,
+                           0.f, 1.f, minus3dB, 0.f, 0.f, minus3dB};
+                break;
+            default:
+                for(int c=0; c<std::min(m_numInputs, m_numOutputs); ++c)
+                {
+                    m_gains[c * m_numInputs + c] = 1.f;
+                }
+                break;
+        }
+
+        updateRoutes();
+        return true;
+    }
+
+    void setGain(int output, int input, float gain)
+    {
+        if(output >= 0 && output < m_numOutputs && input >= 0 && input < m_numInputs)
+        {
+            m_gains[output * m_numInputs + input] = gain;
+            updateRoutes();
+        }
+    }
+
+    float getGain(int output, int input) const
+    {
+        return m_gains[output * m_numInputs + input];
+    }
+
+    /* All gains to 0 */
+    void clear()
+    {
+        m_gains.assign(m_numInputs * m_numOutputs, 0.f);
+        updateRoutes();
+    }
+
+    int getNumInputs() const
+    {
+        return m_numInputs;
+    }
+
+    int getNumOutputs() const
+    {
+        return m_numOutputs;
+    }
+
+    /* Overwrite numFrames frames of the outputs from inputFrame in the inputs and outputFrame in the outputs */
+    void process(const float* const* inputs, unsigned long inputFrame, float* const* outputs, unsigned long outputFrame, unsigned long numFrames) const
+    {
+        for(int o=0; o<m_numOutputs; ++o)
+        {
+            float* output = outputs[o] + outputFrame;
+            const int begin = m_routeStarts[o];
+            const int end = m_routeStarts[o + 1];
+            if(begin == end)
+            {
+                memset(output, 0, numFrames * sizeof(float));
+                continue;
+            }
+
+            // up to three inputs mixed in the pass writing the output, e.g. L + 0.707 C + 0.707 Ls for a 5.1 downmix
+            const Route* routes = &m_routes[begin];
+            const int numRoutes = end - begin;
+            if(numRoutes == 1 && routes[0].m_gain == 1.f)
+            {
+                memcpy(output, inputs[routes[0].m_input] + inputFrame, numFrames * sizeof(float));
+            }
+            else if(numRoutes == 1)
+            {
+                AudioBufferUtils::copyScaled(output, inputs[routes[0].m_input] + inputFrame, routes[0].m_gain, numFrames);
+            }
+            else if(numRoutes == 2)
+            {
+                AudioBufferUtils::mixScaled(output, inputs[routes[0].m_input] + inputFrame, routes[0].m_gain,
+                        inputs[routes[1].m_input] + inputFrame, routes[1].m_gain, numFrames);
+            }
+            else
+            {
+                AudioBufferUtils::mixScaled(output, inputs[routes[0].m_input] + inputFrame, routes[0].m_gain,
+                        inputs[routes[1].m_input] + inputFrame, routes[1].m_gain, inputs[routes[2].m_input] + inputFrame, routes[2].m_gain, numFrames);
+            }
+
+            for(int r=3; r<numRoutes; ++r)
+            {
+                AudioBufferUtils::addScaled(output, inputs[routes[r].m_input] + inputFrame, routes[r].m_gain, numFrames);
+            }
+        }
+    }
+
+    void process(const float* const* inputs, float* const* outputs, unsigned long numFrames) const
+    {
+        process(inputs, 0, outputs, 0, numFrames);
+    }
+
+private:
+    struct Route
+    {
+        int m_input;
+        float m_gain;
+    };
+
+    /* Non zero gains, output after output */
+    void updateRoutes()
+    {
+        m_routes.clear();
+        m_routeStarts.assign(1, 0);
+        for(int o=0; o<m_numOutputs; ++o)
+        {
+            for(int i=0; i<m_numInputs; ++i)
+            {
+                if(m_gains[o * m_numInputs + i] != 0.f)
+                {
+                    m_routes.push_back({i, m_gains[o * m_numInputs + i]});
+                }
+            }
+            m_routeStarts.push_back(static_cast<int>(m_routes.size()));
+        }
+    }
+
+    int m_numInputs;
+    int m_numOutputs;
+    std::vector<float> m_gains; // output after output, m_numInputs gains each
+    std::vector<Route> m_routes;
+    std::vector<int> m_routeStarts; // index of the first route of each output, m_numOutputs + 1 entries
+};
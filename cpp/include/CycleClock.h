@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLE_CLOCK_TSC 1
+#else
+#define CYCLE_CLOCK_TSC 0
+#endif
+
+/*
+    CycleClock
+    A cheap clock to measure short intervals on the audio thread (a few nanoseconds per read).
+    On x86 it reads the time stamp counter, which is constant rate on any recent cpu, and is calibrated once
+    against the steady clock. Elsewhere it falls back to the steady clock in nanoseconds.
+    Call calibrate() once outside the audio thread (e.g. in a constructor) as it takes a few milliseconds.
+*/
+class CycleClock
+{
+public:
+    /* Current time in ticks */
+    static uint64_t now()
+    {
+#if CYCLE_CLOCK_TSC
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    /* Measure the clock rate, only the first call does the work */
+    static void calibrate()
+    {
+        getTicksPerMicrosecond();
+    }
+
+    static double getTicksPerMicrosecond()
+    {
+        static const double ticksPerMicrosecond = measureTicksPerMicrosecond();
+        return ticksPerMicrosecond;
+    }
+
+    static uint64_t microsecondsToTicks(double microseconds)
+    {
+        return static_cast<uint64_t>(microseconds * getTicksPerMicrosecond());
+    }
+
+    static double ticksToMicroseconds(uint64_t ticks)
+    {
+        return ticks / getTicksPerMicrosecond();
+    }
+
+private:
+    static double measureTicksPerMicrosecond()
+    {
+#if CYCLE_CLOCK_TSC
+        auto start = std::chrono::steady_clock::now();
+        uint64_t startTicks = now();
+        std::chrono::duration<double, std::micro> elapsed;
+        do
+        {
+            elapsed = std::chrono::steady_clock::now() - start;
+        }
+        while(elapsed.count() < 10000.);
+        return (now() - startTicks) / elapsed.count();
+#else
+        return 1000.;
+#endif
+    }
+};
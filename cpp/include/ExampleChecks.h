@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+/*
+    Pass/fail checks shared by the self-checking examples: each check prints its outcome, and the example returns
+    getExitCode() from main so that it fails if any check failed.
+*/
+namespace ExampleChecks
+{
+    inline int g_numFailures = 0;
+
+    inline void check(bool condition, const char* description)
+    {
+        printf("  %s %s\n", condition ? "ok  " : "FAIL", description);
+        g_numFailures += condition ? 0 : 1;
+    }
+
+    /* Print the summary of the checks, returns EXIT_SUCCESS if none failed, EXIT_FAILURE otherwise */
+    inline int getExitCode()
+    {
+        printf("\n%s: %i failed checks\n", g_numFailures == 0 ? "PASS" : "FAIL", g_numFailures);
+        return g_numFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+}
@@ -6,8 +6,9 @@
 #include <vector>
 #include <iostream>
 
+#include "AudioBuffer.h"
 #include "AudioSignalUtils.h"
-#include "LogMutex.h"
+#include "Logger.h"
 
 /*
     GranularSynth. 
@@ -44,41 +45,36 @@ public:
         // writing to buffer
         for(int i = 0; i < framesPerBuffer; ++i)
         {
-            // Triggering next grain
-            if(m_samplesNextGrain == 0)
+            float data = processFrame();
+
+            //copy same data to all channels
+            for(int c=0; c<numChannels; ++c)
             {
-                // getting synthesis params
-                int grainStartPosition = 0;
-                int grainDurationSamples = 0;
-                float grainOverlap = 0.5f;
-                float grainPitch = 1.f;
-                getParams(grainStartPosition, grainDurationSamples, grainOverlap, grainPitch);
-                fixParams(grainStartPosition, grainDurationSamples, grainOverlap, grainPitch);
-
-                // triggering next grain
-                triggerNextGrain(grainStartPosition, grainDurationSamples, grainPitch);
-            
-                m_samplesNextGrain = static_cast<int>(grainDurationSamples * grainOverlap);        
+                *outputBuffer++ += data;
             }
-            --m_samplesNextGrain;
+        }
+    }
 
-            // processing active grains
-            float data = 0.f;
-            for(int g = 0; g < m_maxNumGrains; ++g)
-            {
-                
+    /* Planar version: the grains are synthesised into a mono chunk which is then added to each channel */
+    virtual void executePlanar(float* const* outputChannels, unsigned long framesPerBuffer, int numChannels)
+    {
+        if(!m_source)
+        {
+            return;
+        }
 
-                Grain& grain = m_grains[g];
-                if(grain.isActive())
-                {
-                    data += grain.process(*m_source);
-                }
+        float data[ChunkFrames];
+        for(unsigned long i = 0; i < framesPerBuffer; i += ChunkFrames)
+        {
+            const unsigned long numFrames = std::min<unsigned long>(framesPerBuffer - i, ChunkFrames);
+            for(unsigned long j = 0; j < numFrames; ++j)
+            {
+                data[j] = processFrame();
             }
 
-            //copy same data to all channels
             for(int c=0; c<numChannels; ++c)
             {
-                *outputBuffer++ += data;
+                AudioBufferUtils::addScaled(outputChannels[c] + i, data, 1.f, numFrames);
             }
         }
     }
@@ -98,6 +94,43 @@ protected:
     const std::vector<float>* m_source; // a pointer to the source data
 
 private:
+    static const int ChunkFrames = 64;
+
+    /* Trigger the next grain when it's due and sum the active grains */
+    float processFrame()
+    {
+        // Triggering next grain
+        if(m_samplesNextGrain == 0)
+        {
+            // getting synthesis params
+            int grainStartPosition = 0;
+            int grainDurationSamples = 0;
+            float grainOverlap = 0.5f;
+            float grainPitch = 1.f;
+            getParams(grainStartPosition, grainDurationSamples, grainOverlap, grainPitch);
+            fixParams(grainStartPosition, grainDurationSamples, grainOverlap, grainPitch);
+
+            // triggering next grain
+            triggerNextGrain(grainStartPosition, grainDurationSamples, grainPitch);
+        
+            m_samplesNextGrain = static_cast<int>(grainDurationSamples * grainOverlap);        
+        }
+        --m_samplesNextGrain;
+
+        // processing active grains
+        float data = 0.f;
+        for(int g = 0; g < m_maxNumGrains; ++g)
+        {
+            Grain& grain = m_grains[g];
+            if(grain.isActive())
+            {
+                data += grain.process(*m_source);
+            }
+        }
+
+        return data;
+    }
+
     // to ensure params used to get next grain are always valid
     void fixParams(int& grainStartPosition, int& grainDurationSamples, float& grainOverlap, float& grainPitch)
     {
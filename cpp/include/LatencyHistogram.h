@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <stdio.h>
+
+/*
+    LatencyHistogram
+    Lock-free histogram of integer values (e.g. latencies in microseconds), with log-linear buckets:
+    each power of two is split in NumSubBuckets buckets, so percentiles are within 1/NumSubBuckets of the actual value.
+    Recording is wait-free and can be done from any thread (e.g. the audio thread), while other threads read
+    the count, percentiles and max at any time.
+*/
+class LatencyHistogram
+{
+public:
+    static const int SubBucketBits = 3;
+    static const int NumSubBuckets = 1 << SubBucketBits;
+    static const int NumBuckets = (64 - SubBucketBits + 1) * NumSubBuckets;
+
+    LatencyHistogram()
+    {
+        reset();
+    }
+
+    // Deleting other special member functions as the atomics are not copyable
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    /* Thread safe, wait-free */
+    void record(uint64_t value)
+    {
+        m_buckets[getBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        while(value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+        {
+
+        }
+    }
+
+    /* Not thread safe with record() */
+    void reset()
+    {
+        for(int i=0; i<NumBuckets; ++i)
+        {
+            m_buckets[i].store(0, std::memory_order_relaxed);
+        }
+        m_count.store(0, std::memory_order_relaxed);
+        m_sum.store(0, std::memory_order_relaxed);
+        m_max.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t getCount() const
+    {
+        return m_count.load(std::memory_order_relaxed);
+    }
+
+    uint64_t getMax() const
+    {
+        return m_max.load(std::memory_order_relaxed);
+    }
+
+    double getMean() const
+    {
+        uint64_t count = getCount();
+        return count > 0 ? static_cast<double>(m_sum.load(std::memory_order_relaxed)) / count : 0.;
+    }
+
+    /* Upper bound of the bucket containing the given percentile (in the range [0, 100]), 0 if empty */
+    uint64_t getPercentile(double percentile) const
+    {
+        uint64_t count = getCount();
+        if(count == 0)
+        {
+            return 0;
+        }
+
+        uint64_t rank = static_cast<uint64_t>(percentile / 100. * count + 0.5);
+        rank = rank < 1 ? 1 : (rank > count ? count : rank);
+
+        uint64_t cumulated = 0;
+        for(int i=0; i<NumBuckets; ++i)
+        {
+            cumulated += m_buckets[i].load(std::memory_order_relaxed);
+            if(cumulated >= rank)
+            {
+                // the bucket bound can't be more than the max value recorded
+                uint64_t upper = getBucketUpperBound(i);
+                uint64_t max = getMax();
+                return upper < max ? upper : max;
+            }
+        }
+
+        return getMax();
+    }
+
+    /* Print count, mean, p50, p99 and max */
+    void print(const char* name, const char* unit = "us") const
+    {
+        printf("%s: count %lu, mean %.1f %s, p50 %lu %s, p99 %lu %s, max %lu %s\n", name,
+                (unsigned long)getCount(), getMean(), unit, (unsigned long)getPercentile(50.), unit,
+                (unsigned long)getPercentile(99.), unit, (unsigned long)getMax(), unit);
+    }
+
+private:
+    static int getBucketIndex(uint64_t value)
+    {
+        if(value < NumSubBuckets)
+        {
+            return static_cast<int>(value);
+        }
+
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - SubBucketBits;
+        return (shift + 1) * NumSubBuckets + static_cast<int>((value >> shift) & (NumSubBuckets - 1));
+    }
+
+    static uint64_t getBucketUpperBound(int index)
+    {
+        if(index < NumSubBuckets)
+        {
+            return index;
+        }
+
+        int shift = index / NumSubBuckets - 1;
+        uint64_t lower = static_cast<uint64_t>(NumSubBuckets + index % NumSubBuckets) << shift;
+        return lower + (uint64_t(1) << shift) - 1;
+    }
+
+    std::atomic<uint64_t> m_buckets[NumBuckets];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint64_t> m_max;
+};
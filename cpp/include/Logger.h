@@ -0,0 +1,533 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "CycleClock.h"
+
+/*
+    Logger
+    Real-time safe logging: logging from the audio thread never locks, allocates or formats.
+
+    Each thread logs into its own single-producer single-consumer ring of fixed size records, holding the format
+    pointer and the raw arguments (strings are copied, truncated if too long). A background thread drains the rings
+    every few milliseconds, formats the messages in time order and prints them.
+    - The format must be a string literal (or outlive the logger) as only its pointer is stored.
+    - A thread's ring is allocated the first time it logs, call registerThread() beforehand from real-time threads.
+    - When a ring is full the message is dropped and counted, the drops are reported by the background thread.
+    - The level is filtered at runtime with setLevel(), messages below the level cost a relaxed atomic load.
+    - The background thread starts with the first ring, so nothing runs before main (g_logger is a global) nor in
+      programs which never log or register a thread.
+    Logging is compiled in every build: unlike the LogMutex it replaces, which compiled it out of release builds, a
+    release build formats and prints the messages at or above the level (LOG by default). Define LOGGER_DISABLED to
+    compile all the logging out, as release builds did before.
+*/
+
+#ifdef LOGGER_DISABLED
+    #define LM_VERBOSE(fmt, ...) (void)0
+    #define LM_LOG(fmt, ...) (void)0
+    #define LM_ERROR(fmt, ...) (void)0
+#else
+    #define LM_VERBOSE(fmt, ...) g_logger.log(Logger::VERBOSE, fmt, ##__VA_ARGS__)
+    #define LM_LOG(fmt, ...) g_logger.log(Logger::LOG, fmt, ##__VA_ARGS__)
+    #define LM_ERROR(fmt, ...) g_logger.log(Logger::ERROR, fmt, ##__VA_ARGS__)
+#endif
+
+class Logger
+{
+public:
+    enum LogLevel
+    {
+        VERBOSE,
+        LOG,
+        ERROR,
+        NONE
+    };
+
+    static const int MaxNumThreads = 64;
+    static const int RingSize = 512; // records per thread
+    static const int MaxNumArgs = 8;
+    static const int StringBytes = 128; // bytes for the copies of the string arguments of a record
+
+    Logger(int flushIntervalMs = 5):
+        m_level(LOG),
+        m_numRings(0),
+        m_numReportedDrops(0),
+        m_flushIntervalMs(flushIntervalMs),
+        m_runningFlag(true)
+    {
+        // records are ordered by their ticks, which doesn't need the clock to be calibrated
+    }
+
+    ~Logger()
+    {
+        m_runningFlag.store(false);
+        {
+            std::lock_guard<std::mutex> lock(m_registerMutex);
+            if(m_thread.joinable())
+            {
+                m_thread.join();
+            }
+        }
+        flush();
+
+        for(int i=0; i<m_numRings.load(); ++i)
+        {
+            delete m_rings[i];
+        }
+    }
+
+    // Deleting other special member functions as the logger owns a thread
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    /* Thread safe */
+    void setLevel(LogLevel level)
+    {
+        m_level.store(level, std::memory_order_relaxed);
+    }
+
+    LogLevel getLevel() const
+    {
+        return m_level.load(std::memory_order_relaxed);
+    }
+
+    /* Thread safe. Wait-free once the calling thread is registered. */
+    template<typename... Args>
+    void log(LogLevel level, const char* format, Args... args)
+    {
+        static_assert(sizeof...(Args) <= MaxNumArgs, "Logger: too many arguments");
+
+        if(level < m_level.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        Ring* ring = getThreadRing();
+        if(!ring)
+        {
+            return;
+        }
+
+        Record* record = ring->beginWrite();
+        if(!record)
+        {
+            ring->m_numDropped.store(ring->m_numDropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+
+        record->m_ticks = CycleClock::now();
+        record->m_format = format;
+        record->m_numArgs = 0;
+        record->m_stringBytes = 0;
+        (record->capture(args), ...);
+
+        ring->finishWrite();
+    }
+
+    /* Allocate the ring of the calling thread, so that logging from it never allocates */
+    void registerThread()
+    {
+        getThreadRing();
+    }
+
+    /* Thread safe. Messages dropped because a ring was full. */
+    unsigned long getNumDropped() const
+    {
+        unsigned long numDropped = 0;
+        for(int i=0; i<m_numRings.load(std::memory_order_acquire); ++i)
+        {
+            numDropped += m_rings[i]->m_numDropped.load(std::memory_order_relaxed);
+        }
+        return numDropped;
+    }
+
+    /* Print all the pending messages. Not real-time safe. */
+    void flush()
+    {
+        std::lock_guard<std::mutex> lock(m_flushMutex);
+
+        // gathering the pending records of all threads to print them in time order
+        m_pending.clear();
+        for(int i=0; i<m_numRings.load(std::memory_order_acquire); ++i)
+        {
+            Ring* ring = m_rings[i];
+            const Record* record;
+            while((record = ring->beginRead()) != nullptr)
+            {
+                m_pending.push_back(*record);
+                ring->finishRead();
+            }
+        }
+
+        std::stable_sort(m_pending.begin(), m_pending.end(), [](const Record& a, const Record& b)
+        {
+            return a.m_ticks < b.m_ticks;
+        });
+
+        for(const Record& record : m_pending)
+        {
+            print(record);
+        }
+
+        unsigned long numDropped = getNumDropped();
+        if(numDropped != m_numReportedDrops)
+        {
+            printf("Logger: %lu messages dropped\n", numDropped - m_numReportedDrops);
+            m_numReportedDrops = numDropped;
+        }
+
+        fflush(stdout);
+    }
+
+private:
+    /* A captured argument */
+    struct Arg
+    {
+        enum Type
+        {
+            INT,
+            UINT,
+            DOUBLE,
+            STRING,
+            POINTER
+        } m_type;
+
+        union
+        {
+            long long m_int;
+            unsigned long long m_uint;
+            double m_double;
+            int m_stringOffset;
+            const void* m_pointer;
+        };
+    };
+
+    struct Record
+    {
+        uint64_t m_ticks;
+        const char* m_format;
+        int m_numArgs;
+        int m_stringBytes;
+        Arg m_args[MaxNumArgs];
+        char m_strings[StringBytes];
+
+        template<typename T>
+        void capture(T value)
+        {
+            Arg& arg = m_args[m_numArgs++];
+            if constexpr(std::is_same_v<T, const char*> || std::is_same_v<T, char*>)
+            {
+                arg.m_type = Arg::STRING;
+                arg.m_stringOffset = m_stringBytes;
+                const char* string = value ? value : "(null)";
+                int length = std::min(static_cast<int>(strlen(string)), StringBytes - m_stringBytes - 1);
+                if(length >= 0)
+                {
+                    memcpy(m_strings + m_stringBytes, string, length);
+                    m_strings[m_stringBytes + length] = '\0';
+                    m_stringBytes += length + 1;
+                }
+                else
+                {
+                    arg.m_stringOffset = -1;
+                }
+            }
+            else if constexpr(std::is_floating_point_v<T>)
+            {
+                arg.m_type = Arg::DOUBLE;
+                arg.m_double = static_cast<double>(value);
+            }
+            else if constexpr(std::is_enum_v<T>)
+            {
+                arg.m_type = Arg::INT;
+                arg.m_int = static_cast<long long>(value);
+            }
+            else if constexpr(std::is_integral_v<T> && std::is_signed_v<T>)
+            {
+                arg.m_type = Arg::INT;
+                arg.m_int = static_cast<long long>(value);
+            }
+            else if constexpr(std::is_integral_v<T>)
+            {
+                arg.m_type = Arg::UINT;
+                arg.m_uint = static_cast<unsigned long long>(value);
+            }
+            else
+            {
+                static_assert(std::is_pointer_v<T>, "Logger: unsupported argument type");
+                arg.m_type = Arg::POINTER;
+                arg.m_pointer = static_cast<const void*>(value);
+            }
+        }
+    };
+
+    /* Single-producer (the logging thread) single-consumer (the logger thread) ring of records */
+    struct Ring
+    {
+        Ring():
+            m_records(RingSize),
+            m_write(0),
+            m_read(0),
+            m_numDropped(0),
+            m_inUse(true)
+        {
+
+        }
+
+        Record* beginWrite()
+        {
+            const uint64_t write = m_write.load(std::memory_order_relaxed);
+            if(write - m_read.load(std::memory_order_acquire) == RingSize)
+            {
+                return nullptr;
+            }
+            return &m_records[write % RingSize];
+        }
+
+        void finishWrite()
+        {
+            m_write.store(m_write.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        const Record* beginRead()
+        {
+            const uint64_t read = m_read.load(std::memory_order_relaxed);
+            if(read == m_write.load(std::memory_order_acquire))
+            {
+                return nullptr;
+            }
+            return &m_records[read % RingSize];
+        }
+
+        void finishRead()
+        {
+            m_read.store(m_read.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        std::vector<Record> m_records;
+        alignas(64) std::atomic<uint64_t> m_write;
+        alignas(64) std::atomic<uint64_t> m_read;
+        std::atomic<unsigned long> m_numDropped;
+        std::atomic<bool> m_inUse; // rings of exited threads are reused
+    };
+
+    /* Releases the ring of a thread when it exits */
+    struct ThreadRing
+    {
+        Ring* m_ring = nullptr;
+
+        ~ThreadRing()
+        {
+            if(m_ring)
+            {
+                m_ring->m_inUse.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    Ring* getThreadRing()
+    {
+        thread_local ThreadRing threadRing;
+        if(threadRing.m_ring)
+        {
+            return threadRing.m_ring;
+        }
+
+        // reusing the ring of an exited thread, its pending records are still printed
+        const int numRings = m_numRings.load(std::memory_order_acquire);
+        for(int i=0; i<numRings; ++i)
+        {
+            bool inUse = false;
+            if(m_rings[i]->m_inUse.compare_exchange_strong(inUse, true, std::memory_order_acq_rel))
+            {
+                threadRing.m_ring = m_rings[i];
+                return threadRing.m_ring;
+            }
+        }
+
+        // registering a new ring
+        std::lock_guard<std::mutex> lock(m_registerMutex);
+        const int index = m_numRings.load(std::memory_order_relaxed);
+        if(index == MaxNumThreads)
+        {
+            return nullptr;
+        }
+        m_rings[index] = new Ring();
+        m_numRings.store(index + 1, std::memory_order_release);
+        threadRing.m_ring = m_rings[index];
+
+        // starting the background thread with the first ring
+        if(index == 0)
+        {
+            m_thread = std::thread(&Logger::update, this);
+        }
+        return threadRing.m_ring;
+    }
+
+    /* Logger thread */
+    void update()
+    {
+        while(m_runningFlag.load())
+        {
+            flush();
+            std::this_thread::sleep_for(std::chrono::milliseconds(m_flushIntervalMs));
+        }
+    }
+
+    /* Format a record as printf would, one conversion at a time */
+    static void print(const Record& record)
+    {
+        char output[1024];
+        int length = 0;
+        int argIndex = 0;
+        const char* f = record.m_format;
+        while(*f && length < static_cast<int>(sizeof(output)) - 1)
+        {
+            if(*f != '%')
+            {
+                output[length++] = *f++;
+                continue;
+            }
+
+            if(f[1] == '%')
+            {
+                output[length++] = '%';
+                f += 2;
+                continue;
+            }
+
+            // conversion specification: flags, width, precision, length modifiers and conversion
+            char spec[32];
+            int specLength = 0;
+            spec[specLength++] = *f++;
+            while(*f && strchr("-+ #0123456789.", *f) && specLength < 24)
+            {
+                spec[specLength++] = *f++;
+            }
+            while(*f && strchr("hlLqjzt", *f))
+            {
+                ++f; // the length is given by the captured type
+            }
+            const char conversion = *f ? *f++ : 'd';
+
+            if(argIndex >= record.m_numArgs)
+            {
+                continue;
+            }
+
+            const Arg& arg = record.m_args[argIndex++];
+            const int available = static_cast<int>(sizeof(output)) - length;
+            int written = 0;
+            switch(conversion)
+            {
+                case 'c':
+                    spec[specLength++] = 'c';
+                    spec[specLength] = '\0';
+                    written = snprintf(output + length, available, spec, static_cast<int>(getInt(arg)));
+                    break;
+                case 'd':
+                case 'i':
+                    spec[specLength++] = 'l';
+                    spec[specLength++] = 'l';
+                    spec[specLength++] = 'd';
+                    spec[specLength] = '\0';
+                    written = snprintf(output + length, available, spec, getInt(arg));
+                    break;
+                case 'u':
+                case 'x':
+                case 'X':
+                case 'o':
+                    spec[specLength++] = 'l';
+                    spec[specLength++] = 'l';
+                    spec[specLength++] = conversion;
+                    spec[specLength] = '\0';
+                    written = snprintf(output + length, available, spec, static_cast<unsigned long long>(getInt(arg)));
+                    break;
+                case 'f':
+                case 'F':
+                case 'e':
+                case 'E':
+                case 'g':
+                case 'G':
+                case 'a':
+                case 'A':
+                    spec[specLength++] = conversion;
+                    spec[specLength] = '\0';
+                    written = snprintf(output + length, available, spec, getDouble(arg));
+                    break;
+                case 's':
+                    spec[specLength++] = 's';
+                    spec[specLength] = '\0';
+                    written = snprintf(output + length, available, spec,
+                            arg.m_type == Arg::STRING && arg.m_stringOffset >= 0 ? record.m_strings + arg.m_stringOffset : "");
+                    break;
+                case 'p':
+                    spec[specLength++] = 'p';
+                    spec[specLength] = '\0';
+                    written = snprintf(output + length, available, spec, arg.m_type == Arg::POINTER ? arg.m_pointer : nullptr);
+                    break;
+                default:
+                    break;
+            }
+
+            length += std::clamp(written, 0, available - 1);
+        }
+
+        output[length] = '\0';
+        printf("%s\n", output);
+    }
+
+    static long long getInt(const Arg& arg)
+    {
+        switch(arg.m_type)
+        {
+            case Arg::INT:
+                return arg.m_int;
+            case Arg::UINT:
+                return static_cast<long long>(arg.m_uint);
+            case Arg::DOUBLE:
+                return static_cast<long long>(arg.m_double);
+            case Arg::POINTER:
+                return static_cast<long long>(reinterpret_cast<uintptr_t>(arg.m_pointer));
+            default:
+                return 0;
+        }
+    }
+
+    static double getDouble(const Arg& arg)
+    {
+        switch(arg.m_type)
+        {
+            case Arg::DOUBLE:
+                return arg.m_double;
+            case Arg::INT:
+                return static_cast<double>(arg.m_int);
+            case Arg::UINT:
+                return static_cast<double>(arg.m_uint);
+            default:
+                return 0.;
+        }
+    }
+
+    std::atomic<LogLevel> m_level;
+    Ring* m_rings[MaxNumThreads];
+    std::atomic<int> m_numRings;
+    std::mutex m_registerMutex; // only taken by threads logging for the first time
+    std::mutex m_flushMutex; // consumer side only
+    std::vector<Record> m_pending; // consumer side only
+    unsigned long m_numReportedDrops;
+    const int m_flushIntervalMs;
+    std::atomic<bool> m_runningFlag;
+    std::thread m_thread; // started with the first ring, under m_registerMutex
+};
+
+inline Logger g_logger;
@@ -2,6 +2,24 @@
 
 #include <cmath>
 
+/*
+    Some C libraries (e.g. glibc) define the math constants as macros when including cmath,
+    which would clash with the constants declared in the Math namespace.
+*/
+#undef M_E
+#undef M_LOG2E
+#undef M_LOG10E
+#undef M_LN2
+#undef M_LN10
+#undef M_PI
+#undef M_PI_2
+#undef M_PI_4
+#undef M_1_PI
+#undef M_2_PI
+#undef M_2_SQRTPI
+#undef M_SQRT2
+#undef M_SQRT1_2
+
 /*
     Wrapping up some math constants and functions
 */
@@ -0,0 +1,456 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AudioBuffer.h"
+#include "Logger.h"
+#include "WorkerPool.h"
+
+/*
+    Submix bus graph.
+
+    Voices are mixed into buses (e.g. sfx, music, voice) which are mixed into other buses down to the master bus.
+    Each bus can have effect inserts, a gain and sends to other buses.
+
+    - MixGraphDesc: editable description of the graph, built off the audio thread.
+    - MixGraph: the description compiled into a static schedule with preallocated planar buffers (AudioBuffer).
+      Buses are grouped by levels: all the inputs of a bus belong to previous levels, so that the buses of a level
+      are independent and can be processed in parallel. Each bus pulls (sums) its inputs into its own buffer,
+      therefore no two jobs ever write to the same buffer. The master bus is interleaved once into the output.
+    - MixGraphProcessor: executes the current graph on the audio thread and a WorkerPool.
+      A new graph is built off-thread and swapped in atomically at the beginning of a block.
+
+    Each bus job renders the voices of its bus (a MixSourceFunc given to execute), pulls its inputs, then runs its
+    inserts and gain: the voices of the buses of a level are rendered in parallel with each other, e.g. the sfx,
+    music and voice groups. Voices can also be mixed into the buses on the audio thread between beginBlock and
+    execute, e.g. when the block is split at the sample time of scheduled tasks, in which case only the inserts and
+    the gains run in parallel.
+*/
+
+/* Effect insert function type: processes the planar channels of a bus in place */
+typedef void (*MixInsertFunc)(float* const* channels, unsigned long framesPerBuffer, int numChannels, void* context);
+
+/*
+    Voice source function type: mixes the voices of the given bus into its planar channels. Called from the job of the
+    bus, concurrently for the buses of a level: a voice must be mixed into a single bus.
+*/
+typedef void (*MixSourceFunc)(int bus, float* const* channels, unsigned long framesPerBuffer, int numChannels, void* context);
+
+/*
+    MixGraphDesc
+    Description of a bus graph. Bus 0 is the master bus and it's always present.
+*/
+class MixGraphDesc
+{
+public:
+    static const int MasterBus = 0;
+
+    MixGraphDesc()
+    {
+        m_buses.emplace_back();
+        m_buses.back().m_name = "master";
+    }
+
+    /* Add a bus routed to outputBus, returns the bus index */
+    int addBus(const char* name, int outputBus = MasterBus, float gain = 1.f)
+    {
+        int index = static_cast<int>(m_buses.size());
+        m_buses.emplace_back();
+        m_buses.back().m_name = name;
+        m_buses.back().m_gain = gain;
+        addRoute(index, outputBus, 1.f);
+        return index;
+    }
+
+    /* Send a bus (post gain and inserts) to another bus */
+    bool addSend(int fromBus, int toBus, float sendGain)
+    {
+        return addRoute(fromBus, toBus, sendGain);
+    }
+
+    bool addInsert(int bus, MixInsertFunc fn, void* context)
+    {
+        if(!isValidBus(bus) || !fn)
+        {
+            return false;
+        }
+
+        m_buses[bus].m_inserts.push_back({fn, context});
+        return true;
+    }
+
+    bool setGain(int bus, float gain)
+    {
+        if(!isValidBus(bus))
+        {
+            return false;
+        }
+
+        m_buses[bus].m_gain = gain;
+        return true;
+    }
+
+    /* Returns the index of the bus with the given name, -1 if not found */
+    int findBus(const char* name) const
+    {
+        for(size_t i=0; i<m_buses.size(); ++i)
+        {
+            if(m_buses[i].m_name == name)
+            {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    int getNumBuses() const
+    {
+        return static_cast<int>(m_buses.size());
+    }
+
+private:
+    friend class MixGraph;
+
+    struct Insert
+    {
+        MixInsertFunc m_fn;
+        void* m_context;
+    };
+
+    struct Input
+    {
+        int m_bus;
+        float m_gain;
+    };
+
+    struct Bus
+    {
+        std::string m_name;
+        float m_gain = 1.f;
+        std::vector<Insert> m_inserts;
+        std::vector<Input> m_inputs; // buses routed or sent to this bus
+    };
+
+    bool isValidBus(int bus) const
+    {
+        return bus >= 0 && bus < static_cast<int>(m_buses.size());
+    }
+
+    bool addRoute(int fromBus, int toBus, float gain)
+    {
+        if(!isValidBus(fromBus) || !isValidBus(toBus) || fromBus == toBus)
+        {
+            LM_ERROR("MixGraphDesc: invalid route from bus %i to bus %i.", fromBus, toBus);
+            return false;
+        }
+
+        m_buses[toBus].m_inputs.push_back({fromBus, gain});
+        return true;
+    }
+
+    std::vector<Bus> m_buses;
+};
+
+/*
+    MixGraph
+    A compiled graph. Created with compile (off the audio thread), then only used by the audio thread.
+*/
+class MixGraph
+{
+public:
+    /* Returns nullptr if the description contains a cycle */
+    static MixGraph* compile(const MixGraphDesc& desc, int numChannels, unsigned long maxFramesPerBuffer)
+    {
+        int numBuses = desc.getNumBuses();
+
+        // level of each bus: 1 + the highest level of its inputs
+        std::vector<int> levels(numBuses, -1);
+        std::vector<int> visitState(numBuses, 0); // 0 not visited, 1 visiting, 2 visited
+        for(int b=0; b<numBuses; ++b)
+        {
+            if(!computeLevel(desc, b, levels, visitState))
+            {
+                LM_ERROR("MixGraph: the graph contains a cycle.");
+                return nullptr;
+            }
+        }
+
+        MixGraph* graph = new MixGraph(numChannels, maxFramesPerBuffer);
+        graph->m_buses.resize(numBuses);
+        for(int b=0; b<numBuses; ++b)
+        {
+            const MixGraphDesc::Bus& descBus = desc.m_buses[b];
+            Bus& bus = graph->m_buses[b];
+            bus.m_gain = descBus.m_gain;
+            bus.m_inserts = descBus.m_inserts;
+            bus.m_inputs = descBus.m_inputs;
+            bus.m_buffer = std::make_unique<AudioBuffer>(numChannels, maxFramesPerBuffer);
+        }
+
+        int numLevels = *std::max_element(levels.begin(), levels.end()) + 1;
+        graph->m_schedule.resize(numLevels);
+        for(int b=0; b<numBuses; ++b)
+        {
+            graph->m_schedule[levels[b]].push_back(b);
+        }
+
+        return graph;
+    }
+
+    // Deleting other special member functions as they may cause shallow copies
+    MixGraph(const MixGraph&) = delete;
+    MixGraph& operator=(const MixGraph&) = delete;
+    MixGraph(MixGraph&& other) = delete;
+    MixGraph& operator=(MixGraph&& other) = delete;
+
+    /* Audio thread. Planar channels where voices are mixed, valid between beginBlock and execute */
+    float* const* getBusChannels(int bus)
+    {
+        return bus >= 0 && bus < getNumBuses() ? m_buses[bus].m_buffer->getChannels() : nullptr;
+    }
+
+    /* Audio thread. Change the gain of a bus without rebuilding the graph */
+    void setGain(int bus, float gain)
+    {
+        if(bus >= 0 && bus < getNumBuses())
+        {
+            m_buses[bus].m_gain = gain;
+        }
+    }
+
+    int getNumBuses() const
+    {
+        return static_cast<int>(m_buses.size());
+    }
+
+    int getNumLevels() const
+    {
+        return static_cast<int>(m_schedule.size());
+    }
+
+    int getNumChannels() const
+    {
+        return m_numChannels;
+    }
+
+private:
+    friend class MixGraphProcessor;
+
+    struct Bus
+    {
+        float m_gain;
+        std::vector<MixGraphDesc::Insert> m_inserts;
+        std::vector<MixGraphDesc::Input> m_inputs;
+        std::unique_ptr<AudioBuffer> m_buffer;
+    };
+
+    MixGraph(int numChannels, unsigned long maxFramesPerBuffer):
+        m_numChannels(numChannels),
+        m_maxFramesPerBuffer(maxFramesPerBuffer),
+        m_framesPerBuffer(0),
+        m_level(0),
+        m_source(nullptr),
+        m_sourceContext(nullptr)
+    {
+
+    }
+
+    static bool computeLevel(const MixGraphDesc& desc, int bus, std::vector<int>& levels, std::vector<int>& visitState)
+    {
+        if(visitState[bus] == 2)
+        {
+            return true;
+        }
+        if(visitState[bus] == 1)
+        {
+            return false; // cycle
+        }
+
+        visitState[bus] = 1;
+        int level = 0;
+        for(const MixGraphDesc::Input& input : desc.m_buses[bus].m_inputs)
+        {
+            if(!computeLevel(desc, input.m_bus, levels, visitState))
+            {
+                return false;
+            }
+            level = std::max(level, levels[input.m_bus] + 1);
+        }
+        levels[bus] = level;
+        visitState[bus] = 2;
+
+        return true;
+    }
+
+    void clear(unsigned long framesPerBuffer)
+    {
+        m_framesPerBuffer = std::min(framesPerBuffer, m_maxFramesPerBuffer);
+        for(Bus& bus : m_buses)
+        {
+            bus.m_buffer->clear(m_framesPerBuffer);
+        }
+    }
+
+    /* Job executed by the worker pool: process one bus of the current level */
+    static void processBusJob(int jobIndex, void* context)
+    {
+        MixGraph* graph = (MixGraph*)context;
+        graph->processBus(graph->m_schedule[graph->m_level][jobIndex]);
+    }
+
+    void processBus(int busIndex)
+    {
+        Bus& bus = m_buses[busIndex];
+        float* const* channels = bus.m_buffer->getChannels();
+        const unsigned long numFrames = m_framesPerBuffer;
+
+        if(m_source)
+        {
+            m_source(busIndex, channels, numFrames, m_numChannels, m_sourceContext);
+        }
+
+        // pulling the inputs, they have all been processed in previous levels
+        for(const MixGraphDesc::Input& input : bus.m_inputs)
+        {
+            const float* const* sources = m_buses[input.m_bus].m_buffer->getChannels();
+            const float gain = input.m_gain;
+            for(int c=0; c<m_numChannels; ++c)
+            {
+                AudioBufferUtils::addScaled(channels[c], sources[c], gain, numFrames);
+            }
+        }
+
+        for(const MixGraphDesc::Insert& insert : bus.m_inserts)
+        {
+            insert.m_fn(channels, numFrames, m_numChannels, insert.m_context);
+        }
+
+        if(bus.m_gain != 1.f)
+        {
+            for(int c=0; c<m_numChannels; ++c)
+            {
+                AudioBufferUtils::scale(channels[c], bus.m_gain, numFrames);
+            }
+        }
+    }
+
+    void execute(WorkerPool& pool, float* outputBuffer, MixSourceFunc source, void* sourceContext)
+    {
+        m_source = source;
+        m_sourceContext = sourceContext;
+        for(m_level=0; m_level<getNumLevels(); ++m_level)
+        {
+            pool.run(processBusJob, this, static_cast<int>(m_schedule[m_level].size()));
+        }
+
+        // the only interleaved write of the block
+        AudioBufferUtils::interleave(m_buses[MixGraphDesc::MasterBus].m_buffer->getChannels(), m_numChannels, m_framesPerBuffer, outputBuffer);
+    }
+
+    const int m_numChannels;
+    const unsigned long m_maxFramesPerBuffer;
+    unsigned long m_framesPerBuffer; // size of the block being processed
+    int m_level; // level being processed
+    MixSourceFunc m_source; // of the block being processed
+    void* m_sourceContext;
+
+    std::vector<Bus> m_buses;
+    std::vector<std::vector<int>> m_schedule; // bus indices for each level
+};
+
+/*
+    MixGraphProcessor
+    Owns the worker pool and the current graph.
+    setGraph and collectGarbage are called from a single non audio thread (e.g. the game thread),
+    beginBlock and execute from the audio thread.
+*/
+class MixGraphProcessor
+{
+public:
+    MixGraphProcessor(int numWorkers):
+        m_pool(numWorkers),
+        m_current(nullptr),
+        m_pending(nullptr),
+        m_retired(nullptr)
+    {
+
+    }
+
+    ~MixGraphProcessor()
+    {
+        delete m_current;
+        delete m_pending.load();
+        delete m_retired.load();
+    }
+
+    // Deleting other special member functions as they may cause shallow copies
+    MixGraphProcessor(const MixGraphProcessor&) = delete;
+    MixGraphProcessor& operator=(const MixGraphProcessor&) = delete;
+    MixGraphProcessor(MixGraphProcessor&& other) = delete;
+    MixGraphProcessor& operator=(MixGraphProcessor&& other) = delete;
+
+    /* Game thread. Takes ownership of the graph which is swapped in at the beginning of the next block */
+    void setGraph(MixGraph* graph)
+    {
+        collectGarbage();
+
+        // a graph still pending has never been seen by the audio thread: safe to delete
+        MixGraph* previous = m_pending.exchange(graph, std::memory_order_acq_rel);
+        delete previous;
+    }
+
+    /* Game thread. Delete the graph replaced by the audio thread, if any */
+    void collectGarbage()
+    {
+        MixGraph* retired = m_retired.exchange(nullptr, std::memory_order_acq_rel);
+        delete retired;
+    }
+
+    /* Audio thread. Swap in a pending graph and clear the bus buffers. Returns the graph to mix the voices into. */
+    MixGraph* beginBlock(unsigned long framesPerBuffer)
+    {
+        // only swapping once the previous retired graph has been collected: the audio thread never deletes
+        if(m_pending.load(std::memory_order_relaxed) && !m_retired.load(std::memory_order_acquire))
+        {
+            MixGraph* graph = m_pending.exchange(nullptr, std::memory_order_acq_rel);
+            if(graph)
+            {
+                m_retired.store(m_current, std::memory_order_release);
+                m_current = graph;
+            }
+        }
+
+        if(m_current)
+        {
+            m_current->clear(framesPerBuffer);
+        }
+
+        return m_current;
+    }
+
+    /*
+        Audio thread. Process the graph and interleave the master bus into the output buffer. With a source, the voices
+        of each bus are rendered by its job (see MixSourceFunc), after those mixed since beginBlock.
+    */
+    void execute(float* outputBuffer, unsigned long framesPerBuffer, int numChannels, MixSourceFunc source = nullptr, void* sourceContext = nullptr)
+    {
+        if(!m_current)
+        {
+            memset(outputBuffer, 0, framesPerBuffer * numChannels * sizeof(float));
+            return;
+        }
+
+        m_current->execute(m_pool, outputBuffer, source, sourceContext);
+    }
+
+private:
+    WorkerPool m_pool;
+    MixGraph* m_current; // audio thread only
+    std::atomic<MixGraph*> m_pending; // built by the game thread, waiting to be swapped in
+    std::atomic<MixGraph*> m_retired; // replaced by the audio thread, waiting to be deleted
+};
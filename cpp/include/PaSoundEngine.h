@@ -10,8 +10,8 @@
 class PaSoundEngine : public SoundEngine
 {
 public:
-    PaSoundEngine(double sampleRate, int numChannels, unsigned long framesPerBuffer):
-        SoundEngine(sampleRate, numChannels, framesPerBuffer)
+    PaSoundEngine(double sampleRate, int numChannels, unsigned long framesPerBuffer, SampleFormat outputFormat = SampleFormat::FLOAT32):
+        SoundEngine(sampleRate, numChannels, framesPerBuffer, 3, outputFormat)
     {
 
     }
@@ -28,13 +28,12 @@ public:
                                 void *userData)
             {
                 PaSoundEngine* soundEngine = (PaSoundEngine*) userData;
-                float *out = (float*)outputBuffer;
-                soundEngine->callback(out, soundEngine->m_numChannels, framesPerBuffer, userData);
+                soundEngine->callback(outputBuffer, soundEngine->m_numChannels, framesPerBuffer, userData);
 
                 return 0;
             };
 
-            pa.openStartStream(0, m_numChannels, m_sampleRate, m_framesPerBuffer, callback, this);
+            pa.openStartStream(0, m_numChannels, m_sampleRate, m_framesPerBuffer, callback, this, getPaSampleFormat(m_outputFormat));
         }
     }
 
@@ -58,5 +57,18 @@ public:
     }
 
 private:
+    static PaSampleFormat getPaSampleFormat(SampleFormat format)
+    {
+        switch(format)
+        {
+            case SampleFormat::INT16:
+                return paInt16;
+            case SampleFormat::INT24:
+                return paInt24;
+            default:
+                return paFloat32;
+        }
+    }
+
     PaWrapper pa;
 };
\ No newline at end of file
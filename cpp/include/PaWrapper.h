@@ -48,9 +48,10 @@ public:
                             double sampleRate,
                             unsigned long framesPerBuffer,
                             PaStreamCallback *streamCallback,
-                            void *userData )
+                            void *userData,
+                            PaSampleFormat sampleFormat = paFloat32)
     {    
-        openStream(inputChannelCount, outputChannelCount, sampleRate, framesPerBuffer, streamCallback, userData);
+        openStream(inputChannelCount, outputChannelCount, sampleRate, framesPerBuffer, streamCallback, userData, sampleFormat);
         startStream();
     } 
 
@@ -66,7 +67,8 @@ public:
                             double sampleRate,
                             unsigned long framesPerBuffer,
                             PaStreamCallback *streamCallback,
-                            void *userData)
+                            void *userData,
+                            PaSampleFormat sampleFormat = paFloat32)
     {
         if(!m_stream)
         {
@@ -74,7 +76,7 @@ public:
             PaError err = Pa_OpenDefaultStream(&m_stream,
                                         inputChannelCount,          /* no input channels */
                                         outputChannelCount,          /* stereo output */
-                                        paFloat32,  /* 32 bit floating point output */
+                                        sampleFormat,  /* 32 bit floating point output by default */
                                         sampleRate,      /* sample rate */ 
                                         framesPerBuffer, /* frames per buffer, use paFramesPerBufferUnspecified 
                                                             to make PortAudio pick the best, possibly changing, buffer size.*/
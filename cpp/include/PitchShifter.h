@@ -0,0 +1,478 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "AudioSignalUtils.h"
+#include "GranularSynth.h"
+#include "Logger.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define WAVEFORM_SIMILARITY_SSE
+#endif
+
+/*
+    Waveform similarity search (WSOLA): among candidate segments, the one most similar to a template segment, so that
+    the next grain continues the waveform of the previous one instead of cancelling it.
+    The similarity is the cross-correlation normalised by the candidate energy (the template energy being the same for
+    every candidate). The correlations are SSE dot products.
+*/
+namespace WaveformSimilarity
+{
+    inline float dot(const float* a, const float* b, int length)
+    {
+        int i = 0;
+        float sum = 0.f;
+#ifdef WAVEFORM_SIMILARITY_SSE
+        // two accumulators to hide the latency of the additions
+        __m128 sums0 = _mm_setzero_ps();
+        __m128 sums1 = _mm_setzero_ps();
+        const int numPairSamples = length & ~7;
+        for(; i < numPairSamples; i += 8)
+        {
+            sums0 = _mm_add_ps(sums0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+            sums1 = _mm_add_ps(sums1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+        }
+        const int numVectorSamples = length & ~3;
+        for(; i < numVectorSamples; i += 4)
+        {
+            sums0 = _mm_add_ps(sums0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, _mm_add_ps(sums0, sums1));
+        sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+        for(; i < length; ++i)
+        {
+            sum += a[i] * b[i];
+        }
+        return sum;
+    }
+
+    /* Candidate energy normalised cross-correlation, the higher the more similar */
+    inline float getScore(const float* templateSegment, const float* candidate, int length, float energy)
+    {
+        return dot(templateSegment, candidate, length) / std::sqrt(std::max(energy, 1e-12f));
+    }
+
+    /*
+        Offset in [0, numCandidates) of the segment of candidates (length samples from the offset) most similar to the
+        template. Coarse to fine: every CoarseStep offsets from the middle candidate (the nominal position), then every
+        offset around the best one. Ties go to the offset closest to the middle, e.g. on silence.
+    */
+    inline int findBestOffset(const float* templateSegment, const float* candidates, int numCandidates, int length)
+    {
+        static const int CoarseStep = 4;
+        const int middle = numCandidates / 2;
+        int bestOffset = middle;
+        float bestScore = -1e30f;
+        auto compare = [&](int offset, float score)
+        {
+            if(score > bestScore || (score == bestScore && std::abs(offset - middle) < std::abs(bestOffset - middle)))
+            {
+                bestScore = score;
+                bestOffset = offset;
+            }
+        };
+
+        // coarse pass, the candidate energy slides along
+        float energy = dot(candidates, candidates, length);
+        for(int offset = 0; offset < numCandidates; ++offset)
+        {
+            if((offset - middle) % CoarseStep == 0)
+            {
+                compare(offset, getScore(templateSegment, candidates + offset, length, energy));
+            }
+            energy += candidates[offset + length] * candidates[offset + length] - candidates[offset] * candidates[offset];
+        }
+
+        // fine pass
+        const int coarseOffset = bestOffset;
+        for(int offset = std::max(0, coarseOffset - CoarseStep + 1); offset < std::min(numCandidates, coarseOffset + CoarseStep); ++offset)
+        {
+            if(offset != coarseOffset)
+            {
+                compare(offset, getScore(templateSegment, candidates + offset, length, dot(candidates + offset, candidates + offset, length)));
+            }
+        }
+        return bestOffset;
+    }
+}
+
+/*
+    PitchShifter
+    Streaming pitch shift with a fixed latency, processing blocks in place: an insert for a voice (e.g. after
+    Sound::render) or a bus (insert() matches MixInsertFunc).
+
+    The input is written to a history ring per channel. Every hop (half a grain) a grain starts: like the grains of
+    IGranularSynth it is Hann windowed and reads the history at the pitch ratio with linear interpolation, and two
+    grains overlap at any time (periodic Hann windows at 50% overlap sum to 1). The grain starts around the input
+    delayed by the latency, at the offset within the search radius where the waveform best continues the previous grain
+    (WaveformSimilarity, on the mean of the channels so that every channel uses the same grains).
+
+    Latency: (maxPitch - 1) * grainSamples (a grain read at maxPitch must not catch up with the input) plus the search
+    radius and the correlation length, 1410 samples (29 ms at 48 kHz) with the defaults. At a pitch of 1 the output is
+    the input delayed by the latency.
+    The pitch is set from the thread calling process(), it is applied from the next grain.
+*/
+class PitchShifter
+{
+public:
+    PitchShifter(int numChannels, int grainSamples = 1024, float maxPitch = 2.f, int searchRadius = 128, int correlationSamples = 256):
+        m_numChannels(std::max(1, numChannels)),
+        m_grainSamples(std::max(16, grainSamples / 2 * 2)),
+        m_hopSamples(m_grainSamples / 2),
+        m_maxPitch(std::max(1.f, maxPitch)),
+        m_searchRadius(std::max(0, searchRadius)),
+        m_correlationSamples(std::max(4, correlationSamples)),
+        m_pitch(1.f)
+    {
+        m_latency = static_cast<int>(std::ceil((m_maxPitch - 1.f) * m_grainSamples)) + m_searchRadius + m_correlationSamples + 2;
+
+        // oldest sample read: a grain started a grain ago, searched from latency + radius before, the block ahead
+        int historySize = 1;
+        while(historySize < 2 * m_grainSamples + m_latency + m_searchRadius)
+        {
+            historySize *= 2;
+        }
+        m_historyMask = historySize - 1;
+        m_history.assign(m_numChannels, std::vector<float>(2 * historySize, 0.f));
+        if(m_numChannels > 1)
+        {
+            m_analysis.assign(2 * historySize, 0.f);
+        }
+
+        m_window.resize(m_grainSamples);
+        AudioSignalUtils::Windows::window<float>(m_window.data(), m_grainSamples, AudioSignalUtils::Windows::Type::HANN, true);
+        m_mean.resize(m_hopSamples);
+        m_template.resize(m_correlationSamples);
+        m_candidates.resize(2 * m_searchRadius + 1 + m_correlationSamples);
+
+        reset();
+    }
+
+    /* Pitch ratio, clamped to [1 / maxPitch, maxPitch] */
+    void setPitch(float pitch)
+    {
+        m_pitch = std::clamp(pitch, 1.f / m_maxPitch, m_maxPitch);
+    }
+
+    float getPitch() const
+    {
+        return m_pitch;
+    }
+
+    /* Delay between the input and the output, in samples */
+    int getLatency() const
+    {
+        return m_latency;
+    }
+
+    int getNumChannels() const
+    {
+        return m_numChannels;
+    }
+
+    /* Clear the history and the grains */
+    void reset()
+    {
+        for(std::vector<float>& history : m_history)
+        {
+            std::fill(history.begin(), history.end(), 0.f);
+        }
+        std::fill(m_analysis.begin(), m_analysis.end(), 0.f);
+        for(Grain& grain : m_grains)
+        {
+            grain = Grain();
+        }
+        m_writeIndex = 0;
+        m_samplesNextGrain = 0;
+        m_nextGrain = 0;
+        m_hasPreviousGrain = false;
+    }
+
+    /* Process numChannels planar channels in place */
+    void process(float* const* channels, unsigned long numFrames)
+    {
+        unsigned long i = 0;
+        while(i < numFrames)
+        {
+            if(m_samplesNextGrain == 0)
+            {
+                startGrain();
+                m_samplesNextGrain = m_hopSamples;
+            }
+
+            const int numSegmentFrames = static_cast<int>(std::min<unsigned long>(numFrames - i, m_samplesNextGrain));
+            write(channels, i, numSegmentFrames);
+            for(int c=0; c<m_numChannels; ++c)
+            {
+                synthesise(c, channels[c] + i, numSegmentFrames);
+            }
+            for(Grain& grain : m_grains)
+            {
+                grain.m_position += numSegmentFrames;
+            }
+
+            m_writeIndex += numSegmentFrames;
+            m_samplesNextGrain -= numSegmentFrames;
+            i += numSegmentFrames;
+        }
+    }
+
+    /* MixInsertFunc with a PitchShifter as context, numChannels must match */
+    static void insert(float* const* channels, unsigned long framesPerBuffer, int numChannels, void* context)
+    {
+        PitchShifter* pitchShifter = static_cast<PitchShifter*>(context);
+        if(numChannels == pitchShifter->getNumChannels())
+        {
+            pitchShifter->process(channels, framesPerBuffer);
+        }
+    }
+
+private:
+    struct Grain
+    {
+        long long m_start = 0; // input index read at the first sample
+        float m_pitch = 1.f;
+        int m_position = 0; // samples played
+        bool m_active = false;
+    };
+
+    void write(float* const* channels, unsigned long offset, int numFrames)
+    {
+        for(int c=0; c<m_numChannels; ++c)
+        {
+            writeHistory(m_history[c], channels[c] + offset, numFrames);
+        }
+
+        if(m_numChannels > 1)
+        {
+            const float scale = 1.f / m_numChannels;
+            float* mean = m_mean.data();
+            for(int j=0; j<numFrames; ++j)
+            {
+                float sum = 0.f;
+                for(int c=0; c<m_numChannels; ++c)
+                {
+                    sum += channels[c][offset + j];
+                }
+                mean[j] = sum * scale;
+            }
+            writeHistory(m_analysis, mean, numFrames);
+        }
+    }
+
+    /* Start a grain at the write index, searching around the input delayed by the latency */
+    void startGrain()
+    {
+        long long start = m_writeIndex - m_latency;
+        if(m_hasPreviousGrain && m_searchRadius > 0)
+        {
+            // where the previous grain would continue from, and the candidates around the nominal start
+            const Grain& previous = m_grains[1 - m_nextGrain];
+            const std::vector<float>& analysis = m_numChannels > 1 ? m_analysis : m_history[0];
+            readHistory(analysis, previous.m_start + std::lround(previous.m_pitch * m_hopSamples), m_template.data(), m_correlationSamples);
+            readHistory(analysis, start - m_searchRadius, m_candidates.data(), static_cast<int>(m_candidates.size()));
+            start += WaveformSimilarity::findBestOffset(m_template.data(), m_candidates.data(), 2 * m_searchRadius + 1, m_correlationSamples) - m_searchRadius;
+        }
+
+        Grain& grain = m_grains[m_nextGrain];
+        grain.m_start = start;
+        grain.m_pitch = m_pitch;
+        grain.m_position = 0;
+        grain.m_active = true;
+        m_nextGrain = 1 - m_nextGrain;
+        m_hasPreviousGrain = true;
+    }
+
+    /* Write at the write index and at the same index plus the history size (the mirror) */
+    void writeHistory(std::vector<float>& history, const float* input, int numFrames)
+    {
+        const int historySize = m_historyMask + 1;
+        for(int j=0; j<numFrames; ++j)
+        {
+            const int index = static_cast<int>((m_writeIndex + j) & m_historyMask);
+            history[index] = input[j];
+            history[index + historySize] = input[j];
+        }
+    }
+
+    void readHistory(const std::vector<float>& history, long long start, float* output, int numSamples) const
+    {
+        std::copy_n(history.data() + (start & m_historyMask), numSamples, output);
+    }
+
+    /* Overwrite output with the sum of the active grains of the channel */
+    void synthesise(int channel, float* output, int numFrames)
+    {
+        std::fill(output, output + numFrames, 0.f);
+        const std::vector<float>& history = m_history[channel];
+        for(const Grain& grain : m_grains)
+        {
+            if(!grain.m_active)
+            {
+                continue;
+            }
+
+            // the mirrored history is contiguous over a grain
+            const float* source = history.data() + (grain.m_start & m_historyMask);
+            const float* window = m_window.data() + grain.m_position;
+            const float pitch = grain.m_pitch;
+            const int numGrainFrames = std::min(numFrames, m_grainSamples - grain.m_position);
+            int j = 0;
+#ifdef WAVEFORM_SIMILARITY_SSE
+            // four read heads at a time, the interpolated samples are gathered through the integer indices
+            const __m128 pitches = _mm_set1_ps(pitch);
+            const int numVectorFrames = numGrainFrames & ~3;
+            for(; j < numVectorFrames; j += 4)
+            {
+                const __m128i positions = _mm_add_epi32(_mm_set1_epi32(grain.m_position + j), _mm_setr_epi32(0, 1, 2, 3));
+                const __m128 heads = _mm_mul_ps(_mm_cvtepi32_ps(positions), pitches);
+                const __m128i indices = _mm_cvttps_epi32(heads);
+                const __m128 fracs = _mm_sub_ps(heads, _mm_cvtepi32_ps(indices));
+                alignas(16) int lanes[4];
+                _mm_store_si128(reinterpret_cast<__m128i*>(lanes), indices);
+                const __m128 samples1 = _mm_setr_ps(source[lanes[0]], source[lanes[1]], source[lanes[2]], source[lanes[3]]);
+                const __m128 samples2 = _mm_setr_ps(source[lanes[0] + 1], source[lanes[1] + 1], source[lanes[2] + 1], source[lanes[3] + 1]);
+                const __m128 samples = _mm_add_ps(samples1, _mm_mul_ps(fracs, _mm_sub_ps(samples2, samples1)));
+                _mm_storeu_ps(output + j, _mm_add_ps(_mm_loadu_ps(output + j), _mm_mul_ps(samples, _mm_loadu_ps(window + j))));
+            }
+#endif
+            for(; j<numGrainFrames; ++j)
+            {
+                const float head = (grain.m_position + j) * pitch;
+                const int index = static_cast<int>(head);
+                const float frac = head - index;
+                output[j] += (source[index] + frac * (source[index + 1] - source[index])) * window[j];
+            }
+        }
+
+        // grains end on the last channel, once every channel has been synthesised
+        if(channel == m_numChannels - 1)
+        {
+            for(Grain& grain : m_grains)
+            {
+                grain.m_active = grain.m_active && grain.m_position + numFrames < m_grainSamples;
+            }
+        }
+    }
+
+    const int m_numChannels;
+    const int m_grainSamples;
+    const int m_hopSamples;
+    const float m_maxPitch;
+    const int m_searchRadius;
+    const int m_correlationSamples;
+    int m_latency;
+    float m_pitch;
+
+    std::vector<std::vector<float>> m_history; // one ring per channel, mirrored: twice the history size
+    std::vector<float> m_analysis; // mean of the channels, when more than one
+    int m_historyMask;
+    long long m_writeIndex; // input samples written since the last reset
+
+    std::vector<float> m_window; // periodic Hann
+    std::vector<float> m_mean; // preallocated segment and search buffers
+    std::vector<float> m_template;
+    std::vector<float> m_candidates;
+
+    Grain m_grains[2];
+    int m_nextGrain;
+    int m_samplesNextGrain;
+    bool m_hasPreviousGrain;
+};
+
+/*
+    TimeStretchSynth
+    Playback of a source with independent tempo and pitch: an IGranularSynth whose grains, half overlapping, follow
+    the source at the tempo (setStretch: output duration over source duration) and are read at the pitch ratio.
+    Each grain starts at the offset, within the search radius, where the waveform best continues the previous grain.
+    The source loops.
+*/
+class TimeStretchSynth : public IGranularSynth
+{
+public:
+    TimeStretchSynth(int grainSamples = 1024, int searchRadius = 128, int correlationSamples = 256):
+        m_grainSamples(std::max(16, grainSamples)),
+        m_searchRadius(std::max(0, searchRadius)),
+        m_correlationSamples(std::max(4, correlationSamples)),
+        m_stretch(1.f),
+        m_pitch(1.f),
+        m_sourcePosition(0.),
+        m_previousStart(-1),
+        m_previousPitch(1.f)
+    {
+
+    }
+
+    virtual void init(const std::vector<float>& source) override
+    {
+        IGranularSynth::init(source);
+        m_sourcePosition = 0.;
+        m_previousStart = -1;
+    }
+
+    /* Output duration over source duration, in [0.25, 4] */
+    void setStretch(float stretch)
+    {
+        m_stretch = std::clamp(stretch, 0.25f, 4.f);
+    }
+
+    /* Pitch ratio, in [0.5, 2] */
+    void setPitch(float pitch)
+    {
+        m_pitch = std::clamp(pitch, 0.5f, 2.f);
+    }
+
+    virtual void getParams(int& grainStartPosition, int& grainDurationSamples, float& grainOverlap, float& grainPitch) override
+    {
+        const std::vector<float>& source = *m_source;
+        const int hopSamples = m_grainSamples / 2;
+        const int lastStart = static_cast<int>(source.size()) - static_cast<int>(std::ceil(m_grainSamples * m_pitch)) - 2;
+        if(lastStart <= 0)
+        {
+            LM_ERROR("TimeStretchSynth: source shorter than a grain.");
+            grainStartPosition = 0;
+            grainDurationSamples = 0;
+            return;
+        }
+
+        if(m_sourcePosition > lastStart)
+        {
+            m_sourcePosition = 0.; // the search still continues the previous grain across the loop point
+        }
+
+        int start = static_cast<int>(m_sourcePosition);
+        const int templateStart = m_previousStart + static_cast<int>(std::lround(m_previousPitch * hopSamples));
+        const int firstCandidate = std::max(0, start - m_searchRadius);
+        const int numCandidates = std::min(start + m_searchRadius, lastStart) - firstCandidate + 1;
+        if(m_previousStart >= 0 && numCandidates > 0 && templateStart + m_correlationSamples < static_cast<int>(source.size())
+            && firstCandidate + numCandidates + m_correlationSamples < static_cast<int>(source.size()))
+        {
+            start = firstCandidate + WaveformSimilarity::findBestOffset(source.data() + templateStart, source.data() + firstCandidate,
+                                                                          numCandidates, m_correlationSamples);
+        }
+
+        m_previousStart = start;
+        m_previousPitch = m_pitch;
+        m_sourcePosition += hopSamples / m_stretch;
+
+        grainStartPosition = start;
+        grainDurationSamples = m_grainSamples;
+        grainOverlap = 0.5f;
+        grainPitch = m_pitch;
+    }
+
+private:
+    const int m_grainSamples;
+    const int m_searchRadius;
+    const int m_correlationSamples;
+    float m_stretch;
+    float m_pitch;
+    double m_sourcePosition; // nominal start of the next grain
+    int m_previousStart; // -1 when the next grain does not continue a previous one
+    float m_previousPitch;
+};
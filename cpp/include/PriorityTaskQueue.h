@@ -0,0 +1,235 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "CycleClock.h"
+#include "TaskQueue.h"
+#include "TaskScheduler.h"
+
+/*
+    PriorityTaskQueue
+    Task queue with priority lanes, drained by the consumer thread under a time budget.
+    Single-producer single-consumer model (each lane is a TaskQueue).
+
+    Every block the consumer drains the lanes in priority order:
+    - CRITICAL tasks (e.g. stop, emergency mute) are always all processed, whatever the budget.
+    - the other lanes are processed until the budget in microseconds is used, the remaining tasks wait for the next block.
+    Tasks keep their order within a lane, but a task can overtake tasks pushed before it in a lower priority lane.
+    Tasks pushed with a sample time are handed to a TaskScheduler (if given) instead of being executed.
+    The lanes share a wake signal: waitForTasks() blocks the consumer until a task is pushed to any lane.
+    A batch (TaskQueue::Batch) is published whole; in a budgeted lane it may still be processed over several blocks.
+
+    Stats are updated by the consumer and can be read from any thread.
+*/
+class PriorityTaskQueue
+{
+public:
+    enum Priority
+    {
+        CRITICAL,
+        HIGH,
+        NORMAL,
+        LOW,
+        NumPriorities
+    };
+
+    struct Stats
+    {
+        int m_numLastDrained = 0; // tasks processed in the last drained block
+        int m_maxDrained = 0; // maximum number of tasks processed in a block
+        int m_backlog = 0; // tasks left in the queue after the last drained block
+        int m_maxBacklog = 0; // maximum number of tasks left in the queue after a block
+        unsigned long m_numDrained = 0; // tasks processed in total
+        unsigned long m_numBlocks = 0; // number of blocks with tasks to process
+        unsigned long m_numOverruns = 0; // blocks where processing the tasks took longer than the budget
+        float m_lastDrainMicroseconds = 0.f; // time spent processing tasks in the last drained block
+    };
+
+    PriorityTaskQueue(int maxNumTasksPerLane, float budgetMicroseconds):
+        m_budgetTicks(0)
+    {
+        CycleClock::calibrate();
+        setBudget(budgetMicroseconds);
+
+        for(int p=0; p<NumPriorities; ++p)
+        {
+            m_lanes[p] = std::make_unique<TaskQueue>(maxNumTasksPerLane);
+            m_lanes[p]->setWakeSignal(&m_wakeSignal);
+        }
+    }
+
+    // Deleting other special member functions as the lanes are not copyable
+    PriorityTaskQueue(const PriorityTaskQueue&) = delete;
+    PriorityTaskQueue& operator=(const PriorityTaskQueue&) = delete;
+
+    /* Producer thread, before pushing. Overflow policy of every lane (see TaskQueue) */
+    void setOverflowPolicy(TaskQueue::OverflowPolicy policy, float blockTimeoutMicroseconds = 0.f)
+    {
+        for(int p=0; p<NumPriorities; ++p)
+        {
+            m_lanes[p]->setOverflowPolicy(policy, blockTimeoutMicroseconds);
+        }
+    }
+
+    /* Producer thread */
+    bool push(Priority priority, TaskQueue::TaskFunction fn, void* context, const void* params = nullptr, size_t paramsSize = 0)
+    {
+        return m_lanes[priority]->push(fn, context, params, paramsSize);
+    }
+
+    /* Producer thread. The task will be executed at sampleTime by the scheduler given to drain() */
+    bool pushAt(uint64_t sampleTime, Priority priority, TaskQueue::TaskFunction fn, void* context, const void* params = nullptr, size_t paramsSize = 0)
+    {
+        return m_lanes[priority]->pushAt(sampleTime, fn, context, params, paramsSize);
+    }
+
+    /* Producer thread. All the tasks of the batch or none, with a single publish (see TaskQueue::pushBatch) */
+    bool pushBatch(Priority priority, TaskQueue::Batch& batch)
+    {
+        return m_lanes[priority]->pushBatch(batch);
+    }
+
+    /* Consumer thread. Process the tasks for this block, returns the number of tasks processed (executed or scheduled). */
+    int drain(float deltaTime, TaskScheduler* scheduler = nullptr)
+    {
+        if(!getNumTasks())
+        {
+            return 0;
+        }
+
+        const uint64_t start = CycleClock::now();
+        const uint64_t budgetTicks = m_budgetTicks.load(std::memory_order_relaxed);
+        int numDrained = 0;
+
+        // critical tasks are never deferred, and taken all at once
+        numDrained += m_lanes[CRITICAL]->consumeAll([deltaTime, scheduler](TaskQueue::Task& task)
+        {
+            dispatch(task, deltaTime, scheduler);
+        });
+
+        // checking the clock after each task, so that at least one task per block is processed if the budget allows
+        TaskQueue::Task task;
+        for(int p=CRITICAL+1; p<NumPriorities; ++p)
+        {
+            while(CycleClock::now() - start < budgetTicks && m_lanes[p]->pop(task))
+            {
+                dispatch(task, deltaTime, scheduler);
+                ++numDrained;
+            }
+        }
+
+        const uint64_t elapsed = CycleClock::now() - start;
+        updateStats(numDrained, elapsed > budgetTicks, elapsed);
+
+        return numDrained;
+    }
+
+    /* Consumer thread. Block until a task is pushed to any lane or wake() is called */
+    void waitForTasks()
+    {
+        m_wakeSignal.wait([this]()
+        {
+            return getNumTasks() > 0;
+        });
+    }
+
+    /* Any thread. Wake the consumer from waitForTasks(), e.g. to stop it */
+    void wake()
+    {
+        m_wakeSignal.wake();
+    }
+
+    /* Thread safe. Number of times the consumer was woken, pushes while it was busy cost no wake */
+    unsigned long getNumWakes() const
+    {
+        return m_wakeSignal.getNumWakes();
+    }
+
+    /* Thread safe */
+    int getNumTasks()
+    {
+        int numTasks = 0;
+        for(int p=0; p<NumPriorities; ++p)
+        {
+            numTasks += m_lanes[p]->getNumTasks();
+        }
+        return numTasks;
+    }
+
+    /* Thread safe, takes effect from the next block */
+    void setBudget(float budgetMicroseconds)
+    {
+        m_budgetTicks.store(CycleClock::microsecondsToTicks(budgetMicroseconds), std::memory_order_relaxed);
+    }
+
+    float getBudget() const
+    {
+        return static_cast<float>(CycleClock::ticksToMicroseconds(m_budgetTicks.load(std::memory_order_relaxed)));
+    }
+
+    /* Thread safe. Each value is consistent on its own, not necessarily with the others. */
+    Stats getStats() const
+    {
+        Stats stats;
+        stats.m_numLastDrained = m_numLastDrained.load(std::memory_order_relaxed);
+        stats.m_maxDrained = m_maxDrained.load(std::memory_order_relaxed);
+        stats.m_backlog = m_backlog.load(std::memory_order_relaxed);
+        stats.m_maxBacklog = m_maxBacklog.load(std::memory_order_relaxed);
+        stats.m_numDrained = m_numDrained.load(std::memory_order_relaxed);
+        stats.m_numBlocks = m_numBlocks.load(std::memory_order_relaxed);
+        stats.m_numOverruns = m_numOverruns.load(std::memory_order_relaxed);
+        stats.m_lastDrainMicroseconds = m_lastDrainMicroseconds.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    /* Timed tasks are executed right away if they cannot be scheduled */
+    static void dispatch(TaskQueue::Task& task, float deltaTime, TaskScheduler* scheduler)
+    {
+        if(task.m_sampleTime != 0 && scheduler && scheduler->schedule(task))
+        {
+            return;
+        }
+
+        task.execute(deltaTime);
+    }
+
+    /* Consumer thread, the only writer of the stats */
+    void updateStats(int numDrained, bool overrun, uint64_t elapsedTicks)
+    {
+        int backlog = getNumTasks();
+
+        m_numLastDrained.store(numDrained, std::memory_order_relaxed);
+        m_backlog.store(backlog, std::memory_order_relaxed);
+        m_lastDrainMicroseconds.store(static_cast<float>(CycleClock::ticksToMicroseconds(elapsedTicks)), std::memory_order_relaxed);
+        m_numDrained.store(m_numDrained.load(std::memory_order_relaxed) + numDrained, std::memory_order_relaxed);
+        m_numBlocks.store(m_numBlocks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        if(numDrained > m_maxDrained.load(std::memory_order_relaxed))
+        {
+            m_maxDrained.store(numDrained, std::memory_order_relaxed);
+        }
+        if(backlog > m_maxBacklog.load(std::memory_order_relaxed))
+        {
+            m_maxBacklog.store(backlog, std::memory_order_relaxed);
+        }
+        if(overrun)
+        {
+            m_numOverruns.store(m_numOverruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    }
+
+    WakeSignal m_wakeSignal; // shared by the lanes
+    std::unique_ptr<TaskQueue> m_lanes[NumPriorities];
+    std::atomic<uint64_t> m_budgetTicks;
+
+    std::atomic<int> m_numLastDrained{0};
+    std::atomic<int> m_maxDrained{0};
+    std::atomic<int> m_backlog{0};
+    std::atomic<int> m_maxBacklog{0};
+    std::atomic<unsigned long> m_numDrained{0};
+    std::atomic<unsigned long> m_numBlocks{0};
+    std::atomic<unsigned long> m_numOverruns{0};
+    std::atomic<float> m_lastDrainMicroseconds{0.f};
+};
@@ -0,0 +1,391 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "CycleClock.h"
+#include "LatencyHistogram.h"
+#include "Logger.h"
+#include "SessionSink.h"
+#include "WorkerPool.h"
+
+/*
+    RenderSession
+    A lightweight engine instance rendered by a RenderServer: no thread, no ring buffer, no device.
+    process and execute have the same role as SoundEngine::audioThreadProcess / audioThreadExecute, and are called
+    for each block on whichever worker renders it (never concurrently for the same session).
+*/
+class RenderSession
+{
+public:
+    struct Stats
+    {
+        unsigned long m_numBlocks = 0;
+        unsigned long m_numDeadlineMisses = 0; // blocks delivered to the sink after their deadline
+        float m_maxLatenessMicroseconds = 0.f;
+    };
+
+    virtual ~RenderSession() {}
+
+    /* Thread safe. Number of frames rendered so far. */
+    uint64_t getSampleTime() const
+    {
+        return m_sampleTime.load(std::memory_order_acquire);
+    }
+
+    /* Thread safe */
+    Stats getStats() const
+    {
+        Stats stats;
+        stats.m_numBlocks = m_numBlocks.load(std::memory_order_relaxed);
+        stats.m_numDeadlineMisses = m_numDeadlineMisses.load(std::memory_order_relaxed);
+        stats.m_maxLatenessMicroseconds = m_maxLatenessMicroseconds.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+protected:
+    /* Render job. e.g. process the commands of the session. */
+    virtual void process(float /*deltaTime*/)
+    {
+
+    }
+
+    /* Render job. Fill the whole interleaved output buffer. */
+    virtual void execute(float* outputBuffer, unsigned long framesPerBuffer, int numChannels) = 0;
+
+private:
+    friend class RenderServer;
+
+    std::atomic<uint64_t> m_sampleTime{0};
+    std::atomic<unsigned long> m_numBlocks{0};
+    std::atomic<unsigned long> m_numDeadlineMisses{0};
+    std::atomic<float> m_maxLatenessMicroseconds{0.f};
+};
+
+/*
+    RenderServer
+    Renders many sessions on a fixed WorkerPool, for server side audio where a SoundEngine (a thread and a ring per
+    instance) per session doesn't scale.
+
+    Each session renders in real time: its block k is released at start + k * period and due at start + (k+1) * period,
+    when it must have been delivered to the session sink. The scheduler (the thread calling run) works in rounds:
+    - every session with a released block gets exactly one block in the round, so that a session catching up after
+      falling behind can't starve the others (fairness),
+    - the round's blocks are ordered by deadline (earliest deadline first) and the workers claim them in that order,
+      so that the most urgent blocks start first (deadline awareness),
+    - when no block is released the scheduler sleeps until the next release.
+    Under overload all the sessions fall behind evenly and the misses are reported per session.
+
+    Sessions are added and removed from a single control thread, also while the server runs. Sessions and sinks are
+    owned by the caller and must outlive their registration.
+*/
+class RenderServer
+{
+public:
+    struct Stats
+    {
+        unsigned long m_numRounds = 0;
+        unsigned long m_numBlocks = 0;
+        unsigned long m_numDeadlineMisses = 0;
+    };
+
+    /* numWorkers threads are created, the thread running the server also renders */
+    RenderServer(double sampleRate, int numChannels, unsigned long framesPerBuffer, int numWorkers, int maxNumSessions):
+        m_sampleRate(sampleRate),
+        m_numChannels(numChannels),
+        m_framesPerBuffer(framesPerBuffer),
+        m_workerPool(numWorkers),
+        m_slots(maxNumSessions),
+        m_runningFlag(false),
+        m_paced(false),
+        m_numRounds(0),
+        m_numBlocks(0),
+        m_numDeadlineMisses(0)
+    {
+        CycleClock::calibrate();
+        m_periodTicks = CycleClock::microsecondsToTicks(1e6 * framesPerBuffer / sampleRate);
+
+        for(Slot& slot : m_slots)
+        {
+            slot.m_buffer.resize(framesPerBuffer * numChannels, 0.f);
+        }
+        m_dueSlots.reserve(maxNumSessions);
+    }
+
+    // Deleting other special member functions as sessions point to the slots
+    RenderServer(const RenderServer&) = delete;
+    RenderServer& operator=(const RenderServer&) = delete;
+    RenderServer(RenderServer&& other) = delete;
+    RenderServer& operator=(RenderServer&& other) = delete;
+
+    /* Control thread. Returns the session id, -1 if the server is full. The session starts rendering right away. */
+    int addSession(RenderSession* session, ISessionSink* sink)
+    {
+        if(!session)
+        {
+            return -1;
+        }
+
+        for(size_t i=0; i<m_slots.size(); ++i)
+        {
+            Slot& slot = m_slots[i];
+            if(slot.m_state.load() == FREE)
+            {
+                slot.m_session = session;
+                slot.m_sink = sink;
+                slot.m_started = false;
+                slot.m_state.store(ACTIVE, std::memory_order_release);
+                return static_cast<int>(i);
+            }
+        }
+
+        LM_ERROR("RenderServer: no free session slot.");
+        return -1;
+    }
+
+    /* Control thread. Returns once the session is not rendered anymore. */
+    bool removeSession(int sessionId)
+    {
+        if(sessionId < 0 || sessionId >= static_cast<int>(m_slots.size()) || m_slots[sessionId].m_state.load() != ACTIVE)
+        {
+            return false;
+        }
+
+        // the scheduler frees the slot between two rounds. Once it is not running (or stopped in the meantime) no
+        // round can render the slot anymore, it is freed here: the state is set before checking the running flag,
+        // and the scheduler sets the flag before checking the states
+        Slot& slot = m_slots[sessionId];
+        slot.m_state.store(REMOVING);
+        while(slot.m_state.load() == REMOVING)
+        {
+            if(!m_runningFlag.load())
+            {
+                int removing = REMOVING;
+                slot.m_state.compare_exchange_strong(removing, FREE);
+                break;
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    int getNumSessions() const
+    {
+        int numSessions = 0;
+        for(const Slot& slot : m_slots)
+        {
+            numSessions += slot.m_state.load(std::memory_order_relaxed) == ACTIVE ? 1 : 0;
+        }
+        return numSessions;
+    }
+
+    /* Render the sessions in real time for durationSeconds on the calling thread and the workers */
+    void run(float durationSeconds)
+    {
+        m_paced = true;
+        m_runningFlag.store(true);
+
+        const uint64_t endTicks = CycleClock::now() + CycleClock::microsecondsToTicks(1e6 * durationSeconds);
+        while(CycleClock::now() < endTicks)
+        {
+            const uint64_t now = CycleClock::now();
+            uint64_t nextReleaseTicks = endTicks;
+
+            m_dueSlots.clear();
+            for(size_t i=0; i<m_slots.size(); ++i)
+            {
+                Slot& slot = m_slots[i];
+                if(!updateSlot(slot, now))
+                {
+                    continue;
+                }
+
+                const uint64_t releaseTicks = slot.m_deadlineTicks - m_periodTicks;
+                if(now >= releaseTicks)
+                {
+                    m_dueSlots.push_back(static_cast<int>(i));
+                }
+                else
+                {
+                    nextReleaseTicks = std::min(nextReleaseTicks, releaseTicks);
+                }
+            }
+
+            if(m_dueSlots.empty())
+            {
+                const uint64_t waitTicks = nextReleaseTicks > now ? nextReleaseTicks - now : 0;
+                std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(CycleClock::ticksToMicroseconds(waitTicks)));
+                continue;
+            }
+
+            // earliest deadline first, workers claim the jobs in order
+            std::sort(m_dueSlots.begin(), m_dueSlots.end(), [this](int a, int b)
+            {
+                return m_slots[a].m_deadlineTicks < m_slots[b].m_deadlineTicks;
+            });
+            executeRound();
+        }
+
+        // sessions removed from now on are freed by removeSession
+        m_runningFlag.store(false);
+    }
+
+    /* Render numBlocks blocks of every session as fast as possible, without deadlines (offline rendering, benchmarks) */
+    void renderBlocks(int numBlocks)
+    {
+        m_paced = false;
+        m_runningFlag.store(true);
+
+        for(int b=0; b<numBlocks; ++b)
+        {
+            const uint64_t now = CycleClock::now();
+            m_dueSlots.clear();
+            for(size_t i=0; i<m_slots.size(); ++i)
+            {
+                if(updateSlot(m_slots[i], now))
+                {
+                    m_dueSlots.push_back(static_cast<int>(i));
+                }
+            }
+            executeRound();
+        }
+
+        m_runningFlag.store(false);
+    }
+
+    /* Thread safe */
+    Stats getStats() const
+    {
+        Stats stats;
+        stats.m_numRounds = m_numRounds.load(std::memory_order_relaxed);
+        stats.m_numBlocks = m_numBlocks.load(std::memory_order_relaxed);
+        stats.m_numDeadlineMisses = m_numDeadlineMisses.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    /* Render time of each session block (process, execute and sink), in microseconds */
+    const LatencyHistogram& getBlockTime() const
+    {
+        return m_blockTime;
+    }
+
+    int getNumThreads() const
+    {
+        return m_workerPool.getNumWorkers() + 1;
+    }
+
+    void print() const
+    {
+        Stats stats = getStats();
+        printf("Render server: %i sessions on %i threads, %lu rounds, %lu blocks, %lu deadline misses\n", getNumSessions(),
+                getNumThreads(), stats.m_numRounds, stats.m_numBlocks, stats.m_numDeadlineMisses);
+        m_blockTime.print("Session block render time");
+    }
+
+    const double m_sampleRate;
+    const int m_numChannels;
+    const unsigned long m_framesPerBuffer;
+
+private:
+    enum SlotState
+    {
+        FREE,
+        ACTIVE,
+        REMOVING
+    };
+
+    struct Slot
+    {
+        std::atomic<int> m_state{FREE};
+        RenderSession* m_session = nullptr;
+        ISessionSink* m_sink = nullptr;
+        bool m_started = false; // scheduler only
+        uint64_t m_deadlineTicks = 0; // of the next block, scheduler and render job of the slot only
+        std::vector<float> m_buffer;
+    };
+
+    /* Scheduler. Handles sessions added or removed since the last round, returns whether the slot renders. */
+    bool updateSlot(Slot& slot, uint64_t now)
+    {
+        int state = slot.m_state.load();
+        if(state == REMOVING)
+        {
+            // removeSession may free it as well once the scheduler stops
+            slot.m_state.compare_exchange_strong(state, FREE);
+            return false;
+        }
+        if(state != ACTIVE)
+        {
+            return false;
+        }
+
+        if(!slot.m_started)
+        {
+            // first block released now
+            slot.m_deadlineTicks = now + m_periodTicks;
+            slot.m_started = true;
+        }
+        return true;
+    }
+
+    void executeRound()
+    {
+        m_workerPool.run(renderJob, this, static_cast<int>(m_dueSlots.size()));
+        m_numRounds.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void renderJob(int jobIndex, void* context)
+    {
+        RenderServer* server = (RenderServer*)context;
+        server->render(server->m_slots[server->m_dueSlots[jobIndex]]);
+    }
+
+    /* Render job */
+    void render(Slot& slot)
+    {
+        RenderSession* session = slot.m_session;
+        const uint64_t startTicks = CycleClock::now();
+
+        session->process(static_cast<float>(m_framesPerBuffer / m_sampleRate));
+        session->execute(slot.m_buffer.data(), m_framesPerBuffer, m_numChannels);
+        if(slot.m_sink)
+        {
+            slot.m_sink->write(slot.m_buffer.data(), m_framesPerBuffer, m_numChannels, session->m_sampleTime.load(std::memory_order_relaxed));
+        }
+
+        const uint64_t endTicks = CycleClock::now();
+        m_blockTime.record(static_cast<uint64_t>(CycleClock::ticksToMicroseconds(endTicks - startTicks)));
+
+        if(m_paced && endTicks > slot.m_deadlineTicks)
+        {
+            const float latenessMicroseconds = static_cast<float>(CycleClock::ticksToMicroseconds(endTicks - slot.m_deadlineTicks));
+            session->m_numDeadlineMisses.fetch_add(1, std::memory_order_relaxed);
+            if(latenessMicroseconds > session->m_maxLatenessMicroseconds.load(std::memory_order_relaxed))
+            {
+                session->m_maxLatenessMicroseconds.store(latenessMicroseconds, std::memory_order_relaxed);
+            }
+            m_numDeadlineMisses.fetch_add(1, std::memory_order_relaxed);
+        }
+        slot.m_deadlineTicks += m_periodTicks;
+
+        session->m_sampleTime.store(session->m_sampleTime.load(std::memory_order_relaxed) + m_framesPerBuffer, std::memory_order_release);
+        session->m_numBlocks.fetch_add(1, std::memory_order_relaxed);
+        m_numBlocks.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    WorkerPool m_workerPool;
+    std::vector<Slot> m_slots;
+    std::vector<int> m_dueSlots; // slots rendered in the current round, by deadline
+    std::atomic<bool> m_runningFlag;
+    bool m_paced;
+    uint64_t m_periodTicks;
+    std::atomic<unsigned long> m_numRounds;
+    std::atomic<unsigned long> m_numBlocks;
+    std::atomic<unsigned long> m_numDeadlineMisses;
+    LatencyHistogram m_blockTime;
+};
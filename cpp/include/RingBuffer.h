@@ -27,8 +27,8 @@ public:
         m_write(0),
         m_numFrames(numFrames) //you'll then read the init values
     {  
-        m_buffer = (float*) malloc(m_numSamples * m_maxNumFrames * sizeof(float));
-        memset(m_buffer, 0, m_numSamples * m_maxNumFrames * sizeof(float));
+        m_buffer = (T*) malloc(m_numSamples * m_maxNumFrames * sizeof(T));
+        memset(m_buffer, 0, m_numSamples * m_maxNumFrames * sizeof(T));
     }
 
     virtual ~RingBuffer()
@@ -52,6 +52,12 @@ public:
         return m_numFrames.load() != 0;
     }
 
+    /* Number of frames written and not read yet */
+    int getNumFrames() const
+    {
+        return m_numFrames.load();
+    }
+
     T* getWriteBuffer()
     {
         return m_buffer + (m_write * m_numSamples);
@@ -62,6 +68,17 @@ public:
         return m_buffer + (m_read * m_numSamples);
     }
 
+    /* Index of the frame returned by getWriteBuffer / getReadBuffer, e.g. to attach some data to each frame */
+    int getWriteIndex() const
+    {
+        return m_write;
+    }
+
+    int getReadIndex() const
+    {
+        return m_read;
+    }
+
     void finishWrite()
     {
         m_write = (m_write + 1) % m_maxNumFrames;
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SAMPLE_FORMAT_SSE
+#endif
+
+/*
+    Device sample formats. Integer samples are little endian, INT24 is packed (3 bytes per sample) as expected by
+    PortAudio's paInt24.
+*/
+enum class SampleFormat
+{
+    FLOAT32,
+    INT16,
+    INT24
+};
+
+namespace SampleFormatUtils
+{
+    inline int getSampleBytes(SampleFormat format)
+    {
+        switch(format)
+        {
+            case SampleFormat::INT16:
+                return 2;
+            case SampleFormat::INT24:
+                return 3;
+            default:
+                return 4;
+        }
+    }
+
+    inline const char* getName(SampleFormat format)
+    {
+        switch(format)
+        {
+            case SampleFormat::INT16:
+                return "int16";
+            case SampleFormat::INT24:
+                return "int24";
+            default:
+                return "float32";
+        }
+    }
+
+    /* Full scale of the integer formats: a float sample of 1 converts to getFullScale() (clipped to the max value) */
+    inline float getFullScale(SampleFormat format)
+    {
+        return format == SampleFormat::INT16 ? 32768.f : 8388608.f;
+    }
+
+    /* Sample at index as a float, e.g. to check a converted buffer */
+    inline float readSample(const void* buffer, SampleFormat format, unsigned long index)
+    {
+        switch(format)
+        {
+            case SampleFormat::INT16:
+            {
+                int16_t sample;
+                memcpy(&sample, static_cast<const char*>(buffer) + index * 2, 2);
+                return sample / getFullScale(format);
+            }
+            case SampleFormat::INT24:
+            {
+                const unsigned char* bytes = static_cast<const unsigned char*>(buffer) + index * 3;
+                int32_t sample = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
+                sample = (sample ^ 0x800000) - 0x800000; // sign extension
+                return sample / getFullScale(format);
+            }
+            default:
+                return static_cast<const float*>(buffer)[index];
+        }
+    }
+}
+
+/*
+    SampleConverter
+    Converts float samples to the device format: scaling to full scale, optional TPDF dither, clipping, then rounding
+    to the nearest integer (ties to even, the default rounding of the FPU and SSE).
+    TPDF dither adds the sum of two independent uniform values in [-0.5, 0.5) LSB, decorrelating the quantisation
+    error from the signal at the cost of a slightly higher noise floor. The random generator is a 4 lane xorshift so
+    that the SSE and scalar paths produce the same output.
+    A converter holds the dither state: use one per stream, from a single thread.
+*/
+class SampleConverter
+{
+public:
+    SampleConverter(SampleFormat format, bool dither = true, uint32_t seed = 0x9e3779b9u):
+        m_format(format),
+        m_dither(dither)
+    {
+        setSeed(seed);
+    }
+
+    SampleFormat getFormat() const
+    {
+        return m_format;
+    }
+
+    void setDither(bool dither)
+    {
+        m_dither = dither;
+    }
+
+    bool isDithering() const
+    {
+        return m_dither;
+    }
+
+    void setSeed(uint32_t seed)
+    {
+        for(int i=0; i<4; ++i)
+        {
+            // xorshift state must not be 0
+            m_state[i] = seed * (2 * i + 1) + 0x6d2b79f5u * (i + 1);
+            m_state[i] = m_state[i] ? m_state[i] : 1;
+        }
+    }
+
+    /* Convert numSamples samples to output, which must hold numSamples * getSampleBytes(format) bytes */
+    void convert(const float* input, void* output, unsigned long numSamples)
+    {
+        switch(m_format)
+        {
+            case SampleFormat::INT16:
+                convertInt16(input, static_cast<int16_t*>(output), numSamples);
+                break;
+            case SampleFormat::INT24:
+                convertInt24(input, static_cast<unsigned char*>(output), numSamples);
+                break;
+            default:
+                memcpy(output, input, numSamples * sizeof(float));
+                break;
+        }
+    }
+
+private:
+    static uint32_t xorshift(uint32_t& state)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    /* Uniform in [-0.5, 0.5) from the 23 high bits */
+    static float toUniform(uint32_t bits)
+    {
+        uint32_t mantissa = (bits >> 9) | 0x3f800000u;
+        float value;
+        memcpy(&value, &mantissa, sizeof(float));
+        return value - 1.5f;
+    }
+
+    /* Scaled, dithered and clipped sample, for the lane's generator */
+    float prepare(float sample, float scale, float maxValue, int lane)
+    {
+        float value = sample * scale;
+        if(m_dither)
+        {
+            value += toUniform(xorshift(m_state[lane])) + toUniform(xorshift(m_state[lane]));
+        }
+        return std::clamp(value, -scale, maxValue);
+    }
+
+#ifdef SAMPLE_FORMAT_SSE
+    static __m128i xorshift(__m128i& state)
+    {
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+        state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+        return state;
+    }
+
+    static __m128 toUniform(__m128i bits)
+    {
+        __m128i mantissa = _mm_or_si128(_mm_srli_epi32(bits, 9), _mm_set1_epi32(0x3f800000));
+        return _mm_sub_ps(_mm_castsi128_ps(mantissa), _mm_set1_ps(1.5f));
+    }
+
+    /* 4 samples scaled, dithered, clipped and rounded */
+    __m128i prepare(const float* input, __m128 scale, __m128 minValue, __m128 maxValue, __m128i& state)
+    {
+        __m128 value = _mm_mul_ps(_mm_loadu_ps(input), scale);
+        if(m_dither)
+        {
+            __m128 dither1 = toUniform(xorshift(state));
+            __m128 dither2 = toUniform(xorshift(state));
+            value = _mm_add_ps(value, _mm_add_ps(dither1, dither2));
+        }
+        value = _mm_min_ps(_mm_max_ps(value, minValue), maxValue);
+        return _mm_cvtps_epi32(value);
+    }
+#endif
+
+    void convertInt16(const float* input, int16_t* output, unsigned long numSamples)
+    {
+        const float scale = SampleFormatUtils::getFullScale(SampleFormat::INT16);
+        const float maxValue = scale - 1.f;
+        unsigned long i = 0;
+
+#ifdef SAMPLE_FORMAT_SSE
+        __m128i state = _mm_loadu_si128((const __m128i*)m_state);
+        const __m128 scales = _mm_set1_ps(scale);
+        const __m128 minValues = _mm_set1_ps(-scale);
+        const __m128 maxValues = _mm_set1_ps(maxValue);
+        const unsigned long numVectorSamples = numSamples & ~7ul;
+        for(; i < numVectorSamples; i += 8)
+        {
+            __m128i low = prepare(input + i, scales, minValues, maxValues, state);
+            __m128i high = prepare(input + i + 4, scales, minValues, maxValues, state);
+            _mm_storeu_si128((__m128i*)(output + i), _mm_packs_epi32(low, high));
+        }
+        _mm_storeu_si128((__m128i*)m_state, state);
+#endif
+
+        for(; i < numSamples; ++i)
+        {
+            output[i] = static_cast<int16_t>(std::lrint(prepare(input[i], scale, maxValue, static_cast<int>(i % 4))));
+        }
+    }
+
+    void convertInt24(const float* input, unsigned char* output, unsigned long numSamples)
+    {
+        const float scale = SampleFormatUtils::getFullScale(SampleFormat::INT24);
+        const float maxValue = scale - 1.f;
+        unsigned long i = 0;
+
+#ifdef SAMPLE_FORMAT_SSE
+        __m128i state = _mm_loadu_si128((const __m128i*)m_state);
+        const __m128 scales = _mm_set1_ps(scale);
+        const __m128 minValues = _mm_set1_ps(-scale);
+        const __m128 maxValues = _mm_set1_ps(maxValue);
+        const unsigned long numVectorSamples = numSamples & ~3ul;
+        for(; i < numVectorSamples; i += 4)
+        {
+            int32_t samples[4];
+            _mm_storeu_si128((__m128i*)samples, prepare(input + i, scales, minValues, maxValues, state));
+            for(int j=0; j<4; ++j)
+            {
+                writeInt24(output + (i + j) * 3, samples[j]);
+            }
+        }
+        _mm_storeu_si128((__m128i*)m_state, state);
+#endif
+
+        for(; i < numSamples; ++i)
+        {
+            writeInt24(output + i * 3, static_cast<int32_t>(std::lrint(prepare(input[i], scale, maxValue, static_cast<int>(i % 4)))));
+        }
+    }
+
+    static void writeInt24(unsigned char* output, int32_t sample)
+    {
+        output[0] = static_cast<unsigned char>(sample);
+        output[1] = static_cast<unsigned char>(sample >> 8);
+        output[2] = static_cast<unsigned char>(sample >> 16);
+    }
+
+    SampleFormat m_format;
+    bool m_dither;
+    uint32_t m_state[4]; // dither generator, one per SSE lane
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/*
+    SeqLock
+    Publishes a value from a single writer thread to any number of reader threads without locks.
+
+    The writer never waits: it bumps the sequence to an odd number, writes the value and bumps the sequence again.
+    Readers copy the value and retry if the sequence was odd or changed during the copy, so they always get
+    a consistent value (the latest published one).
+    The value is stored as words accessed through atomic references so that concurrent reads and writes are well defined.
+*/
+template<typename T>
+class SeqLock
+{
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock: the published type must be trivially copyable.");
+
+public:
+    SeqLock():
+        m_sequence(0)
+    {
+        memset(m_words, 0, sizeof(m_words));
+    }
+
+    // Deleting other special member functions as they may cause shallow copies
+    SeqLock(const SeqLock&) = delete;
+    SeqLock& operator=(const SeqLock&) = delete;
+    SeqLock(SeqLock&& other) = delete;
+    SeqLock& operator=(SeqLock&& other) = delete;
+
+    /* Writer thread only */
+    void store(const T& value)
+    {
+        uint32_t words[NumWords] = {};
+        memcpy(words, &value, sizeof(T));
+
+        unsigned int sequence = m_sequence.load(std::memory_order_relaxed);
+        m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for(int i=0; i<NumWords; ++i)
+        {
+            std::atomic_ref<uint32_t>(m_words[i]).store(words[i], std::memory_order_relaxed);
+        }
+
+        m_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    /* Any thread. Returns the number of times the value has been published (0 if never) */
+    unsigned int load(T& outValue) const
+    {
+        uint32_t words[NumWords];
+        unsigned int before = 0;
+        unsigned int after = 0;
+
+        do
+        {
+            before = m_sequence.load(std::memory_order_acquire);
+            if(before & 1)
+            {
+                continue; // writing in progress
+            }
+
+            for(int i=0; i<NumWords; ++i)
+            {
+                words[i] = std::atomic_ref<uint32_t>(m_words[i]).load(std::memory_order_relaxed);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = m_sequence.load(std::memory_order_relaxed);
+        }
+        while((before & 1) || before != after);
+
+        memcpy(&outValue, words, sizeof(T));
+
+        return before / 2;
+    }
+
+private:
+    static const int NumWords = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    std::atomic<unsigned int> m_sequence;
+    mutable uint32_t m_words[NumWords];
+};
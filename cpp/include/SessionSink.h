@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdio.h>
+
+#include "Logger.h"
+
+/*
+    Output sinks of the render server sessions.
+    A sink receives every block rendered for its session, in order, on whichever worker thread rendered it
+    (never two blocks of the same session at once). Sinks must not block: they run inside the render jobs.
+
+    - FileSink: 32-bit float WAV file.
+    - SharedMemorySink: single-producer single-consumer ring of frames in a memory region provided by the caller,
+      e.g. a shared memory mapping read by another process.
+    - CallbackSink: hands each block to a function.
+*/
+class ISessionSink
+{
+public:
+    virtual ~ISessionSink() {}
+
+    /* Render job. sampleTime is the session sample time of the first frame of the block. */
+    virtual void write(const float* buffer, unsigned long framesPerBuffer, int numChannels, uint64_t sampleTime) = 0;
+};
+
+/*
+    FileSink
+    Writes an IEEE float WAV file, the header sizes are updated when the sink is closed (or destroyed).
+*/
+class FileSink : public ISessionSink
+{
+public:
+    FileSink(const char* path, double sampleRate, int numChannels):
+        m_file(nullptr),
+        m_sampleRate(sampleRate),
+        m_numChannels(numChannels),
+        m_numDataBytes(0)
+    {
+        m_file = fopen(path, "wb");
+        if(m_file)
+        {
+            writeHeader();
+        }
+        else
+        {
+            LM_ERROR("FileSink: cannot open %s.", path);
+        }
+    }
+
+    virtual ~FileSink()
+    {
+        close();
+    }
+
+    // Deleting other special member functions as they may cause the file to be closed twice
+    FileSink(const FileSink&) = delete;
+    FileSink& operator=(const FileSink&) = delete;
+    FileSink(FileSink&& other) = delete;
+    FileSink& operator=(FileSink&& other) = delete;
+
+    bool isOpen() const
+    {
+        return m_file != nullptr;
+    }
+
+    void close()
+    {
+        if(m_file)
+        {
+            fseek(m_file, 0, SEEK_SET);
+            writeHeader();
+            fclose(m_file);
+            m_file = nullptr;
+        }
+    }
+
+    virtual void write(const float* buffer, unsigned long framesPerBuffer, int numChannels, uint64_t) override
+    {
+        if(m_file && numChannels == m_numChannels)
+        {
+            m_numDataBytes += static_cast<uint32_t>(fwrite(buffer, sizeof(float), framesPerBuffer * numChannels, m_file) * sizeof(float));
+        }
+    }
+
+private:
+    void writeHeader()
+    {
+        const uint32_t sampleRate = static_cast<uint32_t>(m_sampleRate);
+        const uint16_t numChannels = static_cast<uint16_t>(m_numChannels);
+        const uint16_t bitsPerSample = 32;
+        const uint16_t blockAlign = numChannels * bitsPerSample / 8;
+        const uint32_t byteRate = sampleRate * blockAlign;
+        const uint16_t formatFloat = 3;
+        const uint32_t fmtSize = 16;
+        const uint32_t riffSize = 36 + m_numDataBytes;
+
+        fwrite("RIFF", 1, 4, m_file);
+        fwrite(&riffSize, 4, 1, m_file);
+        fwrite("WAVEfmt ", 1, 8, m_file);
+        fwrite(&fmtSize, 4, 1, m_file);
+        fwrite(&formatFloat, 2, 1, m_file);
+        fwrite(&numChannels, 2, 1, m_file);
+        fwrite(&sampleRate, 4, 1, m_file);
+        fwrite(&byteRate, 4, 1, m_file);
+        fwrite(&blockAlign, 2, 1, m_file);
+        fwrite(&bitsPerSample, 2, 1, m_file);
+        fwrite("data", 1, 4, m_file);
+        fwrite(&m_numDataBytes, 4, 1, m_file);
+    }
+
+    FILE* m_file;
+    double m_sampleRate;
+    int m_numChannels;
+    uint32_t m_numDataBytes;
+};
+
+/*
+    SharedMemorySink
+    Writes interleaved frames into a ring laid out in a caller provided memory region of getRequiredBytes() bytes:
+    a Header followed by capacityFrames frames. The writer publishes the total number of frames written, a reader
+    (e.g. another process mapping the same region) keeps its own read count and must stay within capacityFrames
+    of the write count. Frames are written even when the reader lags behind: a live stream never waits.
+*/
+class SharedMemorySink : public ISessionSink
+{
+public:
+    struct Header
+    {
+        std::atomic<uint64_t> m_numWrittenFrames; // published after the frames are written
+        uint32_t m_capacityFrames;
+        uint32_t m_numChannels;
+    };
+
+    static size_t getRequiredBytes(unsigned long capacityFrames, int numChannels)
+    {
+        return sizeof(Header) + capacityFrames * numChannels * sizeof(float);
+    }
+
+    /* memory must be at least getRequiredBytes(capacityFrames, numChannels) bytes and suitably aligned */
+    SharedMemorySink(void* memory, unsigned long capacityFrames, int numChannels):
+        m_header(new (memory) Header()),
+        m_frames(reinterpret_cast<float*>(static_cast<char*>(memory) + sizeof(Header)))
+    {
+        m_header->m_numWrittenFrames.store(0);
+        m_header->m_capacityFrames = static_cast<uint32_t>(capacityFrames);
+        m_header->m_numChannels = static_cast<uint32_t>(numChannels);
+    }
+
+    virtual void write(const float* buffer, unsigned long framesPerBuffer, int numChannels, uint64_t) override
+    {
+        if(static_cast<uint32_t>(numChannels) != m_header->m_numChannels)
+        {
+            return;
+        }
+
+        const uint64_t numWrittenFrames = m_header->m_numWrittenFrames.load(std::memory_order_relaxed);
+        const unsigned long capacityFrames = m_header->m_capacityFrames;
+        unsigned long position = static_cast<unsigned long>(numWrittenFrames % capacityFrames);
+        unsigned long i = 0;
+        while(i < framesPerBuffer)
+        {
+            // up to the end of the ring then wrapping around
+            unsigned long numFrames = std::min(framesPerBuffer - i, capacityFrames - position);
+            memcpy(m_frames + position * numChannels, buffer + i * numChannels, numFrames * numChannels * sizeof(float));
+            i += numFrames;
+            position = 0;
+        }
+
+        m_header->m_numWrittenFrames.store(numWrittenFrames + framesPerBuffer, std::memory_order_release);
+    }
+
+    /*
+        Reader side, from a Header mapped by the reader. Copies the frames [readFrame, readFrame + numFrames)
+        which must have been written and not overwritten yet.
+    */
+    static void read(const void* memory, uint64_t readFrame, float* output, unsigned long numFrames)
+    {
+        const Header* header = static_cast<const Header*>(memory);
+        const float* frames = reinterpret_cast<const float*>(static_cast<const char*>(memory) + sizeof(Header));
+        const unsigned long capacityFrames = header->m_capacityFrames;
+        const int numChannels = static_cast<int>(header->m_numChannels);
+        for(unsigned long i=0; i<numFrames; ++i)
+        {
+            memcpy(output + i * numChannels, frames + ((readFrame + i) % capacityFrames) * numChannels, numChannels * sizeof(float));
+        }
+    }
+
+private:
+    Header* m_header;
+    float* m_frames;
+};
+
+/*
+    CallbackSink
+    Calls a function for each block, e.g. to encode and stream it.
+*/
+class CallbackSink : public ISessionSink
+{
+public:
+    typedef void (*SinkFunc)(const float* buffer, unsigned long framesPerBuffer, int numChannels, uint64_t sampleTime, void* context);
+
+    CallbackSink(SinkFunc fn, void* context):
+        m_fn(fn),
+        m_context(context)
+    {
+
+    }
+
+    virtual void write(const float* buffer, unsigned long framesPerBuffer, int numChannels, uint64_t sampleTime) override
+    {
+        if(m_fn)
+        {
+            m_fn(buffer, framesPerBuffer, numChannels, sampleTime, m_context);
+        }
+    }
+
+private:
+    SinkFunc m_fn;
+    void* m_context;
+};
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <cstring>
 #include <memory>
 
 #include "Math.h"
+#include "SmoothedValue.h"
 
 /*
     A sine generator using a wavetable to generate a sinusoid.
@@ -13,7 +15,8 @@ struct SineGenerator
         m_data(nullptr),
         m_dataSize(0),
         m_phaseIndex(0),
-        m_gain(1.f)
+        m_sampleRate(sampleRate),
+        m_gain(1.f, SmoothedValue::EXPONENTIAL)
     {
         setFrequency(freqHz, sampleRate);
     }
@@ -32,9 +35,10 @@ struct SineGenerator
     SineGenerator(SineGenerator&& other) = delete;
     SineGenerator& operator=(SineGenerator&& other) = delete;
 
-    void setGain(float gain)
+    /* The gain ramps sample accurately to the new value over rampSeconds (immediately if 0) */
+    void setGain(float gain, float rampSeconds = 0.f)
     {
-        m_gain = gain;
+        m_gain.setTarget(gain, static_cast<int>(rampSeconds * m_sampleRate));
     }
 
     void execute(float* outputBuffer, unsigned long framesPerBuffer, int numChannels)
@@ -42,7 +46,7 @@ struct SineGenerator
         for(unsigned int i=0; i<framesPerBuffer; i++)
         {
             // writing same data to all channels
-            float data = m_data[m_phaseIndex] * m_gain;
+            float data = m_data[m_phaseIndex] * m_gain.getNext();
             m_phaseIndex = (m_phaseIndex + 1) % m_dataSize;
         
             for(int c=0; c<numChannels; ++c)
@@ -52,6 +56,27 @@ struct SineGenerator
         }    
     }
 
+    /* Planar version: the sine is written to the first channel and copied to the others */
+    void executePlanar(float* const* outputChannels, unsigned long framesPerBuffer, int numChannels)
+    {
+        if(numChannels <= 0)
+        {
+            return;
+        }
+
+        float* output = outputChannels[0];
+        for(unsigned long i=0; i<framesPerBuffer; i++)
+        {
+            output[i] = m_data[m_phaseIndex] * m_gain.getNext();
+            m_phaseIndex = (m_phaseIndex + 1) % m_dataSize;
+        }
+
+        for(int c=1; c<numChannels; ++c)
+        {
+            memcpy(outputChannels[c], output, framesPerBuffer * sizeof(float));
+        }
+    }
+
 private:
     /* As this is allocating and deallocating memory we make it private to prevent its use in unwanted places: e.g. callback function */
     void setFrequency(float freqHz, double sampleRate)
@@ -82,5 +107,6 @@ private:
     float* m_data; // pointer to our watable data
     int m_dataSize; // size of our wavetable
     int m_phaseIndex; // current phase index to our wavetable
-    float m_gain; //to adjust the volume
+    double m_sampleRate;
+    SmoothedValue m_gain; //to adjust the volume
 };
\ No newline at end of file
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+/*
+    SmoothedValue
+    A parameter (e.g. gain, pan, pitch) ramping towards a target value over a number of samples,
+    so that changes are applied with sample accuracy and without zipper noise whatever the buffer size.
+
+    Linear ramps add a constant increment per sample, exponential ramps multiply by a constant ratio per sample
+    (perceptually smoother for gains and frequencies). When the target is reached the value is snapped to it and
+    the parameter stops ramping: the per sample cost is then the same as a constant value.
+*/
+class SmoothedValue
+{
+public:
+    enum RampType
+    {
+        LINEAR,
+        EXPONENTIAL
+    };
+
+    SmoothedValue(float value = 0.f, RampType rampType = LINEAR):
+        m_current(value),
+        m_target(value),
+        m_step(0.f),
+        m_numRampSamples(0),
+        m_rampType(rampType)
+    {
+
+    }
+
+    /* Set a new target reached after rampSamples samples (immediately if rampSamples <= 0) */
+    void setTarget(float target, int rampSamples)
+    {
+        m_target = target;
+
+        if(rampSamples <= 0 || target == m_current)
+        {
+            setImmediate(target);
+            return;
+        }
+
+        m_numRampSamples = rampSamples;
+        if(m_rampType == EXPONENTIAL)
+        {
+            // exponential ramps cannot cross or reach zero: ramping from/to a minimum value and snapping at the end
+            float from = std::max(std::abs(m_current), MinExponentialValue);
+            float to = std::max(std::abs(target), MinExponentialValue);
+            m_current = std::copysign(from, target);
+            m_step = std::pow(to / from, 1.f / rampSamples);
+        }
+        else
+        {
+            m_step = (target - m_current) / rampSamples;
+        }
+    }
+
+    void setImmediate(float value)
+    {
+        m_current = value;
+        m_target = value;
+        m_step = 0.f;
+        m_numRampSamples = 0;
+    }
+
+    void setRampType(RampType rampType)
+    {
+        m_rampType = rampType;
+    }
+
+    bool isRamping() const
+    {
+        return m_numRampSamples > 0;
+    }
+
+    float getCurrent() const
+    {
+        return m_current;
+    }
+
+    float getTarget() const
+    {
+        return m_target;
+    }
+
+    int getNumRampSamples() const
+    {
+        return m_numRampSamples;
+    }
+
+    /* Sum of the next numSamples values, as fill() would output them, in O(1): the ramping part then the target */
+    double getSum(int numSamples) const
+    {
+        if(numSamples <= 0)
+        {
+            return 0.;
+        }
+
+        const int numRamp = std::min(numSamples, m_numRampSamples);
+        double sum = static_cast<double>(m_target) * (numSamples - numRamp);
+        if(numRamp > 0)
+        {
+            const double current = m_current;
+            const double step = m_step;
+            if(m_rampType == EXPONENTIAL)
+            {
+                // geometric series current * (1 + step + ... + step^(numRamp - 1))
+                sum += step == 1. ? current * numRamp : current * (std::pow(step, numRamp) - 1.) / (step - 1.);
+            }
+            else
+            {
+                sum += numRamp * (current + 0.5 * step * (numRamp - 1));
+            }
+        }
+        return sum;
+    }
+
+    /* Returns the current value and advance by one sample */
+    float getNext()
+    {
+        if(m_numRampSamples <= 0)
+        {
+            return m_current;
+        }
+
+        float value = m_current;
+        advance();
+        return value;
+    }
+
+    /* Advance by numSamples samples without producing values */
+    void skip(int numSamples)
+    {
+        if(m_numRampSamples <= 0 || numSamples <= 0)
+        {
+            return;
+        }
+
+        if(numSamples >= m_numRampSamples)
+        {
+            setImmediate(m_target);
+            return;
+        }
+
+        if(m_rampType == EXPONENTIAL)
+        {
+            m_current *= std::pow(m_step, static_cast<float>(numSamples));
+        }
+        else
+        {
+            m_current += m_step * numSamples;
+        }
+        m_numRampSamples -= numSamples;
+    }
+
+    /* Fill a buffer with the next numSamples values */
+    void fill(float* output, int numSamples)
+    {
+        int i = 0;
+
+        // ramping part, as four interleaved ramps of 4 samples steps so that a value doesn't wait for the previous one
+        int numRamp = std::min(numSamples, m_numRampSamples);
+        if(numRamp > 0)
+        {
+            float value = m_current;
+            const float step = m_step;
+            const int numVectorRamp = numRamp & ~3;
+            if(m_rampType == EXPONENTIAL)
+            {
+                float values[4] = {value, value * step, value * step * step, value * step * step * step};
+                const float step4 = step * step * step * step;
+                for(; i<numVectorRamp; i += 4)
+                {
+                    for(int j=0; j<4; ++j)
+                    {
+                        output[i + j] = values[j];
+                        values[j] *= step4;
+                    }
+                }
+
+                value = values[0];
+                for(; i<numRamp; ++i)
+                {
+                    output[i] = value;
+                    value *= step;
+                }
+            }
+            else
+            {
+                float values[4] = {value, value + step, value + 2.f * step, value + 3.f * step};
+                const float step4 = 4.f * step;
+                for(; i<numVectorRamp; i += 4)
+                {
+                    for(int j=0; j<4; ++j)
+                    {
+                        output[i + j] = values[j];
+                        values[j] += step4;
+                    }
+                }
+
+                value = values[0];
+                for(; i<numRamp; ++i)
+                {
+                    output[i] = value;
+                    value += step;
+                }
+            }
+
+            m_current = value;
+            m_numRampSamples -= numRamp;
+            if(m_numRampSamples == 0)
+            {
+                m_current = m_target;
+            }
+        }
+
+        // constant part
+        const float value = m_current;
+        for(; i<numSamples; ++i)
+        {
+            output[i] = value;
+        }
+    }
+
+    /* Multiply an interleaved buffer by the next framesPerBuffer values */
+    void applyGain(float* buffer, unsigned long framesPerBuffer, int numChannels)
+    {
+        if(!isRamping())
+        {
+            const float gain = m_current;
+            if(gain != 1.f)
+            {
+                for(unsigned long i=0; i<framesPerBuffer * numChannels; ++i)
+                {
+                    buffer[i] *= gain;
+                }
+            }
+            return;
+        }
+
+        for(unsigned long i=0; i<framesPerBuffer; ++i)
+        {
+            const float gain = getNext();
+            for(int c=0; c<numChannels; ++c)
+            {
+                *buffer++ *= gain;
+            }
+        }
+    }
+
+private:
+    void advance()
+    {
+        if(m_rampType == EXPONENTIAL)
+        {
+            m_current *= m_step;
+        }
+        else
+        {
+            m_current += m_step;
+        }
+
+        if(--m_numRampSamples == 0)
+        {
+            m_current = m_target;
+        }
+    }
+
+    static constexpr float MinExponentialValue = 1e-4f; // -80dB
+
+    float m_current;
+    float m_target;
+    float m_step; // increment (linear) or ratio (exponential) per sample
+    int m_numRampSamples; // samples left before reaching the target
+    RampType m_rampType;
+};
@@ -4,7 +4,10 @@
 #include <memory>
 #include <stdio.h>
 
-#include "LogMutex.h"
+#include "AudioBuffer.h"
+#include "Logger.h"
+#include "Math.h"
+#include "SmoothedValue.h"
 #include "Transport.h"
 
 #define SOUND_INVALID_ID 0
@@ -20,7 +23,10 @@ public:
     Sound(unsigned long id = SOUND_INVALID_ID):
         m_id(id),
         m_data(nullptr),
-        m_lengthSamples(0)
+        m_lengthSamples(0),
+        m_gain(1.f, SmoothedValue::EXPONENTIAL),
+        m_pan(0.f, SmoothedValue::LINEAR),
+        m_pitch(1.f, SmoothedValue::EXPONENTIAL)
     {  
 
     }
@@ -34,7 +40,12 @@ public:
     }
 
     Sound(const Sound& other):
-        ITransport(other)
+        ITransport(other),
+        m_data(nullptr),
+        m_lengthSamples(0),
+        m_gain(other.m_gain),
+        m_pan(other.m_pan),
+        m_pitch(other.m_pitch)
     {
         this->m_id = other.m_id;
 
@@ -57,6 +68,9 @@ public:
 
             this->m_id = other.m_id;
             this->m_lengthSamples = 0;
+            this->m_gain = other.m_gain;
+            this->m_pan = other.m_pan;
+            this->m_pitch = other.m_pitch;
 
             /* Because we are assigning new data, we need to always delete existing data */
             if(this->m_data)
@@ -78,7 +92,10 @@ public:
         ITransport(std::move(other)),
         m_id(other.m_id),
         m_data(other.m_data),
-        m_lengthSamples(other.m_lengthSamples)
+        m_lengthSamples(other.m_lengthSamples),
+        m_gain(other.m_gain),
+        m_pan(other.m_pan),
+        m_pitch(other.m_pitch)
     {
         other.m_id = SOUND_INVALID_ID;
         other.m_data = nullptr;
@@ -101,6 +118,9 @@ public:
             this->m_id = other.m_id;
             this->m_data = other.m_data; // no need to deallocating and reallocating data as we're moving it
             this->m_lengthSamples = other.m_lengthSamples;
+            this->m_gain = other.m_gain;
+            this->m_pan = other.m_pan;
+            this->m_pitch = other.m_pitch;
 
             other.m_id = SOUND_INVALID_ID;
             other.m_data = nullptr;
@@ -125,25 +145,123 @@ public:
     /* Update the playing status of this sound */
     void execute(float* outputBuffer, unsigned long framesPerBuffer, int numChannels)
     {
-        if(isPlaying())
+        unsigned long i = 0;
+        while(i < framesPerBuffer && isPlaying())
         {
-            for(unsigned int i=0; i<framesPerBuffer; i++)
-            {
-                int playhead = getAndAdvance(m_lengthSamples);
-                if(playhead < 0)
-                {
-                    break;
-                }
+            int numFrames = static_cast<int>(std::min<unsigned long>(framesPerBuffer - i, ChunkFrames));
+            executeChunk(outputBuffer + i * numChannels, numFrames, numChannels);
+            i += numFrames;
+        }
+    }
 
-                float data = m_data[playhead];
+    /*
+        Mix the sound into planar channels, from startFrame (e.g. the sample time of a scheduled task in the block).
+        Same output as execute, each channel being processed with unit stride.
+    */
+    void executePlanar(float* const* outputChannels, unsigned long framesPerBuffer, int numChannels, unsigned long startFrame = 0)
+    {
+        unsigned long i = startFrame;
+        while(i < framesPerBuffer && isPlaying())
+        {
+            int numFrames = static_cast<int>(std::min<unsigned long>(framesPerBuffer - i, ChunkFrames));
+            executeChunkPlanar(outputChannels, i, numFrames, numChannels);
+            i += numFrames;
+        }
+    }
 
-                // sound is mono and we're sending the signal to all channels
-                for(int c=0; c<numChannels; ++c)
-                {
-                    *outputBuffer++ += data;
-                }
+    /*
+        Virtual voice: advance the playhead and the parameter ramps by numFrames without rendering, in O(1).
+        The playhead advances by the sum of the pitch over the frames, as rendering would: the ramping part in closed
+        form, then the target over the rest.
+    */
+    void skip(unsigned long numFrames)
+    {
+        if(!isPlaying() || numFrames == 0)
+        {
+            return;
+        }
+
+        const int frames = static_cast<int>(numFrames);
+        const double numSourceFrames = m_pitch.getSum(frames);
+        m_pitch.skip(frames);
+        m_gain.skip(frames);
+        m_pan.skip(frames);
+
+        advance(m_lengthSamples, numSourceFrames);
+    }
+
+    /* 
+        Render the sound into a mono buffer, overwriting its content. 
+        Used when the sound needs some per voice processing (e.g. filtering) before being mixed.
+        Gain and pitch are applied, pan is not as the output is mono.
+    */
+    void render(float* monoBuffer, unsigned long framesPerBuffer)
+    {
+        unsigned long i = 0;
+        while(i < framesPerBuffer && isPlaying())
+        {
+            int numFrames = static_cast<int>(std::min<unsigned long>(framesPerBuffer - i, ChunkFrames));
+            int numRead = read(monoBuffer + i, numFrames);
+            m_pan.skip(numFrames);
+
+            float gains[ChunkFrames];
+            m_gain.fill(gains, numFrames);
+            for(int j=0; j<numRead; ++j)
+            {
+                monoBuffer[i + j] *= gains[j];
             }
+
+            i += numRead;
         }
+
+        // silence after the end of the sound
+        for(; i<framesPerBuffer; i++)
+        {
+            monoBuffer[i] = 0.f;
+        }
+    }
+
+    /*
+        Parameters. They ramp sample accurately towards the target over rampSamples (immediately if 0).
+        - gain: linear gain, ramping exponentially.
+        - pan: stereo pan in the range [-1 (left), 1 (right)], equal power law as the Spatialiser: sqrt((1 - pan) / 2)
+          and sqrt((1 + pan) / 2), -3 dB on both channels at the centre. Only the first two channels are affected.
+        - pitch: playback rate ratio, ramping exponentially. Samples are linearly interpolated when different than 1.
+    */
+    void setGain(float gain, int rampSamples = 0)
+    {
+        m_gain.setTarget(gain, rampSamples);
+    }
+
+    void setPan(float pan, int rampSamples = 0)
+    {
+        m_pan.setTarget(std::clamp(pan, -1.f, 1.f), rampSamples);
+    }
+
+    void setPitch(float pitch, int rampSamples = 0)
+    {
+        m_pitch.setTarget(std::clamp(pitch, 0.1f, 10.f), rampSamples);
+    }
+
+    float getGain() const
+    {
+        return m_gain.getCurrent();
+    }
+
+    /* Gain at the end of the current ramp */
+    float getTargetGain() const
+    {
+        return m_gain.getTarget();
+    }
+
+    float getPan() const
+    {
+        return m_pan.getCurrent();
+    }
+
+    float getPitch() const
+    {
+        return m_pitch.getCurrent();
     }
 
     /* Allocating sound data */
@@ -180,7 +298,181 @@ public:
     }
 
 private:
+    /* Parameters ramps are processed in chunks so that per sample values can live on the stack */
+    static const int ChunkFrames = 64;
+
+    /* Read (with pitch) up to numFrames mono samples, returns the number of samples read before the end of the sound */
+    int read(float* output, int numFrames)
+    {
+        int i = 0;
+
+        // no pitch: copying contiguous spans of data
+        if(!m_pitch.isRamping() && m_pitch.getCurrent() == 1.f)
+        {
+            while(i < numFrames)
+            {
+                int spanFrames = 0;
+                int playhead = getAndAdvanceSpan(m_lengthSamples, numFrames - i, spanFrames);
+                if(playhead < 0)
+                {
+                    break;
+                }
+
+                memcpy(output + i, m_data + playhead, spanFrames * sizeof(float));
+                i += spanFrames;
+            }
+
+            return i;
+        }
+
+        // pitch: the positions of the chunk first, then linear interpolation between samples
+        float rates[ChunkFrames];
+        float offsets[ChunkFrames + 1];
+        m_pitch.fill(rates, numFrames);
+        while(i < numFrames)
+        {
+            AudioBufferUtils::runningSum(offsets, rates + i, static_cast<float>(getPlayheadFraction()), numFrames - i);
+
+            int spanFrames = 0;
+            int playhead = getAndAdvanceSpan(m_lengthSamples, offsets, numFrames - i, spanFrames);
+            if(playhead < 0)
+            {
+                break;
+            }
+
+            // the frames after the last sample interpolate towards the start when looping, silence otherwise
+            int numInnerFrames = spanFrames;
+            while(numInnerFrames > 0 && playhead + static_cast<int>(offsets[numInnerFrames - 1]) + 1 >= m_lengthSamples)
+            {
+                --numInnerFrames;
+            }
+
+            AudioBufferUtils::interpolate(output + i, m_data + playhead, offsets, numInnerFrames);
+            const float endSample = isLooping() ? m_data[0] : 0.f;
+            for(int j=numInnerFrames; j<spanFrames; ++j)
+            {
+                const int index = static_cast<int>(offsets[j]);
+                const float frac = offsets[j] - index;
+                const float sample = m_data[playhead + index];
+                output[i + j] = sample + frac * (endSample - sample);
+            }
+
+            i += spanFrames;
+        }
+
+        return i;
+    }
+
+    /* Gains applied by the pan to the left and right channels */
+    static void getPanGains(float pan, float& outLeft, float& outRight)
+    {
+        outLeft = pan > 0.f ? std::cos(pan * static_cast<float>(Math::M_PI_2)) : 1.f;
+        outRight = pan < 0.f ? std::cos(-pan * static_cast<float>(Math::M_PI_2)) : 1.f;
+    }
+
+    /*
+        The mono signal is read, multiplied by the per sample gains (when ramping) then mixed with the pan gains
+        interpolated linearly across the chunk, so that ramps run the same vector loops as constant parameters.
+        Returns the number of frames read, data holds the signal and outGains the gains of the channels at the start
+        of the chunk and their steps per frame, the overall gain included when not ramping.
+    */
+    int readChunk(float* data, int numFrames, int numChannels, float (&outGains)[2], float (&outSteps)[2], float& outGain)
+    {
+        float startGains[2];
+        float endGains[2];
+        getPanGains(m_pan.getCurrent(), startGains[0], startGains[1]);
+        m_pan.skip(numFrames);
+        getPanGains(m_pan.getCurrent(), endGains[0], endGains[1]);
+
+        // the pan only affects the first two channels
+        if(numChannels == 1)
+        {
+            startGains[0] = endGains[0] = 1.f;
+        }
+
+        outGain = 1.f;
+        float gains[ChunkFrames];
+        const bool rampingGain = m_gain.isRamping();
+        if(rampingGain)
+        {
+            m_gain.fill(gains, numFrames);
+        }
+        else
+        {
+            outGain = m_gain.getCurrent();
+        }
+
+        int numRead = read(data, numFrames);
+        if(rampingGain)
+        {
+            AudioBufferUtils::multiply(data, gains, numRead);
+        }
+
+        for(int c=0; c<2; ++c)
+        {
+            outGains[c] = startGains[c] * outGain;
+            outSteps[c] = (endGains[c] - startGains[c]) * outGain / numFrames;
+        }
+        return numRead;
+    }
+
+    void executeChunk(float* outputBuffer, int numFrames, int numChannels)
+    {
+        float data[ChunkFrames];
+        float gains[2];
+        float steps[2];
+        float gain;
+        int numRead = readChunk(data, numFrames, numChannels, gains, steps, gain);
+
+        // sound is mono and we're sending the signal to all channels
+        if(numChannels == 2)
+        {
+            AudioBufferUtils::addRampedStereo(outputBuffer, data, gains[0], steps[0], gains[1], steps[1], numRead);
+            return;
+        }
+
+        for(int i=0; i<numRead; ++i)
+        {
+            const float sample = data[i];
+            outputBuffer[0] += sample * (gains[0] + steps[0] * i);
+            if(numChannels > 1)
+            {
+                outputBuffer[1] += sample * (gains[1] + steps[1] * i);
+            }
+            for(int c=2; c<numChannels; ++c)
+            {
+                outputBuffer[c] += sample * gain;
+            }
+            outputBuffer += numChannels;
+        }
+    }
+
+    void executeChunkPlanar(float* const* outputChannels, unsigned long offset, int numFrames, int numChannels)
+    {
+        float data[ChunkFrames];
+        float gains[2];
+        float steps[2];
+        float gain;
+        int numRead = readChunk(data, numFrames, numChannels, gains, steps, gain);
+
+        for(int c=0; c<numChannels; ++c)
+        {
+            if(c < 2 && steps[c] != 0.f)
+            {
+                AudioBufferUtils::addRamped(outputChannels[c] + offset, data, gains[c], steps[c], numRead);
+            }
+            else
+            {
+                AudioBufferUtils::addScaled(outputChannels[c] + offset, data, c < 2 ? gains[c] : gain, numRead);
+            }
+        }
+    }
+
     unsigned long m_id; // unique identifier for this sound
     float* m_data; // pointer to the sound data
     int m_lengthSamples; // length of the sound in samples
+
+    SmoothedValue m_gain;
+    SmoothedValue m_pan;
+    SmoothedValue m_pitch;
 };
\ No newline at end of file
@@ -1,11 +1,18 @@
 #pragma once
 
+#include <algorithm>
 #include <iostream>
 #include <semaphore>
 #include <thread>
+#include <vector>
 
-#include "LogMutex.h"
+#include "AudioEventQueue.h"
+#include "BlockProfiler.h"
+#include "CycleClock.h"
+#include "LatencyHistogram.h"
+#include "Logger.h"
 #include "RingBuffer.h"
+#include "SampleFormat.h"
 #include "Timer.h"
 
 /*
@@ -13,21 +20,90 @@
 
     Interface for a sound engine.
 
+    Trigger latency: the time from a command issued on the game thread to the first block it affects being copied
+    to the device buffer. Tasks carry the push time, which is reported with markTrigger() when they are executed,
+    and each ring buffer frame carries the earliest trigger it contains, so that the device callback can measure
+    the whole path (task queue wait, audio thread wake, ring buffer depth).
+
+    Render modes:
+    - RING: the audio thread renders ahead into a ring buffer which the device callback copies from. Robust against
+      scheduling jitter, at the cost of the ring depth in latency.
+    - DIRECT: the device callback processes the tasks and renders straight into the device buffer, no copy, no audio
+      thread. Lowest latency, but any render spike is a glitch.
+    - HYBRID: renders directly, falling back to the ring when a block takes more than the overload ratio of its
+      period, and back to direct rendering after enough light blocks in a row. The ring has no lead on a fallback:
+      while it is empty and the audio thread busy, the device callback waits for the frame in flight, for at most the
+      overload ratio of the period, the time a direct render was allowed anyway.
+    Ring depth: the number of frames the audio thread keeps ahead of the device, at most ringBufferNumFrames.
+    By default it is fixed to ringBufferNumFrames. With setRingDepthBounds() it adapts at runtime: it grows by a frame
+    on every underrun and, every AdaptWindowCallbacks device callbacks, settles on the smallest depth covering the
+    worst device callback lateness plus the worst audio thread response (wake up and render) seen over the window,
+    shrinking by at most a frame at a time. Underruns output silence.
+
+    Output format: blocks are rendered in float and converted (SampleConverter, dithered by default) to the device
+    format as they are written to the ring, which stores the device format: int16 halves the memory traffic between
+    the audio thread and the device callback compared to float. The device callback buffer is in the output format.
+
+    Events: notifications to the game thread (see AudioEventQueue), e.g. sounds finishing or looping when their
+    event queue is set to getEvents(). The engine posts an XRUN event after a block rendered late or when the device
+    played silence, and publishes the events of a block once it is rendered. The game thread drains them once per
+    frame.
+
+    audioThreadProcess/audioThreadExecute are the same in every mode, and are never called concurrently. In the DIRECT
+    mode (and in HYBRID when rendering directly) "audio thread" refers to the device thread.
+
     Reference:
     Murray, Dan. "Multithreading for Game Audio." Game Audio Programming 2: Principles and Practices, edited by Guy Somberg, CRC Press, Taylor & Francis Group, 2019, pp. 33-59.
 */
 class SoundEngine
 {
 public:
-    SoundEngine(double sampleRate, int numChannels, unsigned long framesPerBuffer, int ringBufferNumFrames = 3):
+    static const int AdaptWindowCallbacks = 256;
+
+    enum class RenderMode
+    {
+        RING,
+        DIRECT,
+        HYBRID
+    };
+
+    SoundEngine(double sampleRate, int numChannels, unsigned long framesPerBuffer, int ringBufferNumFrames = 3,
+                SampleFormat outputFormat = SampleFormat::FLOAT32):
         m_sampleRate(sampleRate),
         m_numChannels(numChannels),
         m_framesPerBuffer(framesPerBuffer),
-        m_buffers(framesPerBuffer * numChannels, ringBufferNumFrames),
+        m_outputFormat(outputFormat),
+        m_buffers(framesPerBuffer * numChannels * SampleFormatUtils::getSampleBytes(outputFormat), ringBufferNumFrames),
+        m_converter(outputFormat),
+        m_renderBuffer(outputFormat == SampleFormat::FLOAT32 ? 0 : framesPerBuffer * numChannels, 0.f),
         m_audioThreadRunningFlag(false),
         m_semaphore(0),
-        m_initialised(false)
+        m_initialised(false),
+        m_sampleTime(0),
+        m_blockSampleTime(0),
+        m_frameStamps(ringBufferNumFrames),
+        m_pendingTriggerTicks(0),
+        m_profiler(framesPerBuffer / sampleRate),
+        m_numXrunsPosted{0, 0},
+        m_renderMode(RenderMode::RING),
+        m_renderState(RING_RENDER),
+        m_audioThreadBusy(false),
+        m_numRingFallbacks(0),
+        m_numLightBlocks(0),
+        m_minRingDepth(ringBufferNumFrames),
+        m_maxRingDepth(ringBufferNumFrames),
+        m_ringDepth(ringBufferNumFrames),
+        m_numRingDepthChanges(0),
+        m_periodTicks(0),
+        m_lastCallbackTicks(0),
+        m_maxCallbackJitterTicks(0),
+        m_numWindowCallbacks(0),
+        m_releaseTicks(0),
+        m_maxResponseTicks(0)
     {
+        CycleClock::calibrate();
+        setHybridThresholds(0.5f, 0.25f, 256);
+        m_periodTicks = CycleClock::microsecondsToTicks(1e6 * framesPerBuffer / sampleRate);
         LM_VERBOSE("SoundEngine created.");
     }
 
@@ -37,13 +113,118 @@ public:
         LM_VERBOSE("SoundEngine shut down completed.");
     }
 
+    /* Set before initialising the engine. Returns false if the engine is already initialised. */
+    bool setRenderMode(RenderMode renderMode)
+    {
+        if(m_initialised)
+        {
+            return false;
+        }
+
+        m_renderMode = renderMode;
+        return true;
+    }
+
+    RenderMode getRenderMode() const
+    {
+        return m_renderMode;
+    }
+
+    /* Thread safe. Whether blocks are currently rendered in the device callback (DIRECT, or HYBRID not overloaded) */
+    bool isRenderingDirect() const
+    {
+        return m_renderState.load() == DIRECT_RENDER;
+    }
+
+    /* Thread safe. Number of times HYBRID fell back to the ring buffer */
+    unsigned long getNumRingFallbacks() const
+    {
+        return m_numRingFallbacks.load(std::memory_order_relaxed);
+    }
+
+    /*
+        HYBRID. Fall back to the ring when a direct block takes more than overloadRatio of the block period, and go
+        back to direct rendering after numRecoverBlocks blocks in a row below recoverRatio of the period.
+    */
+    void setHybridThresholds(float overloadRatio, float recoverRatio, int numRecoverBlocks)
+    {
+        const float periodMicroseconds = static_cast<float>(1e6 * m_framesPerBuffer / m_sampleRate);
+        m_overloadMicroseconds = overloadRatio * periodMicroseconds;
+        m_overloadTicks = CycleClock::microsecondsToTicks(m_overloadMicroseconds);
+        m_recoverMicroseconds = recoverRatio * periodMicroseconds;
+        m_numRecoverBlocks = numRecoverBlocks;
+    }
+
+    /*
+        Set before initialising the engine. Adapt the ring depth between minFrames and maxFrames, clamped to
+        [1, ringBufferNumFrames]. The depth starts at maxFrames. Returns false if the engine is already initialised.
+    */
+    bool setRingDepthBounds(int minFrames, int maxFrames)
+    {
+        if(m_initialised)
+        {
+            return false;
+        }
+
+        m_maxRingDepth = std::clamp(maxFrames, 1, m_buffers.m_maxNumFrames);
+        m_minRingDepth = std::clamp(minFrames, 1, m_maxRingDepth);
+        m_ringDepth.store(m_maxRingDepth);
+        return true;
+    }
+
+    SampleFormat getOutputFormat() const
+    {
+        return m_outputFormat;
+    }
+
+    /* Set before initialising the engine. TPDF dither of the integer output formats, on by default. */
+    bool setDither(bool dither)
+    {
+        if(m_initialised)
+        {
+            return false;
+        }
+
+        m_converter.setDither(dither);
+        return true;
+    }
+
+    /* Thread safe. Current number of frames kept ahead of the device. */
+    int getRingDepth() const
+    {
+        return m_ringDepth.load(std::memory_order_relaxed);
+    }
+
+    /* Thread safe */
+    unsigned long getNumRingDepthChanges() const
+    {
+        return m_numRingDepthChanges.load(std::memory_order_relaxed);
+    }
+
     /* Initialise sound engine */
     virtual bool initialise()
     {
         if(!m_initialised)
         {
+            m_renderState.store(m_renderMode == RenderMode::RING ? RING_RENDER : DIRECT_RENDER);
+            m_numLightBlocks = 0;
+
+            // the ring starts full of silence, the prefill of the RING mode. HYBRID starts it empty so that the audio
+            // thread fills it on the first fallback, rather than the device playing stale silence.
+            if(m_renderMode != RenderMode::RING)
+            {
+                while(m_buffers.canRead())
+                {
+                    m_buffers.finishRead();
+                }
+            }
+
+            // the direct mode renders on the device thread only
             m_audioThreadRunningFlag.store(true);
-            m_audioThread = std::thread(&SoundEngine::process, this);
+            if(m_renderMode != RenderMode::DIRECT)
+            {
+                m_audioThread = std::thread(&SoundEngine::process, this);
+            }
 
             m_initialised = true;
 
@@ -60,10 +241,10 @@ public:
     {
         if(m_initialised)
         {
-            m_semaphore.release();
             m_audioThreadRunningFlag.store(false); // signal the audio thread to stop
             if (m_audioThread.joinable())
             {
+                m_semaphore.release();
                 m_audioThread.join(); //wait for the write thread to finish
             }
             m_initialised = false;
@@ -81,40 +262,300 @@ public:
         return m_initialised;
     }
 
+    /* 
+        Thread safe. The engine sample clock: number of frames computed by the audio thread so far.
+        Used to schedule tasks at an exact sample time. Computed frames reach the device up to the ring buffer depth later.
+    */
+    uint64_t getSampleTime() const
+    {
+        return m_sampleTime.load(std::memory_order_acquire);
+    }
+
+    /* Audio thread block render times, deadline misses and underruns. Thread safe to poll. */
+    BlockProfiler& getProfiler()
+    {
+        return m_profiler;
+    }
+
+    /* Events from the audio thread, drained by the game thread (see AudioEventQueue) */
+    AudioEventQueue& getEvents()
+    {
+        return m_events;
+    }
+
+    /* Latency histograms in microseconds, updated by the audio and device threads */
+    struct TriggerLatency
+    {
+        LatencyHistogram m_queue; // command pushed to command executed on the audio thread
+        LatencyHistogram m_ring; // frame written to the ring buffer to frame copied to the device (every frame)
+        LatencyHistogram m_total; // command pushed to its first frame copied to the device
+    };
+
+    /* Thread safe */
+    const TriggerLatency& getTriggerLatency() const
+    {
+        return m_triggerLatency;
+    }
+
+    void printTriggerLatency() const
+    {
+        m_triggerLatency.m_queue.print("Trigger latency - task queue");
+        m_triggerLatency.m_ring.print("Trigger latency - ring buffer");
+        m_triggerLatency.m_total.print("Trigger latency - total");
+    }
+
 protected:
-    /* To ensure functions are called from the correct thread */
+    /* To ensure functions are called from the correct thread, i.e. the one currently rendering */
     bool isInAudioThread()
     {
-        return std::this_thread::get_id() == m_audioThread.get_id();
+        return std::this_thread::get_id() == m_renderThreadId.load(std::memory_order_relaxed);
     }
 
-    /* Called theoretically by the audio device where craving more audio data*/
-    static void callback(float* buffer, int numChannels, int numFrames, void* cookie)
+    /* 
+        Audio thread. Report the execution of a command pushed at pushTicks (CycleClock::now() on the game thread).
+        Its latency to the device is measured when the next block computed reaches the device.
+    */
+    void markTrigger(uint64_t pushTicks)
+    {
+        m_triggerLatency.m_queue.record(static_cast<uint64_t>(CycleClock::ticksToMicroseconds(CycleClock::now() - pushTicks)));
+        if(m_pendingTriggerTicks == 0 || pushTicks < m_pendingTriggerTicks)
+        {
+            m_pendingTriggerTicks = pushTicks;
+        }
+    }
+
+    /* Audio thread. Sample time of the first frame of the block being executed */
+    uint64_t getBlockSampleTime() const
+    {
+        return m_blockSampleTime;
+    }
+
+    /* Called theoretically by the audio device where craving more audio data, buffer is in the output format */
+    static void callback(void* buffer, int numChannels, int numFrames, void* cookie)
     {
         SoundEngine* soundEngine = (SoundEngine*) cookie;
-        soundEngine->writeDataToDevice(buffer);
+        switch(soundEngine->m_renderState.load())
+        {
+            case DIRECT_RENDER:
+                soundEngine->renderDirect(buffer);
+                break;
+            case RING_RENDER:
+                soundEngine->writeDataToDevice(buffer);
+                break;
+            case RING_DRAINING:
+                soundEngine->drainToDirect(buffer);
+                break;
+        }
     }
 
     const double m_sampleRate;
     const int m_numChannels;
     const unsigned long m_framesPerBuffer;
+    const SampleFormat m_outputFormat;
 
 private:    
+    /* Device thread. Process the tasks and render a block straight into the device buffer */
+    void renderDirect(void* buffer)
+    {
+        g_logger.registerThread();
+        m_renderThreadId.store(std::this_thread::get_id(), std::memory_order_relaxed);
+
+        audioThreadProcess(static_cast<float>(m_timer.tick()));
+        const float microseconds = renderBlock(buffer);
+
+        // the block is in the device buffer already
+        if(m_pendingTriggerTicks != 0)
+        {
+            m_triggerLatency.m_total.record(static_cast<uint64_t>(CycleClock::ticksToMicroseconds(CycleClock::now() - m_pendingTriggerTicks)));
+            m_pendingTriggerTicks = 0;
+        }
+
+        if(m_renderMode == RenderMode::HYBRID && microseconds > m_overloadMicroseconds)
+        {
+            // hand over to the audio thread, which fills the ring before the next callback
+            LM_LOG("SoundEngine: render overload, falling back to the ring buffer.");
+            m_numRingFallbacks.fetch_add(1, std::memory_order_relaxed);
+            m_numLightBlocks = 0;
+            m_lastCallbackTicks = 0;
+            m_renderState.store(RING_RENDER);
+            m_releaseTicks.store(CycleClock::now(), std::memory_order_relaxed);
+            m_semaphore.release();
+        }
+    }
+
+    /* Device thread. HYBRID going back to direct rendering: play what is left in the ring first */
+    void drainToDirect(void* buffer)
+    {
+        // the audio thread no longer renders in this state, it is busy at most until it publishes its last frame or
+        // sees the state change in beginRingWork: wait for it rather than playing silence
+        if(m_buffers.canRead() || waitForFrame(m_periodTicks / 8))
+        {
+            memcpy(buffer, m_buffers.getReadBuffer(), getReadWriteBufferBytes());
+            m_buffers.finishRead();
+        }
+        else if(!m_audioThreadBusy.load())
+        {
+            // the audio thread saw the state change and won't render anymore
+            m_renderState.store(DIRECT_RENDER);
+            renderDirect(buffer);
+        }
+        else
+        {
+            // the audio thread was descheduled while busy
+            memset(buffer, 0, getReadWriteBufferBytes());
+            m_profiler.recordUnderrun();
+        }
+    }
+
+    /* Device thread. Wait for at most maxTicks for the audio thread to publish a frame, as long as it is busy */
+    bool waitForFrame(uint64_t maxTicks)
+    {
+        const uint64_t endTicks = CycleClock::now() + maxTicks;
+        while(!m_buffers.canRead() && m_audioThreadBusy.load() && CycleClock::now() < endTicks)
+        {
+            std::this_thread::yield();
+        }
+        return m_buffers.canRead();
+    }
+
+    /* Audio thread. Whether the audio thread may process and render (RING_RENDER), marking it busy if so */
+    bool beginRingWork()
+    {
+        m_audioThreadBusy.store(true);
+        if(m_renderState.load() != RING_RENDER)
+        {
+            m_audioThreadBusy.store(false);
+            return false;
+        }
+        return true;
+    }
+
+    void endRingWork()
+    {
+        m_audioThreadBusy.store(false);
+    }
+
+    /* Render a block in the output format, advancing the sample clock. Returns the render time in microseconds. */
+    float renderBlock(void* outputBuffer)
+    {
+        m_blockSampleTime = m_sampleTime.load(std::memory_order_relaxed);
+        m_events.setSampleTime(m_blockSampleTime);
+        m_profiler.beginBlock();
+        if(m_outputFormat == SampleFormat::FLOAT32)
+        {
+            audioThreadExecute((float*)outputBuffer, m_framesPerBuffer, m_numChannels);
+        }
+        else
+        {
+            audioThreadExecute(m_renderBuffer.data(), m_framesPerBuffer, m_numChannels);
+            m_converter.convert(m_renderBuffer.data(), outputBuffer, m_renderBuffer.size());
+        }
+        const float microseconds = m_profiler.endBlock();
+        postXruns();
+        m_events.flush();
+        m_sampleTime.store(m_blockSampleTime + m_framesPerBuffer, std::memory_order_release);
+        return microseconds;
+    }
+
+    /* Post the underruns and deadline misses since the last block, coalesced into one event each */
+    void postXruns()
+    {
+        const unsigned long numXruns[2] = {m_profiler.getNumUnderruns(), m_profiler.getNumDeadlineMisses()};
+        for(int i : {AudioEvent::XrunUnderrun, AudioEvent::XrunDeadlineMiss})
+        {
+            if(numXruns[i] != m_numXrunsPosted[i])
+            {
+                m_events.post(AudioEvent::Type::XRUN, 0, i, static_cast<uint32_t>(numXruns[i] - m_numXrunsPosted[i]));
+                m_numXrunsPosted[i] = numXruns[i];
+            }
+        }
+    }
 
-    void writeDataToDevice(float* buffer)
+    void writeDataToDevice(void* buffer)
     {
         LM_VERBOSE("Call to write data to device.");
 
-        // copies data into the audio device buffer
-        if(m_buffers.canRead())
+        // copies data into the audio device buffer, HYBRID waiting for the frame in flight (see the class description)
+        if(m_buffers.canRead() || (m_renderMode == RenderMode::HYBRID && waitForFrame(m_overloadTicks)))
         {
             LM_VERBOSE("Reading from buffer.");
             memcpy(buffer, m_buffers.getReadBuffer(), getReadWriteBufferBytes());
+
+            // the frame stamps were written before the frame was published
+            const FrameStamp& stamp = m_frameStamps[m_buffers.getReadIndex()];
+            const uint64_t now = CycleClock::now();
+            if(stamp.m_writeTicks != 0)
+            {
+                m_triggerLatency.m_ring.record(static_cast<uint64_t>(CycleClock::ticksToMicroseconds(now - stamp.m_writeTicks)));
+            }
+            if(stamp.m_triggerTicks != 0)
+            {
+                m_triggerLatency.m_total.record(static_cast<uint64_t>(CycleClock::ticksToMicroseconds(now - stamp.m_triggerTicks)));
+            }
+
             m_buffers.finishRead();
 
             // notify the audio thread to compute more data
             LM_VERBOSE("Notify audio thread to compute frame.");
+            m_releaseTicks.store(now, std::memory_order_relaxed);
             m_semaphore.release();
+
+            adaptRingDepth(now, false);
+        }
+        else
+        {
+            // silence rather than the stale content of the device buffer
+            memset(buffer, 0, getReadWriteBufferBytes());
+            m_profiler.recordUnderrun();
+
+            adaptRingDepth(CycleClock::now(), true);
+        }
+    }
+
+    /* Device thread. See the ring depth in the class description. */
+    void adaptRingDepth(uint64_t now, bool underrun)
+    {
+        if(m_minRingDepth == m_maxRingDepth)
+        {
+            return;
+        }
+
+        if(m_lastCallbackTicks != 0)
+        {
+            // only late callbacks matter, early ones are the device catching up
+            const uint64_t interval = now - m_lastCallbackTicks;
+            if(interval > m_periodTicks)
+            {
+                m_maxCallbackJitterTicks = std::max(m_maxCallbackJitterTicks, interval - m_periodTicks);
+            }
+        }
+        m_lastCallbackTicks = now;
+
+        const int depth = m_ringDepth.load(std::memory_order_relaxed);
+        int newDepth = depth;
+        if(underrun)
+        {
+            newDepth = std::min(depth + 1, m_maxRingDepth);
+        }
+        else if(++m_numWindowCallbacks >= AdaptWindowCallbacks)
+        {
+            // the frame being played plus the frames covering the worst delays
+            const uint64_t worstTicks = m_maxCallbackJitterTicks + m_maxResponseTicks.exchange(0, std::memory_order_relaxed);
+            const int required = std::clamp(1 + static_cast<int>((worstTicks + m_periodTicks - 1) / m_periodTicks), m_minRingDepth, m_maxRingDepth);
+            newDepth = required > depth ? required : std::max(required, depth - 1);
+        }
+        else
+        {
+            return;
+        }
+
+        m_numWindowCallbacks = 0;
+        m_maxCallbackJitterTicks = 0;
+        if(newDepth != depth)
+        {
+            m_ringDepth.store(newDepth, std::memory_order_relaxed);
+            m_numRingDepthChanges.fetch_add(1, std::memory_order_relaxed);
+            LM_LOG("SoundEngine: ring depth %i -> %i frames.", depth, newDepth);
         }
     }
 
@@ -133,33 +574,72 @@ private:
 private:
     void process()
     {
+        // logging from the audio thread must never allocate
+        g_logger.registerThread();
         LM_VERBOSE("Audio thread started.");
 
-        Timer timer;
+        m_renderThreadId.store(std::this_thread::get_id(), std::memory_order_relaxed);
 
         while (m_audioThreadRunningFlag.load())
         {
-            // general process logic
-            audioThreadProcess(timer.tick());
+            // general process logic, only while rendering into the ring
+            if(beginRingWork())
+            {
+                m_renderThreadId.store(std::this_thread::get_id(), std::memory_order_relaxed);
+                audioThreadProcess(static_cast<float>(m_timer.tick()));
+                endRingWork();
+            }
 
             // wait to be notified of the need to compute a frame
             LM_VERBOSE("Wait to compute audio frames.");
 
             m_semaphore.acquire();
 
-            while(m_buffers.canWrite())
+            bool rendered = false;
+            while(m_buffers.getNumFrames() < m_ringDepth.load(std::memory_order_relaxed) && beginRingWork())
             {
                 // compute as many frames as needed
                 LM_VERBOSE("Begin audio frame.");
                 
                 //request to write into buffer
-                audioThreadExecute(m_buffers.getWriteBuffer(), m_framesPerBuffer, m_numChannels);
+                const float microseconds = renderBlock(m_buffers.getWriteBuffer());
+
+                FrameStamp& stamp = m_frameStamps[m_buffers.getWriteIndex()];
+                stamp.m_triggerTicks = m_pendingTriggerTicks;
+                stamp.m_writeTicks = CycleClock::now();
+                m_pendingTriggerTicks = 0;
 
                 m_buffers.finishWrite();
 
+                // HYBRID: back to direct rendering once the load has settled
+                if(m_renderMode == RenderMode::HYBRID)
+                {
+                    m_numLightBlocks = microseconds < m_recoverMicroseconds ? m_numLightBlocks + 1 : 0;
+                    if(m_numLightBlocks >= m_numRecoverBlocks)
+                    {
+                        LM_LOG("SoundEngine: load settled, back to direct rendering.");
+                        m_numLightBlocks = 0;
+                        m_renderState.store(RING_DRAINING);
+                    }
+                }
+
+                endRingWork();
+                rendered = true;
+
                 // compute as many frames as needed
                 LM_VERBOSE("End audio frame.");
             }
+
+            // time from the device asking for data to the ring being refilled
+            const uint64_t releaseTicks = m_releaseTicks.load(std::memory_order_relaxed);
+            if(rendered && releaseTicks != 0)
+            {
+                const uint64_t response = CycleClock::now() - releaseTicks;
+                uint64_t maxResponse = m_maxResponseTicks.load(std::memory_order_relaxed);
+                while(response > maxResponse && !m_maxResponseTicks.compare_exchange_weak(maxResponse, response, std::memory_order_relaxed))
+                {
+                }
+            }
         }
 
         LM_VERBOSE("Audio thread exiting.");
@@ -168,12 +648,64 @@ private:
     // helper function to get the num bytes for the ring buffer frames
     int getReadWriteBufferBytes() const
     {
-        return m_buffers.m_numSamples * sizeof(float);
+        return m_buffers.m_numSamples;
     }
 
-    RingBuffer<float> m_buffers;
+    RingBuffer<char> m_buffers; // frames in the output format, m_numSamples is the size of a frame in bytes
+    SampleConverter m_converter; // used by whichever thread renders
+    std::vector<float> m_renderBuffer; // float block converted to the output format, empty for FLOAT32
     std::thread m_audioThread;
     std::atomic<bool> m_audioThreadRunningFlag; //atomic flag to control the lifetime of the audio thread
     std::binary_semaphore m_semaphore; // semaphore used to notify the audio thread when to compute more audio data
     bool m_initialised;
+    std::atomic<uint64_t> m_sampleTime; // frames computed so far
+    uint64_t m_blockSampleTime; // audio thread only
+
+    /* Timestamps attached to each ring buffer frame */
+    struct FrameStamp
+    {
+        uint64_t m_triggerTicks = 0; // push time of the earliest command executed before computing the frame, 0 if none
+        uint64_t m_writeTicks = 0; // time the frame was written
+    };
+    std::vector<FrameStamp> m_frameStamps;
+    uint64_t m_pendingTriggerTicks; // audio thread only
+    TriggerLatency m_triggerLatency;
+    BlockProfiler m_profiler;
+    AudioEventQueue m_events;
+    unsigned long m_numXrunsPosted[2]; // audio thread only, underruns and deadline misses
+
+    /*
+        Render mode. Rendering is handed over between the audio and device threads through m_renderState and
+        m_audioThreadBusy (sequentially consistent): the audio thread sets busy then checks the state, the device
+        thread sets the state then checks busy, so that at most one of them processes and renders at a time.
+    */
+    enum RenderState
+    {
+        DIRECT_RENDER, // device thread renders
+        RING_RENDER, // audio thread renders into the ring
+        RING_DRAINING // device thread plays the ring out before rendering
+    };
+    RenderMode m_renderMode;
+    std::atomic<int> m_renderState;
+    std::atomic<bool> m_audioThreadBusy;
+    std::atomic<std::thread::id> m_renderThreadId;
+    std::atomic<unsigned long> m_numRingFallbacks;
+    Timer m_timer; // delta time between task processing, used by whichever thread renders
+    float m_overloadMicroseconds = 0.f;
+    uint64_t m_overloadTicks = 0;
+    float m_recoverMicroseconds = 0.f;
+    int m_numRecoverBlocks = 0;
+    int m_numLightBlocks; // audio thread only
+
+    // ring depth, see the class description
+    int m_minRingDepth;
+    int m_maxRingDepth;
+    std::atomic<int> m_ringDepth; // written by the device thread
+    std::atomic<unsigned long> m_numRingDepthChanges;
+    uint64_t m_periodTicks;
+    uint64_t m_lastCallbackTicks; // device thread only
+    uint64_t m_maxCallbackJitterTicks; // device thread only
+    int m_numWindowCallbacks; // device thread only
+    std::atomic<uint64_t> m_releaseTicks; // last time the device woke the audio thread
+    std::atomic<uint64_t> m_maxResponseTicks; // over the window, written by the audio thread, reset by the device thread
 };
\ No newline at end of file
@@ -0,0 +1,379 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "AudioBuffer.h"
+#include "Logger.h"
+#include "Math.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SPATIALISER_SSE
+#endif
+
+/*
+    Spatialiser
+    Listener and emitters in 3D: computes, once per block, the gain of every emitter on every output channel, then
+    mixes mono emitter signals with per block gain ramps (from the gains of the previous block to the new ones).
+
+    The gains of all the emitters are computed in one SIMD pass over the emitter positions stored as structure of
+    arrays (x, y and z arrays), 4 emitters at a time:
+    - distance attenuation with a clamped curve between the min and max distances:
+      INVERSE: min / (min + rolloff * (distance - min)), LINEAR: 1 - rolloff * (distance - min) / (max - min),
+    - equal power panning on the horizontal plane of the listener:
+      STEREO: from the lateral position, sqrt((1 - p) / 2) and sqrt((1 + p) / 2) with p in [-1 (left), 1 (right)],
+      SURROUND_5_1: between the two speakers around the azimuth, sqrt(1 - t) and sqrt(t) with t the position
+      between them (channels L, R, C, LFE, Ls, Rs, the LFE is not panned to),
+    - spread: within the min distance of the listener the emitter is progressively spread over all the speakers.
+    Azimuths are computed with a polynomial atan2 approximation (error below 1e-5 radians).
+
+    Emitters are slots added before mixing starts. Positions and the listener are set by the thread calling update()
+    (e.g. the audio thread when processing game commands), gains are read by the thread mixing.
+*/
+class Spatialiser
+{
+public:
+    enum class Layout
+    {
+        STEREO,
+        SURROUND_5_1
+    };
+
+    enum class DistanceModel
+    {
+        INVERSE,
+        LINEAR
+    };
+
+    struct Vector3
+    {
+        float m_x;
+        float m_y;
+        float m_z;
+    };
+
+    Spatialiser(int maxNumEmitters, Layout layout):
+        m_layout(layout),
+        m_numChannels(layout == Layout::STEREO ? 2 : 6),
+        m_maxNumEmitters(maxNumEmitters),
+        m_numEmitters(0),
+        m_capacity((maxNumEmitters + 3) / 4 * 4), // whole SIMD lanes
+        m_distanceModel(DistanceModel::INVERSE),
+        m_minDistance(1.f),
+        m_maxDistance(100.f),
+        m_rolloff(1.f)
+    {
+        m_x.assign(m_capacity, 0.f);
+        m_y.assign(m_capacity, 0.f);
+        m_z.assign(m_capacity, 0.f);
+        m_distanceGains.assign(m_capacity, 0.f);
+        m_gains.assign(m_capacity * m_numChannels, 0.f);
+        m_previousGains.assign(m_capacity * m_numChannels, 0.f);
+
+        setListener({0.f, 0.f, 0.f}, {0.f, 0.f, -1.f}, {0.f, 1.f, 0.f});
+
+        // speaker azimuths in radians, clockwise from the front, and the angles to their neighbours
+        const float degrees = static_cast<float>(Math::M_PI) / 180.f;
+        if(layout == Layout::SURROUND_5_1)
+        {
+            const float azimuths[] = {-30.f, 30.f, 0.f, 0.f, -110.f, 110.f};
+            const float before[] = {80.f, 30.f, 30.f, 0.f, 140.f, 80.f}; // Ls-L, C-R, L-C, -, Rs-Ls (behind), R-Rs
+            const float after[] = {30.f, 80.f, 30.f, 0.f, 80.f, 140.f};
+            for(int c=0; c<m_numChannels; ++c)
+            {
+                const bool panned = c != 3;
+                m_speakers.push_back({azimuths[c] * degrees, panned ? 1.f / (before[c] * degrees) : 0.f, panned ? 1.f / (after[c] * degrees) : 0.f, panned});
+            }
+        }
+    }
+
+    /* Returns the index of the new emitter, at the origin, -1 if maxNumEmitters emitters were already added */
+    int addEmitter()
+    {
+        if(m_numEmitters == m_maxNumEmitters)
+        {
+            LM_ERROR("Spatialiser: cannot add emitter.");
+            return -1;
+        }
+        return m_numEmitters++;
+    }
+
+    void setEmitterPosition(int emitter, const Vector3& position)
+    {
+        if(emitter >= 0 && emitter < m_numEmitters)
+        {
+            m_x[emitter] = position.m_x;
+            m_y[emitter] = position.m_y;
+            m_z[emitter] = position.m_z;
+        }
+    }
+
+    /* Emitter positions as arrays, e.g. to update them in a batch */
+    float* getPositionsX() { return m_x.data(); }
+    float* getPositionsY() { return m_y.data(); }
+    float* getPositionsZ() { return m_z.data(); }
+
+    /* forward and up must be orthogonal unit vectors. Default: at the origin, looking down -z, y up. */
+    void setListener(const Vector3& position, const Vector3& forward, const Vector3& up)
+    {
+        m_listenerPosition = position;
+        m_listenerForward = forward;
+        // right = forward x up
+        m_listenerRight = {forward.m_y * up.m_z - forward.m_z * up.m_y, forward.m_z * up.m_x - forward.m_x * up.m_z,
+                            forward.m_x * up.m_y - forward.m_y * up.m_x};
+    }
+
+    void setDistanceCurve(DistanceModel model, float minDistance, float maxDistance, float rolloff = 1.f)
+    {
+        m_distanceModel = model;
+        m_minDistance = std::max(minDistance, 1e-3f);
+        m_maxDistance = std::max(maxDistance, m_minDistance + 1e-3f);
+        m_rolloff = std::max(rolloff, 0.f);
+    }
+
+    /* Compute the gains of every emitter for the current positions, the current gains become the previous gains */
+    void update()
+    {
+        std::swap(m_gains, m_previousGains);
+
+        int i = 0;
+#ifdef SPATIALISER_SSE
+        for(; i < m_numEmitters; i += 4)
+        {
+            updateSimd(i);
+        }
+#endif
+        for(; i < m_numEmitters; ++i)
+        {
+            updateScalar(i);
+        }
+    }
+
+    /* Mix a block of a mono emitter signal into planar channels, ramping from the gains of the previous update to the current ones */
+    void mixEmitter(int emitter, const float* monoInput, float* const* outputChannels, unsigned long framesPerBuffer) const
+    {
+        for(int c=0; c<m_numChannels; ++c)
+        {
+            const float previous = m_previousGains[c * m_capacity + emitter];
+            const float current = m_gains[c * m_capacity + emitter];
+            if(previous == 0.f && current == 0.f)
+            {
+                continue;
+            }
+
+            AudioBufferUtils::addRamped(outputChannels[c], monoInput, previous, (current - previous) / framesPerBuffer, framesPerBuffer);
+        }
+    }
+
+    float getGain(int emitter, int channel) const
+    {
+        return m_gains[channel * m_capacity + emitter];
+    }
+
+    /* Distance attenuation of the last update, e.g. as the audibility of the emitter's voice */
+    float getDistanceGain(int emitter) const
+    {
+        return m_distanceGains[emitter];
+    }
+
+    int getNumChannels() const
+    {
+        return m_numChannels;
+    }
+
+    int getNumEmitters() const
+    {
+        return m_numEmitters;
+    }
+
+    Layout getLayout() const
+    {
+        return m_layout;
+    }
+
+private:
+    struct Speaker
+    {
+        float m_azimuth;
+        float m_inverseSpanBefore; // 1 / angle to the previous speaker (anticlockwise)
+        float m_inverseSpanAfter; // 1 / angle to the next speaker (clockwise)
+        bool m_panned; // false for the LFE
+    };
+
+    void updateScalar(int i)
+    {
+        const float dx = m_x[i] - m_listenerPosition.m_x;
+        const float dy = m_y[i] - m_listenerPosition.m_y;
+        const float dz = m_z[i] - m_listenerPosition.m_z;
+        const float front = dx * m_listenerForward.m_x + dy * m_listenerForward.m_y + dz * m_listenerForward.m_z;
+        const float side = dx * m_listenerRight.m_x + dy * m_listenerRight.m_y + dz * m_listenerRight.m_z;
+        const float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+        const float horizontal = std::sqrt(front * front + side * side);
+
+        const float clamped = std::clamp(distance, m_minDistance, m_maxDistance);
+        const float distanceGain = m_distanceModel == DistanceModel::INVERSE
+            ? m_minDistance / (m_minDistance + m_rolloff * (clamped - m_minDistance))
+            : std::max(0.f, 1.f - m_rolloff * (clamped - m_minDistance) / (m_maxDistance - m_minDistance));
+        m_distanceGains[i] = distanceGain;
+
+        const float spread = std::clamp(1.f - horizontal / m_minDistance, 0.f, 1.f);
+        if(m_layout == Layout::STEREO)
+        {
+            const float pan = horizontal > 0.f ? side / horizontal : 0.f;
+            setGainScalar(i, 0, (1.f - pan) * 0.5f, spread, 0.5f, distanceGain);
+            setGainScalar(i, 1, (1.f + pan) * 0.5f, spread, 0.5f, distanceGain);
+            return;
+        }
+
+        const float azimuth = std::atan2(side, front);
+        const float spreadPower = 1.f / (m_numChannels - 1);
+        for(int c=0; c<m_numChannels; ++c)
+        {
+            const Speaker& speaker = m_speakers[c];
+            if(!speaker.m_panned)
+            {
+                m_gains[c * m_capacity + i] = 0.f;
+                continue;
+            }
+
+            float difference = azimuth - speaker.m_azimuth;
+            difference = difference > Math::M_PI ? difference - 2.f * static_cast<float>(Math::M_PI) : difference;
+            difference = difference < -Math::M_PI ? difference + 2.f * static_cast<float>(Math::M_PI) : difference;
+            const float inverseSpan = difference >= 0.f ? speaker.m_inverseSpanAfter : speaker.m_inverseSpanBefore;
+            setGainScalar(i, c, std::max(0.f, 1.f - std::abs(difference) * inverseSpan), spread, spreadPower, distanceGain);
+        }
+    }
+
+    /* power: panned power of the channel, spreadPower: power of the channel when fully spread */
+    void setGainScalar(int i, int channel, float power, float spread, float spreadPower, float distanceGain)
+    {
+        m_gains[channel * m_capacity + i] = std::sqrt(power + spread * (spreadPower - power)) * distanceGain;
+    }
+
+#ifdef SPATIALISER_SSE
+    /* 4 emitters from i, the arrays are padded to whole lanes */
+    void updateSimd(int i)
+    {
+        const __m128 dx = _mm_sub_ps(_mm_loadu_ps(&m_x[i]), _mm_set1_ps(m_listenerPosition.m_x));
+        const __m128 dy = _mm_sub_ps(_mm_loadu_ps(&m_y[i]), _mm_set1_ps(m_listenerPosition.m_y));
+        const __m128 dz = _mm_sub_ps(_mm_loadu_ps(&m_z[i]), _mm_set1_ps(m_listenerPosition.m_z));
+        const __m128 front = dot(dx, dy, dz, m_listenerForward);
+        const __m128 side = dot(dx, dy, dz, m_listenerRight);
+        const __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+        const __m128 horizontal = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(front, front), _mm_mul_ps(side, side)));
+
+        const __m128 minDistance = _mm_set1_ps(m_minDistance);
+        const __m128 offset = _mm_sub_ps(_mm_min_ps(_mm_max_ps(distance, minDistance), _mm_set1_ps(m_maxDistance)), minDistance);
+        __m128 distanceGain;
+        if(m_distanceModel == DistanceModel::INVERSE)
+        {
+            distanceGain = _mm_div_ps(minDistance, _mm_add_ps(minDistance, _mm_mul_ps(_mm_set1_ps(m_rolloff), offset)));
+        }
+        else
+        {
+            const __m128 slope = _mm_set1_ps(m_rolloff / (m_maxDistance - m_minDistance));
+            distanceGain = _mm_max_ps(_mm_setzero_ps(), _mm_sub_ps(_mm_set1_ps(1.f), _mm_mul_ps(slope, offset)));
+        }
+        _mm_storeu_ps(&m_distanceGains[i], distanceGain);
+
+        const __m128 one = _mm_set1_ps(1.f);
+        const __m128 spread = _mm_max_ps(_mm_setzero_ps(), _mm_sub_ps(one, _mm_div_ps(horizontal, minDistance)));
+        if(m_layout == Layout::STEREO)
+        {
+            // 0 / 0 gives NaN at the listener position: centre
+            const __m128 valid = _mm_cmpgt_ps(horizontal, _mm_setzero_ps());
+            const __m128 pan = _mm_and_ps(valid, _mm_div_ps(side, horizontal));
+            const __m128 half = _mm_set1_ps(0.5f);
+            storeGain(i, 0, _mm_mul_ps(_mm_sub_ps(one, pan), half), spread, half, distanceGain);
+            storeGain(i, 1, _mm_mul_ps(_mm_add_ps(one, pan), half), spread, half, distanceGain);
+            return;
+        }
+
+        const __m128 azimuth = atan2(side, front);
+        const __m128 spreadPower = _mm_set1_ps(1.f / (m_numChannels - 1));
+        const __m128 pi = _mm_set1_ps(static_cast<float>(Math::M_PI));
+        const __m128 twoPi = _mm_set1_ps(2.f * static_cast<float>(Math::M_PI));
+        const __m128 signMask = _mm_set1_ps(-0.f);
+        for(int c=0; c<m_numChannels; ++c)
+        {
+            const Speaker& speaker = m_speakers[c];
+            if(!speaker.m_panned)
+            {
+                _mm_storeu_ps(&m_gains[c * m_capacity + i], _mm_setzero_ps());
+                continue;
+            }
+
+            __m128 difference = _mm_sub_ps(azimuth, _mm_set1_ps(speaker.m_azimuth));
+            difference = _mm_sub_ps(difference, _mm_and_ps(_mm_cmpgt_ps(difference, pi), twoPi));
+            difference = _mm_add_ps(difference, _mm_and_ps(_mm_cmplt_ps(difference, _mm_sub_ps(_mm_setzero_ps(), pi)), twoPi));
+            const __m128 after = _mm_cmpge_ps(difference, _mm_setzero_ps());
+            const __m128 inverseSpan = _mm_or_ps(_mm_and_ps(after, _mm_set1_ps(speaker.m_inverseSpanAfter)), _mm_andnot_ps(after, _mm_set1_ps(speaker.m_inverseSpanBefore)));
+            const __m128 power = _mm_max_ps(_mm_setzero_ps(), _mm_sub_ps(one, _mm_mul_ps(_mm_andnot_ps(signMask, difference), inverseSpan)));
+            storeGain(i, c, power, spread, spreadPower, distanceGain);
+        }
+    }
+
+    void storeGain(int i, int channel, __m128 power, __m128 spread, __m128 spreadPower, __m128 distanceGain)
+    {
+        const __m128 spreadOut = _mm_add_ps(power, _mm_mul_ps(spread, _mm_sub_ps(spreadPower, power)));
+        _mm_storeu_ps(&m_gains[channel * m_capacity + i], _mm_mul_ps(_mm_sqrt_ps(spreadOut), distanceGain));
+    }
+
+    __m128 dot(__m128 x, __m128 y, __m128 z, const Vector3& v) const
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(v.m_x)), _mm_mul_ps(y, _mm_set1_ps(v.m_y))), _mm_mul_ps(z, _mm_set1_ps(v.m_z)));
+    }
+
+    /* atan2(y, x) from a polynomial approximation of atan on [0, 1] */
+    static __m128 atan2(__m128 y, __m128 x)
+    {
+        const __m128 signMask = _mm_set1_ps(-0.f);
+        const __m128 absX = _mm_andnot_ps(signMask, x);
+        const __m128 absY = _mm_andnot_ps(signMask, y);
+        const __m128 maxValue = _mm_max_ps(absX, absY);
+        const __m128 minValue = _mm_min_ps(absX, absY);
+        const __m128 valid = _mm_cmpgt_ps(maxValue, _mm_setzero_ps());
+        const __m128 a = _mm_and_ps(valid, _mm_div_ps(minValue, maxValue));
+        const __m128 s = _mm_mul_ps(a, a);
+
+        __m128 r = _mm_set1_ps(-0.0464964749f);
+        r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.15931422f));
+        r = _mm_sub_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.327622764f));
+        r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(r, s), a), a);
+
+        // octant corrections
+        const __m128 halfPi = _mm_set1_ps(0.5f * static_cast<float>(Math::M_PI));
+        const __m128 steep = _mm_cmpgt_ps(absY, absX);
+        r = _mm_or_ps(_mm_and_ps(steep, _mm_sub_ps(halfPi, r)), _mm_andnot_ps(steep, r));
+        const __m128 negativeX = _mm_cmplt_ps(x, _mm_setzero_ps());
+        r = _mm_or_ps(_mm_and_ps(negativeX, _mm_sub_ps(_mm_set1_ps(static_cast<float>(Math::M_PI)), r)), _mm_andnot_ps(negativeX, r));
+        return _mm_or_ps(r, _mm_and_ps(signMask, y));
+    }
+#endif
+
+    Layout m_layout;
+    int m_numChannels;
+    int m_maxNumEmitters;
+    int m_numEmitters;
+    int m_capacity; // emitters per array, padded to whole SIMD lanes
+
+    DistanceModel m_distanceModel;
+    float m_minDistance;
+    float m_maxDistance;
+    float m_rolloff;
+
+    Vector3 m_listenerPosition;
+    Vector3 m_listenerForward;
+    Vector3 m_listenerRight;
+    std::vector<Speaker> m_speakers; // SURROUND_5_1 only
+
+    // structure of arrays, m_capacity emitters each
+    std::vector<float> m_x;
+    std::vector<float> m_y;
+    std::vector<float> m_z;
+    std::vector<float> m_distanceGains;
+    std::vector<float> m_gains; // channel after channel
+    std::vector<float> m_previousGains;
+};
@@ -2,19 +2,104 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <cstring>
 #include <functional>
+#include <semaphore>
+#include <vector>
 
-#include "LogMutex.h"
+#include "Logger.h"
+
+/*
+    WakeSignal
+    Blocks a consumer thread until a producer notifies it, through std::atomic::wait (a futex on Linux): no polling,
+    and the consumer is woken as soon as something is published.
+    Producers call notify() after publishing: it only loads a flag while the consumer is not waiting, the wake (and its
+    system call) happens only when the consumer is actually blocked.
+*/
+class WakeSignal
+{
+public:
+    WakeSignal():
+        m_epoch(0),
+        m_waiting(false),
+        m_numWakes(0)
+    {
+
+    }
+
+    /* Producer thread, after publishing */
+    void notify()
+    {
+        if(m_waiting.load())
+        {
+            wake();
+        }
+    }
+
+    /* Any thread. Wake the consumer whether it waits or not, e.g. to stop it */
+    void wake()
+    {
+        m_epoch.fetch_add(1);
+        m_epoch.notify_all();
+        m_numWakes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /*
+        Consumer thread. Block unless hasWork() returns true, until the next notify() or wake(). May return without
+        work (e.g. on wake()), callers check again.
+    */
+    template<typename Func>
+    void wait(Func hasWork)
+    {
+        // the flag is set before checking for work and the producers publish before checking the flag: either the
+        // consumer sees the work, or the producer sees the flag and changes the epoch waited on
+        const uint32_t epoch = m_epoch.load();
+        m_waiting.store(true);
+        if(!hasWork())
+        {
+            m_epoch.wait(epoch);
+        }
+        m_waiting.store(false, std::memory_order_relaxed);
+    }
+
+    /* Thread safe. Number of wakes, notify() calls while the consumer was busy are not counted */
+    unsigned long getNumWakes() const
+    {
+        return m_numWakes.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint32_t> m_epoch;
+    std::atomic<bool> m_waiting;
+    std::atomic<unsigned long> m_numWakes;
+};
 
 /*
     TaskQueue
     Thread-safe task queue.
     Single-producer single-consumer model.
+    Every push publishes its task with an atomic update shared with the consumer. A producer issuing many tasks per
+    frame can accumulate them in a Batch and push them with one publish, all or nothing.
+
+    Overflow policies, when the queue is full:
+    - REJECT (default): the push fails and returns false, the task is lost unless the producer pushes it again.
+    - BLOCK: the producer waits for the consumer to make room, up to a timeout, then fails as REJECT.
+    - SPILL: the tasks go to an overflow of segments allocated by the producer, as many as needed. The consumer takes
+      them after the queue, in order, and never allocates nor frees: the producer recycles the consumed segments.
+    The consumer can block in waitForTasks() instead of polling, it is woken by the next push (see WakeSignal).
 */
 class TaskQueue
 {
 public:
+    enum class OverflowPolicy
+    {
+        REJECT,
+        BLOCK,
+        SPILL
+    };
+
     /* Task function type */
     typedef std::function<void(void* context, void* params, float delatTime)> TaskFunction;
 
@@ -26,7 +111,8 @@ public:
     {
         Task():
             m_fn(nullptr),
-            m_context(nullptr)
+            m_context(nullptr),
+            m_sampleTime(0)
         {
 
         }
@@ -49,6 +135,67 @@ public:
         TaskFunction m_fn; // the callback function
         char m_params[128]; // allocated memory for the task parameters - bytes
         void* m_context; // the context where the task has been created
+        uint64_t m_sampleTime; // sample time at which the task should be executed, 0 as soon as possible (see TaskScheduler)
+    };
+
+    /*
+        Batch
+        Tasks accumulated by the producer thread over a frame (e.g. a game frame) in the batch's own preallocated
+        memory, then pushed with pushBatch(). Producer thread only.
+    */
+    class Batch
+    {
+    public:
+        Batch(int maxNumTasks):
+            m_tasks(maxNumTasks),
+            m_numTasks(0)
+        {
+
+        }
+
+        bool add(TaskFunction fn, void* context, const void* params = nullptr, size_t paramsSize = 0)
+        {
+            return addAt(0, fn, context, params, paramsSize);
+        }
+
+        /* Add a task to be executed at a given sample time of the consumer clock */
+        bool addAt(uint64_t sampleTime, TaskFunction fn, void* context, const void* params = nullptr, size_t paramsSize = 0)
+        {
+            if(m_numTasks == static_cast<int>(m_tasks.size()))
+            {
+                LM_ERROR("TaskQueue error: could not add a task to the batch. Maximum number of tasks reached: %i\n", m_numTasks);
+                return false;
+            }
+
+            if(!makeTask(m_tasks[m_numTasks], sampleTime, fn, context, params, paramsSize))
+            {
+                return false;
+            }
+
+            ++m_numTasks;
+            return true;
+        }
+
+        void clear()
+        {
+            m_numTasks = 0;
+        }
+
+        int getNumTasks() const
+        {
+            return m_numTasks;
+        }
+
+        int getMaxNumTasks() const
+        {
+            return static_cast<int>(m_tasks.size());
+        }
+
+    private:
+        friend class TaskQueue;
+
+        std::vector<Task> m_tasks;
+        int m_numTasks;
     };
 
     TaskQueue(int maxNumTasks):
@@ -56,7 +203,20 @@ public:
         m_maxNumTasks(maxNumTasks),
         m_head(0),
         m_tail(0),
-        m_numTasks(0)
+        m_numTasks(0),
+        m_overflowPolicy(OverflowPolicy::REJECT),
+        m_blockTimeout(0),
+        m_wakeSignal(&m_ownWakeSignal),
+        m_producerWaiting(false),
+        m_spaceSemaphore(0),
+        m_spillTail(nullptr),
+        m_spillTailIndex(0),
+        m_oldestSegment(nullptr),
+        m_numSegments(0),
+        m_spillHead(nullptr),
+        m_spillHeadIndex(0),
+        m_consumedSegment(nullptr),
+        m_numSpilled(0)
 
     {
         /* Allocating memory for our tasks */
@@ -66,6 +226,17 @@ public:
     ~TaskQueue()
     {
         delete[] m_tasks;
+
+        while(m_oldestSegment)
+        {
+            Segment* next = m_oldestSegment->m_next.load();
+            delete m_oldestSegment;
+            m_oldestSegment = next;
+        }
+        for(Segment* segment : m_freeSegments)
+        {
+            delete segment;
+        }
     }
 
     // Deleting other special member functions as they may cause shallow copies
@@ -75,40 +246,99 @@ public:
     TaskQueue& operator=(TaskQueue&& other) = delete;
     
 
-    bool push(TaskFunction fn, void* context, const void* params = nullptr, size_t paramsSize = 0)
+    /*
+        Producer thread, before pushing. What a push does when the queue is full, blockTimeoutMicroseconds being the
+        longest wait of the BLOCK policy.
+    */
+    void setOverflowPolicy(OverflowPolicy policy, float blockTimeoutMicroseconds = 0.f)
     {
-        // Pushing task to our queue
-        if(m_numTasks.load() == m_maxNumTasks)
+        m_overflowPolicy = policy;
+        m_blockTimeout = std::chrono::microseconds(static_cast<long long>(blockTimeoutMicroseconds));
+
+        // the first segment is shared with the consumer before anything is spilled
+        if(policy == OverflowPolicy::SPILL && !m_spillTail)
         {
-            LM_ERROR("TaskQueue error: could not push new task. Maximum number of tasks reached: %i\n", m_maxNumTasks);
-            return false;
+            m_spillTail = new Segment();
+            m_oldestSegment = m_spillTail;
+            m_spillHead = m_spillTail;
+            m_consumedSegment.store(m_spillTail);
+            m_numSegments = 1;
         }
+    }
+
+    OverflowPolicy getOverflowPolicy() const
+    {
+        return m_overflowPolicy;
+    }
+
+    /* Share a wake signal between queues, e.g. the lanes of a PriorityTaskQueue, before using the queue */
+    void setWakeSignal(WakeSignal* wakeSignal)
+    {
+        m_wakeSignal = wakeSignal ? wakeSignal : &m_ownWakeSignal;
+    }
+
+    bool push(TaskFunction fn, void* context, const void* params = nullptr, size_t paramsSize = 0)
+    {
+        return pushAt(0, fn, context, params, paramsSize);
+    }
 
+    /* Push a task to be executed at a given sample time of the consumer clock */
+    bool pushAt(uint64_t sampleTime, TaskFunction fn, void* context, const void* params = nullptr, size_t paramsSize = 0)
+    {
         // Creating a new task
         Task task;
-        task.m_fn = fn;
-        task.m_context = context;
+        if(!makeTask(task, sampleTime, fn, context, params, paramsSize))
+        {
+            return false;
+        }
 
-        // Creating a copy of the task params as the task will be passed onto another thread
-        if(params)
+        // Pushing task to our queue
+        switch(reserve(1))
         {
-            if(paramsSize > 0)
-            {
-                if(paramsSize <= sizeof(task.m_params))
-                {
-                    memcpy(task.m_params, params, std::min(paramsSize, sizeof(task.m_params)));
-                }
-                else
+            case TO_QUEUE:
+                m_tasks[m_head] = task;
+                m_head = (m_head + 1) % m_maxNumTasks;
+                m_numTasks.fetch_add(1);
+                break;
+            case TO_OVERFLOW:
+                spill(&task, 1);
+                break;
+            default:
+                LM_ERROR("TaskQueue error: could not push new task. Maximum number of tasks reached: %i\n", m_maxNumTasks);
+                return false;
+        }
+
+        m_wakeSignal->notify();
+        return true;
+    }
+
+    /*
+        Push every task of the batch with a single publish, or none of them if they don't all fit: the consumer sees
+        the whole batch at once. The batch is cleared once pushed, and kept as is otherwise (e.g. to retry next frame).
+    */
+    bool pushBatch(Batch& batch)
+    {
+        const int numTasks = batch.m_numTasks;
+        switch(reserve(numTasks))
+        {
+            case TO_QUEUE:
+                for(int i=0; i<numTasks; ++i)
                 {
-                    LM_ERROR("TaskQueue error: could not copy task params. Allocated size for task params not sufficient: required %i actual %i\n", paramsSize, sizeof(task.m_params));
-                    return false;
+                    m_tasks[m_head] = batch.m_tasks[i];
+                    m_head = (m_head + 1) % m_maxNumTasks;
                 }
-            }
+                m_numTasks.fetch_add(numTasks);
+                break;
+            case TO_OVERFLOW:
+                spill(batch.m_tasks.data(), numTasks);
+                break;
+            default:
+                LM_ERROR("TaskQueue error: could not push a batch of %i tasks. Free tasks: %i\n", numTasks, m_maxNumTasks - m_numTasks.load());
+                return false;
         }
 
-        m_tasks[m_head] = task;
-        m_head = (m_head + 1) % m_maxNumTasks;
-        m_numTasks.fetch_add(1);
+        batch.clear();
+        m_wakeSignal->notify();
         return true;
     }
 
@@ -119,22 +349,258 @@ public:
             outTask = m_tasks[m_tail];
             m_tail = (m_tail + 1) % m_maxNumTasks;
             m_numTasks.fetch_sub(1);
+            notifySpace();
+            return true;
+        }
+
+        // spilled tasks were all pushed after the ones of the queue
+        if(m_numSpilled.load() != 0)
+        {
+            outTask = getSpilled();
+            ++m_spillHeadIndex;
+            m_numSpilled.fetch_sub(1);
             return true;
         }
 
         return false;
     }
 
-    /* Thread safe */
+    /*
+        Consumer thread. Calls func(Task&) on every task pushed so far, in place, then releases them with a single
+        atomic update. Batches are consumed whole. Returns the number of tasks.
+    */
+    template<typename Func>
+    int consumeAll(Func func)
+    {
+        const int numTasks = m_numTasks.load();
+        for(int i=0; i<numTasks; ++i)
+        {
+            func(m_tasks[m_tail]);
+            m_tail = (m_tail + 1) % m_maxNumTasks;
+        }
+
+        if(numTasks > 0)
+        {
+            m_numTasks.fetch_sub(numTasks);
+            notifySpace();
+        }
+
+        const int numSpilled = m_numSpilled.load();
+        for(int i=0; i<numSpilled; ++i)
+        {
+            func(getSpilled());
+            ++m_spillHeadIndex;
+        }
+
+        if(numSpilled > 0)
+        {
+            m_numSpilled.fetch_sub(numSpilled);
+        }
+        return numTasks + numSpilled;
+    }
+
+    /* Consumer thread. Block until a task is pushed or wake() is called, returns right away if there are tasks */
+    void waitForTasks()
+    {
+        m_wakeSignal->wait([this]()
+        {
+            return getNumTasks() > 0;
+        });
+    }
+
+    /* Any thread. Wake the consumer from waitForTasks(), e.g. to stop it */
+    void wake()
+    {
+        m_wakeSignal->wake();
+    }
+
+    /* Thread safe, spilled tasks included */
     int getNumTasks()
     {
-        return m_numTasks.load();
+        return m_numTasks.load() + m_numSpilled.load();
     }
-    
+
+    /* Thread safe. Tasks waiting in the overflow (SPILL) */
+    int getNumSpilledTasks()
+    {
+        return m_numSpilled.load();
+    }
+
+    /* Producer thread. Overflow segments allocated so far, in use or kept for reuse */
+    int getNumOverflowSegments() const
+    {
+        return m_numSegments;
+    }
+
 private:
+    static const int SegmentTasks = 64;
+
+    /* Overflow segment, linked in the order the tasks were spilled */
+    struct Segment
+    {
+        Task m_tasks[SegmentTasks];
+        std::atomic<Segment*> m_next{nullptr};
+    };
+
+    enum Target
+    {
+        TO_QUEUE,
+        TO_OVERFLOW,
+        TO_NOWHERE
+    };
+
+    /* Producer thread. Where numTasks tasks go according to the overflow policy */
+    Target reserve(int numTasks)
+    {
+        // once spilling, the next tasks are spilled too until the consumer catches up, to keep the order
+        if(m_numSpilled.load() == 0 && m_maxNumTasks - m_numTasks.load() >= numTasks)
+        {
+            return TO_QUEUE;
+        }
+
+        switch(m_overflowPolicy)
+        {
+            case OverflowPolicy::SPILL:
+                return TO_OVERFLOW;
+            case OverflowPolicy::BLOCK:
+                return numTasks <= m_maxNumTasks && waitForSpace(numTasks) ? TO_QUEUE : TO_NOWHERE;
+            default:
+                return TO_NOWHERE;
+        }
+    }
+
+    /* Producer thread. Returns false if there isn't room for numTasks tasks before the block timeout */
+    bool waitForSpace(int numTasks)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + m_blockTimeout;
+        while(m_maxNumTasks - m_numTasks.load() < numTasks)
+        {
+            const auto now = std::chrono::steady_clock::now();
+            if(now >= deadline)
+            {
+                return false;
+            }
+
+            // as WakeSignal: the flag is set before checking the room again
+            m_producerWaiting.store(true);
+            if(m_maxNumTasks - m_numTasks.load() < numTasks)
+            {
+                m_spaceSemaphore.try_acquire_for(deadline - now);
+            }
+            m_producerWaiting.store(false);
+        }
+        return true;
+    }
+
+    /* Consumer thread, after making room. Only loads a flag unless the producer is blocked */
+    void notifySpace()
+    {
+        if(m_producerWaiting.load() && m_producerWaiting.exchange(false))
+        {
+            m_spaceSemaphore.release();
+        }
+    }
+
+    /* Producer thread. Append the tasks to the overflow, published at once */
+    void spill(const Task* tasks, int numTasks)
+    {
+        for(int i=0; i<numTasks; ++i)
+        {
+            if(m_spillTailIndex == SegmentTasks)
+            {
+                Segment* segment = getFreeSegment();
+                m_spillTail->m_next.store(segment);
+                m_spillTail = segment;
+                m_spillTailIndex = 0;
+            }
+            m_spillTail->m_tasks[m_spillTailIndex++] = tasks[i];
+        }
+        m_numSpilled.fetch_add(numTasks);
+    }
+
+    /* Producer thread. A segment the consumer has left behind, or a new one */
+    Segment* getFreeSegment()
+    {
+        const Segment* consumedSegment = m_consumedSegment.load();
+        while(m_oldestSegment != consumedSegment)
+        {
+            Segment* next = m_oldestSegment->m_next.load();
+            m_freeSegments.push_back(m_oldestSegment);
+            m_oldestSegment = next;
+        }
+
+        if(m_freeSegments.empty())
+        {
+            ++m_numSegments;
+            return new Segment();
+        }
+
+        Segment* segment = m_freeSegments.back();
+        m_freeSegments.pop_back();
+        segment->m_next.store(nullptr);
+        return segment;
+    }
+
+    /* Consumer thread, with spilled tasks. The oldest spilled task, moving to the next segment if needed */
+    Task& getSpilled()
+    {
+        if(m_spillHeadIndex == SegmentTasks)
+        {
+            m_spillHead = m_spillHead->m_next.load();
+            m_spillHeadIndex = 0;
+            m_consumedSegment.store(m_spillHead); // the previous segments can be recycled
+        }
+        return m_spillHead->m_tasks[m_spillHeadIndex];
+    }
+
+    /* Fill the task, copying the params as the task will be passed onto another thread */
+    static bool makeTask(Task& task, uint64_t sampleTime, const TaskFunction& fn, void* context, const void* params, size_t paramsSize)
+    {
+        task.m_fn = fn;
+        task.m_context = context;
+        task.m_sampleTime = sampleTime;
+
+        if(params)
+        {
+            if(paramsSize > 0)
+            {
+                if(paramsSize <= sizeof(task.m_params))
+                {
+                    memcpy(task.m_params, params, std::min(paramsSize, sizeof(task.m_params)));
+                }
+                else
+                {
+                    LM_ERROR("TaskQueue error: could not copy task params. Allocated size for task params not sufficient: required %i actual %i\n", paramsSize, sizeof(task.m_params));
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
     Task* m_tasks;
     int m_maxNumTasks;
     int m_head;
     int m_tail;
     std::atomic<int> m_numTasks;
+
+    OverflowPolicy m_overflowPolicy;
+    std::chrono::microseconds m_blockTimeout;
+    WakeSignal m_ownWakeSignal;
+    WakeSignal* m_wakeSignal; // consumer wake up, shared between queues or m_ownWakeSignal
+    std::atomic<bool> m_producerWaiting; // BLOCK: the producer waits for room
+    std::counting_semaphore<> m_spaceSemaphore;
+
+    // overflow (SPILL), producer side
+    Segment* m_spillTail;
+    int m_spillTailIndex;
+    Segment* m_oldestSegment; // segments from the oldest to the consumed one can be recycled
+    std::vector<Segment*> m_freeSegments;
+    int m_numSegments;
+
+    // overflow (SPILL), consumer side
+    Segment* m_spillHead; // set by the producer before anything is spilled
+    int m_spillHeadIndex;
+    std::atomic<Segment*> m_consumedSegment;
+    std::atomic<int> m_numSpilled;
 };
\ No newline at end of file
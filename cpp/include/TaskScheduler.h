@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "Logger.h"
+#include "TaskQueue.h"
+
+/*
+    TaskScheduler
+    Holds tasks waiting for their sample time on the consumer (audio) thread, sorted by sample time.
+    Tasks with the same sample time are executed in the order they were scheduled.
+
+    process() splits a block at the sample times of the tasks falling within it, so that starts, stops and parameter
+    changes land on the exact sample: the block is rendered in sub-blocks, executing the due tasks in between.
+    When no task is due within the block it is rendered in one go, the cost is a single comparison per block.
+
+    Not thread safe: tasks are pushed from other threads through a TaskQueue and scheduled by the consumer.
+*/
+class TaskScheduler
+{
+public:
+    TaskScheduler(int maxNumTasks):
+        m_numTasks(0)
+    {
+        /* Allocating memory for our tasks, scheduling never allocates */
+        m_tasks.resize(maxNumTasks);
+    }
+
+    /* Insert a task keeping the tasks sorted by sample time, returns false if full */
+    bool schedule(const TaskQueue::Task& task)
+    {
+        if(m_numTasks == static_cast<int>(m_tasks.size()))
+        {
+            LM_ERROR("TaskScheduler error: could not schedule new task. Maximum number of tasks reached: %i\n", static_cast<int>(m_tasks.size()));
+            return false;
+        }
+
+        // tasks are mostly scheduled in time order: searching from the back
+        int i = m_numTasks;
+        while(i > 0 && m_tasks[i - 1].m_sampleTime > task.m_sampleTime)
+        {
+            m_tasks[i] = std::move(m_tasks[i - 1]);
+            --i;
+        }
+        m_tasks[i] = task;
+        ++m_numTasks;
+
+        return true;
+    }
+
+    /* Sample time of the next task, max value if there are none */
+    uint64_t getNextSampleTime() const
+    {
+        return m_numTasks > 0 ? m_tasks[0].m_sampleTime : std::numeric_limits<uint64_t>::max();
+    }
+
+    /* Execute the tasks due before or at sampleTime, returns the number of tasks executed */
+    int executeUntil(uint64_t sampleTime, float deltaTime)
+    {
+        int numExecuted = 0;
+        while(numExecuted < m_numTasks && m_tasks[numExecuted].m_sampleTime <= sampleTime)
+        {
+            m_tasks[numExecuted++].execute(deltaTime);
+        }
+
+        if(numExecuted > 0)
+        {
+            for(int i=numExecuted; i<m_numTasks; ++i)
+            {
+                m_tasks[i - numExecuted] = std::move(m_tasks[i]);
+            }
+            m_numTasks -= numExecuted;
+        }
+
+        return numExecuted;
+    }
+
+    /*
+        Render a block starting at blockSampleTime, split at the sample times of the tasks due within it.
+        render(offset, numFrames) is called for each sub-block, tasks late or due at the first frame are executed before rendering.
+    */
+    template<typename RenderFunction>
+    void process(uint64_t blockSampleTime, unsigned long framesPerBuffer, float deltaTime, RenderFunction render)
+    {
+        const uint64_t blockEndSampleTime = blockSampleTime + framesPerBuffer;
+
+        // no task within this block: rendering in one go
+        if(getNextSampleTime() >= blockEndSampleTime)
+        {
+            render(0ul, framesPerBuffer);
+            return;
+        }
+
+        unsigned long offset = 0;
+        while(offset < framesPerBuffer)
+        {
+            executeUntil(blockSampleTime + offset, deltaTime);
+
+            unsigned long end = static_cast<unsigned long>(std::min(getNextSampleTime(), blockEndSampleTime) - blockSampleTime);
+            render(offset, end - offset);
+            offset = end;
+        }
+    }
+
+    int getNumTasks() const
+    {
+        return m_numTasks;
+    }
+
+    void clear()
+    {
+        for(int i=0; i<m_numTasks; ++i)
+        {
+            m_tasks[i] = TaskQueue::Task();
+        }
+        m_numTasks = 0;
+    }
+
+private:
+    std::vector<TaskQueue::Task> m_tasks;
+    int m_numTasks;
+};
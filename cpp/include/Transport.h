@@ -1,10 +1,18 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <stdio.h>
 
+#include "AudioEventQueue.h"
+
 /*
     ITransport
     A minimal interface to add some transport states used for instance by an audio player.
+
+    Events: with an event queue set, the thread advancing the playhead (the audio thread) posts FINISHED when the
+    playhead reaches the end and stops (not on an explicit stop()), LOOPED when it wraps around, and MARKER when it
+    passes a marker position, so that the game thread is told instead of guessing durations or polling.
 */
 class ITransport
 {
@@ -13,7 +21,12 @@ public:
     ITransport():
         m_state(TransportState::Stopped),
         m_playhead(0),
-        m_loop(false)
+        m_playheadFraction(0.),
+        m_loop(false),
+        m_events(nullptr),
+        m_eventSource(0),
+        m_markers{},
+        m_numMarkers(0)
     {
 
     }
@@ -34,6 +47,14 @@ public:
     {
         m_state = TransportState::Stopped;
         m_playhead = 0;
+        m_playheadFraction = 0.;
+    }
+
+    /* Stop to free the voice playing this transport for another one, posting a STOLEN event */
+    void steal()
+    {
+        stop();
+        postEvent(AudioEvent::Type::STOLEN);
     }
 
     bool isPlaying()
@@ -46,24 +67,169 @@ public:
         m_loop = loop;
     }
 
+    /* Events of this transport are posted to events (nullptr for none) with source, e.g. the sound id */
+    void setEventQueue(AudioEventQueue* events, unsigned long source)
+    {
+        m_events = events;
+        m_eventSource = source;
+    }
+
+    /* Post a MARKER event with the marker index when the playhead passes position. Returns false if full. */
+    bool addMarker(int position)
+    {
+        if(m_numMarkers == MaxNumMarkers)
+        {
+            return false;
+        }
+
+        m_markers[m_numMarkers++] = position;
+        return true;
+    }
+
+    void clearMarkers()
+    {
+        m_numMarkers = 0;
+    }
+
     /* Return current playhead position and advance */
     int getAndAdvance(int length)
     {
-        if(m_playhead >= length) 
+        if(!wrapAtEnd(length))
+        {
+            return -1;
+        }
+
+        passMarkers(m_playhead, m_playhead + 1);
+        return m_playhead++;
+    }
+
+    /* 
+        Return current playhead position and advance by up to numFrames frames which can be read contiguously.
+        outNumFrames is set to the number of frames available from the returned position (before the end of the data).
+        It allows processing whole spans of data instead of single samples.
+    */
+    int getAndAdvanceSpan(int length, int numFrames, int& outNumFrames)
+    {
+        outNumFrames = 0;
+
+        if(!wrapAtEnd(length))
+        {
+            return -1;
+        }
+
+        int playhead = m_playhead;
+        outNumFrames = std::min(numFrames, length - playhead);
+        m_playhead += outNumFrames;
+        passMarkers(playhead, m_playhead);
+
+        return playhead;
+    }
+
+    /* 
+        Return current fractional playhead position and advance by rate (e.g. a pitch ratio).
+        Looping keeps the fractional part so that the playback rate is preserved across the loop point.
+    */
+    double getAndAdvance(int length, float rate)
+    {
+        if(!wrapAtEnd(length))
+        {
+            return -1.;
+        }
+
+        double position = m_playhead + m_playheadFraction;
+
+        m_playheadFraction += rate;
+        int frames = static_cast<int>(m_playheadFraction);
+        passMarkers(m_playhead, m_playhead + frames);
+        m_playhead += frames;
+        m_playheadFraction -= frames;
+
+        return position;
+    }
+
+    /*
+        Fractional span. offsets are the positions of up to numFrames frames relative to the playhead, increasing, and
+        offsets[numFrames] the position after them, e.g. running sums of pitch ratios from getPlayheadFraction().
+        Return the playhead they are relative to and advance past the frames before the end of the data, outNumFrames
+        being their number. Returns -1 if stopped.
+    */
+    int getAndAdvanceSpan(int length, const float* offsets, int numFrames, int& outNumFrames)
+    {
+        outNumFrames = 0;
+
+        if(!wrapAtEnd(length))
+        {
+            return -1;
+        }
+
+        const int playhead = m_playhead;
+        const float endOffset = static_cast<float>(length - playhead);
+        while(outNumFrames < numFrames && offsets[outNumFrames] < endOffset)
+        {
+            ++outNumFrames;
+        }
+
+        const double offset = offsets[outNumFrames];
+        const int frames = static_cast<int>(offset);
+        m_playhead += frames;
+        m_playheadFraction = offset - frames;
+        passMarkers(playhead, m_playhead);
+
+        return playhead;
+    }
+
+    /*
+        Advance by numFrames (fractional when playing at a rate) in O(1), as if they had been read.
+        Looping wraps around, otherwise going past the end stops.
+    */
+    void advance(int length, double numFrames)
+    {
+        double position = m_playhead + m_playheadFraction + numFrames;
+        if(position >= length)
         {
-            // reached end of file
-            if(m_loop)
+            passMarkers(m_playhead, length);
+            if(m_loop && length > 0)
             {
-                m_playhead = 0;   
+                // several wraps in one advance are posted as one event with their count, and the markers of the
+                // whole loops in between with theirs
+                const double numLoops = std::floor(position / length);
+                position -= numLoops * length;
+                m_playhead = 0;
+                postEvent(AudioEvent::Type::LOOPED, 0, static_cast<uint32_t>(numLoops));
+                if(numLoops > 1.)
+                {
+                    passMarkers(0, length, static_cast<uint32_t>(numLoops) - 1);
+                }
             }
             else
             {
                 stop();
-                return -1;
+                postEvent(AudioEvent::Type::FINISHED);
+                return;
             }
         }
 
-        return m_playhead++;
+        const int playhead = static_cast<int>(position);
+        passMarkers(m_playhead, playhead);
+        m_playhead = playhead;
+        m_playheadFraction = position - m_playhead;
+    }
+
+    /* Current playhead position in frames */
+    double getPosition() const
+    {
+        return m_playhead + m_playheadFraction;
+    }
+
+    /* Fractional part of the playhead position */
+    double getPlayheadFraction() const
+    {
+        return m_playheadFraction;
+    }
+
+    bool isLooping() const
+    {
+        return m_loop;
     }
 
 protected:
@@ -74,8 +240,61 @@ protected:
     } m_state;
 
 private:
+    static const int MaxNumMarkers = 4;
+
+    /* At the end of the data, wrap around when looping, otherwise stop. Returns false if stopped. */
+    bool wrapAtEnd(int length)
+    {
+        if(m_playhead < length)
+        {
+            return true;
+        }
+
+        // reached end of file
+        if(m_loop && length > 0)
+        {
+            m_playhead %= length;
+            postEvent(AudioEvent::Type::LOOPED);
+            return true;
+        }
+
+        stop();
+        postEvent(AudioEvent::Type::FINISHED);
+        return false;
+    }
+
+    /* Post the markers in [from, to), count times */
+    void passMarkers(int from, int to, uint32_t count = 1)
+    {
+        if(!m_events)
+        {
+            return;
+        }
+
+        for(int i=0; i<m_numMarkers; ++i)
+        {
+            if(m_markers[i] >= from && m_markers[i] < to)
+            {
+                m_events->post(AudioEvent::Type::MARKER, m_eventSource, i, count);
+            }
+        }
+    }
+
+    void postEvent(AudioEvent::Type type, int value = 0, uint32_t count = 1)
+    {
+        if(m_events)
+        {
+            m_events->post(type, m_eventSource, value, count);
+        }
+    }
+
     int m_playhead;
+    double m_playheadFraction; // fractional part of the playhead when playing at a rate different than 1
     bool m_loop;
+    AudioEventQueue* m_events; // not owned
+    unsigned long m_eventSource;
+    int m_markers[MaxNumMarkers];
+    int m_numMarkers;
 };
 
 // Inline definition of the pure virtual destructor
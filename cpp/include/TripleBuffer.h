@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/*
+    TripleBuffer
+    Publishes a whole state (e.g. the listener, emitter positions and game parameters of a game frame) from a single
+    writer thread to a single reader thread, without locks nor copies.
+
+    Three instances of the state: the writer fills its back buffer in place and publishes it by swapping it with the
+    shared buffer, one atomic exchange. The reader, when the shared buffer holds a newer state, swaps it with its front
+    buffer, one atomic exchange, then reads the front buffer in place for as long as it needs. Neither side ever waits
+    nor retries, and intermediate states published between two reads are skipped: the reader always gets the latest
+    complete one.
+
+    The back buffer handed to the writer holds an older state (not the last published one), so the writer writes
+    every field before publishing, e.g. from its own copy of the state. For small values read by several threads,
+    see SeqLock.
+*/
+template<typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer():
+        m_back(0),
+        m_numPublished(0),
+        m_shared(1),
+        m_front(2),
+        m_numAcquired(0)
+    {
+
+    }
+
+    /* The three buffers start as copies of initial, e.g. to preallocate containers so that writing never allocates */
+    explicit TripleBuffer(const T& initial):
+        TripleBuffer()
+    {
+        for(Buffer& buffer : m_buffers)
+        {
+            buffer.m_value = initial;
+        }
+    }
+
+    // Deleting other special member functions as they may cause shallow copies
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+    TripleBuffer(TripleBuffer&& other) = delete;
+    TripleBuffer& operator=(TripleBuffer&& other) = delete;
+
+    /* Writer thread only. The buffer to fill before publish() */
+    T& getWriteBuffer()
+    {
+        return m_buffers[m_back].m_value;
+    }
+
+    /* Writer thread only. Make the write buffer the latest state, the writer gets another buffer */
+    void publish()
+    {
+        m_back = m_shared.exchange(m_back | NewFlag, std::memory_order_acq_rel) & IndexMask;
+        ++m_numPublished;
+    }
+
+    /* Reader thread only. Take the latest published state if newer than the read buffer, returns true if so */
+    bool acquire()
+    {
+        if((m_shared.load(std::memory_order_relaxed) & NewFlag) == 0)
+        {
+            return false;
+        }
+
+        m_front = m_shared.exchange(m_front, std::memory_order_acq_rel) & IndexMask;
+        ++m_numAcquired;
+        return true;
+    }
+
+    /* Reader thread only. The state taken by the last acquire(), valid until the next one */
+    const T& getReadBuffer() const
+    {
+        return m_buffers[m_front].m_value;
+    }
+
+    /* Writer thread only. Number of states published */
+    uint64_t getNumPublished() const
+    {
+        return m_numPublished;
+    }
+
+    /* Reader thread only. Number of states acquired, the others were skipped */
+    uint64_t getNumAcquired() const
+    {
+        return m_numAcquired;
+    }
+
+private:
+    static const uint8_t IndexMask = 3;
+    static const uint8_t NewFlag = 4; // set by the writer, cleared by the reader
+
+    /* A buffer per cache line (at least), so that the writer and the reader never share one */
+    struct alignas(64) Buffer
+    {
+        T m_value{};
+    };
+
+    Buffer m_buffers[3];
+
+    alignas(64) uint8_t m_back; // writer thread only
+    uint64_t m_numPublished;
+    alignas(64) std::atomic<uint8_t> m_shared; // index of the shared buffer and NewFlag
+    alignas(64) uint8_t m_front; // reader thread only
+    uint64_t m_numAcquired;
+};
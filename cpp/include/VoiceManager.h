@@ -0,0 +1,271 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "Logger.h"
+#include "Sound.h"
+
+/*
+    VoiceManager
+    Voice virtualisation: only the audible voices are mixed (real voices), the others (virtual voices) only advance
+    their playhead and parameter ramps, in O(1) per block, so that thousands of emitters can "play" at the cost of
+    the few which are heard.
+
+    update() is the audibility pass, run once per block before execute(). The audibility of a playing voice is its
+    gain (the largest of the current gain and the ramp target, so that a fading in voice is promoted at the start of
+    the ramp) times its attenuation, set by the game (e.g. distance and occlusion, 0 when out of range). A voice is
+    virtual when:
+    - silent: its audibility is below the audibility threshold (-60 dB by default),
+    - masked: its audibility is below the masking ratio times the loudest voice (off by default),
+    - over budget: it is not among the maxNumRealVoices loudest voices.
+    Real voices are only demoted once their audibility is half the thresholds, so that voices close to a threshold do
+    not flip every block. A promoted voice resumes at the exact position it would have reached had it been mixed.
+    Voices starting between two updates (e.g. scheduled within the block) are real until the next update.
+    Voice stealing: acquireVoice() returns a stopped voice to play a new sound on, or steals the least audible one.
+
+    All functions are called from the audio thread, except addVoice which is called before mixing starts.
+    Voices are not owned.
+*/
+class VoiceManager
+{
+public:
+    struct Stats
+    {
+        int m_numVoices = 0;
+        int m_numPlaying = 0;
+        int m_numReal = 0;
+        int m_numVirtual = 0; // m_numSilent + m_numMasked + m_numOverBudget
+        int m_numSilent = 0;
+        int m_numMasked = 0;
+        int m_numOverBudget = 0;
+        unsigned long m_numPromotions = 0; // virtual to real, since creation
+        unsigned long m_numDemotions = 0; // real to virtual, since creation
+        unsigned long m_numSteals = 0; // since creation
+    };
+
+    VoiceManager(int maxNumVoices, int maxNumRealVoices, float audibilityThreshold = 0.001f):
+        m_maxNumRealVoices(std::max(0, maxNumRealVoices)),
+        m_audibilityThreshold(audibilityThreshold),
+        m_maskingRatio(0.f)
+    {
+        m_voices.reserve(maxNumVoices);
+        m_candidates.reserve(maxNumVoices);
+    }
+
+    /* Returns the index of the voice, -1 if maxNumVoices voices were already added */
+    int addVoice(Sound* sound)
+    {
+        if(!sound || m_voices.size() == m_voices.capacity())
+        {
+            LM_ERROR("VoiceManager: cannot add voice.");
+            return -1;
+        }
+
+        m_voices.push_back({sound});
+        return static_cast<int>(m_voices.size()) - 1;
+    }
+
+    /* Attenuation applied by the game on top of the voice gain, 0 when out of range */
+    void setAttenuation(int voice, float attenuation)
+    {
+        if(voice >= 0 && voice < getNumVoices())
+        {
+            m_voices[voice].m_attenuation = std::max(0.f, attenuation);
+        }
+    }
+
+    void setMaxNumRealVoices(int maxNumRealVoices)
+    {
+        m_maxNumRealVoices = std::max(0, maxNumRealVoices);
+    }
+
+    /* Voices quieter than ratio times the loudest voice are masked, 0 to disable */
+    void setMaskingRatio(float ratio)
+    {
+        m_maskingRatio = std::max(0.f, ratio);
+    }
+
+    void setAudibilityThreshold(float threshold)
+    {
+        m_audibilityThreshold = std::max(0.f, threshold);
+    }
+
+    /* Audibility pass, see the class description */
+    void update()
+    {
+        Stats stats;
+        stats.m_numVoices = getNumVoices();
+        stats.m_numPromotions = m_stats.m_numPromotions;
+        stats.m_numDemotions = m_stats.m_numDemotions;
+        stats.m_numSteals = m_stats.m_numSteals;
+
+        // silent voices, and the loudest voice for masking
+        m_candidates.clear();
+        float loudest = 0.f;
+        for(int v=0; v<getNumVoices(); ++v)
+        {
+            Voice& voice = m_voices[v];
+            voice.m_wasReal = voice.m_real;
+            voice.m_wasPlaying = voice.m_playing;
+            voice.m_playing = voice.m_sound->isPlaying();
+            voice.m_real = !voice.m_playing; // stopped voices are real when they start
+            if(!voice.m_playing)
+            {
+                continue;
+            }
+
+            ++stats.m_numPlaying;
+            const float gain = std::max(std::abs(voice.m_sound->getGain()), std::abs(voice.m_sound->getTargetGain()));
+            voice.m_audibility = gain * voice.m_attenuation;
+            if(voice.m_audibility < getThreshold(voice, m_audibilityThreshold))
+            {
+                ++stats.m_numSilent;
+                continue;
+            }
+
+            loudest = std::max(loudest, voice.m_audibility);
+            m_candidates.push_back(v);
+        }
+
+        // masked voices
+        if(m_maskingRatio > 0.f)
+        {
+            const float masking = loudest * m_maskingRatio;
+            auto masked = std::remove_if(m_candidates.begin(), m_candidates.end(), [&](int v)
+            {
+                return m_voices[v].m_audibility < getThreshold(m_voices[v], masking);
+            });
+            stats.m_numMasked = static_cast<int>(m_candidates.end() - masked);
+            m_candidates.erase(masked, m_candidates.end());
+        }
+
+        // the loudest candidates within the budget, real voices winning ties
+        if(static_cast<int>(m_candidates.size()) > m_maxNumRealVoices)
+        {
+            std::nth_element(m_candidates.begin(), m_candidates.begin() + m_maxNumRealVoices, m_candidates.end(), [&](int a, int b)
+            {
+                const Voice& voiceA = m_voices[a];
+                const Voice& voiceB = m_voices[b];
+                return voiceA.m_audibility != voiceB.m_audibility ? voiceA.m_audibility > voiceB.m_audibility : voiceA.m_wasReal > voiceB.m_wasReal;
+            });
+            stats.m_numOverBudget = static_cast<int>(m_candidates.size()) - m_maxNumRealVoices;
+            m_candidates.resize(m_maxNumRealVoices);
+        }
+
+        for(int v : m_candidates)
+        {
+            m_voices[v].m_real = true;
+        }
+
+        for(Voice& voice : m_voices)
+        {
+            if(voice.m_playing && voice.m_wasPlaying && voice.m_real != voice.m_wasReal)
+            {
+                voice.m_real ? ++stats.m_numPromotions : ++stats.m_numDemotions;
+            }
+        }
+
+        stats.m_numReal = static_cast<int>(m_candidates.size());
+        stats.m_numVirtual = stats.m_numSilent + stats.m_numMasked + stats.m_numOverBudget;
+        m_stats = stats;
+    }
+
+    /*
+        A voice to play a new sound on: the first stopped voice, otherwise the least audible playing voice, which is
+        stolen (stopped, posting a STOLEN event to the event queue of its sound). Returns -1 if there are no voices.
+    */
+    int acquireVoice()
+    {
+        int quietest = -1;
+        float quietestAudibility = 0.f;
+        for(int v=0; v<getNumVoices(); ++v)
+        {
+            Sound* sound = m_voices[v].m_sound;
+            if(!sound->isPlaying())
+            {
+                return v;
+            }
+
+            const float audibility = std::max(std::abs(sound->getGain()), std::abs(sound->getTargetGain())) * m_voices[v].m_attenuation;
+            if(quietest < 0 || audibility < quietestAudibility)
+            {
+                quietest = v;
+                quietestAudibility = audibility;
+            }
+        }
+
+        if(quietest >= 0)
+        {
+            m_voices[quietest].m_sound->steal();
+            ++m_stats.m_numSteals;
+        }
+        return quietest;
+    }
+
+    /* Mix the real voices into planar channels from startFrame, advance the virtual ones */
+    void execute(float* const* outputChannels, unsigned long framesPerBuffer, int numChannels, unsigned long startFrame = 0)
+    {
+        for(Voice& voice : m_voices)
+        {
+            if(voice.m_real)
+            {
+                voice.m_sound->executePlanar(outputChannels, framesPerBuffer, numChannels, startFrame);
+            }
+            else
+            {
+                voice.m_sound->skip(framesPerBuffer - startFrame);
+            }
+        }
+    }
+
+    /* Whether the voice was classified real by the last update (stopped voices are real) */
+    bool isReal(int voice) const
+    {
+        return voice >= 0 && voice < getNumVoices() && m_voices[voice].m_real;
+    }
+
+    int getNumVoices() const
+    {
+        return static_cast<int>(m_voices.size());
+    }
+
+    /* Counts of the last update */
+    const Stats& getStats() const
+    {
+        return m_stats;
+    }
+
+    void printStats() const
+    {
+        printf("Voices: %i, playing %i, real %i, virtual %i (silent %i, masked %i, over budget %i), promotions %lu, demotions %lu, steals %lu\n",
+                m_stats.m_numVoices, m_stats.m_numPlaying, m_stats.m_numReal, m_stats.m_numVirtual, m_stats.m_numSilent,
+                m_stats.m_numMasked, m_stats.m_numOverBudget, m_stats.m_numPromotions, m_stats.m_numDemotions, m_stats.m_numSteals);
+    }
+
+private:
+    struct Voice
+    {
+        Sound* m_sound;
+        float m_attenuation = 1.f;
+        float m_audibility = 0.f;
+        bool m_real = true; // classification of the last update
+        bool m_wasReal = true; // classification of the previous update
+        bool m_playing = false; // at the last update
+        bool m_wasPlaying = false; // at the previous update
+    };
+
+    /* Real voices are demoted at half the threshold (hysteresis) */
+    static float getThreshold(const Voice& voice, float threshold)
+    {
+        return voice.m_wasReal ? 0.5f * threshold : threshold;
+    }
+
+    int m_maxNumRealVoices;
+    float m_audibilityThreshold;
+    float m_maskingRatio;
+    std::vector<Voice> m_voices;
+    std::vector<int> m_candidates; // preallocated, indices of the voices which can be real
+    Stats m_stats;
+};
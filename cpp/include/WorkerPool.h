@@ -0,0 +1,184 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+/*
+    WorkerPool
+    A fixed set of worker threads used to execute a batch of independent jobs in parallel.
+
+    run is called from a single thread (e.g. the audio thread) which also executes jobs, and returns once
+    all the jobs of the batch have been completed. No memory is allocated and no lock is taken while running:
+    jobs are claimed through an atomic counter and the workers wait for new batches using atomic wait/notify
+    (the notification is skipped when no worker is sleeping).
+
+    The job counter packs the batch generation, the number of jobs and the next job to claim,
+    so that a worker late from a previous batch can never claim a job of the current one.
+*/
+class WorkerPool
+{
+public:
+    /* Job function type: executes the job with the given index */
+    typedef void (*JobFunc)(int jobIndex, void* context);
+
+    WorkerPool(int numWorkers):
+        m_jobCounter(0),
+        m_numCompletedJobs(0),
+        m_numSleepingWorkers(0),
+        m_runningFlag(true),
+        m_jobFunc(nullptr),
+        m_jobContext(nullptr)
+    {
+        for(int i=0; i<numWorkers; ++i)
+        {
+            m_workers.emplace_back(&WorkerPool::workerProcess, this);
+        }
+    }
+
+    ~WorkerPool()
+    {
+        m_runningFlag.store(false);
+
+        // new generation with no jobs to wake up the workers
+        uint64_t counter = m_jobCounter.load();
+        m_jobCounter.store(pack(getGeneration(counter) + 1, 0, 0));
+        m_jobCounter.notify_all();
+
+        for(std::thread& worker : m_workers)
+        {
+            if(worker.joinable())
+            {
+                worker.join();
+            }
+        }
+    }
+
+    // Deleting other special member functions as they may cause shallow copies
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    WorkerPool(WorkerPool&& other) = delete;
+    WorkerPool& operator=(WorkerPool&& other) = delete;
+
+    /* Execute numJobs jobs, returns when all of them have been completed */
+    void run(JobFunc jobFunc, void* context, int numJobs)
+    {
+        if(numJobs <= 0)
+        {
+            return;
+        }
+
+        // no need to involve the workers for a single job
+        if(numJobs == 1 || m_workers.empty())
+        {
+            for(int i=0; i<numJobs; ++i)
+            {
+                jobFunc(i, context);
+            }
+            return;
+        }
+
+        m_jobFunc.store(jobFunc, std::memory_order_relaxed);
+        m_jobContext.store(context, std::memory_order_relaxed);
+        m_numCompletedJobs.store(0, std::memory_order_relaxed);
+
+        // sequentially consistent store then load, against the workers' increment then wait (which loads the
+        // counter): either this sees the worker going to sleep, or the worker sees the new batch and doesn't sleep
+        uint64_t counter = m_jobCounter.load(std::memory_order_relaxed);
+        m_jobCounter.store(pack(getGeneration(counter) + 1, numJobs, 0));
+        if(m_numSleepingWorkers.load() > 0)
+        {
+            m_jobCounter.notify_all();
+        }
+
+        // the calling thread participates
+        executeJobs();
+
+        while(m_numCompletedJobs.load(std::memory_order_acquire) < numJobs)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    int getNumWorkers() const
+    {
+        return static_cast<int>(m_workers.size());
+    }
+
+private:
+    static const int NumJobBits = 20;
+    static const uint64_t JobMask = (1ull << NumJobBits) - 1;
+
+    static uint64_t pack(uint64_t generation, uint64_t numJobs, uint64_t nextJob)
+    {
+        return (generation << (NumJobBits * 2)) | ((numJobs & JobMask) << NumJobBits) | (nextJob & JobMask);
+    }
+
+    static uint64_t getGeneration(uint64_t counter)
+    {
+        return counter >> (NumJobBits * 2);
+    }
+
+    /* Claim and execute jobs of the current batch until there are none left */
+    void executeJobs()
+    {
+        uint64_t counter = m_jobCounter.load(std::memory_order_acquire);
+        while(true)
+        {
+            int numJobs = static_cast<int>((counter >> NumJobBits) & JobMask);
+            int nextJob = static_cast<int>(counter & JobMask);
+            if(nextJob >= numJobs)
+            {
+                return;
+            }
+
+            if(m_jobCounter.compare_exchange_weak(counter, counter + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                JobFunc jobFunc = m_jobFunc.load(std::memory_order_relaxed);
+                jobFunc(nextJob, m_jobContext.load(std::memory_order_relaxed));
+                m_numCompletedJobs.fetch_add(1, std::memory_order_release);
+
+                counter = m_jobCounter.load(std::memory_order_acquire);
+            }
+        }
+    }
+
+    void workerProcess()
+    {
+        uint64_t generation = getGeneration(m_jobCounter.load());
+
+        while(m_runningFlag.load())
+        {
+            executeJobs();
+
+            // wait for the next batch: spinning for a while as batches are usually issued every audio block
+            uint64_t counter = m_jobCounter.load(std::memory_order_acquire);
+            for(int spin=0; spin<SpinCount && getGeneration(counter) == generation; ++spin)
+            {
+                std::this_thread::yield();
+                counter = m_jobCounter.load(std::memory_order_acquire);
+            }
+
+            while(getGeneration(counter) == generation)
+            {
+                m_numSleepingWorkers.fetch_add(1);
+                m_jobCounter.wait(counter);
+                m_numSleepingWorkers.fetch_sub(1);
+                counter = m_jobCounter.load(std::memory_order_acquire);
+            }
+
+            generation = getGeneration(counter);
+        }
+    }
+
+    static const int SpinCount = 64;
+
+    std::vector<std::thread> m_workers;
+    std::atomic<uint64_t> m_jobCounter; // generation | number of jobs | next job to claim
+    std::atomic<int> m_numCompletedJobs;
+    std::atomic<int> m_numSleepingWorkers;
+    std::atomic<bool> m_runningFlag;
+    std::atomic<JobFunc> m_jobFunc;
+    std::atomic<void*> m_jobContext;
+};